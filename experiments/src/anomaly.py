@@ -1,4 +1,14 @@
+import csv
+import os
+import sys
 from dataclasses import dataclass
+from typing import Dict, Optional, Tuple
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "..", "src", "python"))
+import cutproject  # noqa: E402
+
+# The index written by add_period_set --signatures=FILE.
+SIGNATURES_PATH = "signatures.csv"
 
 @dataclass
 class Configuration:
@@ -7,6 +17,37 @@ class Configuration:
     gamma: int
     delta: int
 
+def load_signatures(path: str = SIGNATURES_PATH) -> Dict[str, Tuple[int, int, int, int, int]]:
+    """
+    The signature index: signature -> (period, o_n, o_d, a_n, a_d) of the
+    first row with that cyclic gap pattern. A missing file is an empty index.
+    """
+    index = {}
+    if not os.path.exists(path):
+        return index
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            if row["signature"] not in index:
+                index[row["signature"]] = tuple(
+                    int(row[k]) for k in ("period", "o_n", "o_d", "a_n", "a_d"))
+    return index
+
+def pattern_signature(con: Configuration) -> Optional[str]:
+    """The signature of the set gap pattern of a configuration (residue model)."""
+    ctx = cutproject.context(periods=cutproject.PERIODS_SET)
+    result = ctx.residues(con.alpha, con.beta, con.gamma, con.delta)
+    if result.set is None or result.set <= 0:
+        return None
+    return ctx.signature(result.set)
+
+def seen_before(con: Configuration, index: Dict[str, Tuple[int, int, int, int, int]]):
+    """
+    The index entry of the first configuration with the same gap pattern
+    up to rotation, or None if the pattern is new.
+    """
+    signature = pattern_signature(con)
+    return index.get(signature) if signature is not None else None
+
 def test_anomaly(con: Configuration):
     
 
@@ -18,5 +59,9 @@ def main():
     $98{,}281$ & $139$ & $68$ & $149$ & $153{,}431$ & $1$ \\
     '''
     configuration = Configuration(alpha=68, beta=149, gamma=98281, delta=139)
+    first = seen_before(configuration, load_signatures())
+    if first is not None:
+        print("same gap pattern as o_n=%d o_d=%d a_n=%d a_d=%d (period %d)" % (first[1:] + first[:1]))
+        return
     test_anomaly(configuration)
                     
\ No newline at end of file
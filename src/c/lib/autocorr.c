@@ -0,0 +1,319 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdlib.h>
+#include "autocorr.h"
+#include "block_sketch.h"
+#include "external.h"
+
+typedef struct
+{
+    double re;
+    double im;
+} complex_t;
+
+/* The transform buffers, reused by the calls of one thread: their own, grown
+ * on demand, or carved from one lent by autocorr_use_buffer(), never grown. */
+static _Thread_local complex_t *signal = NULL;    // N values
+static _Thread_local complex_t *twiddle = NULL;   // per level len: len / 2 roots at len / 2
+static _Thread_local double *power = NULL;        // N values
+static _Thread_local size_t allocated = 0;
+static _Thread_local size_t twiddle_size = 0;     // N of the table
+static _Thread_local bool lent = false;
+
+/* Bytes per transform slot: signal, twiddle and power. */
+#define SLOT_BYTES (2 * sizeof(complex_t) + sizeof(double))
+
+/* The transform size of autocorr_candidates() for n values and max_lag. */
+static size_t transform_size(int64_t n, int64_t max_lag)
+{
+    // Lags up to max_lag must not wrap around.
+    size_t size = 8;
+    while (size < (size_t)(n + max_lag))
+        size *= 2;
+    return size;
+}
+
+size_t autocorr_buffer_bytes(int64_t length)
+{
+    return length < 2 ? 0 : transform_size(length, length / 2) * SLOT_BYTES;
+}
+
+void autocorr_use_buffer(void *buffer, size_t bytes)
+{
+    autocorr_release();
+    if (buffer == NULL)
+        return;
+    allocated = bytes / SLOT_BYTES;
+    signal = buffer;
+    twiddle = signal + allocated;
+    power = (double *)(twiddle + allocated);
+    lent = true;
+}
+
+void autocorr_release(void)
+{
+    if (!lent)
+    {
+        free(signal);
+        free(twiddle);
+        free(power);
+    }
+    signal = twiddle = NULL;
+    power = NULL;
+    allocated = 0;
+    twiddle_size = 0;
+    lent = false;
+}
+
+/* sin and cos of x in [0, pi / 4] by their Taylor series. */
+static void sincos_small(double x, double *s, double *c)
+{
+    const double x2 = x * x;
+    double term_s = x;
+    double term_c = 1.0;
+    double sum_s = x;
+    double sum_c = 1.0;
+    for (int k = 1; k <= 12; k++)
+    {
+        term_s *= -x2 / (double)((2 * k) * (2 * k + 1));
+        term_c *= -x2 / (double)((2 * k - 1) * (2 * k));
+        sum_s += term_s;
+        sum_c += term_c;
+    }
+    *s = sum_s;
+    *c = sum_c;
+}
+
+/* exp(-2 pi i k / n) for a power of two n >= 8, reduced to the first octant. */
+static complex_t root(uint64_t k, uint64_t n)
+{
+    const double two_pi = 6.283185307179586476925286766559;
+    const uint64_t quarter = n / 4;
+    const uint64_t quadrant = k / quarter;
+    uint64_t r = k % quarter;
+    double s, c;
+    if (2 * r <= quarter)
+        sincos_small(two_pi * (double)r / (double)n, &s, &c);
+    else
+        sincos_small(two_pi * (double)(quarter - r) / (double)n, &c, &s);
+    // cos and sin of quadrant * pi / 2 + the reduced angle.
+    double cos_k, sin_k;
+    switch (quadrant)
+    {
+    case 0: cos_k = c;  sin_k = s;  break;
+    case 1: cos_k = -s; sin_k = c;  break;
+    case 2: cos_k = -c; sin_k = -s; break;
+    default: cos_k = s; sin_k = -c; break;
+    }
+    return (complex_t){cos_k, -sin_k};
+}
+
+static int reserve(size_t n)
+{
+    if (n > allocated)
+    {
+        if (lent)
+            return -1;
+        complex_t *grown_signal = realloc(signal, n * sizeof(complex_t));
+        if (grown_signal != NULL)
+            signal = grown_signal;
+        complex_t *grown_twiddle = realloc(twiddle, n * sizeof(complex_t));
+        if (grown_twiddle != NULL)
+            twiddle = grown_twiddle;
+        double *grown_power = realloc(power, n * sizeof(double));
+        if (grown_power != NULL)
+            power = grown_power;
+        if (grown_signal == NULL || grown_twiddle == NULL || grown_power == NULL)
+            return -1;
+        allocated = n;
+        twiddle_size = 0;
+    }
+    if (twiddle_size != n)
+    {
+        // The roots of the last level; each level below takes every other one.
+        for (size_t k = 0; k < n / 2; k++)
+            twiddle[n / 2 + k] = root(k, n);
+        for (size_t half = n / 4; half >= 1; half /= 2)
+            for (size_t k = 0; k < half; k++)
+                twiddle[half + k] = twiddle[2 * half + 2 * k];
+        twiddle_size = n;
+    }
+    return 0;
+}
+
+/* Transform slots whose butterflies run block by block (16 bytes each). */
+#define CACHE_BLOCK 16384
+
+/* The butterflies of the levels len in [first, last] over signal[from, to). */
+static void butterflies(size_t from, size_t to, size_t first, size_t last, bool inverse)
+{
+    for (size_t len = first; len <= last; len <<= 1)
+    {
+        const complex_t *roots = twiddle + len / 2;
+        for (size_t i = from; i < to; i += len)
+            for (size_t k = 0; k < len / 2; k++)
+            {
+                complex_t w = roots[k];
+                if (inverse)
+                    w.im = -w.im;
+                const complex_t a = signal[i + k];
+                const complex_t b = signal[i + k + len / 2];
+                const complex_t t = {b.re * w.re - b.im * w.im, b.re * w.im + b.im * w.re};
+                signal[i + k] = (complex_t){a.re + t.re, a.im + t.im};
+                signal[i + k + len / 2] = (complex_t){a.re - t.re, a.im - t.im};
+            }
+    }
+}
+
+/* In-place radix-2 transform of signal[0, n); inverse without the 1 / n.
+ * The levels up to CACHE_BLOCK stay inside one block each, so they run
+ * block by block in cache instead of one pass over the signal per level. */
+static void fft(size_t n, bool inverse)
+{
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+        {
+            const complex_t t = signal[i];
+            signal[i] = signal[j];
+            signal[j] = t;
+        }
+    }
+    const size_t block = n < CACHE_BLOCK ? n : CACHE_BLOCK;
+    for (size_t from = 0; from < n; from += block)
+        butterflies(from, from + block, 2, block, inverse);
+    butterflies(0, n, 2 * block, n, inverse);
+}
+
+/**
+ * The most frequent values of g[0, n), at most AUTOCORR_MAX_SYMBOLS: a
+ * Misra-Gries pass over twice as many slots, then exact counts.
+ *
+ * @return The number of symbols.
+ */
+static int frequent_symbols(const int64_t *g, int64_t n, int64_t *symbols)
+{
+    enum { SLOTS = 2 * AUTOCORR_MAX_SYMBOLS };
+    int64_t value[SLOTS];
+    int64_t weight[SLOTS] = {0};
+    for (int64_t i = 0; i < n; i++)
+    {
+        int free_slot = -1;
+        int s = 0;
+        for (; s < SLOTS; s++)
+        {
+            if (weight[s] > 0 && value[s] == g[i])
+                break;
+            if (weight[s] == 0 && free_slot < 0)
+                free_slot = s;
+        }
+        if (s < SLOTS)
+            weight[s]++;
+        else if (free_slot >= 0)
+        {
+            value[free_slot] = g[i];
+            weight[free_slot] = 1;
+        }
+        else
+            for (s = 0; s < SLOTS; s++)
+                weight[s]--;
+    }
+    int64_t count[SLOTS] = {0};
+    for (int64_t i = 0; i < n; i++)
+        for (int s = 0; s < SLOTS; s++)
+            if (weight[s] > 0 && value[s] == g[i])
+            {
+                count[s]++;
+                break;
+            }
+    int kept = 0;
+    while (kept < AUTOCORR_MAX_SYMBOLS)
+    {
+        int best = -1;
+        for (int s = 0; s < SLOTS; s++)
+            if (count[s] > 0 && (best < 0 || count[s] > count[best]))
+                best = s;
+        if (best < 0)
+            break;
+        symbols[kept++] = value[best];
+        count[best] = 0;
+    }
+    return kept;
+}
+
+int autocorr_candidates(const int64_t *g, int64_t n, int64_t max_lag, int64_t *candidates, int count)
+{
+    if (max_lag >= n)
+        max_lag = n - 1;
+    if (max_lag < 1 || count < 1)
+        return 0;
+    const size_t size = transform_size(n, max_lag);
+    if (reserve(size) != 0)
+        return -1;
+
+    int64_t symbols[AUTOCORR_MAX_SYMBOLS];
+    const int channels = frequent_symbols(g, n, symbols);
+    for (size_t k = 0; k < size; k++)
+        power[k] = 0.0;
+    for (int c = 0; c < channels; c += 2)
+    {
+        // Channel c in the real part, channel c + 1 (if any) in the imaginary part.
+        const int64_t re = symbols[c];
+        const int64_t im = c + 1 < channels ? symbols[c + 1] : symbols[c];
+        const double im_weight = c + 1 < channels ? 1.0 : 0.0;
+        for (int64_t i = 0; i < n; i++)
+            signal[i] = (complex_t){g[i] == re ? 1.0 : 0.0, g[i] == im ? im_weight : 0.0};
+        for (size_t i = (size_t)n; i < size; i++)
+            signal[i] = (complex_t){0.0, 0.0};
+        fft(size, false);
+        // |X_k|^2 + |Y_k|^2 = (|Z_k|^2 + |Z_{N-k}|^2) / 2 for Z = X + iY.
+        for (size_t k = 0; k < size; k++)
+        {
+            const complex_t a = signal[k];
+            const complex_t b = signal[(size - k) & (size - 1)];
+            power[k] += 0.5 * (a.re * a.re + a.im * a.im + b.re * b.re + b.im * b.im);
+        }
+    }
+    for (size_t k = 0; k < size; k++)
+        signal[k] = (complex_t){power[k], 0.0};
+    fft(size, true);
+
+    // The lags with the fewest mismatches, kept sorted (ties: the smaller lag).
+    int64_t mismatches[AUTOCORR_CANDIDATES];
+    if (count > AUTOCORR_CANDIDATES)
+        count = AUTOCORR_CANDIDATES;
+    int kept = 0;
+    for (int64_t p = 1; p <= max_lag; p++)
+    {
+        const int64_t matches = (int64_t)(signal[p].re / (double)size + 0.5);
+        const int64_t m = n - p - matches;
+        if (kept == count && m >= mismatches[kept - 1])
+            continue;
+        int i = kept < count ? kept++ : kept - 1;
+        for (; i > 0 && mismatches[i - 1] > m; i--)
+        {
+            mismatches[i] = mismatches[i - 1];
+            candidates[i] = candidates[i - 1];
+        }
+        mismatches[i] = m;
+        candidates[i] = p;
+    }
+    return kept;
+}
+
+int64_t autocorr_period(const int64_t *gaps, int64_t length, int64_t to_delete, double fraction)
+{
+    const int64_t start = to_delete + 1;
+    const int64_t n = length - 2 * to_delete - 1;   // the window of the first step
+    if (n < 2)
+        return EXT_WINDOW_TOO_SMALL;
+    int64_t candidates[AUTOCORR_CANDIDATES];
+    const int count = autocorr_candidates(gaps + start, n, n / 2, candidates, AUTOCORR_CANDIDATES);
+    if (count < 0)
+        return AUTOCORR_NO_MEMORY;
+    return sketch_verify(gaps, length, to_delete, fraction, candidates, count);
+}
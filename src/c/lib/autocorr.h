@@ -0,0 +1,88 @@
+#ifndef AUTOCORR_H
+#define AUTOCORR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Period candidates by autocorrelation. The number of exact matches
+ * g[i] == g[i + p] of every lag p at once is the sum over the symbols s
+ * (distinct gap values) of the autocorrelations of their indicator
+ * sequences [g[i] == s], computed with a radix-2 FFT (self-contained, no
+ * libm). Two indicator channels share one complex transform. The lags
+ * with the fewest mismatches are handed to the exact verification of
+ * block_sketch.h.
+ *
+ * The sketch needs the central blocks to recur inside the gaps, so it
+ * misses periods just under the half-window limit; the autocorrelation
+ * sees every lag but costs O(N log N) per pair of symbols, with N the
+ * power of two above 1.5 times the gaps, and 40 bytes per N. The buffers
+ * are kept per thread and grown on demand; autocorr_use_buffer() lends
+ * them memory allocated beforehand instead.
+ */
+
+/* Gap values with their own channel (the most frequent ones); matches of
+ * rarer values are not counted. */
+#define AUTOCORR_MAX_SYMBOLS 4
+
+/* Lags handed to the verification. */
+#define AUTOCORR_CANDIDATES 16
+
+/* autocorr_period() result when the transform cannot be allocated. */
+#define AUTOCORR_NO_MEMORY (-7)
+
+/**
+ * Ranks the lags 1..max_lag of g[0, n) by their number of mismatches
+ * (n - p minus the matches of the counted symbols).
+ *
+ * @param g The sequence.
+ * @param n Its length.
+ * @param max_lag The largest lag (< n).
+ * @param candidates Receives the lags with the fewest mismatches, fewest first.
+ * @param count The size of candidates.
+ * @return The number of candidates, or -1 if the transform cannot be allocated.
+ */
+int autocorr_candidates(const int64_t *g, int64_t n, int64_t max_lag, int64_t *candidates, int count);
+
+/**
+ * lambda_trim() for sorted gaps in memory with the AUTOCORR_CANDIDATES
+ * best lags of the window of the first step as candidates, verified
+ * exactly (sketch_verify()).
+ *
+ * @param gaps The gaps.
+ * @param length The number of gaps.
+ * @param to_delete The gaps cut from each end before the first step.
+ * @param fraction The fraction of the initial window below which the
+ *                 search stops (FRACTION_OF_REMAINING_ELEMENTS).
+ * @return The period, EXT_NO_PERIOD, EXT_WINDOW_TOO_SMALL (external.h)
+ *         or AUTOCORR_NO_MEMORY.
+ */
+int64_t autocorr_period(const int64_t *gaps, int64_t length, int64_t to_delete, double fraction);
+
+/**
+ * Returns the size of the transform buffers autocorr_period() needs for
+ * up to length gaps.
+ *
+ * @param length The number of gaps.
+ * @return The size in bytes.
+ */
+size_t autocorr_buffer_bytes(int64_t length);
+
+/**
+ * Lends the transform of the calling thread a buffer of the caller, as
+ * sketch_use_buffer(): autocorr_candidates() then never allocates and
+ * returns -1 for transforms that do not fit. Frees the thread's own
+ * buffers; NULL goes back to growing them on demand.
+ *
+ * @param buffer The buffer (8-byte aligned), or NULL.
+ * @param bytes Its size.
+ */
+void autocorr_use_buffer(void *buffer, size_t bytes);
+
+/**
+ * Frees the transform buffers of the calling thread and forgets a lent
+ * one; to be called before a thread that used them exits.
+ */
+void autocorr_release(void);
+
+#endif /* AUTOCORR_H */
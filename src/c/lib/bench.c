@@ -0,0 +1,413 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "autocorr.h"
+#include "block_sketch.h"
+#include "mathematics.h"
+#include "period_stream.h"
+
+/**
+ * Micro-benchmark of the stages of lambda():
+ *
+ *   enumerate  lambda_enumerate() in sort mode (projected values)
+ *   sort       sort_range() over the enumerated values
+ *   gaps       lambda_gaps(): differences (and compaction in the set engine)
+ *   period     one find_period_length() call on the first trim window
+ *   trim       lambda_trim(): the whole trim loop
+ *   prefix     period_stream_feed() over the first trim window (linear
+ *              prefix function, the period with the most repetitions)
+ *   sketch     sketch_period(): block sketch candidates, verified
+ *   autocorr   autocorr_period(): FFT autocorrelation candidates, verified
+ *   lambda     lambda() end to end
+ *
+ * Every stage runs on its own copy of its input, so stages are timed in
+ * isolation. Each measurement is warmed up and repeated; the report is
+ * JSON with median and median absolute deviation (MAD) in nanoseconds,
+ * points/s and bytes/s, where bytes are the number_t values the stage
+ * reads once. The last three stages compare the period searches
+ * lambda_trim_method() chooses from on the same gaps. The raw samples are included for the regression gate
+ * (src/python/perf_gate.py).
+ *
+ * One source for both engines: src/c/set and src/c/multiset build it
+ * against their own mathematics.h and constants.h (ENGINE_NAME).
+ */
+
+typedef struct
+{
+    const char *name;
+    const char *description;
+    number_t alpha;
+    number_t beta;
+    number_t gamma;
+    number_t delta;
+} bench_case_t;
+
+static const bench_case_t CASES[] = {
+    {"small_n", "small N, N >= D", 1, 2, 5, 3},
+    {"n_lt_d", "small N, N < D", 1, 2, 3, 7},
+    {"d_divides_n", "D | N (integer omega)", 1, 3, 12, 4},
+    {"large_n", "large N and D, N >= D", 20305, 27081, 45863, 7347},
+    {"test_speed", "the parameters of test_speed()", 37033, 4687, 51, 4},
+};
+
+#define NUMBER_OF_CASES (sizeof(CASES) / sizeof(CASES[0]))
+
+typedef enum
+{
+    STAGE_ENUMERATE = 0,
+    STAGE_SORT,
+    STAGE_GAPS,
+    STAGE_PERIOD,
+    STAGE_TRIM,
+    STAGE_PREFIX,
+    STAGE_SKETCH,
+    STAGE_AUTOCORR,
+    STAGE_LAMBDA,
+    NUMBER_OF_STAGES
+} stage_t;
+
+static const char *STAGE_NAMES[NUMBER_OF_STAGES] = {
+    "enumerate", "sort", "gaps", "period", "trim", "prefix", "sketch", "autocorr", "lambda"};
+
+typedef struct
+{
+    int warmup;
+    int repeat;
+    number_t points;
+    const char *only;
+    const char *output;
+} bench_options_t;
+
+/**
+ * Buffers of one case: the enumerated, sorted and gap arrays are kept so
+ * every stage can start from a fresh copy of its input.
+ */
+typedef struct
+{
+    const bench_case_t *c;
+    number_t x_max;
+    long values;
+    long gaps;
+    long window_start;
+    long window_end;
+    long to_delete;
+    long period;
+    number_t *raw;
+    number_t *sorted;
+    number_t *gap;
+    number_t *work;
+    int64_t *stream;   // the buffer of the prefix stage
+    size_t stream_values;
+} bench_data_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_uint64(const void *p, const void *q)
+{
+    const uint64_t x = *(const uint64_t *)p;
+    const uint64_t y = *(const uint64_t *)q;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns the median of samples; the array is sorted in place.
+ */
+static uint64_t median(uint64_t *samples, int count)
+{
+    qsort(samples, (size_t)count, sizeof(*samples), cmp_uint64);
+    return count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+}
+
+/**
+ * Returns the median absolute deviation of samples around m.
+ */
+static uint64_t mad(const uint64_t *samples, int count, uint64_t m)
+{
+    uint64_t *deviation = malloc((size_t)count * sizeof(*deviation));
+    for (int i = 0; i < count; i++)
+        deviation[i] = samples[i] > m ? samples[i] - m : m - samples[i];
+    const uint64_t result = median(deviation, count);
+    free(deviation);
+    return result;
+}
+
+/**
+ * Runs one stage on a fresh copy of its input and returns the elapsed time
+ * in nanoseconds. *result receives the value computed by the stage.
+ */
+static uint64_t run_stage(bench_data_t *d, stage_t stage, long *result)
+{
+    const bench_case_t *c = d->c;
+    uint64_t start;
+
+    switch (stage)
+    {
+    case STAGE_ENUMERATE:
+        start = now_ns();
+        *result = lambda_enumerate(c->alpha, c->beta, c->gamma, c->delta, X_MIN, d->x_max, true, d->work);
+        return now_ns() - start;
+    case STAGE_SORT:
+        memcpy(d->work, d->raw, (size_t)d->values * sizeof(number_t));
+        start = now_ns();
+        sort_range(d->work, 0, (size_t)d->values - 1);
+        *result = d->values;
+        return now_ns() - start;
+    case STAGE_GAPS:
+        memcpy(d->work, d->sorted, (size_t)d->values * sizeof(number_t));
+        start = now_ns();
+        *result = lambda_gaps(d->work, d->values);
+        return now_ns() - start;
+    case STAGE_PERIOD:
+        start = now_ns();
+        *result = find_period_length(d->window_start, d->window_end, d->gap);
+        return now_ns() - start;
+    case STAGE_TRIM:
+        start = now_ns();
+        *result = lambda_trim(d->gap, d->gaps, true);
+        return now_ns() - start;
+    case STAGE_PREFIX:
+    {
+        period_stream_t s;
+        start = now_ns();
+        period_stream_init(&s, d->stream, d->stream_values, 2);
+        for (long i = d->window_start; i <= d->window_end; i++)
+            period_stream_feed(&s, d->gap[i]);
+        *result = (long)period_stream_result(&s, NULL);
+        return now_ns() - start;
+    }
+    case STAGE_SKETCH:
+        start = now_ns();
+        *result = sketch_period(d->gap, d->gaps, d->to_delete, FRACTION_OF_REMAINING_ELEMENTS);
+        return now_ns() - start;
+    case STAGE_AUTOCORR:
+        start = now_ns();
+        *result = autocorr_period(d->gap, d->gaps, d->to_delete, FRACTION_OF_REMAINING_ELEMENTS);
+        return now_ns() - start;
+    default:
+        start = now_ns();
+        *result = lambda(c->alpha, c->beta, c->gamma, c->delta, X_MIN, d->x_max, true, d->work);
+        return now_ns() - start;
+    }
+}
+
+/**
+ * Returns the number of values a stage reads.
+ */
+static long stage_points(const bench_data_t *d, stage_t stage)
+{
+    switch (stage)
+    {
+    case STAGE_PERIOD:
+    case STAGE_PREFIX:
+        return d->window_end - d->window_start + 1;
+    case STAGE_TRIM:
+    case STAGE_SKETCH:
+    case STAGE_AUTOCORR:
+        return d->gaps;
+    default:
+        return d->values;
+    }
+}
+
+/**
+ * Chooses x_max for about options->points values, enumerates the case once
+ * and prepares the sorted and gap arrays.
+ *
+ * @return 0 on success, -1 if the case does not fit.
+ */
+static int prepare(bench_data_t *d, const bench_case_t *c, number_t points)
+{
+    memset(d, 0, sizeof(*d));
+    d->c = c;
+
+    // About omega * (1 + a) points are projected per unit of x.
+    const number_t density_num = (c->alpha + c->beta) * c->gamma;
+    const number_t density_den = c->beta * c->delta;
+    d->x_max = MAX(1000, points * density_den / density_num);
+
+    const size_t capacity = (size_t)(2 * points + 1024);
+    d->raw = malloc(capacity * sizeof(number_t));
+    d->sorted = malloc(capacity * sizeof(number_t));
+    d->gap = malloc(capacity * sizeof(number_t));
+    d->work = malloc(capacity * sizeof(number_t));
+    if (!d->raw || !d->sorted || !d->gap || !d->work)
+        return -1;
+
+    d->values = lambda_enumerate(c->alpha, c->beta, c->gamma, c->delta, X_MIN, d->x_max, true, d->raw);
+    if (d->values < 2 || (size_t)d->values > capacity)
+        return -1;
+
+    memcpy(d->sorted, d->raw, (size_t)d->values * sizeof(number_t));
+    sort_range(d->sorted, 0, (size_t)d->values - 1);
+    memcpy(d->gap, d->sorted, (size_t)d->values * sizeof(number_t));
+    d->gaps = lambda_gaps(d->gap, d->values);
+
+    // The first window lambda_trim() searches.
+    d->to_delete = (1.0 - FRACTION_OF_REMAINING_ELEMENTS) / 40.0 * d->gaps;
+    d->window_start = d->to_delete + 1;
+    d->window_end = d->gaps - d->to_delete - 1;
+    d->period = lambda_trim(d->gap, d->gaps, true);
+
+    // Periods up to half the window fit the prefix stage.
+    d->stream_values = PERIOD_STREAM_VALUES_PER_PERIOD * (size_t)(d->gaps / 2 + 1) + 2;
+    d->stream = malloc(d->stream_values * sizeof(int64_t));
+    if (!d->stream)
+        return -1;
+    return 0;
+}
+
+static void release(bench_data_t *d)
+{
+    free(d->raw);
+    free(d->sorted);
+    free(d->gap);
+    free(d->work);
+    free(d->stream);
+}
+
+/**
+ * Benchmarks all stages of one case and writes its JSON object.
+ */
+static void bench_case(FILE *out, const bench_case_t *c, const bench_options_t *options, bool first)
+{
+    bench_data_t d;
+    uint64_t *samples = malloc((size_t)options->repeat * sizeof(*samples));
+
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"description\": \"%s\", "
+            "\"alpha\": %lld, \"beta\": %lld, \"gamma\": %lld, \"delta\": %lld, ",
+            first ? "" : ",", c->name, c->description,
+            (long long)c->alpha, (long long)c->beta, (long long)c->gamma, (long long)c->delta);
+
+    if (prepare(&d, c, options->points) != 0)
+    {
+        fprintf(stderr, "%s: skipped (enumeration does not fit)\n", c->name);
+        fprintf(out, "\"skipped\": true}");
+        release(&d);
+        free(samples);
+        return;
+    }
+
+    fprintf(out, "\"x_max\": %lld, \"values\": %ld, \"gaps\": %ld, \"period\": %ld,\n     \"stages\": [",
+            (long long)d.x_max, d.values, d.gaps, d.period);
+
+    for (int s = 0; s < NUMBER_OF_STAGES; s++)
+    {
+        long result = 0;
+        for (int i = 0; i < options->warmup; i++)
+            run_stage(&d, (stage_t)s, &result);
+        for (int i = 0; i < options->repeat; i++)
+            samples[i] = run_stage(&d, (stage_t)s, &result);
+
+        const uint64_t m = median(samples, options->repeat);
+        const uint64_t deviation = mad(samples, options->repeat, m);
+        const long points = stage_points(&d, (stage_t)s);
+        const double seconds = m > 0 ? (double)m * 1e-9 : 1e-9;
+
+        fprintf(out, "%s\n      {\"stage\": \"%s\", \"median_ns\": %llu, \"mad_ns\": %llu, "
+                "\"min_ns\": %llu, \"max_ns\": %llu, \"points\": %ld, "
+                "\"points_per_s\": %.0f, \"bytes_per_s\": %.0f, \"result\": %ld, \"samples_ns\": [",
+                s ? "," : "", STAGE_NAMES[s],
+                (unsigned long long)m, (unsigned long long)deviation,
+                (unsigned long long)samples[0], (unsigned long long)samples[options->repeat - 1],
+                points, (double)points / seconds, (double)points * sizeof(number_t) / seconds, result);
+        for (int i = 0; i < options->repeat; i++)
+            fprintf(out, "%s%llu", i ? ", " : "", (unsigned long long)samples[i]);
+        fprintf(out, "]}");
+        fprintf(stderr, "%-12s %-10s median %12.3f ms  mad %9.3f ms\n",
+                c->name, STAGE_NAMES[s], (double)m * 1e-6, (double)deviation * 1e-6);
+    }
+    fprintf(out, "\n     ]}");
+
+    release(&d);
+    free(samples);
+}
+
+/**
+ * Parses "--name=value" options.
+ *
+ * @return 0 on success, -1 on an unknown option.
+ */
+static int parse_options(int argc, const char *argv[], bench_options_t *options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--warmup=", 9) == 0)
+            options->warmup = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--repeat=", 9) == 0)
+            options->repeat = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--points=", 9) == 0)
+            options->points = atoll(argv[i] + 9);
+        else if (strncmp(argv[i], "--case=", 7) == 0)
+            options->only = argv[i] + 7;
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+            options->output = argv[i] + 9;
+        else if (strncmp(argv[i], "--kernel=", 9) == 0)
+        {
+            if (kernel_select(argv[i] + 9) != 0)
+            {
+                fprintf(stderr, "Kernel '%s' is unknown, not supported by this CPU or failed its self-test\n",
+                        argv[i] + 9);
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf(stderr,
+                    "Usage: %s [--warmup=N] [--repeat=N] [--points=N] [--case=NAME] [--output=FILE]\n"
+                    "          [--kernel=scalar|avx2|avx512|auto]\n",
+                    argv[0]);
+            return -1;
+        }
+    }
+    if (options->warmup < 0)
+        options->warmup = 0;
+    if (options->repeat < 1)
+        options->repeat = 1;
+    if (options->points < 1000)
+        options->points = 1000;
+    if (kernel_rejected() != NULL)
+        fprintf(stderr, "Warning: CNP_KERNEL=%s is unknown, unsupported or failed its self-test; "
+                        "selecting automatically\n", kernel_rejected());
+    return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    bench_options_t options = {3, 15, 1 << 21, NULL, NULL};
+    if (parse_options(argc, argv, &options) != 0)
+        return 1;
+
+    FILE *out = stdout;
+    if (options.output && !(out = fopen(options.output, "w")))
+    {
+        fprintf(stderr, "Error opening '%s'\n", options.output);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"engine\": \"%s\",\n  \"compiler\": \"%s\",\n  \"kernel\": \"%s\",\n"
+            "  \"timestamp\": %lld,\n"
+            "  \"warmup\": %d,\n  \"repeat\": %d,\n  \"target_points\": %lld,\n  \"cases\": [",
+            ENGINE_NAME, __VERSION__, kernel_name(), (long long)time(NULL),
+            options.warmup, options.repeat, (long long)options.points);
+
+    bool first = true;
+    for (size_t i = 0; i < NUMBER_OF_CASES; i++)
+    {
+        if (options.only && strcmp(options.only, CASES[i].name) != 0)
+            continue;
+        bench_case(out, &CASES[i], &options, first);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
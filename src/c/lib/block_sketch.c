@@ -0,0 +1,367 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "block_sketch.h"
+#include "external.h"
+#include "kernels.h"
+#include "period_stream.h"
+
+/* Rolling hash of the blocks, modulo 2^64 (odd base). */
+#define HASH_BASE UINT64_C(0x9E3779B97F4A7C15)
+
+/* Gaps compared per kernel_equal() call while a mismatch is searched. */
+#define SCAN_CHUNK 4096
+
+/* Most candidates: both sides and the period of a run. */
+#define MAX_CANDIDATES (2 * SKETCH_CANDIDATES_PER_SIDE + 1)
+
+typedef struct
+{
+    int64_t position;       // first gap of the block
+    uint64_t fingerprint;   // hash of gaps[position, position + SKETCH_BLOCK)
+} anchor_t;
+
+/* The sketch, reused by the calls of one thread: its own buffer, grown on
+ * demand, or one lent by sketch_use_buffer(), which is never grown. */
+static _Thread_local anchor_t *anchors = NULL;
+static _Thread_local size_t anchor_capacity = 0;
+static _Thread_local bool lent = false;
+
+/* Anchors of the sketch of length gaps: at most one per SKETCH_BLOCK / 4. */
+static size_t anchors_needed(int64_t length)
+{
+    return (size_t)(length / (SKETCH_BLOCK / 4)) + 2;
+}
+
+size_t sketch_buffer_bytes(int64_t length)
+{
+    return anchors_needed(length) * sizeof(anchor_t);
+}
+
+void sketch_use_buffer(void *buffer, size_t bytes)
+{
+    sketch_release();
+    if (buffer == NULL)
+        return;
+    anchors = buffer;
+    anchor_capacity = bytes / sizeof(anchor_t);
+    lent = true;
+}
+
+void sketch_release(void)
+{
+    if (!lent)
+        free(anchors);
+    anchors = NULL;
+    anchor_capacity = 0;
+    lent = false;
+}
+
+/* Spreads a gap over all 64 bits (splitmix64 finalizer). */
+static inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= UINT64_C(0xBF58476D1CE4E5B9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+/**
+ * Builds the sketch of gaps[0, length).
+ *
+ * @return The number of anchors, or -1 if the sketch cannot be allocated.
+ */
+static int64_t build(const int64_t *gaps, int64_t length)
+{
+    const int64_t b = SKETCH_BLOCK;
+    const size_t needed = anchors_needed(length);
+    if (needed > anchor_capacity)
+    {
+        if (lent)
+            return -1;
+        anchor_t *grown = realloc(anchors, needed * sizeof(anchor_t));
+        if (grown == NULL)
+            return -1;
+        anchors = grown;
+        anchor_capacity = needed;
+    }
+    // HASH_BASE^b removes the gap that leaves the block.
+    uint64_t power = 1;
+    for (int64_t i = 0; i < b; i++)
+        power *= HASH_BASE;
+
+    int64_t count = 0;
+    int64_t last = -b;
+    uint64_t hash = 0;
+    for (int64_t i = 0; i < length; i++)
+    {
+        hash = hash * HASH_BASE + mix((uint64_t)gaps[i]);
+        if (i < b - 1)
+            continue;
+        if (i >= b)
+            hash -= power * mix((uint64_t)gaps[i - b]);
+        const int64_t start = i + 1 - b;
+        if ((mix(hash) & (uint64_t)(b - 1)) == 0 && start - last >= b / 4)
+        {
+            anchors[count++] = (anchor_t){start, hash};
+            last = start;
+        }
+    }
+    return count;
+}
+
+/* The first anchor at or after position. */
+static int64_t first_anchor(int64_t count, int64_t position)
+{
+    int64_t lo = 0;
+    int64_t hi = count;
+    while (lo < hi)
+    {
+        const int64_t mid = lo + (hi - lo) / 2;
+        if (anchors[mid].position < position)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Whether the anchors from j on repeat the pattern anchors [a, a + n). */
+static bool recurs(int64_t count, int64_t a, int64_t n, int64_t j)
+{
+    if (j + n > count)
+        return false;
+    const int64_t shift = anchors[j].position - anchors[a].position;
+    for (int64_t i = 0; i < n; i++)
+        if (anchors[j + i].fingerprint != anchors[a + i].fingerprint ||
+            anchors[j + i].position - anchors[a + i].position != shift)
+            return false;
+    return true;
+}
+
+/**
+ * Appends the distances from the pattern around center to its nearest
+ * recurrences in the sketch (SKETCH_CANDIDATES_PER_SIDE on each side).
+ *
+ * @return The new number of candidates.
+ */
+static int find_candidates(int64_t count, int64_t center, int64_t *candidates, int found)
+{
+    const int64_t half = SKETCH_PATTERN_BLOCKS * SKETCH_BLOCK / 2;
+    const int64_t a = first_anchor(count, center - half);
+    if (a >= count)
+        return found;
+    int64_t n = first_anchor(count, center + half) - a;
+    if (n < 1)
+        n = 1;   // no anchor near the center: the nearest one after it
+
+    int64_t before[SKETCH_CANDIDATES_PER_SIDE];   // the last recurrences before a (ring)
+    int before_count = 0;
+    int after_count = 0;
+    for (int64_t j = 0; j < count && after_count < SKETCH_CANDIDATES_PER_SIDE; j++)
+    {
+        if (j == a || anchors[j].fingerprint != anchors[a].fingerprint || !recurs(count, a, n, j))
+            continue;
+        if (j < a)
+            before[before_count++ % SKETCH_CANDIDATES_PER_SIDE] = anchors[a].position - anchors[j].position;
+        else
+        {
+            candidates[found++] = anchors[j].position - anchors[a].position;
+            after_count++;
+        }
+    }
+    const int kept = before_count < SKETCH_CANDIDATES_PER_SIDE ? before_count : SKETCH_CANDIDATES_PER_SIDE;
+    for (int i = 0; i < kept; i++)
+        candidates[found++] = before[i];
+    return found;
+}
+
+static int sort_unique(int64_t *values, int count)
+{
+    kernel_sort(values, (size_t)count);
+    int unique = 0;
+    for (int i = 0; i < count; i++)
+        if (unique == 0 || values[i] != values[unique - 1])
+            values[unique++] = values[i];
+    return unique;
+}
+
+/* The minimal period of g[0, n) if it is at most n / 2, otherwise 0. */
+static int64_t run_period(const int64_t *g, int64_t n)
+{
+    int64_t buffer[PERIOD_STREAM_VALUES_PER_PERIOD * SKETCH_PATTERN_BLOCKS * SKETCH_BLOCK / 2 + 2];
+    period_stream_t s;
+    period_stream_init(&s, buffer, sizeof(buffer) / sizeof(buffer[0]), 2);
+    for (int64_t i = 0; i < n; i++)
+        period_stream_feed(&s, g[i]);
+    const int64_t period = (int64_t)period_stream_current(&s);
+    return s.restarts == 0 && 2 * period <= n ? period : 0;
+}
+
+/* The first index >= from where g[i] != g[i - q], or the length. */
+static int64_t run_end(const int64_t *g, int64_t length, int64_t from, int64_t q)
+{
+    for (int64_t index = from; index < length; index += SCAN_CHUNK)
+    {
+        const int64_t n = length - index < SCAN_CHUNK ? length - index : SCAN_CHUNK;
+        if (kernel_equal(&g[index], &g[index - q], (size_t)n))
+            continue;
+        for (int64_t i = index;; i++)
+            if (g[i] != g[i - q])
+                return i;
+    }
+    return length;
+}
+
+/**
+ * The deepest mismatch g[m] != g[m + p] inside the window of step 1, as
+ * min(m - t, length - t - p - m): the candidate holds from the next step
+ * on. That depth grows towards the middle, so the mismatches closest to
+ * it on either side decide; once one side reaches limit the candidate is
+ * out and the other side is skipped.
+ */
+static int64_t depth(const int64_t *g, int64_t length, int64_t t, int64_t p, int64_t limit)
+{
+    const int64_t lo = t + 1;
+    const int64_t hi = length - t - p - 1;   // m in [lo, hi]
+    if (hi < lo)
+        return 0;
+    int64_t mid = (length - p) / 2;
+    if (mid > hi)
+        mid = hi;
+    if (mid < lo)
+        mid = lo - 1;
+
+    int64_t deepest = 0;
+    for (int64_t end = mid + 1; end > lo;)
+    {
+        const int64_t start = end - SCAN_CHUNK > lo ? end - SCAN_CHUNK : lo;
+        if (!kernel_equal(&g[start], &g[start + p], (size_t)(end - start)))
+        {
+            int64_t m = end - 1;
+            while (g[m] == g[m + p])
+                m--;
+            deepest = m - t;
+            break;
+        }
+        end = start;
+    }
+    if (deepest >= limit)
+        return deepest;
+    for (int64_t start = mid + 1; start <= hi; start += SCAN_CHUNK)
+    {
+        const int64_t n = hi + 1 - start < SCAN_CHUNK ? hi + 1 - start : SCAN_CHUNK;
+        if (!kernel_equal(&g[start], &g[start + p], (size_t)n))
+        {
+            int64_t m = start;
+            while (g[m] == g[m + p])
+                m++;
+            const int64_t d = length - t - p - m;
+            return d > deepest ? d : deepest;
+        }
+    }
+    return deepest;
+}
+
+/**
+ * The minimal period at step of a period p that holds there: it divides
+ * p (Fine and Wilf, as p is at most half the window), so p is divided by
+ * its prime factors q as long as p / q still holds.
+ */
+static int64_t reduce(const int64_t *g, int64_t length, int64_t t, int64_t p, int64_t step)
+{
+    int64_t rest = p;   // the prime factors of p not tried yet
+    for (int64_t q = 2; rest > 1; q++)
+    {
+        if (q > rest / q)
+            q = rest;   // rest is prime
+        if (rest % q != 0)
+            continue;
+        while (rest % q == 0)
+            rest /= q;
+        while (p % q == 0 && depth(g, length, t, p / q, step) + 1 <= step)
+            p /= q;
+    }
+    return p;
+}
+
+int64_t sketch_verify(const int64_t *gaps, int64_t length, int64_t to_delete, double fraction,
+                      const int64_t *found, int count)
+{
+    const int64_t t = to_delete;
+    if (2 * t + 2 >= length)
+        return EXT_WINDOW_TOO_SMALL;
+    const int64_t initial = length - 2 * t + 1;
+    int64_t k_fraction, k_empty;
+    ext_trim_steps(length, t, fraction, &k_fraction, &k_empty);
+    const int64_t k_end = k_fraction <= k_empty ? k_fraction : k_empty;
+    if (count > SKETCH_MAX_CANDIDATES)
+        count = SKETCH_MAX_CANDIDATES;
+    // The small lags are always checked: a generator that ranks lags may
+    // keep only multiples of a short period.
+    int64_t candidates[SKETCH_MAX_CANDIDATES + SKETCH_SMALL_LAGS];
+    memcpy(candidates, found, (size_t)count * sizeof(*found));
+    for (int64_t lag = 1; lag <= SKETCH_SMALL_LAGS; lag++)
+        candidates[count++] = lag;
+    count = sort_unique(candidates, count);
+
+    // The first step at which a candidate holds, then the smallest one there.
+    int64_t step = k_end;
+    int64_t first[SKETCH_MAX_CANDIDATES + SKETCH_SMALL_LAGS];   // per candidate: its first step, or k_end
+    for (int c = 0; c < count; c++)
+    {
+        const int64_t p = candidates[c];
+        int64_t last = (initial - 2 * p) / 2;   // the last step with 2p <= n_k
+        if (last > k_end - 1)
+            last = k_end - 1;
+        first[c] = k_end;
+        if (p < 1 || last < 1)
+            continue;
+        const int64_t d = depth(gaps, length, t, p, last);
+        if (d + 1 <= last)
+        {
+            first[c] = d + 1;
+            if (first[c] < step)
+                step = first[c];
+        }
+    }
+    if (step < k_end)
+        for (int c = 0; c < count; c++)
+            if (first[c] <= step && step <= (initial - 2 * candidates[c]) / 2)
+                return reduce(gaps, length, t, candidates[c], step);
+    return k_fraction <= k_empty ? EXT_WINDOW_TOO_SMALL : EXT_NO_PERIOD;
+}
+
+int64_t sketch_period(const int64_t *gaps, int64_t length, int64_t to_delete, double fraction)
+{
+    if (2 * to_delete + 2 >= length)
+        return EXT_WINDOW_TOO_SMALL;
+    const int64_t count = build(gaps, length);
+    if (count < 0)
+        return SKETCH_NO_MEMORY;
+
+    // The minimal period q of the central pattern, if it repeats inside it:
+    // the center then lies in a run (long runs of one gap with rare
+    // defects), the pattern recurs at every multiple of q and its anchors
+    // at multiples of their spacing. Keep q and look the pattern up around
+    // the defect that ends the run.
+    int64_t candidates[MAX_CANDIDATES];
+    int found = 0;
+    const int64_t pattern = SKETCH_PATTERN_BLOCKS * SKETCH_BLOCK;
+    int64_t center = length / 2;
+    if (length >= 2 * pattern)
+    {
+        const int64_t q = run_period(gaps + center - pattern / 2, pattern);
+        if (q > 0)
+        {
+            candidates[found++] = q;
+            const int64_t end = run_end(gaps, length, center + pattern / 2, q);
+            if (end < length)
+                center = end;
+        }
+    }
+    found = find_candidates(count, center, candidates, found);
+    return sketch_verify(gaps, length, to_delete, fraction, candidates, found);
+}
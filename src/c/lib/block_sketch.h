@@ -0,0 +1,114 @@
+#ifndef BLOCK_SKETCH_H
+#define BLOCK_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Two-level period search for long gap sequences in memory. The search
+ * of lambda_trim() tries every period at every step and reads the gaps
+ * again for each; for periods of 10^5 gaps and more that is memory bound.
+ *
+ * The first level is a sketch: the fingerprints (rolling hashes) of
+ * blocks of SKETCH_BLOCK gaps. Fixed, aligned blocks would only reveal
+ * periods that are multiples of the block size, so the blocks start at
+ * content-defined anchors: the positions whose fingerprint is 0 modulo
+ * SKETCH_BLOCK, at least SKETCH_BLOCK / 4 apart. The anchors of a
+ * periodic stretch repeat with its period, and there are about
+ * length / SKETCH_BLOCK of them. The candidates are the distances from
+ * the anchors around the center to their nearest recurrences in the
+ * sketch (a probabilistic step that never reads the gaps). If the central
+ * gaps repeat with a short period (long runs of one gap), that period is
+ * a candidate and the lookup moves to the defect that ends the run.
+ *
+ * The second level is exact: for each candidate the mismatch
+ * g[m] != g[m + p] closest to the middle on each side gives the first
+ * trim step at which it holds. The smallest candidate at the first such
+ * step is reduced by its divisors to the minimal period there, as
+ * lambda_trim() would return if that step is its first with a period.
+ */
+
+/* Gaps per fingerprint. A power of two. */
+#define SKETCH_BLOCK 64
+
+/* The pattern looked up in the sketch: the anchors of the
+ * SKETCH_PATTERN_BLOCKS * SKETCH_BLOCK gaps around the center. */
+#define SKETCH_PATTERN_BLOCKS 16
+
+/* Recurrences of the pattern kept on each side of it. */
+#define SKETCH_CANDIDATES_PER_SIDE 8
+
+/* Most candidates sketch_verify() checks. */
+#define SKETCH_MAX_CANDIDATES 32
+
+/* Lags 1..SKETCH_SMALL_LAGS sketch_verify() checks besides the candidates. */
+#define SKETCH_SMALL_LAGS 8
+
+/* sketch_period() result when the sketch cannot be allocated. */
+#define SKETCH_NO_MEMORY (-7)
+
+/**
+ * lambda_trim() for sorted gaps in memory. The window
+ * [to_delete + k, length - to_delete - k] shrinks by one gap per side and
+ * step k = 1, 2, ... until it has a period. Only the sketch candidates
+ * (and their divisors) are checked, so a period whose stretch is too short
+ * to repeat the central pattern is not found.
+ *
+ * The sketch memory (sketch_buffer_bytes(), about length bytes) is kept
+ * per thread and grown on demand; sketch_use_buffer() lends it a buffer
+ * allocated beforehand instead.
+ *
+ * @param gaps The gaps.
+ * @param length The number of gaps.
+ * @param to_delete The gaps cut from each end before the first step.
+ * @param fraction The fraction of the initial window below which the
+ *                 search stops (FRACTION_OF_REMAINING_ELEMENTS).
+ * @return The period, EXT_NO_PERIOD, EXT_WINDOW_TOO_SMALL (external.h)
+ *         or SKETCH_NO_MEMORY.
+ */
+int64_t sketch_period(const int64_t *gaps, int64_t length, int64_t to_delete, double fraction);
+
+/**
+ * Returns the size of the sketch of length gaps.
+ *
+ * @param length The number of gaps.
+ * @return The size in bytes.
+ */
+size_t sketch_buffer_bytes(int64_t length);
+
+/**
+ * Lends the sketch of the calling thread a buffer of the caller, e.g. one
+ * allocated before a search that a row timeout may leave with
+ * siglongjmp(): sketch_period() then never allocates and returns
+ * SKETCH_NO_MEMORY for gaps whose sketch does not fit. Frees the thread's
+ * own buffer; NULL goes back to growing one on demand.
+ *
+ * @param buffer The buffer (8-byte aligned), or NULL.
+ * @param bytes Its size.
+ */
+void sketch_use_buffer(void *buffer, size_t bytes);
+
+/**
+ * Frees the sketch buffer of the calling thread and forgets a lent one;
+ * to be called before a thread that used the sketch exits.
+ */
+void sketch_release(void);
+
+/**
+ * The exact second level on its own, for candidates from elsewhere: the
+ * smallest candidate (or lag up to SKETCH_SMALL_LAGS) at the first step
+ * at which one holds, reduced to the minimal period of that step by its
+ * divisors. It is the result of lambda_trim() if that step is its step.
+ *
+ * @param gaps The gaps.
+ * @param length The number of gaps.
+ * @param to_delete The gaps cut from each end before the first step.
+ * @param fraction The fraction of the initial window below which the search stops.
+ * @param candidates The candidate periods.
+ * @param count Their number (at most SKETCH_MAX_CANDIDATES are checked).
+ * @return The period, EXT_NO_PERIOD or EXT_WINDOW_TOO_SMALL.
+ */
+int64_t sketch_verify(const int64_t *gaps, int64_t length, int64_t to_delete, double fraction,
+                      const int64_t *candidates, int count);
+
+#endif /* BLOCK_SKETCH_H */
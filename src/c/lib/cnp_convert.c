@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csv_loader.h"
+#include "result_file.h"
+
+/**
+ * Converts a five- or six-column CSV file into a binary result file.
+ */
+static int csv_to_binary(const char *in_path, const char *out_path)
+{
+    csv_table_t table;
+    if (csv_table_load(in_path, 0, &table) != 0)
+        return 1;
+    csv_table_report_errors(&table, in_path, 20);
+
+    // Only the parsed columns are kept, so the header is cut to match.
+    size_t header_length = 0;
+    int separators = 0;
+    while (header_length < table.header_length)
+    {
+        if (table.header[header_length] == table.separator && ++separators == table.columns)
+            break;
+        header_length++;
+    }
+    char *header = malloc(header_length + 1);
+    if (header == NULL)
+    {
+        csv_table_free(&table);
+        return 1;
+    }
+    for (size_t i = 0; i < header_length; i++)
+        header[i] = table.header[i] == table.separator ? ',' : table.header[i];
+    header[header_length] = '\0';
+
+    result_writer_t writer;
+    int rc = result_writer_open(&writer, out_path, table.columns, header, false);
+    free(header);
+    if (rc != 0)
+    {
+        csv_table_free(&table);
+        return 1;
+    }
+
+    int64_t row[CSV_MAX_COLUMNS];
+    for (size_t i = 0; i < table.rows && rc == 0; i++)
+    {
+        for (int c = 0; c < table.columns; c++)
+            row[c] = table.column[c][i];
+        rc = result_writer_append(&writer, row);
+    }
+    if (result_writer_close(&writer) != 0)
+        rc = -1;
+
+    printf("Converted %zu rows (%d columns, %zu malformed lines skipped) to '%s'.\n",
+           table.rows, table.columns, table.error_count, out_path);
+    csv_table_free(&table);
+    return rc == 0 ? 0 : 1;
+}
+
+/**
+ * Converts a binary result file into a CSV file.
+ */
+static int binary_to_csv(const char *in_path, const char *out_path)
+{
+    result_reader_t reader;
+    if (result_reader_open(&reader, in_path) != 0)
+    {
+        fprintf(stderr, "Error: '%s' is not a result file\n", in_path);
+        return 1;
+    }
+    if (reader.recovered)
+        fprintf(stderr, "Warning: '%s' has no valid footer, recovered %llu rows from its blocks.\n",
+                in_path, (unsigned long long)reader.rows);
+
+    FILE *out = fopen(out_path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "Error: could not open %s for writing\n", out_path);
+        result_reader_close(&reader);
+        return 1;
+    }
+    static char buffer[1 << 20];
+    setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+
+    fprintf(out, "%.*s\n", (int)reader.header_length, reader.header);
+    for (uint64_t i = 0; i < reader.rows; i++)
+    {
+        for (int c = 0; c < reader.columns; c++)
+            fprintf(out, c == 0 ? "%lld" : ",%lld", (long long)result_reader_get(&reader, i, c));
+        fputc('\n', out);
+    }
+
+    const int rc = fclose(out);
+    printf("Converted %llu rows (%d columns) to '%s'.\n",
+           (unsigned long long)reader.rows, reader.columns, out_path);
+    result_reader_close(&reader);
+    return rc == 0 ? 0 : 1;
+}
+
+/**
+ * Verifies the block checksums of a binary result file.
+ */
+static int check_binary(const char *path)
+{
+    result_reader_t reader;
+    if (result_reader_open(&reader, path) != 0)
+    {
+        fprintf(stderr, "Error: '%s' is not a result file\n", path);
+        return 1;
+    }
+
+    uint64_t bad_block = 0;
+    const bool ok = result_reader_verify(&reader, &bad_block);
+    printf("%s: %llu rows, %llu blocks, %d columns, footer %s, checksums %s",
+           path, (unsigned long long)reader.rows, (unsigned long long)reader.blocks, reader.columns,
+           reader.recovered ? "missing (recovered)" : "ok", ok ? "ok\n" : "BAD");
+    if (!ok)
+        printf(" (block %llu)\n", (unsigned long long)bad_block);
+    result_reader_close(&reader);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, const char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--check") == 0)
+        return check_binary(argv[2]);
+
+    if (argc != 3)
+    {
+        fprintf(stderr,
+            "Usage: %s <input> <output>\n"
+            "       %s --check <file" RESULT_FILE_EXTENSION ">\n"
+            "Converts between the CSV result format and the binary columnar\n"
+            "format; the direction follows from the '" RESULT_FILE_EXTENSION "' extension.\n",
+            argv[0], argv[0]);
+        return 1;
+    }
+
+    const bool in_binary = result_file_is_binary(argv[1]);
+    const bool out_binary = result_file_is_binary(argv[2]);
+    if (in_binary == out_binary)
+    {
+        fprintf(stderr, "Error: exactly one of input and output must end in '" RESULT_FILE_EXTENSION "'\n");
+        return 1;
+    }
+    return in_binary ? binary_to_csv(argv[1], argv[2]) : csv_to_binary(argv[1], argv[2]);
+}
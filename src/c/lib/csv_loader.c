@@ -0,0 +1,492 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "csv_loader.h"
+
+/* Files smaller than this are parsed by a single thread. */
+#define CSV_MIN_BYTES_PER_THREAD (1 << 20)
+
+/* Line states used while the chunks are parsed. */
+#define CSV_LINE_VALID 0
+#define CSV_LINE_BLANK 1
+#define CSV_LINE_MALFORMED 2
+
+int csv_map(const char *path, csv_map_t *map)
+{
+    map->data = NULL;
+    map->size = 0;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size > 0)
+    {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+        map->data = data;
+        map->size = (size_t)st.st_size;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    return 0;
+}
+
+void csv_unmap(csv_map_t *map)
+{
+    if (map->data != NULL)
+        munmap((void *)map->data, map->size);
+    map->data = NULL;
+    map->size = 0;
+}
+
+size_t csv_split(const char *data, size_t size, size_t parts, size_t *bounds)
+{
+    if (parts == 0)
+        parts = 1;
+
+    size_t produced = 0;
+    size_t start = 0;
+    bounds[0] = 0;
+    for (size_t k = 1; k <= parts && start < size; k++)
+    {
+        size_t cut = (k == parts) ? size : size / parts * k;
+        if (cut <= start)
+            continue;
+        if (cut < size)
+        {
+            // Move the cut behind the next newline.
+            const char *nl = memchr(data + cut - 1, '\n', size - (cut - 1));
+            cut = nl ? (size_t)(nl - data) + 1 : size;
+        }
+        bounds[++produced] = cut;
+        start = cut;
+    }
+    return produced;
+}
+
+/**
+ * Parses an optionally negative decimal integer.
+ * The digit loop has no data-dependent branch besides its exit; the sign is
+ * applied arithmetically. More than 18 digits, which could overflow
+ * int64_t, are rejected.
+ *
+ * @param p The first character of the number.
+ * @param end The end of the buffer.
+ * @param value The parsed value.
+ * @param ok Cleared if no digit was found or the number is too long.
+ * @return The position behind the last digit.
+ */
+static inline const char *parse_int64(const char *p, const char *end, int64_t *value, bool *ok)
+{
+    const uint64_t negative = (p < end && *p == '-');
+    p += negative;
+
+    const char *digits = p;
+    uint64_t v = 0;
+    unsigned d;
+    while (p < end && (d = (unsigned)(unsigned char)*p - '0') < 10)
+    {
+        v = v * 10 + d;
+        p++;
+    }
+
+    const ptrdiff_t length = p - digits;
+    *ok = *ok && length > 0 && length <= 18;
+    *value = (int64_t)((v ^ -negative) + negative);
+    return p;
+}
+
+int csv_parse_line(const char **cursor, const char *end, char separator,
+                   int64_t *values, int max_values)
+{
+    const char *p = *cursor;
+    bool ok = true;
+    int fields = 0;
+
+    while (fields < max_values)
+    {
+        p = parse_int64(p, end, &values[fields], &ok);
+        fields++;
+        if (p < end && *p == separator && fields < max_values)
+            p++;
+        else
+            break;
+    }
+
+    // Count, but do not parse, any further fields.
+    while (p < end && *p == separator)
+    {
+        fields++;
+        p++;
+        while (p < end && *p != separator && *p != '\n' && *p != '\r')
+            p++;
+    }
+
+    if (p < end && *p == '\r')
+        p++;
+    if (p < end && *p != '\n')
+        ok = false;
+
+    const char *nl = (p < end) ? memchr(p, '\n', (size_t)(end - p)) : NULL;
+    *cursor = nl ? nl + 1 : end;
+    return ok ? fields : -1;
+}
+
+/**
+ * Work item of one parser thread: the chunk [begin, end) of the mapping and
+ * the global index of its first line.
+ */
+typedef struct
+{
+    csv_table_t *table;
+    const char *begin;
+    const char *end;
+    size_t first_line;
+    size_t lines;
+    uint8_t *state;
+} csv_chunk_t;
+
+/**
+ * Counts the lines of a chunk; a last line without newline counts as well.
+ */
+static size_t count_lines(const char *begin, const char *end)
+{
+    size_t lines = 0;
+    const char *p = begin;
+    while (p < end)
+    {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        lines++;
+        if (nl == NULL)
+            break;
+        p = nl + 1;
+    }
+    return lines;
+}
+
+static void *parse_chunk(void *arg)
+{
+    csv_chunk_t *chunk = arg;
+    csv_table_t *table = chunk->table;
+    const char *p = chunk->begin;
+    int64_t values[CSV_MAX_COLUMNS];
+
+    for (size_t i = 0; i < chunk->lines; i++)
+    {
+        const size_t line = chunk->first_line + i;
+        table->offset[line] = (uint64_t)(p - table->map.data);
+
+        if (p >= chunk->end || *p == '\n' || (*p == '\r' && p + 1 < chunk->end && p[1] == '\n'))
+        {
+            const char *nl = (p < chunk->end) ? memchr(p, '\n', (size_t)(chunk->end - p)) : NULL;
+            p = nl ? nl + 1 : chunk->end;
+            chunk->state[line] = CSV_LINE_BLANK;
+            continue;
+        }
+
+        const int fields = csv_parse_line(&p, chunk->end, table->separator, values, table->columns);
+        if (fields < table->columns)
+        {
+            chunk->state[line] = CSV_LINE_MALFORMED;
+            continue;
+        }
+
+        chunk->state[line] = CSV_LINE_VALID;
+        for (int c = 0; c < table->columns; c++)
+            table->column[c][line] = values[c];
+    }
+    return NULL;
+}
+
+/**
+ * Reads the header line, which decides the separator and the number of
+ * columns.
+ *
+ * @return The offset of the first data line, or SIZE_MAX (after printing
+ *         an error) if the file has fewer than five columns.
+ */
+static size_t read_header(const char *path, const char *data, size_t size,
+                          const char **header, size_t *header_length,
+                          char *separator, int *fields, int *columns)
+{
+    const char *header_end = memchr(data, '\n', size);
+    *header = data;
+    *header_length = header_end ? (size_t)(header_end - data) : size;
+    while (*header_length > 0 && data[*header_length - 1] == '\r')
+        (*header_length)--;
+
+    size_t commas = 0, semicolons = 0;
+    for (size_t i = 0; i < *header_length; i++)
+    {
+        commas += data[i] == ',';
+        semicolons += data[i] == ';';
+    }
+    *separator = (semicolons > commas) ? ';' : ',';
+    *fields = (int)(semicolons > commas ? semicolons : commas) + 1;
+    *columns = *fields < CSV_MAX_COLUMNS ? *fields : CSV_MAX_COLUMNS;
+    if (*columns <= CSV_PERIOD)
+    {
+        fprintf(stderr, "Error: %s has %d columns, expected at least %d\n",
+                path, *fields, CSV_PERIOD + 1);
+        return SIZE_MAX;
+    }
+    return header_end ? (size_t)(header_end - data) + 1 : size;
+}
+
+int csv_table_load(const char *path, int threads, csv_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+    if (csv_map(path, &table->map) != 0)
+    {
+        fprintf(stderr, "Error: could not open %s\n", path);
+        return -1;
+    }
+
+    const char *data = table->map.data;
+    const size_t size = table->map.size;
+    if (size == 0)
+    {
+        fprintf(stderr, "Error: empty file %s\n", path);
+        csv_table_free(table);
+        return -1;
+    }
+
+    const size_t body = read_header(path, data, size, &table->header, &table->header_length,
+                                    &table->separator, &table->fields, &table->columns);
+    if (body == SIZE_MAX)
+    {
+        csv_table_free(table);
+        return -1;
+    }
+    const char *header_end = body > 0 ? data + body - 1 : NULL;
+
+    // Split the body at line boundaries and count the lines of each chunk.
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t parts = (size - body) / CSV_MIN_BYTES_PER_THREAD + 1;
+    if (parts > (size_t)threads)
+        parts = threads > 0 ? (size_t)threads : 1;
+
+    size_t *bounds = malloc((parts + 1) * sizeof(*bounds));
+    csv_chunk_t *chunks = calloc(parts, sizeof(*chunks));
+    pthread_t *tids = calloc(parts, sizeof(*tids));
+    if (!bounds || !chunks || !tids)
+    {
+        fprintf(stderr, "Error: out of memory while loading %s\n", path);
+        free(bounds); free(chunks); free(tids);
+        csv_table_free(table);
+        return -1;
+    }
+    parts = csv_split(data + body, size - body, parts, bounds);
+
+    size_t lines = 0;
+    for (size_t k = 0; k < parts; k++)
+    {
+        chunks[k].table = table;
+        chunks[k].begin = data + body + bounds[k];
+        chunks[k].end = data + body + bounds[k + 1];
+        chunks[k].first_line = lines;
+        chunks[k].lines = count_lines(chunks[k].begin, chunks[k].end);
+        lines += chunks[k].lines;
+    }
+
+    uint8_t *state = malloc(lines + 1);
+    table->offset = malloc((lines + 1) * sizeof(*table->offset));
+    bool allocated = state && table->offset;
+    for (int c = 0; c < table->columns; c++)
+    {
+        table->column[c] = malloc((lines + 1) * sizeof(int64_t));
+        allocated = allocated && table->column[c];
+    }
+    if (!allocated)
+    {
+        fprintf(stderr, "Error: out of memory while loading %s\n", path);
+        free(state); free(bounds); free(chunks); free(tids);
+        csv_table_free(table);
+        return -1;
+    }
+
+    // Parse the chunks in parallel; chunk 0 runs on the calling thread.
+    for (size_t k = 0; k < parts; k++)
+        chunks[k].state = state;
+    size_t started = 1;
+    for (size_t k = 1; k < parts; k++)
+    {
+        if (pthread_create(&tids[k], NULL, parse_chunk, &chunks[k]) != 0)
+            break;
+        started++;
+    }
+    if (parts > 0)
+        parse_chunk(&chunks[0]);
+    for (size_t k = 1; k < started; k++)
+        pthread_join(tids[k], NULL);
+    for (size_t k = started; k < parts; k++)
+        parse_chunk(&chunks[k]);
+
+    // Compact the valid lines and collect the malformed ones in file order.
+    size_t malformed = 0;
+    for (size_t line = 0; line < lines; line++)
+        malformed += state[line] == CSV_LINE_MALFORMED;
+    if (malformed > 0)
+        table->errors = malloc(malformed * sizeof(*table->errors));
+
+    const size_t first_line_number = header_end ? 2 : 1;
+    size_t rows = 0;
+    for (size_t line = 0; line < lines; line++)
+    {
+        if (state[line] == CSV_LINE_MALFORMED && table->errors != NULL)
+        {
+            table->errors[table->error_count].line = line + first_line_number;
+            table->errors[table->error_count].offset = (size_t)table->offset[line];
+            table->error_count++;
+        }
+        if (state[line] != CSV_LINE_VALID)
+            continue;
+        if (rows != line)
+        {
+            for (int c = 0; c < table->columns; c++)
+                table->column[c][rows] = table->column[c][line];
+            table->offset[rows] = table->offset[line];
+        }
+        rows++;
+    }
+    table->rows = rows;
+
+    free(state);
+    free(bounds);
+    free(chunks);
+    free(tids);
+    return 0;
+}
+
+void csv_table_free(csv_table_t *table)
+{
+    for (int c = 0; c < CSV_MAX_COLUMNS; c++)
+        free(table->column[c]);
+    free(table->offset);
+    free(table->errors);
+    csv_unmap(&table->map);
+    memset(table, 0, sizeof(*table));
+}
+
+void csv_table_report_errors(const csv_table_t *table, const char *path, size_t limit)
+{
+    for (size_t i = 0; i < table->error_count && i < limit; i++)
+    {
+        const csv_error_t *e = &table->errors[i];
+        const char *line = table->map.data + e->offset;
+        const char *nl = memchr(line, '\n', table->map.size - e->offset);
+        int length = (int)((nl ? (size_t)(nl - line) : table->map.size - e->offset));
+        if (length > 80)
+            length = 80;
+        fprintf(stderr, "%s:%zu (byte %zu): malformed line '%.*s'\n",
+                path, e->line, e->offset, length, line);
+    }
+    if (table->error_count > limit)
+        fprintf(stderr, "%s: %zu further malformed lines\n", path, table->error_count - limit);
+}
+
+int csv_stream_open(const char *path, csv_stream_t *stream)
+{
+    memset(stream, 0, sizeof(*stream));
+    if (csv_map(path, &stream->map) != 0 || stream->map.size == 0)
+    {
+        fprintf(stderr, "Error: could not read %s\n", path);
+        csv_unmap(&stream->map);
+        return -1;
+    }
+
+    const size_t body = read_header(path, stream->map.data, stream->map.size, &stream->header,
+                                    &stream->header_length, &stream->separator,
+                                    &stream->fields, &stream->columns);
+    if (body == SIZE_MAX)
+    {
+        csv_unmap(&stream->map);
+        return -1;
+    }
+    stream->path = path;
+    stream->cursor = stream->map.data + body;
+    stream->line = 1;
+    return 0;
+}
+
+bool csv_stream_next(csv_stream_t *stream, int64_t *values, uint64_t *offset)
+{
+    const char *end = stream->map.data + stream->map.size;
+    while (stream->cursor < end)
+    {
+        const char *line = stream->cursor;
+        stream->line++;
+        if (*line == '\n' || (*line == '\r' && line + 1 < end && line[1] == '\n'))
+        {
+            const char *nl = memchr(line, '\n', (size_t)(end - line));
+            stream->cursor = nl + 1;
+            continue;
+        }
+
+        if (csv_parse_line(&stream->cursor, end, stream->separator, values, stream->columns) >= stream->columns)
+        {
+            if (offset != NULL)
+                *offset = (uint64_t)(line - stream->map.data);
+            return true;
+        }
+
+        if (stream->error_count++ < 20)
+        {
+            const char *nl = memchr(line, '\n', (size_t)(end - line));
+            int length = (int)((nl ? nl : end) - line);
+            fprintf(stderr, "%s:%zu (byte %zu): malformed line '%.*s'\n", stream->path, stream->line,
+                    (size_t)(line - stream->map.data), length > 80 ? 80 : length, line);
+        }
+    }
+    return false;
+}
+
+void csv_stream_close(csv_stream_t *stream)
+{
+    csv_unmap(&stream->map);
+    memset(stream, 0, sizeof(*stream));
+}
+
+size_t csv_count_rows(const char *path)
+{
+    csv_map_t map;
+    if (csv_map(path, &map) != 0 || map.size == 0)
+        return 0;
+
+    const char *p = memchr(map.data, '\n', map.size);
+    const char *end = map.data + map.size;
+    size_t rows = 0;
+    while (p != NULL && p + 1 < end)
+    {
+        p++;
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        // Blank lines (including a lone '\r') are not rows.
+        if (!(*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n')))
+            rows++;
+        p = nl;
+    }
+
+    csv_unmap(&map);
+    return rows;
+}
@@ -0,0 +1,194 @@
+#ifndef CSV_LOADER_H
+#define CSV_LOADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Columns of the five-column ("o_n,o_d,a_n,a_d,period") and six-column
+ * ("o_n,o_d,a_n,a_d,period_multiset,period_set") CSV formats.
+ * Any further columns of a row are skipped by the loader.
+ */
+typedef enum
+{
+    CSV_O_N = 0,
+    CSV_O_D,
+    CSV_A_N,
+    CSV_A_D,
+    CSV_PERIOD,
+    CSV_PERIOD_SET,
+    CSV_MAX_COLUMNS
+} csv_column_t;
+
+/**
+ * A line that could not be parsed.
+ * line is 1-based (the header is line 1), offset is the byte offset of the
+ * first character of the line in the file.
+ */
+typedef struct
+{
+    size_t line;
+    size_t offset;
+} csv_error_t;
+
+/**
+ * A read-only memory mapping of a whole file.
+ */
+typedef struct
+{
+    const char *data;
+    size_t size;
+} csv_map_t;
+
+/**
+ * A CSV file parsed into struct-of-arrays columns.
+ * column[c] is NULL for c >= columns. offset[i] is the byte offset of the
+ * start of data row i, so a driver can seek back into the file.
+ * The header points into the mapping and is not NUL terminated.
+ */
+typedef struct
+{
+    csv_map_t map;
+    const char *header;
+    size_t header_length;
+    char separator;
+    int fields;
+    int columns;
+    size_t rows;
+    int64_t *column[CSV_MAX_COLUMNS];
+    uint64_t *offset;
+    csv_error_t *errors;
+    size_t error_count;
+} csv_table_t;
+
+/**
+ * Sequential reader over a mapped CSV file that parses one row per call,
+ * for drivers that stream rows instead of loading whole columns.
+ */
+typedef struct
+{
+    csv_map_t map;
+    const char *path;
+    const char *header;
+    size_t header_length;
+    char separator;
+    int fields;
+    int columns;
+    const char *cursor;
+    size_t line;
+    size_t error_count;
+} csv_stream_t;
+
+/**
+ * Maps a file read-only into memory. An empty file yields data == NULL and
+ * size == 0.
+ *
+ * @param path The path of the file.
+ * @param map The mapping to initialize.
+ * @return 0 on success, -1 if the file cannot be opened or mapped.
+ */
+int csv_map(const char *path, csv_map_t *map);
+
+/**
+ * Releases a mapping created by csv_map().
+ *
+ * @param map The mapping to release.
+ */
+void csv_unmap(csv_map_t *map);
+
+/**
+ * Splits data[0, size) into at most parts chunks whose boundaries all lie
+ * directly behind a newline, so each chunk can be parsed independently.
+ * bounds must have room for parts + 1 entries; chunk k is
+ * [bounds[k], bounds[k + 1]).
+ *
+ * @param data The buffer to split.
+ * @param size The size of the buffer.
+ * @param parts The desired number of chunks.
+ * @param bounds The chunk boundaries.
+ * @return The number of non-empty chunks actually produced.
+ */
+size_t csv_split(const char *data, size_t size, size_t parts, size_t *bounds);
+
+/**
+ * Parses one line of comma (or semicolon) separated integers.
+ * At most max_values values are stored; further fields are skipped.
+ * On return *cursor points behind the line terminator.
+ *
+ * @param cursor The position of the line start; advanced past the line.
+ * @param end The end of the buffer.
+ * @param separator The field separator.
+ * @param values The parsed values.
+ * @param max_values The number of values to parse.
+ * @return The number of fields on the line, or -1 if the line is malformed.
+ */
+int csv_parse_line(const char **cursor, const char *end, char separator,
+                   int64_t *values, int max_values);
+
+/**
+ * Loads a five- or six-column CSV file with a header line.
+ * The file is mapped, split at line boundaries into threads chunks and
+ * parsed in parallel. Blank lines are ignored; malformed lines are recorded
+ * in errors and left out of the columns.
+ *
+ * @param path The path of the CSV file.
+ * @param threads The number of parser threads (0 selects one per CPU).
+ * @param table The table to fill; release it with csv_table_free().
+ * @return 0 on success, -1 if the file cannot be read or has no header.
+ */
+int csv_table_load(const char *path, int threads, csv_table_t *table);
+
+/**
+ * Releases all memory and the mapping held by a table.
+ *
+ * @param table The table to release.
+ */
+void csv_table_free(csv_table_t *table);
+
+/**
+ * Prints the malformed lines of a table to stderr, at most limit of them.
+ *
+ * @param table The table.
+ * @param path The path used in the messages.
+ * @param limit The maximum number of lines to print.
+ */
+void csv_table_report_errors(const csv_table_t *table, const char *path, size_t limit);
+
+/**
+ * Maps a CSV file and reads its header for streaming.
+ *
+ * @param path The path of the CSV file.
+ * @param stream The stream to initialize.
+ * @return 0 on success, -1 if the file cannot be read or has no header.
+ */
+int csv_stream_open(const char *path, csv_stream_t *stream);
+
+/**
+ * Parses the next valid row. Blank lines are skipped; malformed lines are
+ * counted in error_count and the first 20 are reported on stderr.
+ *
+ * @param stream The stream.
+ * @param values Receives stream->columns values.
+ * @param offset Receives the byte offset of the row (may be NULL).
+ * @return true if a row was read, false at the end of the file.
+ */
+bool csv_stream_next(csv_stream_t *stream, int64_t *values, uint64_t *offset);
+
+/**
+ * Unmaps a stream.
+ *
+ * @param stream The stream.
+ */
+void csv_stream_close(csv_stream_t *stream);
+
+/**
+ * Counts the non-blank data lines (all lines after the header) of a file.
+ * A missing or empty file counts as zero rows.
+ *
+ * @param path The path of the file.
+ * @return The number of data rows.
+ */
+size_t csv_count_rows(const char *path);
+
+#endif /* CSV_LOADER_H */
@@ -0,0 +1,901 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cutproject.h"
+#include "kernels.h"
+#include "signature.h"
+
+/* Initial capacity of the work buffer; it doubles on demand. */
+#define INITIAL_CAPACITY (1 << 16)
+
+/* The enumeration checks the deadline every DEADLINE_STRIDE x values. */
+#define DEADLINE_STRIDE 4096
+
+/* Random positions cnp_oracle_periods() checks before the exact pass over
+ * a candidate period. */
+#define ORACLE_SAMPLES 64
+
+/* The random-access gap oracle of cnp_gap_oracle(). */
+typedef struct
+{
+    int64_t length;     // gaps per cycle, 0 if there is none
+    int64_t n;          // residues (with copies)
+    int64_t d;
+    bool unit;          // all gaps 1 (set gaps with N >= D)
+    int64_t gap[3];     // N <= D: the gap of each kind
+    int64_t copies;     // N > D: floor(N / D)
+    uint64_t *bits;     // N <= D: the kind after each rank (2 bits); N > D: residues with one copy more
+    int64_t *rank;      // N > D: the ones in bits before each word
+    size_t words;       // allocated words of bits and rank
+} gap_oracle_t;
+
+struct cnp_ctx
+{
+    cnp_config_t config;
+    int64_t *dx;
+    int64_t capacity;
+    bool borrowed;         // dx belongs to the caller (cnp_ctx_use_buffer())
+    int64_t gaps_length;   // of the sequence searched last, see cnp_ctx_gaps()
+    uint64_t start_ns;     // of the current call
+    uint64_t deadline_ns;  // of the current call, 0 if none
+    gap_oracle_t oracle;
+    cnp_stats_t stats;
+};
+
+typedef struct
+{
+    int64_t numerator;
+    int64_t denominator;
+} ratio_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int64_t gcd64(int64_t a, int64_t b)
+{
+    while (b != 0)
+    {
+        const int64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/* The rational helpers of mathematics.h, without the exit() on a zero
+ * denominator (arguments are validated up front). */
+static ratio_t ratio_create(int64_t numerator, int64_t denominator)
+{
+    const int64_t g = gcd64(numerator, denominator);
+    numerator /= g;
+    denominator /= g;
+    return denominator > 0 ? (ratio_t){numerator, denominator} : (ratio_t){-numerator, -denominator};
+}
+
+static ratio_t ratio_add(ratio_t x, ratio_t y)
+{
+    const int64_t lcm = (x.denominator / gcd64(x.denominator, y.denominator)) * y.denominator;
+    return (ratio_t){x.numerator * (lcm / x.denominator) + y.numerator * (lcm / y.denominator), lcm};
+}
+
+static int64_t ratio_floor(ratio_t r)
+{
+    const int64_t div = r.numerator / r.denominator;
+    return (r.numerator % r.denominator != 0 && r.numerator < 0) ? div - 1 : div;
+}
+
+static int64_t ratio_ceil(ratio_t r)
+{
+    const int64_t div = r.numerator / r.denominator;
+    return (r.numerator % r.denominator != 0 && r.numerator > 0) ? div + 1 : div;
+}
+
+static bool deadline_passed(const cnp_ctx *ctx)
+{
+    return ctx->deadline_ns != 0 && now_ns() >= ctx->deadline_ns;
+}
+
+void cnp_config_default(cnp_config_t *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->max_values = (int64_t)1 << 27;
+    config->x_max_limit = 1000000000LL;
+    config->remaining_fraction = 0.9;
+    config->periods = CNP_PERIODS_MULTISET | CNP_PERIODS_SET;
+}
+
+cnp_ctx *cnp_ctx_create(const cnp_config_t *config)
+{
+    cnp_ctx *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL)
+        return NULL;
+    if (config != NULL)
+        ctx->config = *config;
+    else
+        cnp_config_default(&ctx->config);
+
+    const cnp_config_t *c = &ctx->config;
+    const unsigned all_periods = CNP_PERIODS_MULTISET | CNP_PERIODS_SET;
+    if (c->max_values < 2 || c->x_max_limit < 1 || c->remaining_fraction <= 0 || c->remaining_fraction >= 1
+        || c->periods == 0 || (c->periods & ~all_periods) != 0
+        || (c->ordered && !(c->periods & CNP_PERIODS_MULTISET)))
+    {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void cnp_ctx_destroy(cnp_ctx *ctx)
+{
+    if (ctx == NULL)
+        return;
+    if (!ctx->borrowed)
+        free(ctx->dx);
+    free(ctx->oracle.bits);
+    free(ctx->oracle.rank);
+    free(ctx);
+}
+
+const cnp_config_t *cnp_ctx_config(const cnp_ctx *ctx)
+{
+    return &ctx->config;
+}
+
+const cnp_stats_t *cnp_ctx_stats(const cnp_ctx *ctx)
+{
+    return &ctx->stats;
+}
+
+void cnp_ctx_use_buffer(cnp_ctx *ctx, int64_t *buffer, int64_t capacity)
+{
+    if (!ctx->borrowed)
+        free(ctx->dx);
+    ctx->dx = buffer;
+    ctx->capacity = capacity;
+    ctx->borrowed = true;
+    ctx->gaps_length = 0;
+    ctx->stats.buffer_bytes = 0;
+}
+
+const int64_t *cnp_ctx_gaps(const cnp_ctx *ctx, int64_t *length)
+{
+    *length = ctx->gaps_length;
+    return ctx->gaps_length > 0 ? ctx->dx : NULL;
+}
+
+cnp_status_t cnp_ctx_signature(const cnp_ctx *ctx, int64_t period, char *hex)
+{
+    if (period < 1 || period > ctx->gaps_length)
+        return CNP_INVALID_ARGUMENT;
+    signature_t signature;
+    signature_of(ctx->dx + (ctx->gaps_length - period) / 2, period, &signature);
+    signature_format(&signature, hex);
+    return CNP_OK;
+}
+
+/**
+ * Makes room for needed values in the work buffer.
+ */
+static cnp_status_t reserve(cnp_ctx *ctx, int64_t needed)
+{
+    if (needed <= ctx->capacity)
+        return CNP_OK;
+    if (ctx->borrowed)
+        return CNP_BUFFER_EXCEEDED;
+    int64_t capacity = ctx->capacity ? ctx->capacity : INITIAL_CAPACITY;
+    while (capacity < needed)
+        capacity *= 2;
+    if (capacity > ctx->config.max_values)
+        capacity = ctx->config.max_values;
+    int64_t *dx = realloc(ctx->dx, (size_t)capacity * sizeof(*dx));
+    if (dx == NULL)
+        return CNP_OUT_OF_MEMORY;
+    ctx->dx = dx;
+    ctx->capacity = capacity;
+    ctx->stats.buffer_bytes = (uint64_t)capacity * sizeof(*dx);
+    return CNP_OK;
+}
+
+/**
+ * Enumerates the projected values of x in [x_min, x_max) into ctx->dx, as
+ * lambda_enumerate() with sort. budget_left limits the values (0: none).
+ */
+static cnp_status_t enumerate(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                              int64_t x_min, int64_t x_max, int64_t budget_left, int64_t *length)
+{
+    const int64_t beta_delta = beta * delta;
+    const int64_t alpha_delta_xmin = alpha * delta * x_min;
+    ratio_t l = ratio_create(alpha_delta_xmin - alpha * gamma, beta_delta);
+    ratio_t u = ratio_create(alpha_delta_xmin + beta * gamma, beta_delta);
+    const ratio_t to_add = ratio_create(alpha, beta);
+
+    int64_t index = 0;
+    int64_t beta_x = beta * x_min;
+    for (int64_t x = x_min; x < x_max; x++)
+    {
+        if ((x - x_min) % DEADLINE_STRIDE == DEADLINE_STRIDE - 1 && deadline_passed(ctx))
+            return CNP_BUDGET_EXCEEDED;
+
+        const int64_t y_ceil_l = ratio_ceil(l);
+        const int64_t elements = ratio_floor(u) - y_ceil_l + 1;
+        if (index + elements >= ctx->config.max_values)
+            return CNP_BUFFER_EXCEEDED;
+        if (budget_left > 0 && index + elements > budget_left)
+            return CNP_BUDGET_EXCEEDED;
+        if (index + elements > ctx->capacity)
+        {
+            const cnp_status_t status = reserve(ctx, index + elements);
+            if (status != CNP_OK)
+                return status;
+        }
+
+        kernel_fill(ctx->dx + index, beta_x + alpha * y_ceil_l, alpha, elements, false);
+        index += elements;
+
+        beta_x += beta;
+        l = ratio_add(l, to_add);
+        u = ratio_add(u, to_add);
+    }
+    *length = index;
+    return CNP_OK;
+}
+
+/**
+ * find_period_length() of mathematics.h: the smallest period of
+ * dx[index_start, index_end], 0 if there is none.
+ */
+static int64_t find_period(const int64_t *dx, int64_t index_start, int64_t index_end)
+{
+    const int64_t n = index_end - index_start + 1;
+    if (n < 2)
+        return 0;
+    for (int64_t period = 1; period <= n / 2; period++)
+    {
+        if (dx[index_end] != dx[index_start + (n - 1) % period])
+            continue;
+        const size_t count = (size_t)(index_end - period - index_start + 1);
+        if (kernel_equal(&dx[index_start], &dx[index_start + period], count))
+            return period;
+    }
+    return 0;
+}
+
+/**
+ * lambda_trim() of the engines: shrinks the window from both ends until a
+ * period is found or less than remaining_fraction of it is left.
+ */
+static cnp_period_t trim(const cnp_ctx *ctx, const int64_t *dx, int64_t length, bool sort)
+{
+    const double fraction = ctx->config.remaining_fraction;
+    const int64_t to_delete = sort ? (int64_t)((1.0 - fraction) / 40.0 * (double)length) : 1;
+    int64_t index_start = to_delete;
+    int64_t index_end = length - to_delete;
+    const int64_t initial_length = index_end - index_start + 1;
+    int64_t current_length = initial_length;
+
+    for (;;)
+    {
+        index_start++;
+        index_end--;
+        current_length -= 2;
+        if ((double)current_length / (double)initial_length < fraction)
+            return (cnp_period_t){CNP_WINDOW_TOO_SMALL, 0};
+        if (index_start >= index_end)
+            return (cnp_period_t){CNP_NO_PERIOD, 0};
+        if (deadline_passed(ctx))
+            return (cnp_period_t){CNP_BUDGET_EXCEEDED, 0};
+        const int64_t period = find_period(dx, index_start, index_end);
+        if (period > 0)
+            return (cnp_period_t){CNP_OK, period};
+    }
+}
+
+/**
+ * One attempt: enumerate, sort, take the multiset period of all gaps and
+ * the set period of the non-zero gaps (in ordered mode the multiset period
+ * of the unsorted differences).
+ */
+static void attempt(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                    int64_t x_min, int64_t x_max, cnp_result_t *result)
+{
+    const int64_t budget = ctx->config.budget_values;
+    int64_t budget_left = 0;
+    if (budget > 0)
+    {
+        budget_left = budget - result->values;
+        if (budget_left <= 0)
+        {
+            result->multiset = result->set = (cnp_period_t){CNP_BUDGET_EXCEEDED, 0};
+            return;
+        }
+    }
+
+    const cnp_period_t skipped = {CNP_SKIPPED, 0};
+    const unsigned periods = ctx->config.periods;
+    int64_t length = 0;
+    ctx->gaps_length = 0;
+    const cnp_status_t status = enumerate(ctx, alpha, beta, gamma, delta, x_min, x_max, budget_left, &length);
+    result->x_min = x_min;
+    result->x_max = x_max;
+    result->attempts++;
+    if (status != CNP_OK)
+    {
+        result->multiset = result->set = (cnp_period_t){status, 0};
+        return;
+    }
+    result->values += length;
+    if (length > result->max_values)
+        result->max_values = length;
+
+    int64_t *dx = ctx->dx;
+    if (ctx->config.ordered)
+    {
+        // lambda_enumerate() without sort: every value but the last is
+        // replaced by its difference to the next one.
+        for (int64_t i = 1; i < length; i++)
+            dx[i - 1] -= dx[i];
+        ctx->gaps_length = length;
+        result->multiset = trim(ctx, dx, length, false);
+        result->set = skipped;
+        return;
+    }
+
+    kernel_sort(dx, (size_t)length);
+    for (int64_t i = 1; i < length; i++)
+        dx[i - 1] = dx[i] - dx[i - 1];
+    const int64_t gaps = length > 0 ? length - 1 : 0;
+    ctx->gaps_length = gaps;
+    result->multiset = periods & CNP_PERIODS_MULTISET ? trim(ctx, dx, gaps, true) : skipped;
+    if (!(periods & CNP_PERIODS_SET))
+    {
+        result->set = skipped;
+        return;
+    }
+
+    int64_t write = 0;
+    for (int64_t read = 0; read < gaps; read++)
+        if (dx[read] != 0)
+            dx[write++] = dx[read];
+    ctx->gaps_length = write;
+    result->set = trim(ctx, dx, write, true);
+}
+
+static bool is_retryable(cnp_status_t status)
+{
+    return status == CNP_NO_PERIOD || status == CNP_WINDOW_TOO_SMALL;
+}
+
+/**
+ * Validates and reduces the parameters, fills n and d and starts the clock.
+ */
+static bool begin(cnp_ctx *ctx, int64_t *alpha, int64_t *beta, int64_t *gamma, int64_t *delta,
+                  cnp_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    ctx->gaps_length = 0;
+    ctx->start_ns = now_ns();
+    ctx->deadline_ns = ctx->config.budget_seconds > 0
+                       ? ctx->start_ns + (uint64_t)(ctx->config.budget_seconds * 1e9) : 0;
+    if (*alpha <= 0 || *beta <= 0 || *gamma <= 0 || *delta <= 0)
+    {
+        result->multiset = result->set = (cnp_period_t){CNP_INVALID_ARGUMENT, 0};
+        return false;
+    }
+
+    int64_t g = gcd64(*alpha, *beta);
+    *alpha /= g;
+    *beta /= g;
+    g = gcd64(*gamma, *delta);
+    *gamma /= g;
+    *delta /= g;
+    result->n = (*gamma * *alpha) / *delta + (*gamma * *beta) / *delta + 1;
+    result->d = *alpha * *alpha + *beta * *beta;
+    return true;
+}
+
+/**
+ * Sets the overall status and time and adds the call to the statistics.
+ */
+static cnp_status_t finish(cnp_ctx *ctx, cnp_result_t *result)
+{
+    const cnp_status_t multiset = result->multiset.status, set = result->set.status;
+    result->status = multiset != CNP_OK && multiset != CNP_SKIPPED ? multiset
+                     : set != CNP_SKIPPED ? set : CNP_OK;
+    result->seconds = (double)(now_ns() - ctx->start_ns) * 1e-9;
+
+    cnp_stats_t *s = &ctx->stats;
+    s->calls++;
+    s->attempts += (uint64_t)result->attempts;
+    s->values += (uint64_t)result->values;
+    s->status[result->status]++;
+    s->seconds += result->seconds;
+    return result->status;
+}
+
+cnp_status_t cnp_lambda(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                        int64_t x_min, int64_t x_max, cnp_result_t *result)
+{
+    if (begin(ctx, &alpha, &beta, &gamma, &delta, result))
+    {
+        if (x_max <= x_min)
+            result->multiset = result->set = (cnp_period_t){CNP_INVALID_ARGUMENT, 0};
+        else
+            attempt(ctx, alpha, beta, gamma, delta, x_min, x_max, result);
+    }
+    return finish(ctx, result);
+}
+
+cnp_status_t cnp_search(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                        int64_t period_hint, cnp_result_t *result)
+{
+    if (!begin(ctx, &alpha, &beta, &gamma, &delta, result))
+        return finish(ctx, result);
+
+    const cnp_config_t *c = &ctx->config;
+    if (c->degenerate)
+    {
+        const int64_t omega_int = gamma / delta + 1;
+        attempt(ctx, alpha, beta, gamma, delta, 0, 25 * omega_int > 1000 ? 25 * omega_int : 1000, result);
+        return finish(ctx, result);
+    }
+
+    // The window of lambda_search(): x_max for about MAX(200000, 4 * period)
+    // values at the projected density (alpha + beta) * gamma / (beta * delta).
+    const int64_t density_num = (alpha + beta) * gamma;
+    const int64_t density_den = beta * delta;
+    const int64_t buffer_cap = c->max_values - 1024;
+    int64_t target = period_hint * 4 > 200000 ? period_hint * 4 : 200000;
+    if (target > buffer_cap)
+        target = buffer_cap;
+    int64_t x_max = target * density_den / density_num;
+    if (x_max > c->x_max_limit) x_max = c->x_max_limit;
+    if (x_max < 1000) x_max = 1000;
+
+    for (;;)
+    {
+        attempt(ctx, alpha, beta, gamma, delta, 0, x_max, result);
+        if (!is_retryable(result->multiset.status) && !is_retryable(result->set.status))
+            break;
+
+        int64_t new_target = target * 2;
+        if (new_target > buffer_cap) new_target = buffer_cap;
+        if (new_target <= target) break;
+        int64_t new_x_max = new_target * density_den / density_num;
+        if (new_x_max > c->x_max_limit) new_x_max = c->x_max_limit;
+        if (new_x_max < 1000) new_x_max = 1000;
+        if (new_x_max <= x_max) break;
+        target = new_target;
+        x_max = new_x_max;
+    }
+    return finish(ctx, result);
+}
+
+/**
+ * (a * b) mod m for 0 <= a, b < m < 2^62, without overflow.
+ */
+static int64_t mul_mod(int64_t a, int64_t b, int64_t m)
+{
+    int64_t product = 0;
+    while (b > 0)
+    {
+        if (b & 1)
+            product = (product + a) % m;
+        a = (a + a) % m;
+        b >>= 1;
+    }
+    return product;
+}
+
+/**
+ * The inverse of a modulo m (gcd(a, m) == 1), by the extended Euclidean
+ * algorithm.
+ */
+static int64_t inverse_mod(int64_t a, int64_t m)
+{
+    int64_t r0 = m, r1 = a % m, s0 = 0, s1 = 1;
+    while (r1 != 0)
+    {
+        const int64_t q = r0 / r1;
+        int64_t t = r0 - q * r1;
+        r0 = r1;
+        r1 = t;
+        t = s0 - q * s1;
+        s0 = s1;
+        s1 = t;
+    }
+    return s0 < 0 ? s0 + m : s0;
+}
+
+/**
+ * The smallest period of the cyclic sequence gaps[0, length): the smallest
+ * divisor p of length with gaps[i] == gaps[i + p] for all i < length - p.
+ */
+static cnp_period_t cyclic_period(const cnp_ctx *ctx, const int64_t *gaps, int64_t length)
+{
+    int64_t root = 1;
+    while ((root + 1) * (root + 1) <= length)
+        root++;
+    // Divisors in increasing order: i up to the root, then length / i.
+    for (int64_t k = 1; k <= 2 * root; k++)
+    {
+        const int64_t i = k <= root ? k : 2 * root + 1 - k;
+        if (length % i != 0)
+            continue;
+        const int64_t period = k <= root ? i : length / i;
+        if (period == length)
+            break;
+        if (deadline_passed(ctx))
+            return (cnp_period_t){CNP_BUDGET_EXCEEDED, 0};
+        if (kernel_equal(gaps, gaps + period, (size_t)(length - period)))
+            return (cnp_period_t){CNP_OK, period};
+    }
+    return (cnp_period_t){CNP_OK, length};
+}
+
+/**
+ * The residues of the reduced row as a progression: c_{r_min + j} = (first +
+ * j * step) mod D for j = 0, ..., N - 1, with step = -alpha * beta^-1 mod D.
+ * False (CNP_INVALID_ARGUMENT) if D would not stay below 2^62.
+ */
+static bool residue_progression(int64_t alpha, int64_t beta, int64_t gamma, int64_t delta, int64_t d,
+                                int64_t *first, int64_t *step, cnp_result_t *result)
+{
+    const int64_t limit = (int64_t)1 << 30;  // D = alpha^2 + beta^2 < 2^61
+    if (alpha > limit || beta > limit)
+    {
+        result->multiset = result->set = (cnp_period_t){CNP_INVALID_ARGUMENT, 0};
+        return false;
+    }
+    const int64_t m = (d - mul_mod(alpha, inverse_mod(beta, d), d)) % d;
+    const int64_t r_min = -((gamma * beta) / delta);
+    *first = mul_mod(m, ((r_min % d) + d) % d, d);
+    *step = m;
+    return true;
+}
+
+cnp_status_t cnp_residues(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                          cnp_result_t *result)
+{
+    int64_t residue, m;
+    if (!begin(ctx, &alpha, &beta, &gamma, &delta, result)
+        || !residue_progression(alpha, beta, gamma, delta, result->d, &residue, &m, result))
+        return finish(ctx, result);
+
+    const cnp_period_t skipped = {CNP_SKIPPED, 0};
+    const unsigned periods = ctx->config.periods;
+    const int64_t n = result->n, d = result->d;
+    const int64_t budget = ctx->config.budget_values;
+    cnp_status_t status = n >= ctx->config.max_values ? CNP_BUFFER_EXCEEDED
+                          : budget > 0 && n > budget ? CNP_BUDGET_EXCEEDED : reserve(ctx, n);
+    if (status != CNP_OK)
+    {
+        result->multiset = result->set = (cnp_period_t){status, 0};
+        return finish(ctx, result);
+    }
+
+    // c_r for r = r_min, ..., r_max: c_{r + 1} = c_r + m (mod D).
+    int64_t *c = ctx->dx;
+    for (int64_t i = 0; i < n; i++)
+    {
+        c[i] = residue;
+        residue += m;
+        if (residue >= d)
+            residue -= d;
+    }
+    result->attempts = 1;
+    result->values = result->max_values = n;
+
+    kernel_sort(c, (size_t)n);
+    const int64_t wrap = c[0] + d - c[n - 1];
+    for (int64_t i = 1; i < n; i++)
+        c[i - 1] = c[i] - c[i - 1];
+    c[n - 1] = wrap;
+    ctx->gaps_length = n;
+    result->multiset = periods & CNP_PERIODS_MULTISET ? cyclic_period(ctx, c, n) : skipped;
+    if (!(periods & CNP_PERIODS_SET))
+    {
+        result->set = skipped;
+        return finish(ctx, result);
+    }
+
+    // Duplicates are the zero gaps; the wrap-around gap is never zero.
+    int64_t k = 0;
+    for (int64_t i = 0; i < n; i++)
+        if (c[i] != 0)
+            c[k++] = c[i];
+    ctx->gaps_length = k;
+    result->set = cyclic_period(ctx, c, k);
+    return finish(ctx, result);
+}
+
+/**
+ * Makes room for words words in the oracle bits (and rank counts).
+ */
+static cnp_status_t oracle_reserve(gap_oracle_t *o, size_t words)
+{
+    if (words <= o->words)
+        return CNP_OK;
+    uint64_t *bits = realloc(o->bits, words * sizeof(*bits));
+    if (bits != NULL)
+        o->bits = bits;
+    int64_t *rank = realloc(o->rank, words * sizeof(*rank));
+    if (rank != NULL)
+        o->rank = rank;
+    if (bits == NULL || rank == NULL)
+        return CNP_OUT_OF_MEMORY;
+    o->words = words;
+    return CNP_OK;
+}
+
+/**
+ * N <= D: walks the residues in increasing order by the three-distance
+ * theorem and stores the kind of each step.
+ */
+static cnp_status_t oracle_walk(const cnp_ctx *ctx, gap_oracle_t *o, int64_t first, int64_t m)
+{
+    const int64_t n = o->n, d = o->d;
+    if (n == 1)
+    {
+        o->gap[0] = d;
+        o->bits[0] = 0;
+        return CNP_OK;
+    }
+    // a and b: the offsets of the residues closest above and below the first.
+    int64_t a = 1, b = 1, p_a = m, p_b = m;
+    int64_t start = 0, lowest = first;
+    int64_t p = 0, c = first;
+    for (int64_t j = 1; j < n; j++)
+    {
+        p += m;
+        if (p >= d)
+            p -= d;
+        c += m;
+        if (c >= d)
+            c -= d;
+        if (p < p_a)
+            a = j, p_a = p;
+        if (p > p_b)
+            b = j, p_b = p;
+        if (c < lowest)
+            start = j, lowest = c;
+    }
+    o->gap[0] = p_a;            // j -> j + a
+    o->gap[1] = d - p_b;        // j -> j - b
+    o->gap[2] = p_a + d - p_b;  // j -> j + a - b
+
+    memset(o->bits, 0, (size_t)(n + 31) / 32 * sizeof(*o->bits));
+    int64_t j = start;
+    for (int64_t rank = 0; rank < n; rank++)
+    {
+        if (rank % DEADLINE_STRIDE == DEADLINE_STRIDE - 1 && deadline_passed(ctx))
+            return CNP_BUDGET_EXCEEDED;
+        uint64_t kind;
+        if (j + a < n)
+            kind = 0, j += a;
+        else if (j >= b)
+            kind = 1, j -= b;
+        else
+            kind = 2, j += a - b;
+        o->bits[rank / 32] |= kind << (2 * (rank % 32));
+    }
+    return CNP_OK;
+}
+
+/**
+ * N > D: marks the N mod D residues with floor(N / D) + 1 copies and
+ * counts the marks before each word.
+ */
+static void oracle_copies(gap_oracle_t *o, int64_t first, int64_t m)
+{
+    const int64_t d = o->d;
+    const size_t words = (size_t)(d + 63) / 64;
+    memset(o->bits, 0, words * sizeof(*o->bits));
+    int64_t c = first;
+    for (int64_t j = 0; j < o->n % d; j++)
+    {
+        o->bits[c / 64] |= UINT64_C(1) << (c % 64);
+        c += m;
+        if (c >= d)
+            c -= d;
+    }
+    int64_t ones = 0;
+    for (size_t w = 0; w < words; w++)
+    {
+        o->rank[w] = ones;
+        ones += __builtin_popcountll(o->bits[w]);
+    }
+}
+
+/* N > D: the rank of the first copy of residue v (v <= D). */
+static int64_t oracle_rank(const gap_oracle_t *o, int64_t v)
+{
+    if (v == o->d)
+        return o->n;
+    const uint64_t below = o->bits[v / 64] & ((UINT64_C(1) << (v % 64)) - 1);
+    return o->copies * v + o->rank[v / 64] + __builtin_popcountll(below);
+}
+
+/**
+ * Builds the oracle of the set gaps (set) or of the multiset gaps for the
+ * residues first + j * m mod d, j < n.
+ */
+static cnp_status_t oracle_build(cnp_ctx *ctx, int64_t first, int64_t m, int64_t n, int64_t d, bool set)
+{
+    gap_oracle_t *o = &ctx->oracle;
+    const int64_t budget = ctx->config.budget_values;
+    o->n = n;
+    o->d = d;
+    o->unit = set && n >= d;
+    o->copies = n / d;
+    cnp_status_t status = budget > 0 && n > budget ? CNP_BUDGET_EXCEEDED : CNP_OK;
+    if (status == CNP_OK && !o->unit)
+        status = oracle_reserve(o, n <= d ? (size_t)(n + 31) / 32 : (size_t)(d + 63) / 64);
+    if (status == CNP_OK && !o->unit)
+    {
+        if (n <= d)
+            status = oracle_walk(ctx, o, first, m);
+        else
+            oracle_copies(o, first, m);
+    }
+    if (status == CNP_OK)
+        o->length = o->unit ? d : n;
+    return status;
+}
+
+cnp_status_t cnp_gap_oracle(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                            cnp_result_t *result)
+{
+    ctx->oracle.length = 0;
+    int64_t first, m;
+    if (!begin(ctx, &alpha, &beta, &gamma, &delta, result)
+        || !residue_progression(alpha, beta, gamma, delta, result->d, &first, &m, result))
+        return finish(ctx, result);
+
+    const bool set = ctx->config.periods & CNP_PERIODS_SET;
+    const cnp_status_t status = oracle_build(ctx, first, m, result->n, result->d, set);
+    const cnp_period_t skipped = {CNP_SKIPPED, 0};
+    result->multiset = result->set = status == CNP_OK ? skipped : (cnp_period_t){status, 0};
+    if (status == CNP_OK)
+    {
+        result->attempts = 1;
+        result->values = ctx->oracle.length;
+    }
+    return finish(ctx, result);
+}
+
+int64_t cnp_gap_at(const cnp_ctx *ctx, int64_t i)
+{
+    const gap_oracle_t *o = &ctx->oracle;
+    if (o->length == 0)
+        return 0;
+    i %= o->length;
+    if (i < 0)
+        i += o->length;
+    if (o->unit)
+        return 1;
+    if (o->n <= o->d)
+        return o->gap[(o->bits[i / 32] >> (2 * (i % 32))) & 3];
+
+    // The residue v whose copies hold rank i; the gap after the last copy is 1.
+    int64_t lo = 0, hi = o->d - 1;
+    while (lo < hi)
+    {
+        const int64_t mid = lo + (hi - lo + 1) / 2;
+        if (oracle_rank(o, mid) <= i)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return oracle_rank(o, lo + 1) == i + 1 ? 1 : 0;
+}
+
+int64_t cnp_gap_check(const cnp_ctx *ctx, int64_t period, int64_t samples, uint64_t seed)
+{
+    const int64_t length = ctx->oracle.length;
+    for (int64_t k = 0; k < samples && length > 0; k++)
+    {
+        // splitmix64
+        uint64_t z = (seed += UINT64_C(0x9E3779B97F4A7C15));
+        z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+        z ^= z >> 31;
+        const int64_t i = (int64_t)(z % (uint64_t)length);
+        if (cnp_gap_at(ctx, i) != cnp_gap_at(ctx, i + period % length))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * cyclic_period() on the oracle: each divisor of the cycle, in increasing
+ * order, is spot-checked and then compared gap by gap.
+ */
+static cnp_period_t oracle_period(const cnp_ctx *ctx)
+{
+    const int64_t length = ctx->oracle.length;
+    int64_t root = 1;
+    while ((root + 1) * (root + 1) <= length)
+        root++;
+    for (int64_t k = 1; k <= 2 * root; k++)
+    {
+        const int64_t i = k <= root ? k : 2 * root + 1 - k;
+        if (length % i != 0)
+            continue;
+        const int64_t period = k <= root ? i : length / i;
+        if (period == length)
+            break;
+        if (deadline_passed(ctx))
+            return (cnp_period_t){CNP_BUDGET_EXCEEDED, 0};
+        if (cnp_gap_check(ctx, period, ORACLE_SAMPLES, (uint64_t)period) >= 0)
+            continue;
+        int64_t j = 0;
+        for (; j < length - period; j++)
+        {
+            if (j % DEADLINE_STRIDE == DEADLINE_STRIDE - 1 && deadline_passed(ctx))
+                return (cnp_period_t){CNP_BUDGET_EXCEEDED, 0};
+            if (cnp_gap_at(ctx, j) != cnp_gap_at(ctx, j + period))
+                break;
+        }
+        if (j == length - period)
+            return (cnp_period_t){CNP_OK, period};
+    }
+    return (cnp_period_t){CNP_OK, length};
+}
+
+cnp_status_t cnp_oracle_periods(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                                cnp_result_t *result)
+{
+    ctx->oracle.length = 0;
+    int64_t first, m;
+    if (!begin(ctx, &alpha, &beta, &gamma, &delta, result)
+        || !residue_progression(alpha, beta, gamma, delta, result->d, &first, &m, result))
+        return finish(ctx, result);
+
+    // For N <= D the residues are distinct, so the set gaps are the
+    // multiset gaps; for N > D every set gap is 1.
+    const unsigned periods = ctx->config.periods;
+    const int64_t n = result->n, d = result->d;
+    const cnp_period_t skipped = {CNP_SKIPPED, 0};
+    result->multiset = result->set = skipped;
+    if ((periods & CNP_PERIODS_MULTISET) || n < d)
+    {
+        const cnp_status_t status = oracle_build(ctx, first, m, n, d, false);
+        const cnp_period_t period = status == CNP_OK ? oracle_period(ctx) : (cnp_period_t){status, 0};
+        if (periods & CNP_PERIODS_MULTISET)
+            result->multiset = period;
+        if (periods & CNP_PERIODS_SET)
+            result->set = period;
+        result->attempts = 1;
+        result->values = n;
+    }
+    if ((periods & CNP_PERIODS_SET) && n >= d)
+        result->set = (cnp_period_t){CNP_OK, 1};
+    return finish(ctx, result);
+}
+
+const char *cnp_status_string(cnp_status_t status)
+{
+    static const char *NAMES[CNP_STATUS_COUNT] = {
+        "ok", "no_period", "buffer_exceeded", "window_too_small",
+        "budget_exceeded", "invalid_argument", "out_of_memory", "skipped"};
+    return status < CNP_STATUS_COUNT ? NAMES[status] : "unknown";
+}
+
+int cnp_status_code(cnp_status_t status)
+{
+    switch (status)
+    {
+    case CNP_OK: return 0;
+    case CNP_NO_PERIOD: return -1;
+    case CNP_BUFFER_EXCEEDED: return -2;
+    case CNP_WINDOW_TOO_SMALL: return -3;
+    case CNP_BUDGET_EXCEEDED: return -4;
+    default: return -5;
+    }
+}
@@ -0,0 +1,333 @@
+#ifndef CUTPROJECT_H
+#define CUTPROJECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * libcutproject: the period computation of the engines as a library.
+ *
+ * All state lives in a cnp_ctx: the configuration (fixed at creation), the
+ * work buffer (grown on demand up to max_values and reused between calls)
+ * and cumulative statistics. There is no global state, so any number of
+ * contexts can be used concurrently; a single context must not be used by
+ * two threads at the same time (create one per thread).
+ *
+ * Unlike lambda() in src/c/set and src/c/multiset, every call computes the
+ * multiset and the set period from the same sorted enumeration and reports
+ * failures through cnp_status_t instead of negative period values.
+ * cnp_residues() computes both periods exactly from the residue model, with
+ * no enumeration window at all; cnp_gap_at() reads single gaps of the
+ * infinite sequence from it without enumerating.
+ *
+ * src/python/cutproject.py loads libcutproject.so with ctypes.
+ *
+ * Build: make in src/c/lib produces libcutproject.a and libcutproject.so.
+ */
+
+typedef struct cnp_ctx cnp_ctx;
+
+typedef enum
+{
+    CNP_OK = 0,
+    CNP_NO_PERIOD,         // no period in the trim window (NO_PERIOD)
+    CNP_BUFFER_EXCEEDED,   // the window holds more than max_values values (ARRAY_SIZE_EXCEEDED)
+    CNP_WINDOW_TOO_SMALL,  // the trim window shrank below remaining_fraction (DX_LENGTH_TO_SMALL)
+    CNP_BUDGET_EXCEEDED,   // budget_values or budget_seconds spent
+    CNP_INVALID_ARGUMENT,  // a parameter is not positive, or x_max <= x_min
+    CNP_OUT_OF_MEMORY,
+    CNP_SKIPPED,           // the period was not requested (cnp_config_t.periods)
+    CNP_STATUS_COUNT
+} cnp_status_t;
+
+/* Bits of cnp_config_t.periods. */
+#define CNP_PERIODS_MULTISET 1u
+#define CNP_PERIODS_SET 2u
+
+/**
+ * Configuration of a context; start from cnp_config_default().
+ */
+typedef struct
+{
+    int64_t max_values;        // capacity limit of the work buffer (values)
+    int64_t x_max_limit;       // largest x_max cnp_search() may choose
+    double remaining_fraction; // trim stops below this share of the window (0.9)
+    bool degenerate;           // cnp_search(): x_max = MAX(1000, 25 * (floor(omega) + 1)), no retries
+    int64_t budget_values;     // values one call may enumerate over all attempts (0: unlimited)
+    double budget_seconds;     // wall time of one call (0: unlimited), checked cooperatively
+    unsigned periods;          // CNP_PERIODS_* to compute (both); the others are CNP_SKIPPED
+    bool ordered;              // gaps in x order, like lambda(..., false, dx): multiset period only
+} cnp_config_t;
+
+/**
+ * The period of one gap sequence.
+ */
+typedef struct
+{
+    cnp_status_t status;
+    int64_t period;  // > 0 if status == CNP_OK, else 0
+} cnp_period_t;
+
+/**
+ * The result of a call, parameters a = alpha / beta, omega = gamma / delta
+ * (reduced). n and d are the theoretical N = floor(alpha * omega) +
+ * floor(beta * omega) + 1 and D = alpha^2 + beta^2 of the row.
+ */
+typedef struct
+{
+    cnp_status_t status;    // CNP_OK if the requested periods were found, else the first failure
+    cnp_period_t multiset;
+    cnp_period_t set;
+    int64_t n;
+    int64_t d;
+    int64_t x_min;          // window of the last attempt
+    int64_t x_max;
+    int attempts;           // enumerations (1 + retries)
+    int64_t values;         // values enumerated over all attempts
+    int64_t max_values;     // values of the largest attempt
+    double seconds;
+} cnp_result_t;
+
+/**
+ * Cumulative statistics of a context.
+ */
+typedef struct
+{
+    uint64_t calls;
+    uint64_t attempts;
+    uint64_t values;
+    uint64_t status[CNP_STATUS_COUNT];  // calls per result status
+    uint64_t buffer_bytes;              // current size of the work buffer
+    double seconds;
+} cnp_stats_t;
+
+/**
+ * Fills a configuration with the defaults: max_values 2^27, x_max_limit
+ * 10^9, remaining_fraction 0.9, global window, no budget, both periods of
+ * the sorted values.
+ *
+ * @param config The configuration.
+ */
+void cnp_config_default(cnp_config_t *config);
+
+/**
+ * Creates a context. The work buffer is allocated by the first call.
+ *
+ * @param config The configuration (copied), NULL for the defaults.
+ * @return The context, or NULL if out of memory or config is invalid.
+ */
+cnp_ctx *cnp_ctx_create(const cnp_config_t *config);
+
+/**
+ * Releases a context and its buffer.
+ *
+ * @param ctx The context (may be NULL).
+ */
+void cnp_ctx_destroy(cnp_ctx *ctx);
+
+/**
+ * Returns the configuration of a context.
+ *
+ * @param ctx The context.
+ * @return The configuration.
+ */
+const cnp_config_t *cnp_ctx_config(const cnp_ctx *ctx);
+
+/**
+ * Returns the cumulative statistics of a context.
+ *
+ * @param ctx The context.
+ * @return The statistics.
+ */
+const cnp_stats_t *cnp_ctx_stats(const cnp_ctx *ctx);
+
+/**
+ * Computes both periods over the fixed window [x_min, x_max), like
+ * lambda(alpha, beta, gamma, delta, x_min, x_max, true, dx).
+ *
+ * @param ctx The context.
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param x_min The minimum value of x.
+ * @param x_max The maximum value of x (exclusive).
+ * @param result Receives the result.
+ * @return result->status.
+ */
+cnp_status_t cnp_lambda(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                        int64_t x_min, int64_t x_max, cnp_result_t *result);
+
+/**
+ * Computes both periods of a corpus row, choosing the window like
+ * lambda_search(): about MAX(200000, 4 * period_hint) values, doubled while
+ * a period is CNP_NO_PERIOD or CNP_WINDOW_TOO_SMALL until max_values or
+ * x_max_limit stops it (in degenerate mode the fixed degenerate window).
+ *
+ * @param ctx The context.
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param period_hint The expected multiset period, e.g. the period column.
+ * @param result Receives the result.
+ * @return result->status.
+ */
+cnp_status_t cnp_search(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                        int64_t period_hint, cnp_result_t *result);
+
+/**
+ * Computes both periods from the residue model instead of an enumeration:
+ * the N residues c_r = (-alpha * beta^-1 * r) mod D for r = -floor(beta *
+ * omega), ..., floor(alpha * omega) are the projected values of one length-D
+ * window, so the sorted residues form a cyclic gap sequence of length N
+ * (multiset) and, without duplicates, of length K <= N (set). The periods
+ * are the smallest divisors of N and K that repeat the gaps. Exact (no
+ * boundary trim), O(N log N); needs N <= max_values and D < 2^62. The
+ * ordered flag does not apply; result->values is N, the window fields are 0.
+ *
+ * @param ctx The context.
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param result Receives the result.
+ * @return result->status.
+ */
+cnp_status_t cnp_residues(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                          cnp_result_t *result);
+
+/**
+ * Prepares the random-access gap oracle of a row (cnp_gap_at()) from the
+ * residue model of cnp_residues(): the sorted values are the sorted
+ * residues shifted by k * D, so the gap sequence is cyclic with N gaps
+ * (multiset) or K = min(N, D) gaps (set). For N <= D the residues are
+ * ordered without sorting by the three-distance theorem: the successor of
+ * the residue of r is that of r + a, r - b or r + a - b for the two
+ * residues a, b closest to the first one, so there are at most three gap
+ * values and 2 bits per residue store which one follows each rank. For
+ * N > D every residue occurs floor(N / D) times and N mod D of them once
+ * more; a bit vector over the D residues with rank counts marks those. O(N)
+ * preprocessing and memory in bits, not values (max_values does not
+ * apply); needs D < 2^62. The set gaps are taken if the configuration
+ * requests the set period, else the multiset gaps (as cnp_ctx_gaps()).
+ * result->values is the number of gaps per cycle, the periods are
+ * CNP_SKIPPED. The oracle stays valid until the next cnp_gap_oracle() on
+ * the context.
+ *
+ * @param ctx The context.
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param result Receives the result.
+ * @return result->status.
+ */
+cnp_status_t cnp_gap_oracle(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                            cnp_result_t *result);
+
+/**
+ * Returns gap i of the cyclic sequence of the last cnp_gap_oracle(): gap 0
+ * follows the smallest residue, as in cnp_ctx_gaps() after cnp_residues(),
+ * and i may be any integer (taken modulo the cycle). O(1) for N <= D, else
+ * O(log D) (select by binary search over the rank counts).
+ *
+ * @param ctx The context.
+ * @param i The index.
+ * @return The gap, 0 if there is no oracle.
+ */
+int64_t cnp_gap_at(const cnp_ctx *ctx, int64_t i);
+
+/**
+ * Spot-checks a claimed period on the oracle: gap i against gap i + period
+ * at samples pseudo-random positions (splitmix64 from seed). A wrong period
+ * fails each sample with probability at least 1 / cycle, usually much more.
+ *
+ * @param ctx The context.
+ * @param period The claimed period.
+ * @param samples The number of positions.
+ * @param seed The seed of the positions.
+ * @return A position where the gaps differ, or -1 if all samples agree.
+ */
+int64_t cnp_gap_check(const cnp_ctx *ctx, int64_t period, int64_t samples, uint64_t seed);
+
+/**
+ * Computes both periods of cnp_residues() on the gap oracle instead of the
+ * sorted residues: the smallest divisor of the cycle whose shift matches
+ * 64 random gaps and then every gap. For N <= D the set gaps are the
+ * multiset gaps, for N >= D the set period is 1. The memory is
+ * that of cnp_gap_oracle() (N / 2 bytes for N <= D, D / 4 bytes above), so
+ * rows far beyond max_values and with huge D still answer; the time is
+ * O(N) per candidate that passes the samples, O(N log D) for N > D. The
+ * oracle of the multiset gaps stays valid; cnp_ctx_gaps() has none.
+ *
+ * @param ctx The context.
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param result Receives the result.
+ * @return result->status.
+ */
+cnp_status_t cnp_oracle_periods(cnp_ctx *ctx, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta,
+                                cnp_result_t *result);
+
+/**
+ * Makes a context work in a buffer of the caller instead of its own, which
+ * is freed: calls that need more than capacity values fail with
+ * CNP_BUFFER_EXCEEDED, and cnp_ctx_destroy() leaves the buffer alone. Lets
+ * a driver reuse the buffer of its engine (add_period_set --escalate).
+ *
+ * @param ctx The context.
+ * @param buffer The buffer, valid until the context is destroyed.
+ * @param capacity Its size in values.
+ */
+void cnp_ctx_use_buffer(cnp_ctx *ctx, int64_t *buffer, int64_t capacity);
+
+/**
+ * Returns the gap sequence the last call searched last, in the work buffer:
+ * the set gaps if the set period was computed, else the multiset (or, when
+ * ordered, the x-order) gaps. cnp_lambda() and cnp_search() leave the
+ * untrimmed sequence, cnp_residues() the cyclic one. Valid until the next
+ * call on the context.
+ *
+ * @param ctx The context.
+ * @param length Receives the number of gaps (0 if the last call failed before).
+ * @return The gaps, NULL if there are none.
+ */
+const int64_t *cnp_ctx_gaps(const cnp_ctx *ctx, int64_t *length);
+
+/**
+ * Computes the canonical signature of the gaps the last call left
+ * (cnp_ctx_gaps()) with a given period, as add_period_set --signatures
+ * stores it: the 128-bit hash of the least rotation of period consecutive
+ * gaps from the middle (signature.h). Rows whose blocks are rotations of
+ * each other get the same signature.
+ *
+ * @param ctx The context.
+ * @param period The period of those gaps, e.g. result.set.period.
+ * @param hex Receives 32 hex digits and a NUL.
+ * @return CNP_OK, or CNP_INVALID_ARGUMENT if period is not in [1, number of gaps].
+ */
+cnp_status_t cnp_ctx_signature(const cnp_ctx *ctx, int64_t period, char *hex);
+
+/**
+ * Returns a short name of a status, e.g. "no_period".
+ *
+ * @param status The status.
+ * @return The name.
+ */
+const char *cnp_status_string(cnp_status_t status);
+
+/**
+ * Returns the engines' negative code of a failure status (NO_PERIOD -1,
+ * ARRAY_SIZE_EXCEEDED -2, DX_LENGTH_TO_SMALL -3, timeout -4), e.g. to write
+ * the six-column CSV; 0 for CNP_OK and -5 for argument or memory errors
+ * and skipped periods.
+ *
+ * @param status The status.
+ * @return The code.
+ */
+int cnp_status_code(cnp_status_t status);
+
+#endif /* CUTPROJECT_H */
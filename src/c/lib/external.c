@@ -0,0 +1,504 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "external.h"
+#include "kernels.h"
+
+/* Largest single pread() / pwrite(), in bytes. */
+#define IO_CHUNK ((size_t)1 << 26)
+
+/* Rolling hash of the candidate search, modulo the Mersenne prime 2^61 - 1. */
+#define HASH_MOD ((UINT64_C(1) << 61) - 1)
+#define HASH_BASE UINT64_C(0x1D3C5B7A9E2F4861)
+
+/* Open scratch files tracked per thread for ext_close_thread_files(). */
+#define MAX_TRACKED 16
+
+static _Thread_local int tracked[MAX_TRACKED];
+static _Thread_local int tracked_count = 0;
+
+int ext_file_create(ext_file_t *file, const char *dir)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/cnp-scratch-XXXXXX", dir != NULL && dir[0] != '\0' ? dir : ".");
+    file->length = 0;
+    file->fd = mkstemp(path);
+    if (file->fd < 0)
+    {
+        fprintf(stderr, "Error: Cannot create a scratch file in '%s': %s\n",
+                dir != NULL && dir[0] != '\0' ? dir : ".", strerror(errno));
+        return -1;
+    }
+    // The name is not needed: the space is freed when the file is closed.
+    unlink(path);
+    if (tracked_count < MAX_TRACKED)
+        tracked[tracked_count++] = file->fd;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return 0;
+}
+
+int ext_file_append(ext_file_t *file, const int64_t *values, size_t count)
+{
+    const char *p = (const char *)values;
+    size_t bytes = count * sizeof(int64_t);
+    off_t offset = (off_t)(file->length * sizeof(int64_t));
+    while (bytes > 0)
+    {
+        const ssize_t n = pwrite(file->fd, p, bytes < IO_CHUNK ? bytes : IO_CHUNK, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "Error: Cannot write a scratch file: %s\n", n < 0 ? strerror(errno) : "no space");
+            return -1;
+        }
+        p += n;
+        bytes -= (size_t)n;
+        offset += n;
+    }
+    file->length += count;
+    return 0;
+}
+
+int ext_file_read(const ext_file_t *file, uint64_t index, int64_t *values, size_t count)
+{
+    if (index + count > file->length)
+        return -1;
+    char *p = (char *)values;
+    size_t bytes = count * sizeof(int64_t);
+    off_t offset = (off_t)(index * sizeof(int64_t));
+    while (bytes > 0)
+    {
+        const ssize_t n = pread(file->fd, p, bytes < IO_CHUNK ? bytes : IO_CHUNK, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "Error: Cannot read a scratch file: %s\n", n < 0 ? strerror(errno) : "truncated");
+            return -1;
+        }
+        p += n;
+        bytes -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+void ext_file_close(ext_file_t *file)
+{
+    if (file->fd >= 0)
+    {
+        for (int i = 0; i < tracked_count; i++)
+            if (tracked[i] == file->fd)
+            {
+                tracked[i] = tracked[--tracked_count];
+                break;
+            }
+        close(file->fd);
+    }
+    file->fd = -1;
+    file->length = 0;
+}
+
+void ext_close_thread_files(void)
+{
+    while (tracked_count > 0)
+        close(tracked[--tracked_count]);
+}
+
+int ext_runs_create(ext_runs_t *runs, const char *dir)
+{
+    runs->runs = 0;
+    runs->start[0] = 0;
+    return ext_file_create(&runs->file, dir);
+}
+
+int ext_runs_add(ext_runs_t *runs, const int64_t *values, size_t count)
+{
+    if (runs->runs == EXT_MAX_RUNS)
+    {
+        fprintf(stderr, "Error: More than %d sorted runs\n", EXT_MAX_RUNS);
+        return -1;
+    }
+    if (ext_file_append(&runs->file, values, count) != 0)
+        return -1;
+    runs->start[++runs->runs] = runs->file.length;
+    return 0;
+}
+
+void ext_runs_close(ext_runs_t *runs)
+{
+    ext_file_close(&runs->file);
+    runs->runs = 0;
+}
+
+/**
+ * The read position of one run during the merge.
+ */
+typedef struct
+{
+    int64_t *buffer;
+    size_t count;    // values in buffer
+    size_t pos;      // next value in buffer
+    uint64_t next;   // next value in the file
+    uint64_t end;    // end of the run in the file
+} cursor_t;
+
+_Static_assert(sizeof(cursor_t) + sizeof(int) <= EXT_MERGE_STATE_VALUES * sizeof(int64_t),
+               "EXT_MERGE_STATE_VALUES too small for a cursor and its heap slot");
+
+static int refill(const ext_file_t *file, cursor_t *c, size_t capacity)
+{
+    const uint64_t left = c->end - c->next;
+    c->count = left < capacity ? (size_t)left : capacity;
+    c->pos = 0;
+    if (c->count > 0 && ext_file_read(file, c->next, c->buffer, c->count) != 0)
+        return -1;
+    c->next += c->count;
+    return 0;
+}
+
+static inline int64_t head(const cursor_t *cursors, int run)
+{
+    return cursors[run].buffer[cursors[run].pos];
+}
+
+static void sift_down(int *heap, int size, const cursor_t *cursors, int i)
+{
+    while (true)
+    {
+        int least = i;
+        const int left = 2 * i + 1;
+        const int right = left + 1;
+        if (left < size && head(cursors, heap[left]) < head(cursors, heap[least]))
+            least = left;
+        if (right < size && head(cursors, heap[right]) < head(cursors, heap[least]))
+            least = right;
+        if (least == i)
+            return;
+        const int t = heap[i];
+        heap[i] = heap[least];
+        heap[least] = t;
+        i = least;
+    }
+}
+
+int ext_runs_merge(const ext_runs_t *runs, int64_t *buffer, size_t buffer_values,
+                   ext_emit_t emit, void *arg)
+{
+    const int k = runs->runs;
+    if (k == 0)
+        return 0;
+    // The cursors and the heap come first: a merge under a row timeout
+    // (siglongjmp()) must not allocate. Then the output block (after its
+    // one scratch slot) and one read buffer per run.
+    const size_t state = (size_t)k * EXT_MERGE_STATE_VALUES;
+    const size_t share = buffer_values > state ? (buffer_values - state) / (size_t)(k + 1) : 0;
+    if (share < EXT_MIN_SHARE)
+    {
+        fprintf(stderr, "Error: Too little memory to merge %d sorted runs\n", k);
+        return -1;
+    }
+    cursor_t *cursors = (cursor_t *)buffer;
+    int *heap = (int *)(cursors + k);
+    buffer += state;
+    int64_t *out = buffer + 1;
+    const size_t out_capacity = share - 1;
+    size_t out_count = 0;
+
+    int result = 0;
+    int size = 0;
+    for (int r = 0; r < k; r++)
+    {
+        cursors[r] = (cursor_t){buffer + share * (size_t)(r + 1), 0, 0, runs->start[r], runs->start[r + 1]};
+        if (refill(&runs->file, &cursors[r], share) != 0)
+        {
+            result = -1;
+            break;
+        }
+        if (cursors[r].count > 0)
+            heap[size++] = r;
+    }
+    for (int i = size / 2 - 1; result == 0 && i >= 0; i--)
+        sift_down(heap, size, cursors, i);
+
+    while (result == 0 && size > 0)
+    {
+        cursor_t *c = &cursors[heap[0]];
+        out[out_count++] = c->buffer[c->pos++];
+        if (out_count == out_capacity)
+        {
+            if (emit(arg, out, out_count) != 0)
+                result = -1;
+            out_count = 0;
+        }
+        if (c->pos == c->count)
+        {
+            if (refill(&runs->file, c, share) != 0)
+                result = -1;
+            else if (c->count == 0)
+                heap[0] = heap[--size];
+        }
+        sift_down(heap, size, cursors, 0);
+    }
+    if (result == 0 && out_count > 0 && emit(arg, out, out_count) != 0)
+        result = -1;
+    return result;
+}
+
+static int sort_unique(int64_t *values, int count)
+{
+    kernel_sort(values, (size_t)count);
+    int unique = 0;
+    for (int i = 0; i < count; i++)
+        if (unique == 0 || values[i] != values[unique - 1])
+            values[unique++] = values[i];
+    return unique;
+}
+
+static inline uint64_t mul_mod(uint64_t a, uint64_t b)
+{
+    __extension__ const unsigned __int128 product = (unsigned __int128)a * b;
+    const uint64_t r = ((uint64_t)product & HASH_MOD) + (uint64_t)(product >> 61);
+    return r >= HASH_MOD ? r - HASH_MOD : r;
+}
+
+static inline uint64_t hash_push(uint64_t hash, int64_t value)
+{
+    const uint64_t r = mul_mod(hash, HASH_BASE) + (uint64_t)value % HASH_MOD;
+    return r >= HASH_MOD ? r - HASH_MOD : r;
+}
+
+/**
+ * Finds the candidates: the distances from the b gaps at center to the
+ * nearest windows with the same hash on both sides (collisions are left
+ * to the verification). Reads the file up to the
+ * EXT_CANDIDATES_PER_SIDE-th match after the center.
+ *
+ * @return The number of candidates (sorted, unique), or -1 on an I/O error.
+ */
+static int find_candidates(const ext_file_t *gaps, uint64_t center, uint64_t b, int64_t *buffer,
+                           size_t buffer_values, int64_t *candidates)
+{
+    const uint64_t length = gaps->length;
+    const size_t half = buffer_values / 2;
+    int64_t *lead = buffer;
+    int64_t *lag = buffer + half;
+
+    uint64_t target = 0;
+    for (uint64_t index = center; index < center + b;)
+    {
+        const size_t n = center + b - index < half ? (size_t)(center + b - index) : half;
+        if (ext_file_read(gaps, index, lead, n) != 0)
+            return -1;
+        for (size_t i = 0; i < n; i++)
+            target = hash_push(target, lead[i]);
+        index += n;
+    }
+    // HASH_BASE^b removes the gap that leaves the window.
+    uint64_t power = 1;
+    for (uint64_t e = b, x = HASH_BASE; e > 0; e >>= 1, x = mul_mod(x, x))
+        if (e & 1)
+            power = mul_mod(power, x);
+
+    uint64_t before[EXT_CANDIDATES_PER_SIDE];   // the last matches before center (ring)
+    int before_count = 0;
+    int after_count = 0;
+    int count = 0;
+    uint64_t hash = 0;
+    for (uint64_t index = 0; index < length && after_count < EXT_CANDIDATES_PER_SIDE;)
+    {
+        const size_t n = length - index < half ? (size_t)(length - index) : half;
+        if (ext_file_read(gaps, index, lead, n) != 0)
+            return -1;
+        // lag[i] = g[index + i - b] where that exists.
+        const size_t skip = index < b ? (size_t)(b - index < n ? b - index : n) : 0;
+        if (skip < n && ext_file_read(gaps, index + skip - b, lag + skip, n - skip) != 0)
+            return -1;
+        for (size_t i = 0; i < n && after_count < EXT_CANDIDATES_PER_SIDE; i++)
+        {
+            hash = hash_push(hash, lead[i]);
+            if (i >= skip)
+            {
+                const uint64_t out = mul_mod((uint64_t)lag[i] % HASH_MOD, power);
+                hash = hash >= out ? hash - out : hash + HASH_MOD - out;
+            }
+            if (index + i + 1 < b || hash != target)
+                continue;
+            const uint64_t start = index + i + 1 - b;
+            if (start < center)
+                before[before_count++ % EXT_CANDIDATES_PER_SIDE] = start;
+            else if (start > center)
+            {
+                candidates[count++] = (int64_t)(start - center);
+                after_count++;
+            }
+        }
+        index += n;
+    }
+    const int kept = before_count < EXT_CANDIDATES_PER_SIDE ? before_count : EXT_CANDIDATES_PER_SIDE;
+    for (int i = 0; i < kept; i++)
+        candidates[count++] = (int64_t)(center - before[i]);
+    return sort_unique(candidates, count);
+}
+
+/**
+ * Returns the first index >= from where g[i] != g[i - q], or the length.
+ */
+static int64_t run_end(const ext_file_t *gaps, uint64_t from, uint64_t q, int64_t *buffer,
+                       size_t buffer_values)
+{
+    const uint64_t length = gaps->length;
+    const size_t half = buffer_values / 2;
+    for (uint64_t index = from; index < length;)
+    {
+        const size_t n = length - index < half ? (size_t)(length - index) : half;
+        if (ext_file_read(gaps, index, buffer, n) != 0 ||
+            ext_file_read(gaps, index - q, buffer + half, n) != 0)
+            return -1;
+        if (!kernel_equal(buffer, buffer + half, n))
+            for (size_t i = 0; i < n; i++)
+                if (buffer[i] != buffer[half + i])
+                    return (int64_t)(index + i);
+        index += n;
+    }
+    return (int64_t)length;
+}
+
+void ext_trim_steps(int64_t length, int64_t to_delete, double fraction,
+                    int64_t *k_fraction, int64_t *k_empty)
+{
+    const int64_t initial = length - 2 * to_delete + 1;
+    int64_t k = (int64_t)(initial * (1.0 - fraction) / 2.0) - 2;
+    if (k < 1)
+        k = 1;
+    while ((double)(initial - 2 * k) / (double)initial >= fraction)
+        k++;
+    while (k > 1 && (double)(initial - 2 * (k - 1)) / (double)initial < fraction)
+        k--;
+    *k_fraction = k;
+    *k_empty = initial / 2;   // first k with to_delete + k >= length - to_delete - k
+}
+
+int64_t ext_period(const ext_file_t *gaps, uint64_t to_delete, double fraction, int64_t hint,
+                   int64_t *buffer, size_t buffer_values)
+{
+    const int64_t length = (int64_t)gaps->length;
+    const int64_t t = (int64_t)to_delete;
+    if (length < EXT_MIN_GAPS || 2 * t + 2 >= length || buffer_values < 64 * 1024)
+        return EXT_WINDOW_TOO_SMALL;
+
+    // The window of step k is [t + k, length - t - k], of n_k = initial - 2k gaps.
+    const int64_t initial = length - 2 * t + 1;
+    int64_t k_fraction, k_empty;
+    ext_trim_steps(length, t, fraction, &k_fraction, &k_empty);
+    const int64_t k_end = k_fraction <= k_empty ? k_fraction : k_empty;
+
+    int64_t candidates[2 * EXT_CANDIDATES_PER_SIDE + 2];
+    const uint64_t b = (uint64_t)length / EXT_PATTERN_DIVISOR;
+    uint64_t start = ((uint64_t)length - b) / 2;
+    int count = find_candidates(gaps, start, b, buffer, buffer_values, candidates);
+    if (count > 0 && candidates[0] < (int64_t)b)
+    {
+        // The pattern lies in a run of period q (long runs of one gap with
+        // rare defects): it recurs at every multiple of q nearby. Keep q
+        // and search again with the pattern ending on the defect that ends
+        // the run.
+        const int64_t q = candidates[0];
+        const int64_t end = run_end(gaps, start + b, (uint64_t)q, buffer, buffer_values);
+        if (end < 0)
+            return EXT_IO_ERROR;
+        if (end < length)
+        {
+            start = (uint64_t)end + 1 - b;
+            count = find_candidates(gaps, start, b, buffer, buffer_values, candidates);
+            if (count >= 0)
+            {
+                candidates[count++] = q;
+                count = sort_unique(candidates, count);
+            }
+        }
+    }
+    if (count < 0)
+        return EXT_IO_ERROR;
+    if (hint > 0)
+    {
+        candidates[count++] = hint;
+        count = sort_unique(candidates, count);
+    }
+
+    // Per candidate: the last step where it is short enough (2p <= n_k) and
+    // the depth of its deepest mismatch; it holds from step depth + 1 on.
+    int64_t last_step[2 * EXT_CANDIDATES_PER_SIDE + 2];
+    int64_t depth[2 * EXT_CANDIDATES_PER_SIDE + 2];
+    int live = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const int64_t last = (initial - 2 * candidates[i]) / 2;
+        if (last < 1)
+            continue;
+        candidates[live] = candidates[i];
+        last_step[live] = last < k_end - 1 ? last : k_end - 1;
+        depth[live] = 0;
+        live++;
+    }
+
+    // One pass: g[m] against g[m + p] for all candidates, over the gaps
+    // that are inside the window of step 1.
+    const size_t share = buffer_values / (size_t)(live + 1);
+    int64_t *base = buffer;
+    for (int64_t m0 = t + 1; live > 0 && m0 < length - t - candidates[0]; m0 += (int64_t)share)
+    {
+        const int64_t rest = length - t - candidates[0] - m0;
+        const size_t n = rest < (int64_t)share ? (size_t)rest : share;
+        bool alive = false;
+        for (int c = 0; c < live; c++)
+            alive |= depth[c] + 1 <= last_step[c];
+        if (!alive)
+            break;
+        if (ext_file_read(gaps, (uint64_t)m0, base, n) != 0)
+            return EXT_IO_ERROR;
+        for (int c = 0; c < live; c++)
+        {
+            const int64_t p = candidates[c];
+            if (depth[c] + 1 > last_step[c])
+                continue;   // fails before it is short enough, or not before the search stops
+            const int64_t reach = length - t - p - m0;   // base gaps with a partner in the window
+            if (reach <= 0)
+                continue;
+            const size_t cn = reach < (int64_t)n ? (size_t)reach : n;
+            int64_t *shifted = buffer + share * (size_t)(c + 1);
+            if (ext_file_read(gaps, (uint64_t)(m0 + p), shifted, cn) != 0)
+                return EXT_IO_ERROR;
+            if (kernel_equal(base, shifted, cn))
+                continue;
+            for (size_t i = 0; i < cn; i++)
+                if (base[i] != shifted[i])
+                {
+                    const int64_t m = m0 + (int64_t)i;
+                    const int64_t left = m - t;
+                    const int64_t right = length - t - p - m;
+                    const int64_t d = left < right ? left : right;
+                    if (d > depth[c])
+                        depth[c] = d;
+                }
+        }
+    }
+
+    // The first step at which a candidate holds, then the smallest one there.
+    int64_t step = k_end;
+    for (int c = 0; c < live; c++)
+        if (depth[c] + 1 <= last_step[c] && depth[c] + 1 < step)
+            step = depth[c] + 1;
+    if (step < k_end)
+        for (int c = 0; c < live; c++)
+            if (depth[c] + 1 <= step && step <= last_step[c])
+                return candidates[c];
+    return k_fraction <= k_empty ? EXT_WINDOW_TOO_SMALL : EXT_NO_PERIOD;
+}
@@ -0,0 +1,185 @@
+#ifndef EXTERNAL_H
+#define EXTERNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Out-of-core building blocks for windows larger than the dx buffer: an
+ * external sort (sorted runs in a scratch file, merged k-way into a
+ * stream of sorted blocks) and the period search of lambda_trim() over a
+ * gap sequence on disk.
+ *
+ * Scratch files are created in a caller-chosen directory and unlinked at
+ * once, so they vanish with the process. All I/O is large sequential
+ * pread() / pwrite() with the kernel read-ahead hinted; the caller lends
+ * the memory (typically the dx buffer), so the resident size stays bounded
+ * however long the sequence is.
+ */
+
+/* ext_period() results besides a period (the engines' sentinel values). */
+#define EXT_NO_PERIOD (-1)
+#define EXT_WINDOW_TOO_SMALL (-3)
+#define EXT_IO_ERROR (-6)
+
+/* Maximum number of sorted runs one merge combines. */
+#define EXT_MAX_RUNS 4096
+
+/* Fewest buffer values per run (and for the output block) of a merge. */
+#define EXT_MIN_SHARE 1024
+
+/* Buffer values a merge takes per run for its cursor and heap slot. */
+#define EXT_MERGE_STATE_VALUES 6
+
+/* The central pattern whose occurrences yield the period candidates is
+ * 1 / EXT_PATTERN_DIVISOR of the gaps. */
+#define EXT_PATTERN_DIVISOR 16
+
+/* Fewest gaps ext_period() searches. */
+#define EXT_MIN_GAPS 1024
+
+/* Occurrences of the pattern kept on each side of it. */
+#define EXT_CANDIDATES_PER_SIDE 8
+
+/**
+ * An unlinked scratch file of int64_t values, appended sequentially.
+ */
+typedef struct
+{
+    int fd;
+    uint64_t length;   // values written
+} ext_file_t;
+
+/**
+ * Sorted runs appended to one scratch file.
+ */
+typedef struct
+{
+    ext_file_t file;
+    int runs;
+    uint64_t start[EXT_MAX_RUNS + 1];   // run i is [start[i], start[i + 1])
+} ext_runs_t;
+
+/**
+ * Receives the merged values in ascending blocks. block[-1] is writable
+ * scratch, so a block can be differenced in place together with the last
+ * value of the previous block.
+ *
+ * @return 0 to continue, -1 to abort the merge.
+ */
+typedef int (*ext_emit_t)(void *arg, int64_t *block, size_t count);
+
+/**
+ * Creates an empty scratch file in dir.
+ *
+ * @param file The file.
+ * @param dir The directory (NULL or "": the current directory).
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int ext_file_create(ext_file_t *file, const char *dir);
+
+/**
+ * Appends values to a scratch file.
+ *
+ * @return 0 on success, -1 on a write error (e.g. the disk is full).
+ */
+int ext_file_append(ext_file_t *file, const int64_t *values, size_t count);
+
+/**
+ * Reads values [index, index + count) of a scratch file.
+ *
+ * @return 0 on success, -1 on a read error or beyond the end.
+ */
+int ext_file_read(const ext_file_t *file, uint64_t index, int64_t *values, size_t count);
+
+/**
+ * Closes (and so deletes) a scratch file; a no-op on a closed file.
+ */
+void ext_file_close(ext_file_t *file);
+
+/**
+ * Closes the scratch files the calling thread still has open, after a
+ * siglongjmp() out of their owner (a row timeout) that skipped the
+ * ext_file_close() calls.
+ */
+void ext_close_thread_files(void);
+
+/**
+ * Creates an empty run set in dir.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int ext_runs_create(ext_runs_t *runs, const char *dir);
+
+/**
+ * Appends one sorted run.
+ *
+ * @param runs The run set.
+ * @param values The values, sorted ascending.
+ * @param count The number of values.
+ * @return 0 on success, -1 on a write error or after EXT_MAX_RUNS runs.
+ */
+int ext_runs_add(ext_runs_t *runs, const int64_t *values, size_t count);
+
+/**
+ * Merges all runs and hands the values to emit in ascending order.
+ *
+ * @param runs The run set.
+ * @param buffer Working memory: the merge state (EXT_MERGE_STATE_VALUES
+ *               per run), one read buffer per run and the output block;
+ *               the merge allocates nothing.
+ * @param buffer_values The size of buffer in values.
+ * @param emit The consumer.
+ * @param arg Passed to emit.
+ * @return 0 on success, -1 on an I/O error, too little memory for the
+ *         number of runs, or if emit aborted.
+ */
+int ext_runs_merge(const ext_runs_t *runs, int64_t *buffer, size_t buffer_values,
+                   ext_emit_t emit, void *arg);
+
+/**
+ * Closes (and deletes) a run set.
+ */
+void ext_runs_close(ext_runs_t *runs);
+
+/**
+ * The steps at which lambda_trim() stops without a period on length gaps:
+ * k_fraction, the first whose window is below fraction of the initial
+ * one (DX_LENGTH_TO_SMALL), and k_empty, the first whose window is empty
+ * (NO_PERIOD). The search ends at the smaller one.
+ */
+void ext_trim_steps(int64_t length, int64_t to_delete, double fraction,
+                    int64_t *k_fraction, int64_t *k_empty);
+
+/**
+ * lambda_trim() for sorted gaps stored in a scratch file. The window
+ * [to_delete + k, length - to_delete - k] shrinks by one gap per side and
+ * step k = 1, 2, ... until it has a period, and the smallest period of
+ * the first such window is returned.
+ *
+ * Instead of checking every period at every step, the candidates are the
+ * distances from the central length / EXT_PATTERN_DIVISOR gaps to their
+ * nearest occurrences (EXT_CANDIDATES_PER_SIDE on each side, found by a
+ * rolling hash): the period of every trimmed window repeats that central
+ * pattern, and a pattern this long rarely recurs at other distances, even
+ * in runs of equal gaps. One sequential pass then records, per candidate,
+ * the mismatch g[m] != g[m + p] deepest inside the window, which gives the
+ * first step where the candidate holds. A period within half the pattern
+ * of the half-window limit is not found. A caller that saw the gaps go by
+ * (period_stream.h) may add its own candidate; it is verified like the
+ * others, so a wrong hint costs one more comparison, never a wrong result.
+ *
+ * @param gaps The gaps, at least EXT_MIN_GAPS.
+ * @param to_delete The gaps cut from each end before the first step.
+ * @param fraction The fraction of the initial window below which the
+ *                 search stops (FRACTION_OF_REMAINING_ELEMENTS).
+ * @param hint One more period candidate (<= 0: none).
+ * @param buffer Working memory for the read buffers.
+ * @param buffer_values The size of buffer in values (>= 64 * 1024).
+ * @return The period, EXT_NO_PERIOD, EXT_WINDOW_TOO_SMALL or EXT_IO_ERROR.
+ */
+int64_t ext_period(const ext_file_t *gaps, uint64_t to_delete, double fraction, int64_t hint,
+                   int64_t *buffer, size_t buffer_values);
+
+#endif /* EXTERNAL_H */
@@ -0,0 +1,348 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "journal.h"
+#include "result_file.h"
+
+#define JOURNAL_MAGIC "CNPJRN01"
+#define SNAPSHOT_HEADER_BYTES 32
+#define RECORD_BYTES 32
+
+/* Rewrite the snapshot once this many records have been appended. */
+#define JOURNAL_SNAPSHOT_RECORDS 65536
+
+typedef struct
+{
+    uint64_t row;
+    uint64_t output_offset;
+    uint64_t output_rows;
+    uint64_t checksum;
+} journal_record_t;
+
+static int write_all(int fd, const void *buffer, size_t size)
+{
+    const char *p = buffer;
+    while (size > 0)
+    {
+        const ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Returns the index of the first interval whose hi is > row.
+ */
+static size_t lower_interval(const journal_t *journal, uint64_t row)
+{
+    size_t lo = 0, hi = journal->count;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (journal->intervals[mid].hi <= row)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Adds [lo, hi) to the interval list, merging with its neighbours.
+ */
+static int add_interval(journal_t *journal, uint64_t lo, uint64_t hi)
+{
+    if (lo >= hi)
+        return 0;
+
+    // In-order completion only ever extends the last interval.
+    if (journal->count > 0 && journal->intervals[journal->count - 1].hi == lo)
+    {
+        journal->intervals[journal->count - 1].hi = hi;
+        journal->done += hi - lo;
+        return 0;
+    }
+
+    size_t first = lower_interval(journal, lo);
+    if (first > 0 && journal->intervals[first - 1].hi == lo)
+        first--;
+    size_t last = first;
+    uint64_t new_lo = lo, new_hi = hi, covered = 0;
+    while (last < journal->count && journal->intervals[last].lo <= hi)
+    {
+        const journal_interval_t *in = &journal->intervals[last];
+        new_lo = in->lo < new_lo ? in->lo : new_lo;
+        new_hi = in->hi > new_hi ? in->hi : new_hi;
+        covered += in->hi - in->lo;
+        last++;
+    }
+
+    if (first == last)
+    {
+        if (journal->count == journal->capacity)
+        {
+            const size_t capacity = journal->capacity ? 2 * journal->capacity : 64;
+            journal_interval_t *grown = realloc(journal->intervals, capacity * sizeof(*grown));
+            if (grown == NULL)
+                return -1;
+            journal->intervals = grown;
+            journal->capacity = capacity;
+        }
+        memmove(&journal->intervals[first + 1], &journal->intervals[first],
+                (journal->count - first) * sizeof(journal_interval_t));
+        journal->count++;
+    }
+    else if (last - first > 1)
+    {
+        memmove(&journal->intervals[first + 1], &journal->intervals[last],
+                (journal->count - last) * sizeof(journal_interval_t));
+        journal->count -= last - first - 1;
+    }
+    journal->intervals[first].lo = new_lo;
+    journal->intervals[first].hi = new_hi;
+    journal->done += (new_hi - new_lo) - covered;
+    return 0;
+}
+
+/**
+ * Atomically replaces the journal file by a snapshot of the interval list
+ * and reopens it for appending records.
+ */
+static int write_snapshot(journal_t *journal)
+{
+    const size_t intervals_bytes = journal->count * sizeof(journal_interval_t);
+    const size_t size = SNAPSHOT_HEADER_BYTES + intervals_bytes + sizeof(uint64_t);
+    unsigned char *buffer = malloc(size);
+    if (buffer == NULL)
+        return -1;
+
+    const uint64_t fields[3] = {journal->count, journal->output_offset, journal->output_rows};
+    memcpy(buffer, JOURNAL_MAGIC, 8);
+    memcpy(buffer + 8, fields, sizeof(fields));
+    memcpy(buffer + SNAPSHOT_HEADER_BYTES, journal->intervals, intervals_bytes);
+    const uint64_t checksum = result_checksum(buffer + 8, size - 8 - sizeof(uint64_t));
+    memcpy(buffer + size - sizeof(uint64_t), &checksum, sizeof(checksum));
+
+    const size_t path_length = strlen(journal->path);
+    char *tmp = malloc(path_length + 5);
+    if (tmp == NULL)
+    {
+        free(buffer);
+        return -1;
+    }
+    memcpy(tmp, journal->path, path_length);
+    memcpy(tmp + path_length, ".tmp", 5);
+
+    int rc = -1;
+    const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        rc = (write_all(fd, buffer, size) == 0 && fdatasync(fd) == 0) ? 0 : -1;
+        if (close(fd) != 0)
+            rc = -1;
+        if (rc == 0)
+            rc = rename(tmp, journal->path);
+    }
+    free(tmp);
+    free(buffer);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Error: writing journal snapshot %s failed: %s\n", journal->path, strerror(errno));
+        return -1;
+    }
+
+    // The snapshot covers all buffered records as well.
+    if (journal->fd >= 0)
+        close(journal->fd);
+    journal->fd = open(journal->path, O_WRONLY | O_APPEND);
+    journal->records = 0;
+    journal->pending_bytes = 0;
+    return journal->fd >= 0 ? 0 : -1;
+}
+
+/**
+ * Loads snapshot and records; drops a torn tail. Returns -1 on corruption.
+ */
+static int load(journal_t *journal, const unsigned char *data, size_t size)
+{
+    uint64_t fields[3];
+    if (size < SNAPSHOT_HEADER_BYTES + sizeof(uint64_t) || memcmp(data, JOURNAL_MAGIC, 8) != 0)
+        return -1;
+    memcpy(fields, data + 8, sizeof(fields));
+    if (fields[0] > (size - SNAPSHOT_HEADER_BYTES - sizeof(uint64_t)) / sizeof(journal_interval_t))
+        return -1;
+
+    const size_t snapshot = SNAPSHOT_HEADER_BYTES + fields[0] * sizeof(journal_interval_t) + sizeof(uint64_t);
+    uint64_t checksum;
+    memcpy(&checksum, data + snapshot - sizeof(uint64_t), sizeof(checksum));
+    if (checksum != result_checksum(data + 8, snapshot - 8 - sizeof(uint64_t)))
+        return -1;
+
+    journal->output_offset = fields[1];
+    journal->output_rows = fields[2];
+    for (uint64_t i = 0; i < fields[0]; i++)
+    {
+        journal_interval_t in;
+        memcpy(&in, data + SNAPSHOT_HEADER_BYTES + i * sizeof(in), sizeof(in));
+        if (add_interval(journal, in.lo, in.hi) != 0)
+            return -1;
+    }
+
+    size_t end = snapshot;
+    while (end + RECORD_BYTES <= size)
+    {
+        journal_record_t record;
+        memcpy(&record, data + end, sizeof(record));
+        if (record.checksum != result_checksum(&record, offsetof(journal_record_t, checksum)))
+            break;
+        if (add_interval(journal, record.row, record.row + 1) != 0)
+            return -1;
+        journal->output_offset = record.output_offset;
+        journal->output_rows = record.output_rows;
+        journal->records++;
+        end += RECORD_BYTES;
+    }
+    return 0;
+}
+
+int journal_open(journal_t *journal, const char *output_path, bool *existed)
+{
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = -1;
+    const size_t length = strlen(output_path);
+    journal->path = malloc(length + sizeof(JOURNAL_SUFFIX));
+    if (journal->path == NULL)
+        return -1;
+    memcpy(journal->path, output_path, length);
+    memcpy(journal->path + length, JOURNAL_SUFFIX, sizeof(JOURNAL_SUFFIX));
+
+    csv_map_t map;
+    const bool found = csv_map(journal->path, &map) == 0;
+    if (existed != NULL)
+        *existed = found;
+    if (!found)
+        return write_snapshot(journal);
+
+    const int rc = load(journal, (const unsigned char *)map.data, map.size);
+    csv_unmap(&map);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Error: journal %s is corrupt\n", journal->path);
+        free(journal->intervals);
+        free(journal->path);
+        return -1;
+    }
+
+    // Rewriting the snapshot also drops a torn record at the end.
+    return write_snapshot(journal);
+}
+
+bool journal_is_done(const journal_t *journal, uint64_t row)
+{
+    const size_t i = lower_interval(journal, row);
+    return i < journal->count && journal->intervals[i].lo <= row;
+}
+
+uint64_t journal_next_pending(const journal_t *journal, uint64_t row)
+{
+    const size_t i = lower_interval(journal, row);
+    if (i < journal->count && journal->intervals[i].lo <= row)
+        return journal->intervals[i].hi;
+    return row;
+}
+
+int journal_mark(journal_t *journal, uint64_t row, uint64_t output_offset, uint64_t output_rows)
+{
+    if (journal->pending_bytes + RECORD_BYTES > journal->pending_capacity)
+    {
+        const size_t capacity = journal->pending_capacity ? 2 * journal->pending_capacity : 64 * RECORD_BYTES;
+        unsigned char *grown = realloc(journal->pending, capacity);
+        if (grown == NULL)
+            return -1;
+        journal->pending = grown;
+        journal->pending_capacity = capacity;
+    }
+
+    journal_record_t record = {row, output_offset, output_rows, 0};
+    record.checksum = result_checksum(&record, offsetof(journal_record_t, checksum));
+    memcpy(journal->pending + journal->pending_bytes, &record, sizeof(record));
+    journal->pending_bytes += RECORD_BYTES;
+
+    journal->output_offset = output_offset;
+    journal->output_rows = output_rows;
+    return add_interval(journal, row, row + 1);
+}
+
+int journal_mark_range(journal_t *journal, uint64_t lo, uint64_t hi,
+                       uint64_t output_offset, uint64_t output_rows)
+{
+    journal->output_offset = output_offset;
+    journal->output_rows = output_rows;
+    if (add_interval(journal, lo, hi) != 0)
+        return -1;
+    return write_snapshot(journal);
+}
+
+int journal_flush(journal_t *journal)
+{
+    if (journal->pending_bytes == 0)
+        return 0;
+    if (write_all(journal->fd, journal->pending, journal->pending_bytes) != 0)
+    {
+        fprintf(stderr, "Error: writing journal %s failed: %s\n", journal->path, strerror(errno));
+        return -1;
+    }
+    journal->records += journal->pending_bytes / RECORD_BYTES;
+    journal->pending_bytes = 0;
+
+    if (journal->records >= JOURNAL_SNAPSHOT_RECORDS)
+        return write_snapshot(journal);
+    return 0;
+}
+
+int journal_sync(journal_t *journal, int output_fd)
+{
+    if (output_fd >= 0 && fdatasync(output_fd) != 0)
+        return -1;
+    if (journal_flush(journal) != 0)
+        return -1;
+    return fdatasync(journal->fd);
+}
+
+/* Releases the journal without writing anything. */
+static void release(journal_t *journal)
+{
+    if (journal->fd >= 0)
+        close(journal->fd);
+    free(journal->intervals);
+    free(journal->pending);
+    free(journal->path);
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = -1;
+}
+
+int journal_close(journal_t *journal)
+{
+    int rc = journal_flush(journal);
+    if (rc == 0)
+        rc = write_snapshot(journal);
+    release(journal);
+    return rc;
+}
+
+void journal_abandon(journal_t *journal)
+{
+    release(journal);
+}
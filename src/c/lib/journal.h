@@ -0,0 +1,136 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Checkpoint journal of a sweep, kept next to its output as
+ * "<output>" JOURNAL_SUFFIX.
+ *
+ * The journal records which row IDs are complete (as a sorted list of
+ * half-open intervals, so rows may complete in any order) together with
+ * the durable end of the output (byte offset for CSV, row count for the
+ * binary format) and the number of rows in the output.
+ *
+ * On disk it is a checksummed snapshot of the interval list followed by
+ * fixed-size checksummed records, one per completed row. A torn record at
+ * the end (crash while writing) is dropped on load. The snapshot is
+ * rewritten atomically (temporary file and rename) when the journal is
+ * closed or the record tail grows long, so loading stays cheap.
+ */
+#define JOURNAL_SUFFIX ".journal"
+
+typedef struct
+{
+    uint64_t lo;
+    uint64_t hi;
+} journal_interval_t;
+
+typedef struct
+{
+    int fd;
+    char *path;
+    journal_interval_t *intervals;
+    size_t count;
+    size_t capacity;
+    uint64_t done;
+    uint64_t output_offset;
+    uint64_t output_rows;
+    unsigned char *pending;
+    size_t pending_bytes;
+    size_t pending_capacity;
+    uint64_t records;
+} journal_t;
+
+/**
+ * Opens (and loads, if present) the journal belonging to an output file.
+ *
+ * @param journal The journal to initialize.
+ * @param output_path The path of the output file.
+ * @param existed Receives whether a journal was found (may be NULL).
+ * @return 0 on success, -1 if the journal cannot be created or is corrupt.
+ */
+int journal_open(journal_t *journal, const char *output_path, bool *existed);
+
+/**
+ * Returns whether a row has been completed. O(log intervals).
+ *
+ * @param journal The journal.
+ * @param row The row ID.
+ * @return true if the row is recorded as complete.
+ */
+bool journal_is_done(const journal_t *journal, uint64_t row);
+
+/**
+ * Returns the smallest row ID >= row that is not complete. O(log intervals).
+ *
+ * @param journal The journal.
+ * @param row The row ID to start at.
+ * @return The next pending row ID.
+ */
+uint64_t journal_next_pending(const journal_t *journal, uint64_t row);
+
+/**
+ * Records a completed row and the output position behind its result.
+ * The record is buffered until journal_flush() or journal_sync().
+ *
+ * @param journal The journal.
+ * @param row The completed row ID.
+ * @param output_offset The end of the output after this row was written.
+ * @param output_rows The number of rows in the output after this row.
+ * @return 0 on success, -1 if out of memory.
+ */
+int journal_mark(journal_t *journal, uint64_t row, uint64_t output_offset, uint64_t output_rows);
+
+/**
+ * Marks all rows in [lo, hi) as complete without writing records; used to
+ * seed a journal from an output written before journals existed.
+ *
+ * @param journal The journal.
+ * @param lo The first row.
+ * @param hi One past the last row.
+ * @param output_offset The end of the output.
+ * @param output_rows The number of rows in the output.
+ * @return 0 on success, -1 on error.
+ */
+int journal_mark_range(journal_t *journal, uint64_t lo, uint64_t hi,
+                       uint64_t output_offset, uint64_t output_rows);
+
+/**
+ * Writes the buffered records to the journal file (no fsync).
+ *
+ * @param journal The journal.
+ * @return 0 on success, -1 on a write error.
+ */
+int journal_flush(journal_t *journal);
+
+/**
+ * Makes the output and the journal durable, in that order, so a journaled
+ * output position never points past data that could be lost.
+ *
+ * @param journal The journal.
+ * @param output_fd The file descriptor of the output (-1 to skip it).
+ * @return 0 on success, -1 on error.
+ */
+int journal_sync(journal_t *journal, int output_fd);
+
+/**
+ * Writes a compact snapshot and closes the journal.
+ *
+ * @param journal The journal.
+ * @return 0 on success, -1 on error.
+ */
+int journal_close(journal_t *journal);
+
+/**
+ * Closes the journal without recording the rows marked since the last
+ * journal_sync(), e.g. because the output they point into could not be
+ * written. A resume computes those rows again.
+ *
+ * @param journal The journal.
+ */
+void journal_abandon(journal_t *journal);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,531 @@
+#define _GNU_SOURCE
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+/* Progressions shorter than this are written by the scalar loop. */
+#define VECTOR_MIN_COUNT 8
+
+/* Ranges of kernel_sort() up to this length are insertion-sorted. */
+#define SORT_INSERTION_MAX 16
+
+/**
+ * One implementation of the kernels.
+ */
+typedef struct
+{
+    const char *name;
+    bool (*supported)(void);
+    void (*fill)(int64_t *dst, int64_t first, int64_t step, int64_t count, bool stream);
+    bool (*equal)(const int64_t *a, const int64_t *b, size_t count);
+} kernel_impl_t;
+
+size_t kernel_llc_bytes(void)
+{
+    static _Atomic size_t cached = 0;
+    size_t bytes = atomic_load_explicit(&cached, memory_order_relaxed);
+    if (bytes == 0)
+    {
+        long size = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (size <= 0)
+            size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        bytes = size > 0 ? (size_t)size : (size_t)32 << 20;
+        atomic_store_explicit(&cached, bytes, memory_order_relaxed);
+    }
+    return bytes;
+}
+
+/* ---------------------------------------------------------------------
+ * Sort: an introsort on int64_t (no comparator calls, in place, no
+ * allocation). It has no vector version: the partitions are bound by
+ * unpredictable branches, not by arithmetic, so every implementation
+ * runs this scalar one.
+ * --------------------------------------------------------------------- */
+
+static ALWAYS_INLINE void insertion_sort(int64_t *a, size_t n)
+{
+    for (size_t i = 1; i < n; i++)
+    {
+        const int64_t v = a[i];
+        size_t j = i;
+        for (; j > 0 && a[j - 1] > v; j--)
+            a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+static ALWAYS_INLINE void sift_down(int64_t *a, size_t root, size_t n)
+{
+    const int64_t v = a[root];
+    for (size_t child; (child = 2 * root + 1) < n; root = child)
+    {
+        if (child + 1 < n && a[child + 1] > a[child])
+            child++;
+        if (a[child] <= v)
+            break;
+        a[root] = a[child];
+    }
+    a[root] = v;
+}
+
+static ALWAYS_INLINE void heap_sort(int64_t *a, size_t n)
+{
+    for (size_t i = n / 2; i-- > 0;)
+        sift_down(a, i, n);
+    for (size_t end = n; end-- > 1;)
+    {
+        const int64_t top = a[0];
+        a[0] = a[end];
+        a[end] = top;
+        sift_down(a, 0, end);
+    }
+}
+
+static ALWAYS_INLINE void swap_if_greater(int64_t *a, size_t i, size_t j)
+{
+    if (a[i] > a[j])
+    {
+        const int64_t t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+}
+
+/**
+ * Hoare partition around the median of a[0], a[n / 2] and a[n - 1]
+ * (n > 2): afterwards a[0..j] <= pivot <= a[j + 1..n - 1] with
+ * 0 <= j < n - 1.
+ */
+static ALWAYS_INLINE size_t partition(int64_t *a, size_t n)
+{
+    const size_t mid = n / 2;
+    swap_if_greater(a, 0, mid);
+    swap_if_greater(a, mid, n - 1);
+    swap_if_greater(a, 0, mid);
+    const int64_t pivot = a[mid];
+
+    size_t i = 0, j = n - 1;
+    for (;;)
+    {
+        while (a[i] < pivot)
+            i++;
+        while (a[j] > pivot)
+            j--;
+        if (i >= j)
+            return j;
+        const int64_t t = a[i];
+        a[i++] = a[j];
+        a[j--] = t;
+    }
+}
+
+/**
+ * A range kernel_sort() still has to sort.
+ */
+typedef struct
+{
+    int64_t *a;
+    size_t n;
+    int depth;    // partitions left before falling back to heap_sort()
+} sort_range_t;
+
+static ALWAYS_INLINE void sort_body(int64_t *a, size_t n)
+{
+    // The smaller side is sorted first and the larger one pushed, so the
+    // stack never holds more than log2(n) ranges.
+    sort_range_t stack[64];
+    int top = 0;
+    int depth = 0;
+    for (size_t m = n; m > 1; m >>= 1)
+        depth += 2;
+
+    for (;;)
+    {
+        while (n > SORT_INSERTION_MAX)
+        {
+            if (depth == 0)
+            {
+                heap_sort(a, n);
+                n = 0;
+                break;
+            }
+            depth--;
+            const size_t left = partition(a, n) + 1;
+            const size_t right = n - left;
+            if (left < right)
+            {
+                stack[top++] = (sort_range_t){a + left, right, depth};
+                n = left;
+            }
+            else
+            {
+                stack[top++] = (sort_range_t){a, left, depth};
+                a += left;
+                n = right;
+            }
+        }
+        insertion_sort(a, n);
+        if (top == 0)
+            return;
+        top--;
+        a = stack[top].a;
+        n = stack[top].n;
+        depth = stack[top].depth;
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Scalar implementation (any CPU)
+ * --------------------------------------------------------------------- */
+
+static bool supported_scalar(void)
+{
+    return true;
+}
+
+static void fill_scalar(int64_t *dst, int64_t first, int64_t step, int64_t count, bool stream)
+{
+    (void)stream;
+    for (int64_t i = 0; i < count; i++)
+    {
+        dst[i] = first;
+        first += step;
+    }
+}
+
+static bool equal_scalar(const int64_t *a, const int64_t *b, size_t count)
+{
+    return memcmp(a, b, count * sizeof(*a)) == 0;
+}
+
+#ifdef KERNELS_X86
+
+/* ---------------------------------------------------------------------
+ * AVX2
+ * --------------------------------------------------------------------- */
+
+static bool supported_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+TARGET("avx2")
+static void fill_avx2(int64_t *dst, int64_t first, int64_t step, int64_t count, bool stream)
+{
+    int64_t i = 0;
+    // Non-temporal stores need 32-byte aligned addresses.
+    for (; stream && i < count && ((uintptr_t)(dst + i) & 31) != 0; i++)
+        dst[i] = first + i * step;
+
+    __m256i v = _mm256_add_epi64(_mm256_set1_epi64x(first + i * step),
+                                 _mm256_set_epi64x(3 * step, 2 * step, step, 0));
+    const __m256i step4 = _mm256_set1_epi64x(4 * step);
+    if (stream)
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm256_stream_si256((__m256i *)(dst + i), v);
+            v = _mm256_add_epi64(v, step4);
+        }
+    else
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm256_storeu_si256((__m256i *)(dst + i), v);
+            v = _mm256_add_epi64(v, step4);
+        }
+    for (; i < count; i++)
+        dst[i] = first + i * step;
+}
+
+TARGET("avx2")
+static bool equal_avx2(const int64_t *a, const int64_t *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                            _mm256_loadu_si256((const __m256i *)(b + i)));
+        const __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 4)),
+                                            _mm256_loadu_si256((const __m256i *)(b + i + 4)));
+        const __m256i x = _mm256_or_si256(x0, x1);
+        if (!_mm256_testz_si256(x, x))
+            return false;
+    }
+    for (; i < count; i++)
+        if (a[i] != b[i])
+            return false;
+    return true;
+}
+
+/* ---------------------------------------------------------------------
+ * AVX-512 (F)
+ * --------------------------------------------------------------------- */
+
+static bool supported_avx512(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+TARGET("avx512f")
+static void fill_avx512(int64_t *dst, int64_t first, int64_t step, int64_t count, bool stream)
+{
+    int64_t i = 0;
+    // Non-temporal stores need 64-byte aligned addresses.
+    for (; stream && i < count && ((uintptr_t)(dst + i) & 63) != 0; i++)
+        dst[i] = first + i * step;
+
+    __m512i v = _mm512_add_epi64(_mm512_set1_epi64(first + i * step),
+                                 _mm512_set_epi64(7 * step, 6 * step, 5 * step, 4 * step,
+                                                  3 * step, 2 * step, step, 0));
+    const __m512i step8 = _mm512_set1_epi64(8 * step);
+    if (stream)
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm512_stream_si512((void *)(dst + i), v);
+            v = _mm512_add_epi64(v, step8);
+        }
+    else
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm512_storeu_si512((void *)(dst + i), v);
+            v = _mm512_add_epi64(v, step8);
+        }
+    if (i < count)
+        _mm512_mask_storeu_epi64(dst + i, (__mmask8)((1u << (count - i)) - 1), v);
+}
+
+TARGET("avx512f")
+static bool equal_avx512(const int64_t *a, const int64_t *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512((const void *)(a + i)),
+                                     _mm512_loadu_si512((const void *)(b + i))) != 0)
+            return false;
+    if (i == count)
+        return true;
+    const __mmask8 tail = (__mmask8)((1u << (count - i)) - 1);
+    return _mm512_mask_cmpneq_epi64_mask(tail, _mm512_maskz_loadu_epi64(tail, a + i),
+                                         _mm512_maskz_loadu_epi64(tail, b + i)) == 0;
+}
+
+#endif /* KERNELS_X86 */
+
+/* Ordered from the most portable to the fastest. */
+static const kernel_impl_t IMPLEMENTATIONS[] = {
+    {"scalar", supported_scalar, fill_scalar, equal_scalar},
+#ifdef KERNELS_X86
+    {"avx2", supported_avx2, fill_avx2, equal_avx2},
+    {"avx512", supported_avx512, fill_avx512, equal_avx512},
+#endif
+};
+#define NUMBER_OF_IMPLEMENTATIONS (sizeof(IMPLEMENTATIONS) / sizeof(IMPLEMENTATIONS[0]))
+
+static _Atomic(const kernel_impl_t *) selected = NULL;
+// $CNP_KERNEL if current() rejected it; written before selected is published.
+static const char *rejected = NULL;
+
+static const kernel_impl_t *find(const char *name)
+{
+    for (size_t i = 0; i < NUMBER_OF_IMPLEMENTATIONS; i++)
+        if (strcmp(IMPLEMENTATIONS[i].name, name) == 0)
+            return &IMPLEMENTATIONS[i];
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------
+ * Self-test
+ * --------------------------------------------------------------------- */
+
+#define SELF_TEST_SIZE 320
+
+static int64_t self_test_random(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int64_t)(*state >> 33);
+}
+
+static bool self_test_fill(const kernel_impl_t *impl)
+{
+    // Every length up to 40 at every 8-byte offset of a cache line, with
+    // guard values around the progression.
+    _Alignas(64) int64_t buffer[64];
+    for (int stream = 0; stream <= 1; stream++)
+        for (int64_t offset = 0; offset < 8; offset++)
+            for (int64_t count = 0; count <= 40; count++)
+            {
+                for (int i = 0; i < 64; i++)
+                    buffer[i] = INT64_MIN;
+                impl->fill(buffer + offset, -7, 3, count, stream != 0);
+                for (int64_t i = 0; i < 64; i++)
+                {
+                    const bool inside = i >= offset && i < offset + count;
+                    if (buffer[i] != (inside ? -7 + (i - offset) * 3 : INT64_MIN))
+                        return false;
+                }
+            }
+    return true;
+}
+
+static bool self_test_sort(void)
+{
+    static const size_t sizes[] = {0, 1, 2, 3, 16, 17, 100, SELF_TEST_SIZE};
+    int64_t values[SELF_TEST_SIZE], expected[SELF_TEST_SIZE];
+    uint64_t state = 1;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        for (int pattern = 0; pattern < 4; pattern++)
+        {
+            // random, few distinct values, descending, ascending
+            const size_t n = sizes[s];
+            for (size_t i = 0; i < n; i++)
+            {
+                const int64_t r = self_test_random(&state);
+                values[i] = pattern == 0 ? r - (INT64_C(1) << 30)
+                          : pattern == 1 ? r % 3 - 1
+                          : pattern == 2 ? (int64_t)(n - i)
+                          : (int64_t)i;
+            }
+            memcpy(expected, values, n * sizeof(*values));
+            insertion_sort(expected, n);
+            kernel_sort(values, n);
+            if (memcmp(values, expected, n * sizeof(*values)) != 0)
+                return false;
+        }
+    return true;
+}
+
+static bool self_test_equal(const kernel_impl_t *impl)
+{
+    int64_t a[70], b[70];
+    uint64_t state = 2;
+    for (int i = 0; i < 70; i++)
+        a[i] = b[i] = self_test_random(&state);
+    for (size_t n = 0; n <= 70; n++)
+    {
+        if (!impl->equal(a, b, n))
+            return false;
+        for (size_t k = 0; k < n; k++)
+        {
+            b[k] ^= INT64_C(1) << (k % 63);
+            const bool equal = impl->equal(a, b, n);
+            b[k] = a[k];
+            if (equal)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool kernel_self_test(const char *name)
+{
+    const kernel_impl_t *impl = find(name);
+    return impl != NULL && impl->supported() &&
+           self_test_fill(impl) && self_test_sort() && self_test_equal(impl);
+}
+
+/* ---------------------------------------------------------------------
+ * Selection
+ * --------------------------------------------------------------------- */
+
+bool kernel_supported(const char *name)
+{
+    const kernel_impl_t *impl = find(name);
+    return impl != NULL && impl->supported();
+}
+
+int kernel_select(const char *name)
+{
+    const kernel_impl_t *impl = NULL;
+    if (name == NULL || *name == '\0' || strcmp(name, "auto") == 0)
+    {
+        for (size_t i = NUMBER_OF_IMPLEMENTATIONS; i-- > 0 && impl == NULL;)
+            if (kernel_self_test(IMPLEMENTATIONS[i].name))
+                impl = &IMPLEMENTATIONS[i];
+    }
+    else if (kernel_self_test(name))
+        impl = find(name);
+    if (impl == NULL)
+        return -1;
+    atomic_store_explicit(&selected, impl, memory_order_release);
+    return 0;
+}
+
+/**
+ * Returns the selected implementation; the first call selects the one
+ * named by $CNP_KERNEL or, without it or if it is rejected, the fastest
+ * that passes its self-test on this CPU.
+ */
+static const kernel_impl_t *current(void)
+{
+    const kernel_impl_t *impl = atomic_load_explicit(&selected, memory_order_acquire);
+    if (impl != NULL)
+        return impl;
+    const char *name = getenv("CNP_KERNEL");
+    if (kernel_select(name) != 0)
+    {
+        rejected = name;
+        kernel_select(NULL);
+    }
+    return atomic_load_explicit(&selected, memory_order_acquire);
+}
+
+const char *kernel_name(void)
+{
+    return current()->name;
+}
+
+const char *kernel_rejected(void)
+{
+    current();
+    return rejected;
+}
+
+/* ---------------------------------------------------------------------
+ * Kernels
+ * --------------------------------------------------------------------- */
+
+void kernel_fill(int64_t *dst, int64_t first, int64_t step, int64_t count, bool stream)
+{
+    if (count >= VECTOR_MIN_COUNT)
+        current()->fill(dst, first, step, count, stream);
+    else
+        fill_scalar(dst, first, step, count, false);
+}
+
+void kernel_sort(int64_t *values, size_t count)
+{
+    if (count > SORT_INSERTION_MAX)
+        sort_body(values, count);
+    else
+        insertion_sort(values, count);
+}
+
+bool kernel_equal(const int64_t *a, const int64_t *b, size_t count)
+{
+    return current()->equal(a, b, count);
+}
+
+void kernel_fence(void)
+{
+#ifdef KERNELS_X86
+    _mm_sfence();
+#endif
+}
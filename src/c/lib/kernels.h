@@ -0,0 +1,120 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hot kernels of lambda() and libcutproject, multi-versioned and selected
+ * at run time.
+ *
+ * Every kernel but the sort exists as a scalar, an AVX2 and an AVX-512
+ * implementation (the vector ones on x86 only), compiled with function
+ * target attributes, so a binary built for the baseline instruction set
+ * still uses the widest vectors of the CPU it runs on. The first call selects the
+ * implementation named by $CNP_KERNEL or, by default, the fastest one the
+ * CPU supports (cpuid) that passes its self-test; kernel_select() (the
+ * --kernel= option of the tools) overrides the choice.
+ *
+ * kernel_fill() writes the per-x progression of the enumeration. With
+ * stream set it uses non-temporal stores, which bypass the caches: worth
+ * it only when the whole buffer is larger than the last-level cache, and
+ * to be followed by kernel_fence() before the buffer is read.
+ */
+
+/**
+ * Returns the size of the last-level cache in bytes (32 MiB if unknown).
+ *
+ * @return The size.
+ */
+size_t kernel_llc_bytes(void);
+
+/**
+ * Writes dst[i] = first + i * step for 0 <= i < count; step 0 fills a
+ * constant.
+ *
+ * @param dst The destination (any 8-byte alignment).
+ * @param first The first value.
+ * @param step The difference between neighbours.
+ * @param count The number of values (<= 0: none).
+ * @param stream Whether to use non-temporal stores.
+ */
+void kernel_fill(int64_t *dst, int64_t first, int64_t step, int64_t count, bool stream);
+
+/**
+ * Sorts values ascending, in place and without allocating (introsort).
+ * Scalar whatever kernel_select() chose.
+ *
+ * @param values The values.
+ * @param count The number of values.
+ */
+void kernel_sort(int64_t *values, size_t count);
+
+/**
+ * Compares two arrays; the period checks call it with overlapping
+ * ranges of one array.
+ *
+ * @param a The first array.
+ * @param b The second array.
+ * @param count The number of elements to compare.
+ * @return true if a[i] == b[i] for all 0 <= i < count.
+ */
+bool kernel_equal(const int64_t *a, const int64_t *b, size_t count);
+
+/**
+ * Orders the non-temporal stores of kernel_fill() before later loads and
+ * stores; a no-op without vector stores.
+ */
+void kernel_fence(void);
+
+/**
+ * Selects the implementation of all kernels.
+ *
+ * @param name "scalar", "avx2", "avx512", or NULL / "" / "auto" for the
+ *             fastest one that the CPU supports and that passes its
+ *             self-test.
+ * @return 0 on success, -1 if the name is unknown, the CPU lacks the
+ *         instruction set or the self-test fails (the selection is then
+ *         unchanged).
+ */
+int kernel_select(const char *name);
+
+/**
+ * Returns whether the CPU supports an implementation.
+ *
+ * @param name The name of the implementation.
+ * @return true if it is known and its instruction set is available.
+ */
+bool kernel_supported(const char *name);
+
+/**
+ * Checks an implementation against reference results on fixed inputs:
+ * every fill length and alignment up to a few vectors, sorts of random,
+ * repetitive and monotone arrays, and comparisons with one differing
+ * element at every position.
+ *
+ * @param name The name of the implementation.
+ * @return true if it is supported and all checks pass.
+ */
+bool kernel_self_test(const char *name);
+
+/**
+ * Returns the name of the selected implementation: "scalar", "avx2" or
+ * "avx512".
+ *
+ * @return The name.
+ */
+const char *kernel_name(void);
+
+/**
+ * Returns the value of $CNP_KERNEL if the implicit selection rejected it
+ * (unknown, unsupported or failed self-test) and fell back to "auto". The
+ * library prints nothing; the tools report it.
+ *
+ * @return The rejected name, or NULL if $CNP_KERNEL was unset, accepted or
+ *         overridden by kernel_select() before the first kernel call.
+ */
+const char *kernel_rejected(void);
+
+#endif /* KERNELS_H */
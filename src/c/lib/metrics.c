@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "trace.h"
+
+static const char *FAILURE_REASONS[METRICS_SENTINELS] = {
+    "no_period", "array_size_exceeded", "dx_length_to_small", "timeout"};
+
+/**
+ * Appends a label value to dst with the escapes of the text format.
+ */
+static void append_label(char *dst, size_t size, const char *name, const char *value)
+{
+    size_t n = strlen(dst);
+    const int written = snprintf(dst + n, size - n, "%s%s=\"", n ? "," : "", name);
+    if (written < 0 || n + (size_t)written >= size)
+        return;
+    n += (size_t)written;
+    for (const char *c = value; *c && n + 3 < size; c++)
+    {
+        if (*c == '\\' || *c == '"')
+            dst[n++] = '\\';
+        if (*c == '\n')
+        {
+            dst[n++] = '\\';
+            dst[n++] = 'n';
+            continue;
+        }
+        dst[n++] = *c;
+    }
+    if (n + 2 <= size)
+    {
+        dst[n++] = '"';
+        dst[n] = '\0';
+    }
+}
+
+int metrics_open(metrics_t *m, const char *path, const char *engine, const char *job, double interval_sec)
+{
+    memset(m, 0, sizeof(*m));
+    if (path == NULL || path[0] == '\0')
+        return 0;
+
+    const size_t length = strlen(path);
+    m->path = malloc(length + 1);
+    m->tmp_path = malloc(length + 5);
+    if (!m->path || !m->tmp_path)
+    {
+        metrics_close(m);
+        return -1;
+    }
+    memcpy(m->path, path, length + 1);
+    snprintf(m->tmp_path, length + 5, "%s.tmp", path);
+
+    // Only the file name of the job; the directory adds nothing to a label.
+    const char *slash = strrchr(job, '/');
+    append_label(m->labels, sizeof(m->labels), "engine", engine);
+    append_label(m->labels, sizeof(m->labels), "job_file", slash ? slash + 1 : job);
+
+    m->start_ns = trace_now();
+    m->last_ns = m->start_ns;
+    m->interval_ns = interval_sec > 0 ? (uint64_t)(interval_sec * 1e9) : 0;
+    return 0;
+}
+
+void metrics_count_failure(metrics_sample_t *sample, long result)
+{
+    if (result < 0 && result >= -METRICS_SENTINELS)
+        sample->failures[-result - 1]++;
+}
+
+/**
+ * Returns the resident memory of the process in bytes, 0 if unknown.
+ */
+static uint64_t resident_bytes(void)
+{
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long long size, resident;
+    if (f == NULL)
+        return 0;
+    const int n = fscanf(f, "%llu %llu", &size, &resident);
+    fclose(f);
+    if (n == 2)
+        return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}
+
+static void metric(FILE *f, const char *name, const char *type, const char *help,
+                   const char *labels, double value)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n%s{%s} %.15g\n", name, help, name, type, name, labels, value);
+}
+
+/**
+ * Seconds to finish: the remaining cost at the average cost rate of the run
+ * so far. Returns a negative value while there is no estimate.
+ */
+static double eta_seconds(const metrics_sample_t *s, double elapsed)
+{
+    if (s->rows_total == 0 || s->rows_done == 0 || elapsed <= 0)
+        return -1.0;
+    if (s->rows_done >= s->rows_total)
+        return 0.0;
+    double done = (double)s->rows_done, total = (double)s->rows_total;
+    if (s->cost_total > 0 && s->cost_done > 0)
+    {
+        done = s->cost_done;
+        total = s->cost_total;
+    }
+    return done < total ? (total - done) * elapsed / done : 0.0;
+}
+
+int metrics_update(metrics_t *m, const metrics_sample_t *sample, bool force)
+{
+    if (m->path == NULL)
+        return 0;
+    const uint64_t now = trace_now();
+    if (!force && now - m->last_ns < m->interval_ns)
+        return 0;
+
+    FILE *f = fopen(m->tmp_path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error writing metrics '%s'\n", m->tmp_path);
+        return -1;
+    }
+
+    // Rates over the interval since the previous write.
+    const double interval = (double)(now - m->last_ns) * 1e-9;
+    const double elapsed = (double)(now - m->start_ns) * 1e-9;
+    const double rows_per_s = interval > 0 ? (double)(sample->rows_done - m->last.rows_done) / interval : 0.0;
+    const double points_per_s = interval > 0 ? (double)(sample->points - m->last.points) / interval : 0.0;
+    const char *l = m->labels;
+
+    metric(f, "cnp_rows_done_total", "counter", "Rows finished by this run, failures included.",
+           l, (double)sample->rows_done);
+    metric(f, "cnp_rows", "gauge", "Rows to process in this run (0 if unknown).", l, (double)sample->rows_total);
+    metric(f, "cnp_rows_skipped", "gauge", "Rows completed by an earlier run (resume).",
+           l, (double)sample->rows_skipped);
+    metric(f, "cnp_rows_per_second", "gauge", "Rows finished per second since the previous update.",
+           l, rows_per_s);
+    metric(f, "cnp_points_total", "counter", "Projected values enumerated by lambda().", l, (double)sample->points);
+    metric(f, "cnp_points_per_second", "gauge", "Projected values enumerated per second since the previous update.",
+           l, points_per_s);
+
+    fprintf(f, "# HELP cnp_failures_total Rows without a period, by sentinel result code.\n"
+               "# TYPE cnp_failures_total counter\n");
+    for (int k = 0; k < METRICS_SENTINELS; k++)
+        fprintf(f, "cnp_failures_total{%s,code=\"%d\",reason=\"%s\"} %llu\n",
+                l, -(k + 1), FAILURE_REASONS[k], (unsigned long long)sample->failures[k]);
+
+    const uint64_t rss = resident_bytes();
+    if (rss > 0)
+        metric(f, "cnp_resident_memory_bytes", "gauge", "Resident memory of the process.", l, (double)rss);
+    metric(f, "cnp_buffer_bytes", "gauge", "Work buffers (dx, trim candidates) allocated; reserved, not necessarily resident.",
+           l, (double)sample->buffer_bytes);
+
+    const double eta = eta_seconds(sample, elapsed);
+    if (eta >= 0)
+        metric(f, "cnp_eta_seconds", "gauge", "Estimated seconds to finish, from the cost model.", l, eta);
+    metric(f, "cnp_elapsed_seconds", "gauge", "Seconds since the run started.", l, elapsed);
+    metric(f, "cnp_last_update_timestamp_seconds", "gauge", "Unix time of this update.", l, (double)time(NULL));
+
+    const int rc = ferror(f) ? -1 : 0;
+    if (fclose(f) != 0 || rc != 0 || rename(m->tmp_path, m->path) != 0)
+    {
+        fprintf(stderr, "Error writing metrics '%s'\n", m->path);
+        return -1;
+    }
+    m->last_ns = now;
+    m->last = *sample;
+    return 0;
+}
+
+void metrics_close(metrics_t *m)
+{
+    free(m->path);
+    free(m->tmp_path);
+    m->path = NULL;
+    m->tmp_path = NULL;
+}
@@ -0,0 +1,88 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Progress metrics of a long run, written as a Prometheus text exposition
+ * file (e.g. for the node-exporter textfile collector).
+ *
+ * The driver fills a metrics_sample_t as rows finish and calls
+ * metrics_update() for every row; the file is rewritten at most once per
+ * interval, atomically (a temporary file renamed over the old one), so a
+ * scraper never reads a partial file. Nothing is written while no path is
+ * configured.
+ */
+
+/* Sentinel results counted per code: -1 (NO_PERIOD) to -4 (timeout). */
+#define METRICS_SENTINELS 4
+
+/**
+ * The state of a run. Counters cover this run only; rows_skipped are rows
+ * an earlier run completed (resume). The cost model weights rows by their
+ * expected work, so the ETA accounts for rows of very different size; with
+ * cost_total == 0 rows are weighted equally.
+ */
+typedef struct
+{
+    uint64_t rows_total;                   // rows of this run, 0 if unknown
+    uint64_t rows_done;                    // finished rows, failures included
+    uint64_t rows_skipped;
+    uint64_t points;                       // projected values enumerated
+    uint64_t failures[METRICS_SENTINELS];  // failures[k]: result -(k + 1)
+    uint64_t buffer_bytes;                 // work buffers (dx, trim) allocated
+    double cost_total;
+    double cost_done;
+} metrics_sample_t;
+
+typedef struct
+{
+    char *path;
+    char *tmp_path;
+    char labels[256];
+    uint64_t start_ns;
+    uint64_t interval_ns;
+    uint64_t last_ns;
+    metrics_sample_t last;  // sample of the previous write, for the rates
+} metrics_t;
+
+/**
+ * Prepares writing metrics to path. The file is created by the first
+ * metrics_update().
+ *
+ * @param m The metrics.
+ * @param path The output file, by convention ending in ".prom".
+ * @param engine The engine label, e.g. "set".
+ * @param job The job label, e.g. the output file of the run.
+ * @param interval_sec The minimal time between two rewrites.
+ * @return 0 on success, -1 if out of memory.
+ */
+int metrics_open(metrics_t *m, const char *path, const char *engine, const char *job, double interval_sec);
+
+/**
+ * Counts a sentinel result (-1 to -4) as a failure; other results are ignored.
+ *
+ * @param sample The sample.
+ * @param result The result of lambda() or lambda_search().
+ */
+void metrics_count_failure(metrics_sample_t *sample, long result);
+
+/**
+ * Rewrites the metrics file if the interval has passed (or force is set).
+ *
+ * @param m The metrics.
+ * @param sample The current state of the run.
+ * @param force Whether to write regardless of the interval, e.g. at the end.
+ * @return 0 if written or not due, -1 on a write error.
+ */
+int metrics_update(metrics_t *m, const metrics_sample_t *sample, bool force);
+
+/**
+ * Releases the metrics. The file is left in place with its last contents.
+ *
+ * @param m The metrics.
+ */
+void metrics_close(metrics_t *m);
+
+#endif /* METRICS_H */
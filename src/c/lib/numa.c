@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "numa.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define NODE_DIR "/sys/devices/system/node"
+
+/* Modes of mbind() (linux/mempolicy.h). */
+#define POLICY_PREFERRED 1
+#define POLICY_INTERLEAVE 3
+
+/**
+ * The nodes with CPUs the process may run on, and the nodes with memory.
+ */
+typedef struct
+{
+    int nodes;                              // >= 1
+    int node_id[NUMA_MAX_NODES];
+#ifdef __linux__
+    cpu_set_t cpus[NUMA_MAX_NODES];         // allowed CPUs of each node
+#endif
+    int memory_nodes;
+    uint64_t memory[NUMA_MAX_NODES / 64];   // bit per node ID
+} topology_t;
+
+static topology_t topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+int numa_parse_list(const char *list, uint64_t *mask, int max_bits)
+{
+    memset(mask, 0, (size_t)max_bits / 8);
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0' && *p != '\n')
+    {
+        if (!isdigit((unsigned char)*p))
+            return -1;
+        char *end;
+        const long first = strtol(p, &end, 10);
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            if (!isdigit((unsigned char)p[1]))
+                return -1;
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        if (last < first || last >= max_bits)
+            return -1;
+        for (long i = first; i <= last; i++)
+            mask[i / 64] |= UINT64_C(1) << (i % 64);
+        count += (int)(last - first + 1);
+        if (*p == ',')
+            p++;
+        else if (*p != '\0' && *p != '\n')
+            return -1;
+    }
+    return count;
+}
+
+#ifdef __linux__
+
+static int read_list(const char *path, uint64_t *mask, int max_bits)
+{
+    char line[8192];
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    const bool read = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    return read ? numa_parse_list(line, mask, max_bits) : -1;
+}
+
+static void load_topology(void)
+{
+    cpu_set_t allowed;
+    uint64_t online[NUMA_MAX_NODES / 64];
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+        read_list(NODE_DIR "/online", online, NUMA_MAX_NODES) <= 0)
+        return;
+
+    for (int node = 0; node < NUMA_MAX_NODES; node++)
+    {
+        if (!(online[node / 64] >> (node % 64) & 1))
+            continue;
+        char path[64];
+        uint64_t cpus[NUMA_MAX_CPUS / 64];
+        snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+        if (read_list(path, cpus, NUMA_MAX_CPUS) <= 0)
+            continue;
+        cpu_set_t *set = &topology.cpus[topology.nodes];
+        CPU_ZERO(set);
+        for (int cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+            if ((cpus[cpu / 64] >> (cpu % 64) & 1) && CPU_ISSET(cpu, &allowed))
+                CPU_SET(cpu, set);
+        if (CPU_COUNT(set) > 0)
+            topology.node_id[topology.nodes++] = node;
+    }
+
+    const int memory_nodes = read_list(NODE_DIR "/has_memory", topology.memory, NUMA_MAX_NODES);
+    topology.memory_nodes = memory_nodes > 0 ? memory_nodes : 0;
+}
+
+#endif /* __linux__ */
+
+static void init_topology(void)
+{
+#ifdef __linux__
+    load_topology();
+#endif
+    if (topology.nodes == 0)
+    {
+        topology.nodes = 1;
+        topology.node_id[0] = 0;
+    }
+}
+
+static const topology_t *get_topology(void)
+{
+    pthread_once(&topology_once, init_topology);
+    return &topology;
+}
+
+int numa_nodes(void)
+{
+    return get_topology()->nodes;
+}
+
+int numa_worker_node(int index)
+{
+    const topology_t *t = get_topology();
+    return t->node_id[index % t->nodes];
+}
+
+int numa_pin_thread(int index)
+{
+    const topology_t *t = get_topology();
+    if (t->nodes < 2)
+        return t->node_id[0];
+#ifdef __linux__
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &t->cpus[index % t->nodes]) == 0)
+        return t->node_id[index % t->nodes];
+#endif
+    return -1;
+}
+
+int numa_place(void *addr, size_t bytes, int node)
+{
+    const topology_t *t = get_topology();
+    if (node == NUMA_INTERLEAVE ? t->memory_nodes < 2 : t->nodes < 2)
+        return 0;
+#ifdef __linux__
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t start = ((uintptr_t)addr + page - 1) & ~(page - 1);
+    const uintptr_t end = ((uintptr_t)addr + bytes) & ~(page - 1);
+    if (end <= start)
+        return 0;
+
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    const int bits = 8 * (int)sizeof(unsigned long);
+    if (node == NUMA_INTERLEAVE)
+        for (int i = 0; i < NUMA_MAX_NODES; i++)
+        {
+            if (t->memory[i / 64] >> (i % 64) & 1)
+                mask[i / bits] |= 1UL << (i % bits);
+        }
+    else if (node >= 0 && node < NUMA_MAX_NODES)
+        mask[node / bits] |= 1UL << (node % bits);
+    else
+        return -1;
+    // maxnode counts one more than the bits the kernel reads.
+    if (syscall(SYS_mbind, (void *)start, (unsigned long)(end - start),
+                node == NUMA_INTERLEAVE ? POLICY_INTERLEAVE : POLICY_PREFERRED,
+                mask, (unsigned long)NUMA_MAX_NODES + 1, 0UL) == 0)
+        return 0;
+#endif
+    return -1;
+}
@@ -0,0 +1,75 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * NUMA placement of work buffers and worker threads, without libnuma.
+ *
+ * The topology is read once from /sys/devices/system/node (nodes with
+ * CPUs the process may run on); pages are placed with the mbind() system
+ * call. A dx buffer is never touched before lambda() writes it, so a
+ * policy set right after the allocation decides where all of its pages
+ * land. On a single-node machine, outside Linux, or where mbind() is not
+ * permitted, every function degrades to a no-op: one node, no pinning,
+ * default placement.
+ */
+
+/* Maximum node ID and CPU number considered. */
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+
+/* Node argument of numa_place(): spread the pages over all nodes. */
+#define NUMA_INTERLEAVE (-1)
+
+/**
+ * Returns the number of nodes with CPUs available to the process.
+ *
+ * @return The number of nodes, at least 1.
+ */
+int numa_nodes(void);
+
+/**
+ * Returns the node of the index-th worker: workers are spread round-robin
+ * over the nodes.
+ *
+ * @param index The index of the worker (>= 0).
+ * @return The node ID.
+ */
+int numa_worker_node(int index);
+
+/**
+ * Restricts the calling thread to the CPUs of the node of the index-th
+ * worker (numa_worker_node()), so its first touches allocate local pages.
+ * Nothing is done on a single-node machine.
+ *
+ * @param index The index of the worker.
+ * @return The node ID, or -1 if the affinity could not be set.
+ */
+int numa_pin_thread(int index);
+
+/**
+ * Sets the placement of the pages of [addr, addr + bytes) that are not
+ * yet touched; the partial pages at both ends keep the default policy.
+ *
+ * @param addr The start of the buffer.
+ * @param bytes The size of the buffer.
+ * @param node A node ID to prefer (falling back to other nodes when it
+ *             is full), or NUMA_INTERLEAVE.
+ * @return 0 on success or on a single-node machine, -1 if mbind() failed.
+ */
+int numa_place(void *addr, size_t bytes, int node);
+
+/**
+ * Parses a sysfs CPU or node list such as "0-3,8,10-11".
+ *
+ * @param list The list.
+ * @param mask Receives one bit per listed number (max_bits bits, cleared first).
+ * @param max_bits The number of bits of mask, a multiple of 64.
+ * @return The number of listed numbers, or -1 on a syntax error or a
+ *         number >= max_bits.
+ */
+int numa_parse_list(const char *list, uint64_t *mask, int max_bits);
+
+#endif /* NUMA_H */
@@ -0,0 +1,123 @@
+#include "period_stream.h"
+
+int period_stream_init(period_stream_t *s, int64_t *buffer, size_t buffer_values, uint64_t repeats)
+{
+    *s = (period_stream_t){0};
+    if (buffer == NULL || buffer_values < 2 + PERIOD_STREAM_VALUES_PER_PERIOD || repeats < 2)
+        return -1;
+    s->max_period = (buffer_values - 2) / PERIOD_STREAM_VALUES_PER_PERIOD;
+    s->repeats = repeats;
+    s->text = buffer;
+    s->pi = (uint64_t *)(buffer + 2 * s->max_period + 1);
+    return 0;
+}
+
+/* g[j] for j < fed: stored, or by the period. */
+static inline int64_t gap_at(const period_stream_t *s, uint64_t j)
+{
+    return j < s->stored ? s->text[j] : s->text[j % s->period];
+}
+
+/* pi(l) for 1 <= l <= fed. */
+static inline uint64_t pi_at(const period_stream_t *s, uint64_t l)
+{
+    return l <= s->stored ? s->pi[l] : l - s->period;
+}
+
+/* Keeps the current period as the result if it covers more periods. */
+static void remember(period_stream_t *s)
+{
+    if (s->period == 0)
+        return;
+    if (s->best_period == 0 ||
+        (double)s->fed / (double)s->period > (double)s->best_run / (double)s->best_period)
+    {
+        s->best_period = s->period;
+        s->best_run = s->fed;
+    }
+}
+
+static void restart(period_stream_t *s)
+{
+    remember(s);
+    s->stored = 0;
+    s->fed = 0;
+    s->period = 0;
+    s->restarts++;
+}
+
+void period_stream_feed(period_stream_t *s, int64_t gap)
+{
+    s->total++;
+    const uint64_t i = s->fed;
+    if (i == 0)
+    {
+        s->text[0] = gap;
+        s->pi[0] = 0;
+        s->pi[1] = 0;
+        s->stored = 1;
+        s->fed = 1;
+        s->period = 1;
+        return;
+    }
+
+    const uint64_t p = s->period;
+    if (gap == gap_at(s, i - p))
+    {
+        // The period continues; the first 2p gaps are kept.
+        if (s->stored == i && i < 2 * p)
+        {
+            s->text[i] = gap;
+            s->pi[i + 1] = i + 1 - p;
+            s->stored++;
+        }
+        s->fed++;
+        return;
+    }
+
+    // The longest border of g[0, i] through the failure links.
+    uint64_t k = pi_at(s, i);
+    while (k > 0 && gap_at(s, k) != gap)
+        k = pi_at(s, k);
+    if (gap_at(s, k) == gap)
+        k++;
+    const uint64_t period = i + 1 - k;
+    if (period > s->max_period)
+    {
+        restart(s);
+        return;
+    }
+
+    // i < 2 * period <= 2 * max_period: spell out g[0, i] and pi up to i.
+    remember(s);
+    for (uint64_t j = s->stored; j < i; j++)
+    {
+        s->text[j] = s->text[j % p];
+        s->pi[j + 1] = j + 1 - p;
+    }
+    s->text[i] = gap;
+    s->pi[i + 1] = k;
+    s->stored = i + 1;
+    s->fed = i + 1;
+    s->period = period;
+}
+
+uint64_t period_stream_current(const period_stream_t *s)
+{
+    return s->period;
+}
+
+uint64_t period_stream_result(const period_stream_t *s, bool *stable)
+{
+    uint64_t period = s->best_period;
+    uint64_t run = s->best_run;
+    if (s->period != 0 &&
+        (period == 0 || (double)s->fed / (double)s->period > (double)run / (double)period))
+    {
+        period = s->period;
+        run = s->fed;
+    }
+    if (stable != NULL)
+        *stable = period != 0 && run >= s->repeats * period;
+    return period;
+}
@@ -0,0 +1,87 @@
+#ifndef PERIOD_STREAM_H
+#define PERIOD_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Online period detector for a gap sequence pushed one gap at a time, for
+ * producers that emit the sorted gaps in order (the k-way merge of the
+ * out-of-core mode) without the array find_period_length() needs.
+ *
+ * The detector keeps the minimal period p of everything fed since its
+ * (re)start with an incremental prefix function (failure links). Only
+ * one period is needed to know the prefix: the text and the prefix
+ * function are stored for the first 2p gaps, beyond that g[i] = g[i mod p]
+ * and pi(l) = l - p. A gap that breaks the period follows the failure
+ * links through that reconstruction; the new period p' always satisfies
+ * i < 2p', so the stored part grows to at most 2 * max_period gaps:
+ * memory is bounded in the period, not in the length of the stream. The
+ * caller lends it (as for the out-of-core merge), so a row timeout that
+ * leaves with siglongjmp() leaks nothing.
+ *
+ * A period longer than max_period (noise at the start of the stream, a
+ * sequence without a short period) restarts the detector at the next gap.
+ * The answer is the period that covered the most repetitions before it
+ * broke (or until now); it is stable once that is at least `repeats`.
+ */
+
+/* period_stream_init() errors and period_stream_result() without a period. */
+#define PERIOD_STREAM_NONE 0
+
+typedef struct
+{
+    size_t max_period;   // longest period kept before a restart
+    uint64_t repeats;    // periods a result must hold to be stable
+
+    int64_t *text;       // g[0, stored) since the restart
+    uint64_t *pi;        // pi[l] for l in [1, stored]
+    size_t stored;
+    uint64_t fed;        // gaps since the restart
+    uint64_t period;     // minimal period of those gaps (0: none fed)
+
+    uint64_t best_period;   // the period that covered the most periods
+    uint64_t best_run;      // ... over that many gaps
+    uint64_t total;         // gaps fed over all restarts
+    uint64_t restarts;
+} period_stream_t;
+
+/* Values of the lent buffer per unit of max_period (text and pi, 2p each). */
+#define PERIOD_STREAM_VALUES_PER_PERIOD 4
+
+/**
+ * Initializes a detector on a lent buffer.
+ *
+ * @param s The detector.
+ * @param buffer Working memory, used until the detector is dropped.
+ * @param buffer_values The size of buffer in values; max_period is
+ *                      (buffer_values - 2) / PERIOD_STREAM_VALUES_PER_PERIOD.
+ * @param repeats The number of periods a result must hold to be stable (>= 2).
+ * @return 0 on success, -1 if the buffer holds no period or repeats is out of range.
+ */
+int period_stream_init(period_stream_t *s, int64_t *buffer, size_t buffer_values, uint64_t repeats);
+
+/**
+ * Pushes the next gap.
+ */
+void period_stream_feed(period_stream_t *s, int64_t gap);
+
+/**
+ * Returns the minimal period of the gaps fed since the last restart.
+ *
+ * @return The period, or PERIOD_STREAM_NONE right after a restart.
+ */
+uint64_t period_stream_current(const period_stream_t *s);
+
+/**
+ * Returns the period that covered the most repetitions so far, the
+ * current one included.
+ *
+ * @param s The detector.
+ * @param stable Receives whether it held for at least `repeats` periods (may be NULL).
+ * @return The period, or PERIOD_STREAM_NONE if no gap was fed.
+ */
+uint64_t period_stream_result(const period_stream_t *s, bool *stable);
+
+#endif /* PERIOD_STREAM_H */
@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* syscall() */
+#include <string.h>
+#include <unistd.h>
+#include "phase_stats.h"
+#include "trace.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {"enumerate", "sort", "diff", "compact", "trim"};
+
+static _Thread_local phase_stats_t thread_stats;
+
+/* Leader of the thread's counter group: -2 not yet opened, -1 unavailable. */
+static _Thread_local int counter_group = -2;
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * Opens cycles, instructions, LLC and dTLB read misses of the calling
+ * thread as one group, so they are read with a single read().
+ */
+static void open_counters(void)
+{
+    const uint64_t llc = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint64_t dtlb = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    int fds[COUNTER_COUNT];
+
+    counter_group = -1;
+    fds[COUNTER_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (fds[COUNTER_CYCLES] < 0)
+        return;
+    fds[COUNTER_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fds[0]);
+    fds[COUNTER_LLC_MISSES] = open_counter(PERF_TYPE_HW_CACHE, llc, fds[0]);
+    fds[COUNTER_DTLB_MISSES] = open_counter(PERF_TYPE_HW_CACHE, dtlb, fds[0]);
+    for (int c = 1; c < COUNTER_COUNT; c++)
+    {
+        if (fds[c] < 0)
+        {
+            for (int k = 0; k < COUNTER_COUNT; k++)
+                if (fds[k] >= 0)
+                    close(fds[k]);
+            return;
+        }
+    }
+
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    counter_group = fds[0];
+    thread_stats.counters_available = true;
+}
+
+static void read_counters(uint64_t counters[COUNTER_COUNT])
+{
+    uint64_t values[1 + COUNTER_COUNT];
+    if (read(counter_group, values, sizeof(values)) == (ssize_t)sizeof(values))
+        memcpy(counters, values + 1, sizeof(uint64_t) * COUNTER_COUNT);
+}
+#else
+static void open_counters(void)
+{
+    counter_group = -1;
+}
+
+static void read_counters(uint64_t counters[COUNTER_COUNT])
+{
+    (void)counters;
+}
+#endif
+
+void phase_begin(phase_mark_t *mark)
+{
+    if (counter_group == -2)
+        open_counters();
+    memset(mark->counters, 0, sizeof(mark->counters));
+    if (counter_group >= 0)
+        read_counters(mark->counters);
+    mark->ns = trace_now();
+}
+
+void phase_end(phase_t phase, const phase_mark_t *mark, uint64_t items)
+{
+    const uint64_t ns = trace_now();
+    phase_stats_t *stats = &thread_stats;
+    stats->calls[phase]++;
+    stats->items[phase] += items;
+    stats->ns[phase] += ns - mark->ns;
+    trace_span(PHASE_NAMES[phase], "phase", mark->ns, ns, (int64_t)items);
+    if (counter_group >= 0)
+    {
+        uint64_t counters[COUNTER_COUNT];
+        read_counters(counters);
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            stats->counters[phase][c] += counters[c] - mark->counters[c];
+    }
+}
+
+phase_stats_t *phase_stats_thread(void)
+{
+    return &thread_stats;
+}
+
+void phase_stats_reset(phase_stats_t *stats)
+{
+    const bool available = stats->counters_available;
+    memset(stats, 0, sizeof(*stats));
+    stats->counters_available = available;
+}
+
+void phase_stats_add(phase_stats_t *dst, const phase_stats_t *src)
+{
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        dst->calls[p] += src->calls[p];
+        dst->items[p] += src->items[p];
+        dst->ns[p] += src->ns[p];
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            dst->counters[p][c] += src->counters[p][c];
+    }
+    dst->counters_available |= src->counters_available;
+}
+
+void phase_stats_print(FILE *out, const phase_stats_t *stats, const char *label)
+{
+    uint64_t total = 0;
+    for (int p = 0; p < PHASE_COUNT; p++)
+        total += stats->ns[p];
+
+    fprintf(out, "\n%s\n%-10s %10s %12s %7s %14s", label, "phase", "calls", "seconds", "share%", "items/s");
+    if (stats->counters_available)
+        fprintf(out, " %7s %12s %12s", "IPC", "LLC miss/it", "dTLB miss/it");
+    fprintf(out, "\n");
+
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        if (stats->calls[p] == 0)
+            continue;
+        const double seconds = (double)stats->ns[p] * 1e-9;
+        fprintf(out, "%-10s %10llu %12.3f %7.2f %14.0f", PHASE_NAMES[p],
+                (unsigned long long)stats->calls[p], seconds,
+                total ? 100.0 * (double)stats->ns[p] / (double)total : 0.0,
+                seconds > 0 ? (double)stats->items[p] / seconds : 0.0);
+        if (stats->counters_available)
+        {
+            const uint64_t *c = stats->counters[p];
+            const double items = stats->items[p] ? (double)stats->items[p] : 1.0;
+            fprintf(out, " %7.2f %12.4f %12.4f",
+                    c[COUNTER_CYCLES] ? (double)c[COUNTER_INSTRUCTIONS] / (double)c[COUNTER_CYCLES] : 0.0,
+                    (double)c[COUNTER_LLC_MISSES] / items, (double)c[COUNTER_DTLB_MISSES] / items);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef PHASE_STATS_H
+#define PHASE_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Optional per-phase instrumentation of lambda().
+ *
+ * Built with -DCNP_PHASE_STATS (make STATS=1), every phase of lambda() adds
+ * its wall time and, where perf_event_open() is permitted, the hardware
+ * counters below to a statistics struct owned by the calling thread.
+ * Without the flag PHASE_BEGIN / PHASE_END expand to nothing, so the engine
+ * is compiled exactly as before.
+ */
+typedef enum
+{
+    PHASE_ENUMERATE = 0,
+    PHASE_SORT,
+    PHASE_DIFF,
+    PHASE_COMPACT,
+    PHASE_TRIM,
+    PHASE_COUNT
+} phase_t;
+
+typedef enum
+{
+    COUNTER_CYCLES = 0,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_LLC_MISSES,
+    COUNTER_DTLB_MISSES,
+    COUNTER_COUNT
+} phase_counter_t;
+
+/**
+ * Accumulated statistics of one thread (or of several, see phase_stats_add).
+ * items counts the values a phase processed; for PHASE_TRIM it counts the
+ * find_period_length() calls.
+ */
+typedef struct
+{
+    uint64_t calls[PHASE_COUNT];
+    uint64_t items[PHASE_COUNT];
+    uint64_t ns[PHASE_COUNT];
+    uint64_t counters[PHASE_COUNT][COUNTER_COUNT];
+    bool counters_available;
+} phase_stats_t;
+
+/**
+ * The start of a phase: a timestamp and the counter readings.
+ */
+typedef struct
+{
+    uint64_t ns;
+    uint64_t counters[COUNTER_COUNT];
+} phase_mark_t;
+
+#ifdef CNP_PHASE_STATS
+#define PHASE_STATS_ENABLED 1
+#define PHASE_BEGIN(phase) phase_mark_t phase_mark_##phase; phase_begin(&phase_mark_##phase)
+#define PHASE_END(phase, items) phase_end((phase), &phase_mark_##phase, (uint64_t)(items))
+#else
+#define PHASE_STATS_ENABLED 0
+#define PHASE_BEGIN(phase) ((void)0)
+#define PHASE_END(phase, items) ((void)0)
+#endif
+
+/**
+ * Starts a phase on the calling thread. The thread's counters are opened
+ * on first use.
+ *
+ * @param mark Receives the start readings.
+ */
+void phase_begin(phase_mark_t *mark);
+
+/**
+ * Ends a phase and adds its cost to the calling thread's statistics.
+ *
+ * @param phase The phase.
+ * @param mark The readings taken by phase_begin().
+ * @param items The number of items the phase processed.
+ */
+void phase_end(phase_t phase, const phase_mark_t *mark, uint64_t items);
+
+/**
+ * Returns the statistics of the calling thread.
+ *
+ * @return The thread's statistics.
+ */
+phase_stats_t *phase_stats_thread(void);
+
+/**
+ * Clears statistics.
+ *
+ * @param stats The statistics.
+ */
+void phase_stats_reset(phase_stats_t *stats);
+
+/**
+ * Adds the statistics of src to dst, e.g. to aggregate worker threads.
+ *
+ * @param dst The accumulated statistics.
+ * @param src The statistics to add.
+ */
+void phase_stats_add(phase_stats_t *dst, const phase_stats_t *src);
+
+/**
+ * Prints one line per phase that ran: calls, time, items/s and, if
+ * available, IPC and misses per item.
+ *
+ * @param out The output stream.
+ * @param stats The statistics.
+ * @param label A title for the table.
+ */
+void phase_stats_print(FILE *out, const phase_stats_t *stats, const char *label);
+
+#endif /* PHASE_STATS_H */
@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "queue.h"
+
+/* Busy retries before a waiting side starts to sleep. */
+#define QUEUE_SPINS 256
+#define QUEUE_SLEEP_NS 50000
+
+int queue_init(queue_t *queue, size_t capacity, size_t element_size)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    // Each cell is a sequence number followed by the element, padded to
+    // 16 bytes so elements stay aligned for int64 members.
+    queue->stride = (sizeof(atomic_size_t) + element_size + 15) & ~(size_t)15;
+    queue->cells = aligned_alloc(64, (size * queue->stride + 63) & ~(size_t)63);
+    if (queue->cells == NULL)
+        return -1;
+
+    queue->mask = size - 1;
+    queue->element_size = element_size;
+    for (size_t i = 0; i < size; i++)
+        atomic_init((atomic_size_t *)(queue->cells + i * queue->stride), i);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 0;
+}
+
+void queue_destroy(queue_t *queue)
+{
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+static inline atomic_size_t *cell_sequence(const queue_t *queue, size_t position)
+{
+    return (atomic_size_t *)(queue->cells + (position & queue->mask) * queue->stride);
+}
+
+static inline void *cell_data(const queue_t *queue, size_t position)
+{
+    return queue->cells + (position & queue->mask) * queue->stride + sizeof(atomic_size_t);
+}
+
+bool queue_try_push(queue_t *queue, const void *element)
+{
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;)
+    {
+        const size_t sequence = atomic_load_explicit(cell_sequence(queue, position), memory_order_acquire);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return false;
+        else
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    }
+
+    memcpy(cell_data(queue, position), element, queue->element_size);
+    atomic_store_explicit(cell_sequence(queue, position), position + 1, memory_order_release);
+    return true;
+}
+
+bool queue_try_pop(queue_t *queue, void *element)
+{
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    for (;;)
+    {
+        const size_t sequence = atomic_load_explicit(cell_sequence(queue, position), memory_order_acquire);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return false;
+        else
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+
+    memcpy(element, cell_data(queue, position), queue->element_size);
+    atomic_store_explicit(cell_sequence(queue, position), position + queue->mask + 1, memory_order_release);
+    return true;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Backs off a waiting side: yields first, then sleeps.
+ */
+static void back_off(unsigned attempt)
+{
+    if (attempt < QUEUE_SPINS)
+    {
+        sched_yield();
+        return;
+    }
+    const struct timespec pause = {0, QUEUE_SLEEP_NS};
+    nanosleep(&pause, NULL);
+}
+
+uint64_t queue_push(queue_t *queue, const void *element)
+{
+    if (queue_try_push(queue, element))
+        return 0;
+
+    const uint64_t start = now_ns();
+    for (unsigned attempt = 0; !queue_try_push(queue, element); attempt++)
+        back_off(attempt);
+    return now_ns() - start;
+}
+
+uint64_t queue_pop(queue_t *queue, void *element)
+{
+    if (queue_try_pop(queue, element))
+        return 0;
+
+    const uint64_t start = now_ns();
+    for (unsigned attempt = 0; !queue_try_pop(queue, element); attempt++)
+        back_off(attempt);
+    return now_ns() - start;
+}
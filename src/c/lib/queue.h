@@ -0,0 +1,78 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bounded lock-free multi-producer/multi-consumer queue of fixed-size
+ * elements (Vyukov's sequence-numbered ring buffer). Every cell carries a
+ * sequence number telling producers and consumers whether it is free or
+ * full, so neither side ever takes a lock.
+ */
+typedef struct
+{
+    unsigned char *cells;
+    size_t mask;
+    size_t element_size;
+    size_t stride;
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+} queue_t;
+
+/**
+ * Initializes a queue.
+ *
+ * @param queue The queue.
+ * @param capacity The capacity, rounded up to a power of two.
+ * @param element_size The size of one element in bytes.
+ * @return 0 on success, -1 if out of memory.
+ */
+int queue_init(queue_t *queue, size_t capacity, size_t element_size);
+
+/**
+ * Releases the memory of a queue.
+ *
+ * @param queue The queue.
+ */
+void queue_destroy(queue_t *queue);
+
+/**
+ * Enqueues a copy of element unless the queue is full.
+ *
+ * @param queue The queue.
+ * @param element The element to copy in.
+ * @return true if the element was enqueued.
+ */
+bool queue_try_push(queue_t *queue, const void *element);
+
+/**
+ * Dequeues an element unless the queue is empty.
+ *
+ * @param queue The queue.
+ * @param element Receives the element.
+ * @return true if an element was dequeued.
+ */
+bool queue_try_pop(queue_t *queue, void *element);
+
+/**
+ * Enqueues an element, spinning and then sleeping while the queue is full.
+ *
+ * @param queue The queue.
+ * @param element The element to copy in.
+ * @return The time spent waiting in nanoseconds.
+ */
+uint64_t queue_push(queue_t *queue, const void *element);
+
+/**
+ * Dequeues an element, spinning and then sleeping while the queue is empty.
+ *
+ * @param queue The queue.
+ * @param element Receives the element.
+ * @return The time spent waiting in nanoseconds.
+ */
+uint64_t queue_pop(queue_t *queue, void *element);
+
+#endif /* QUEUE_H */
@@ -0,0 +1,394 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "mathematics.h"
+#include "csv_loader.h"
+#include "phase_stats.h"
+#include "trace.h"
+
+/**
+ * Corpus replay profiler: runs lambda_search() of this engine over the rows
+ * of a corpus CSV (or a stratified sample of them) and reports where the
+ * time goes: the slowest rows and the cost per N/D bucket, where N / D are
+ * the numerator / denominator of omega (o_n / o_d) bucketed by decade.
+ * Per-row measurements can be written to a CSV for further analysis.
+ *
+ * One source for both engines: src/c/set and src/c/multiset build it
+ * against their own mathematics.h and constants.h (ENGINE_NAME).
+ */
+
+/* Decades of N and D that get their own bucket; larger values share the last. */
+#define DECADES 8
+#define NUMBER_OF_BUCKETS (DECADES * DECADES)
+
+typedef struct
+{
+    const char *corpus;
+    bool degenerate;
+    size_t sample;
+    uint64_t seed;
+    size_t top;
+    const char *rows;
+    const char *trace;
+} replay_options_t;
+
+/**
+ * Measurements of one replayed row.
+ */
+typedef struct
+{
+    size_t row;
+    int bucket;
+    long result;
+    long expected;
+    uint64_t wall_ns;
+    lambda_search_t stats;
+    long max_rss_kb;
+} replay_row_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Returns the peak resident set size of the process in KiB.
+ */
+static long max_rss_kb(void)
+{
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+static int decade(int64_t value)
+{
+    int d = 0;
+    for (value = value < 0 ? -value : value; value >= 10 && d < DECADES - 1; value /= 10)
+        d++;
+    return d;
+}
+
+static int bucket_of(const csv_table_t *table, size_t row)
+{
+    return decade(table->column[CSV_O_N][row]) * DECADES + decade(table->column[CSV_O_D][row]);
+}
+
+/**
+ * xorshift64* generator for a reproducible sample.
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Selects the rows to replay. Without a sample size all rows are taken;
+ * otherwise every bucket contributes in proportion to its size (at least
+ * one row), drawn uniformly with selection sampling so the corpus order
+ * is kept.
+ *
+ * @return The number of selected rows, stored in selected.
+ */
+static size_t select_rows(const csv_table_t *table, const replay_options_t *options, size_t *selected)
+{
+    if (options->sample == 0 || options->sample >= table->rows)
+    {
+        for (size_t i = 0; i < table->rows; i++)
+            selected[i] = i;
+        return table->rows;
+    }
+
+    size_t remaining[NUMBER_OF_BUCKETS] = {0}, needed[NUMBER_OF_BUCKETS];
+    for (size_t i = 0; i < table->rows; i++)
+        remaining[bucket_of(table, i)]++;
+    for (int b = 0; b < NUMBER_OF_BUCKETS; b++)
+    {
+        const double share = (double)options->sample * (double)remaining[b] / (double)table->rows;
+        needed[b] = remaining[b] == 0 ? 0 : MIN(remaining[b], MAX(1, (size_t)(share + 0.5)));
+    }
+
+    uint64_t state = options->seed ? options->seed : 1;
+    size_t count = 0;
+    for (size_t i = 0; i < table->rows; i++)
+    {
+        const int b = bucket_of(table, i);
+        if (next_random(&state) % remaining[b] < needed[b])
+        {
+            selected[count++] = i;
+            needed[b]--;
+        }
+        remaining[b]--;
+    }
+    return count;
+}
+
+static int cmp_wall_descending(const void *p, const void *q)
+{
+    const uint64_t x = ((const replay_row_t *)p)->wall_ns;
+    const uint64_t y = ((const replay_row_t *)q)->wall_ns;
+    return (x < y) - (x > y);
+}
+
+static int cmp_uint64(const void *p, const void *q)
+{
+    const uint64_t x = *(const uint64_t *)p;
+    const uint64_t y = *(const uint64_t *)q;
+    return (x > y) - (x < y);
+}
+
+static void print_decade(int d)
+{
+    if (d == DECADES - 1)
+        printf("  >=1e%d  ", d);
+    else
+        printf("1e%d..1e%d", d, d + 1);
+}
+
+/**
+ * Prints rows, time share and time quantiles per N/D bucket.
+ */
+static void report_buckets(const replay_row_t *rows, size_t count, uint64_t total_ns)
+{
+    uint64_t *times = malloc(count * sizeof(*times));
+    printf("\nCost by N/D bucket (N = o_n, D = o_d):\n");
+    printf("%-9s  %-9s %8s %8s %11s %11s %11s %11s %13s\n",
+           "N", "D", "rows", "share%", "mean ms", "p50 ms", "p90 ms", "max ms", "mean values");
+    for (int b = 0; b < NUMBER_OF_BUCKETS; b++)
+    {
+        size_t n = 0;
+        uint64_t sum = 0;
+        double values = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (rows[i].bucket != b)
+                continue;
+            times[n++] = rows[i].wall_ns;
+            sum += rows[i].wall_ns;
+            values += (double)rows[i].stats.values;
+        }
+        if (n == 0)
+            continue;
+        qsort(times, n, sizeof(*times), cmp_uint64);
+        print_decade(b / DECADES);
+        printf("  ");
+        print_decade(b % DECADES);
+        printf(" %8zu %8.2f %11.3f %11.3f %11.3f %11.3f %13.0f\n",
+               n, total_ns ? 100.0 * (double)sum / (double)total_ns : 0.0,
+               (double)sum / (double)n * 1e-6, (double)times[n / 2] * 1e-6,
+               (double)times[(n * 9) / 10] * 1e-6, (double)times[n - 1] * 1e-6, values / (double)n);
+    }
+    free(times);
+
+    // Wall time histogram over all rows, one bin per decade of microseconds.
+    size_t bins[10] = {0};
+    for (size_t i = 0; i < count; i++)
+        bins[MIN(9, decade((int64_t)(rows[i].wall_ns / 1000)))]++;
+    printf("\nWall time histogram:\n");
+    for (int d = 0; d < 10; d++)
+        if (bins[d] > 0)
+            printf("  %s1e%d us  %8zu\n", d == 9 ? ">=" : "< ", d == 9 ? 9 : d + 1, bins[d]);
+}
+
+/**
+ * Prints the k slowest rows; rows is sorted by descending wall time.
+ */
+static void report_slowest(const replay_row_t *rows, size_t count, const csv_table_t *table, size_t k)
+{
+    printf("\nSlowest %zu rows:\n", MIN(k, count));
+    printf("%8s %10s %10s %10s %10s %12s %12s %12s %8s %11s\n",
+           "row", "o_n", "o_d", "a_n", "a_d", "result", "ms", "values", "retries", "x_max");
+    for (size_t i = 0; i < MIN(k, count); i++)
+    {
+        const replay_row_t *r = &rows[i];
+        printf("%8zu %10lld %10lld %10lld %10lld %12ld %12.3f %12ld %8d %11lld\n",
+               r->row, (long long)table->column[CSV_O_N][r->row], (long long)table->column[CSV_O_D][r->row],
+               (long long)table->column[CSV_A_N][r->row], (long long)table->column[CSV_A_D][r->row],
+               r->result, (double)r->wall_ns * 1e-6, r->stats.values, r->stats.attempts - 1,
+               (long long)r->stats.x_max);
+    }
+}
+
+static int write_rows(const char *path, const replay_row_t *rows, size_t count, const csv_table_t *table)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    fprintf(f, "row,o_n,o_d,a_n,a_d,expected,result,wall_ns,values,max_values,x_max,retries,max_rss_kb\n");
+    for (size_t i = 0; i < count; i++)
+    {
+        const replay_row_t *r = &rows[i];
+        fprintf(f, "%zu,%lld,%lld,%lld,%lld,%ld,%ld,%llu,%ld,%ld,%lld,%d,%ld\n",
+                r->row, (long long)table->column[CSV_O_N][r->row], (long long)table->column[CSV_O_D][r->row],
+                (long long)table->column[CSV_A_N][r->row], (long long)table->column[CSV_A_D][r->row],
+                r->expected, r->result, (unsigned long long)r->wall_ns, r->stats.values,
+                r->stats.max_values, (long long)r->stats.x_max, r->stats.attempts - 1, r->max_rss_kb);
+    }
+    return fclose(f);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s <corpus.csv> [options]\n"
+        "  --mode=global|degenerate : x_max policy of add_period_set (default global)\n"
+        "  --sample=N               : replay about N rows, stratified by N/D bucket\n"
+        "  --seed=S                 : seed of the sample (default 1)\n"
+        "  --top=K                  : number of slowest rows to report (default 20)\n"
+        "  --rows=FILE              : write per-row measurements as CSV\n"
+        "  --trace=FILE             : write a Chrome trace of the rows (and of the\n"
+        "                             lambda() phases with make STATS=1)\n"
+        "  --kernel=NAME            : kernel implementation: scalar, avx2, avx512\n"
+        "                             or auto (default; also $CNP_KERNEL)\n"
+        "  --scratch=DIR            : out-of-core mode as in add_period_set, windows\n"
+        "                             up to 10 dx buffers\n",
+        program);
+}
+
+/**
+ * Parses the corpus path and "--name=value" options.
+ *
+ * @return 0 on success, -1 on a usage error.
+ */
+static int parse_options(int argc, const char *argv[], replay_options_t *options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--mode=global") == 0)
+            options->degenerate = false;
+        else if (strcmp(argv[i], "--mode=degenerate") == 0)
+            options->degenerate = true;
+        else if (strncmp(argv[i], "--sample=", 9) == 0)
+            options->sample = (size_t)atoll(argv[i] + 9);
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            options->seed = (uint64_t)atoll(argv[i] + 7);
+        else if (strncmp(argv[i], "--top=", 6) == 0)
+            options->top = (size_t)atoll(argv[i] + 6);
+        else if (strncmp(argv[i], "--rows=", 7) == 0)
+            options->rows = argv[i] + 7;
+        else if (strncmp(argv[i], "--trace=", 8) == 0)
+            options->trace = argv[i] + 8;
+        else if (strncmp(argv[i], "--kernel=", 9) == 0)
+        {
+            if (kernel_select(argv[i] + 9) != 0)
+            {
+                fprintf(stderr, "Kernel '%s' is unknown, not supported by this CPU or failed its self-test\n",
+                        argv[i] + 9);
+                return -1;
+            }
+        }
+        else if (strncmp(argv[i], "--scratch=", 10) == 0)
+        {
+            const lambda_scratch_t scratch = {argv[i] + 10, 10L * MAX_PERIOD_ARRAY_SIZE, MAX_PERIOD_ARRAY_SIZE};
+            lambda_set_scratch(&scratch);
+        }
+        else if (argv[i][0] != '-' && options->corpus == NULL)
+            options->corpus = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (options->corpus == NULL)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+    if (kernel_rejected() != NULL)
+        fprintf(stderr, "Warning: CNP_KERNEL=%s is unknown, unsupported or failed its self-test; "
+                        "selecting automatically\n", kernel_rejected());
+    return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    replay_options_t options = {NULL, false, 0, 1, 20, NULL, NULL};
+    if (parse_options(argc, argv, &options) != 0)
+        return 1;
+
+    csv_table_t table;
+    if (csv_table_load(options.corpus, 0, &table) != 0)
+        return 1;
+    csv_table_report_errors(&table, options.corpus, 20);
+
+    // The set engine is checked against period_set, the multiset engine
+    // against the (multiset) period column.
+    const bool is_set = strcmp(ENGINE_NAME, "set") == 0;
+    const int expected_column = is_set ? (table.columns > CSV_PERIOD_SET ? CSV_PERIOD_SET : -1) : CSV_PERIOD;
+
+    size_t *selected = malloc(table.rows * sizeof(*selected));
+    replay_row_t *rows = calloc(table.rows, sizeof(*rows));
+    if (!selected || !rows)
+    {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    const size_t count = select_rows(&table, &options, selected);
+    printf("Replaying %zu of %zu rows of '%s' with the %s engine (%s mode, %s kernels).\n",
+           count, table.rows, options.corpus, ENGINE_NAME, options.degenerate ? "degenerate" : "global",
+           kernel_name());
+
+    if (options.trace && trace_open(options.trace) != 0)
+        return 1;
+    trace_thread("replay");
+
+    number_t *dx = dx_alloc(MAX_PERIOD_ARRAY_SIZE);
+    uint64_t total_ns = 0;
+    size_t mismatches = 0, failures = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t row = selected[i];
+        replay_row_t *r = &rows[i];
+        r->row = row;
+        r->bucket = bucket_of(&table, row);
+        r->expected = expected_column >= 0 ? (long)table.column[expected_column][row] : 0;
+
+        const uint64_t start = now_ns();
+        r->result = lambda_search(table.column[CSV_A_N][row], table.column[CSV_A_D][row],
+                                  table.column[CSV_O_N][row], table.column[CSV_O_D][row],
+                                  table.column[CSV_PERIOD][row], options.degenerate, dx, &r->stats);
+        r->wall_ns = now_ns() - start;
+        trace_span("row", "row", start, start + r->wall_ns, (int64_t)row);
+        r->max_rss_kb = max_rss_kb();
+        total_ns += r->wall_ns;
+
+        if (!is_legal_period_length(r->result))
+            failures++;
+        else if (expected_column >= 0 && r->result != r->expected)
+            mismatches++;
+        if ((i + 1) % 100 == 0)
+        {
+            printf("\rRow %zu/%zu", i + 1, count);
+            fflush(stdout);
+        }
+    }
+    free(dx);
+    if (trace_close() != 0)
+        fprintf(stderr, "Error writing trace '%s'\n", options.trace);
+
+    printf("\rReplayed %zu rows in %.3f s: %zu failures, %zu mismatches%s, peak RSS %ld MiB.\n",
+           count, (double)total_ns * 1e-9, failures, mismatches,
+           expected_column >= 0 ? "" : " (no expected column)", max_rss_kb() / 1024);
+
+    if (options.rows && write_rows(options.rows, rows, count, &table) != 0)
+        fprintf(stderr, "Error writing '%s'\n", options.rows);
+
+    report_buckets(rows, count, total_ns);
+    if (PHASE_STATS_ENABLED)
+        phase_stats_print(stdout, phase_stats_thread(), "lambda() phases over all replayed rows:");
+    qsort(rows, count, sizeof(*rows), cmp_wall_descending);
+    report_slowest(rows, count, &table, options.top);
+
+    free(rows);
+    free(selected);
+    csv_table_free(&table);
+    return 0;
+}
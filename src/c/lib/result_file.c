@@ -0,0 +1,386 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "result_file.h"
+
+#define FILE_MAGIC "CNPRES01"
+#define FOOTER_MAGIC "CNPRFTR1"
+#define BLOCK_MAGIC 0x424e4e43u /* "CNNB" */
+#define FILE_HEADER_BYTES 24
+#define BLOCK_HEADER_BYTES 16
+#define FOOTER_BYTES 32
+
+#define PAD8(n) (((n) + 7) & ~(uint64_t)7)
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint32_t block_rows;
+    uint32_t header_length;
+} file_header_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t rows;
+    uint64_t checksum;
+} block_header_t;
+
+typedef struct
+{
+    char magic[8];
+    uint64_t rows;
+    uint64_t blocks;
+    uint64_t checksum;
+} footer_t;
+
+uint64_t result_checksum(const void *data, size_t size)
+{
+    // Word-wise multiply/rotate hash; fast enough to run on every block.
+    const uint64_t *words = data;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+    for (size_t i = 0; i < size / 8; i++)
+    {
+        h ^= words[i] * 0xff51afd7ed558ccdULL;
+        h = (h << 31) | (h >> 33);
+        h *= 0xc4ceb9fe1a85ec53ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+bool result_file_is_binary(const char *path)
+{
+    const size_t n = strlen(path);
+    const size_t e = strlen(RESULT_FILE_EXTENSION);
+    return n >= e && strcmp(path + n - e, RESULT_FILE_EXTENSION) == 0;
+}
+
+/**
+ * Writes the whole buffer at the given offset, retrying short writes.
+ */
+static int pwrite_all(int fd, const void *buffer, size_t size, uint64_t offset)
+{
+    const char *p = buffer;
+    while (size > 0)
+    {
+        const ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Writes the current (possibly partial) block into its slot.
+ */
+static int write_block(result_writer_t *writer)
+{
+    const uint64_t index = (writer->rows - writer->buffered) / writer->block_rows;
+    const size_t payload = writer->block_bytes - BLOCK_HEADER_BYTES;
+    block_header_t header = {BLOCK_MAGIC, writer->buffered, result_checksum(writer->block, payload)};
+
+    const uint64_t offset = writer->data_offset + index * writer->block_bytes;
+    if (pwrite_all(writer->fd, &header, sizeof(header), offset) != 0 ||
+        pwrite_all(writer->fd, writer->block, payload, offset + BLOCK_HEADER_BYTES) != 0)
+    {
+        fprintf(stderr, "Error: writing result block failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int result_writer_open(result_writer_t *writer, const char *path, int columns,
+                       const char *header, bool append)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    if (columns < 1 || columns > RESULT_FILE_MAX_COLUMNS)
+    {
+        fprintf(stderr, "Error: unsupported column count %d for %s\n", columns, path);
+        return -1;
+    }
+
+    writer->columns = columns;
+    writer->block_rows = RESULT_FILE_BLOCK_ROWS;
+    writer->block_bytes = BLOCK_HEADER_BYTES + (uint64_t)columns * writer->block_rows * sizeof(int64_t);
+    writer->block = calloc((size_t)columns * writer->block_rows, sizeof(int64_t));
+    if (writer->block == NULL)
+    {
+        fprintf(stderr, "Error: out of memory for result block\n");
+        return -1;
+    }
+
+    result_reader_t existing;
+    if (append && result_reader_open(&existing, path) == 0)
+    {
+        if (existing.columns != columns || existing.block_rows != writer->block_rows)
+        {
+            fprintf(stderr, "Error: %s has %d columns, expected %d\n", path, existing.columns, columns);
+            result_reader_close(&existing);
+            free(writer->block);
+            return -1;
+        }
+
+        // Reload a partial last block; it is rewritten in place.
+        writer->data_offset = existing.data_offset;
+        writer->rows = existing.rows;
+        writer->buffered = (uint32_t)(existing.rows % writer->block_rows);
+        for (uint32_t j = 0; j < writer->buffered; j++)
+        {
+            const uint64_t row = existing.rows - writer->buffered + j;
+            for (int c = 0; c < columns; c++)
+                writer->block[(size_t)c * writer->block_rows + j] = result_reader_get(&existing, row, c);
+        }
+        result_reader_close(&existing);
+
+        writer->fd = open(path, O_RDWR);
+        const uint64_t keep = writer->data_offset
+                              + (writer->rows - writer->buffered) / writer->block_rows * writer->block_bytes;
+        if (writer->fd < 0 || ftruncate(writer->fd, (off_t)keep) != 0)
+        {
+            fprintf(stderr, "Error: could not reopen %s: %s\n", path, strerror(errno));
+            if (writer->fd >= 0)
+                close(writer->fd);
+            free(writer->block);
+            return -1;
+        }
+        return 0;
+    }
+
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0)
+    {
+        fprintf(stderr, "Error: could not create %s: %s\n", path, strerror(errno));
+        free(writer->block);
+        return -1;
+    }
+
+    const size_t header_length = strlen(header);
+    file_header_t fh;
+    memcpy(fh.magic, FILE_MAGIC, 8);
+    fh.version = RESULT_FILE_VERSION;
+    fh.columns = (uint32_t)columns;
+    fh.block_rows = writer->block_rows;
+    fh.header_length = (uint32_t)header_length;
+    writer->data_offset = FILE_HEADER_BYTES + PAD8(header_length);
+
+    char *head = calloc(1, writer->data_offset);
+    if (head == NULL)
+    {
+        close(writer->fd);
+        free(writer->block);
+        return -1;
+    }
+    memcpy(head, &fh, sizeof(fh));
+    memcpy(head + FILE_HEADER_BYTES, header, header_length);
+    const int rc = pwrite_all(writer->fd, head, writer->data_offset, 0);
+    free(head);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Error: writing header of %s failed: %s\n", path, strerror(errno));
+        close(writer->fd);
+        free(writer->block);
+        return -1;
+    }
+    return 0;
+}
+
+int result_writer_append(result_writer_t *writer, const int64_t *row)
+{
+    for (int c = 0; c < writer->columns; c++)
+        writer->block[(size_t)c * writer->block_rows + writer->buffered] = row[c];
+    writer->buffered++;
+    writer->rows++;
+
+    if (writer->buffered == writer->block_rows)
+    {
+        if (write_block(writer) != 0)
+            return -1;
+        memset(writer->block, 0, (size_t)writer->columns * writer->block_rows * sizeof(int64_t));
+        writer->buffered = 0;
+    }
+    return 0;
+}
+
+int result_writer_truncate(result_writer_t *writer, uint64_t rows)
+{
+    if (rows >= writer->rows)
+        return 0;
+
+    const uint64_t block = rows / writer->block_rows;
+    const uint32_t keep = (uint32_t)(rows % writer->block_rows);
+    const uint64_t current = (writer->rows - writer->buffered) / writer->block_rows;
+    const size_t payload = writer->block_bytes - BLOCK_HEADER_BYTES;
+
+    // Reload the block that becomes the partial last block.
+    if (block != current && keep > 0)
+    {
+        const uint64_t offset = writer->data_offset + block * writer->block_bytes + BLOCK_HEADER_BYTES;
+        if (pread(writer->fd, writer->block, payload, (off_t)offset) != (ssize_t)payload)
+        {
+            fprintf(stderr, "Error: reading result block failed: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    for (int c = 0; c < writer->columns; c++)
+        memset(&writer->block[(size_t)c * writer->block_rows + keep], 0,
+               (writer->block_rows - keep) * sizeof(int64_t));
+
+    writer->rows = rows;
+    writer->buffered = keep;
+    if (ftruncate(writer->fd, (off_t)(writer->data_offset + block * writer->block_bytes)) != 0)
+        return -1;
+    return 0;
+}
+
+int result_writer_flush(result_writer_t *writer, bool durable)
+{
+    if (writer->buffered > 0 && write_block(writer) != 0)
+        return -1;
+    if (durable && fdatasync(writer->fd) != 0)
+        return -1;
+    return 0;
+}
+
+int result_writer_close(result_writer_t *writer)
+{
+    int rc = result_writer_flush(writer, false);
+
+    footer_t footer;
+    memcpy(footer.magic, FOOTER_MAGIC, 8);
+    footer.rows = writer->rows;
+    footer.blocks = (writer->rows + writer->block_rows - 1) / writer->block_rows;
+    footer.checksum = result_checksum(&footer, offsetof(footer_t, checksum));
+
+    const uint64_t offset = writer->data_offset + footer.blocks * writer->block_bytes;
+    if (rc == 0 && (pwrite_all(writer->fd, &footer, sizeof(footer), offset) != 0 ||
+                    ftruncate(writer->fd, (off_t)(offset + sizeof(footer))) != 0))
+    {
+        fprintf(stderr, "Error: writing result footer failed: %s\n", strerror(errno));
+        rc = -1;
+    }
+
+    if (close(writer->fd) != 0)
+        rc = -1;
+    free(writer->block);
+    writer->block = NULL;
+    writer->fd = -1;
+    return rc;
+}
+
+int result_reader_open(result_reader_t *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    if (csv_map(path, &reader->map) != 0)
+        return -1;
+
+    const char *data = reader->map.data;
+    const size_t size = reader->map.size;
+    file_header_t fh;
+    if (size < FILE_HEADER_BYTES || memcmp(data, FILE_MAGIC, 8) != 0)
+    {
+        csv_unmap(&reader->map);
+        return -1;
+    }
+    memcpy(&fh, data, sizeof(fh));
+    if (fh.version != RESULT_FILE_VERSION || fh.columns < 1 || fh.columns > RESULT_FILE_MAX_COLUMNS ||
+        fh.block_rows == 0 || FILE_HEADER_BYTES + PAD8(fh.header_length) > size)
+    {
+        csv_unmap(&reader->map);
+        return -1;
+    }
+
+    reader->columns = (int)fh.columns;
+    reader->block_rows = fh.block_rows;
+    reader->header = data + FILE_HEADER_BYTES;
+    reader->header_length = fh.header_length;
+    reader->data_offset = FILE_HEADER_BYTES + PAD8(fh.header_length);
+    reader->block_bytes = BLOCK_HEADER_BYTES + (uint64_t)fh.columns * fh.block_rows * sizeof(int64_t);
+
+    // Trust a consistent footer; otherwise recover the rows from the blocks.
+    if (size >= reader->data_offset + FOOTER_BYTES)
+    {
+        footer_t footer;
+        memcpy(&footer, data + size - FOOTER_BYTES, sizeof(footer));
+        if (memcmp(footer.magic, FOOTER_MAGIC, 8) == 0 &&
+            footer.checksum == result_checksum(&footer, offsetof(footer_t, checksum)) &&
+            reader->data_offset + footer.blocks * reader->block_bytes + FOOTER_BYTES == size &&
+            footer.rows <= footer.blocks * reader->block_rows)
+        {
+            reader->rows = footer.rows;
+            reader->blocks = footer.blocks;
+            return 0;
+        }
+    }
+
+    reader->recovered = true;
+    const uint64_t slots = (size - reader->data_offset) / reader->block_bytes;
+    for (uint64_t b = 0; b < slots; b++)
+    {
+        block_header_t bh;
+        const char *block = data + reader->data_offset + b * reader->block_bytes;
+        memcpy(&bh, block, sizeof(bh));
+        if (bh.magic != BLOCK_MAGIC || bh.rows == 0 || bh.rows > reader->block_rows ||
+            bh.checksum != result_checksum(block + BLOCK_HEADER_BYTES, reader->block_bytes - BLOCK_HEADER_BYTES))
+            break;
+        reader->rows += bh.rows;
+        reader->blocks++;
+        if (bh.rows < reader->block_rows)
+            break;
+    }
+    return 0;
+}
+
+bool result_reader_verify(const result_reader_t *reader, uint64_t *bad_block)
+{
+    for (uint64_t b = 0; b < reader->blocks; b++)
+    {
+        block_header_t bh;
+        const char *block = reader->map.data + reader->data_offset + b * reader->block_bytes;
+        memcpy(&bh, block, sizeof(bh));
+        const uint64_t expected_rows = (b + 1 < reader->blocks)
+                                           ? reader->block_rows
+                                           : reader->rows - b * reader->block_rows;
+        if (bh.magic != BLOCK_MAGIC || bh.rows != expected_rows ||
+            bh.checksum != result_checksum(block + BLOCK_HEADER_BYTES, reader->block_bytes - BLOCK_HEADER_BYTES))
+        {
+            if (bad_block != NULL)
+                *bad_block = b;
+            return false;
+        }
+    }
+    return true;
+}
+
+void result_reader_close(result_reader_t *reader)
+{
+    csv_unmap(&reader->map);
+    memset(reader, 0, sizeof(*reader));
+}
+
+size_t result_file_count_rows(const char *path)
+{
+    if (!result_file_is_binary(path))
+        return csv_count_rows(path);
+
+    result_reader_t reader;
+    if (result_reader_open(&reader, path) != 0)
+        return 0;
+    const size_t rows = (size_t)reader.rows;
+    result_reader_close(&reader);
+    return rows;
+}
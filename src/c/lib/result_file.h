@@ -0,0 +1,177 @@
+#ifndef RESULT_FILE_H
+#define RESULT_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "csv_loader.h"
+
+/**
+ * Binary columnar result format (".cnpr").
+ *
+ * Layout (all integers little-endian):
+ *   header  magic "CNPRES01", version, columns, block_rows, header text
+ *           length, then the CSV header text padded to 8 bytes
+ *   blocks  each block holds block_rows rows: a block header (magic, row
+ *           count, checksum of the payload) followed by one int64 array
+ *           of block_rows entries per column. Every block has the same
+ *           size, so row i lives in block i / block_rows and can be read
+ *           in O(1); only the last block may be partially filled.
+ *   footer  magic "CNPRFTR1", row count, block count, checksum
+ *
+ * A file without a valid footer (e.g. after a crash) is recovered from its
+ * blocks: the row count is taken from the last block whose checksum holds.
+ */
+#define RESULT_FILE_EXTENSION ".cnpr"
+#define RESULT_FILE_VERSION 1
+#define RESULT_FILE_BLOCK_ROWS 4096
+#define RESULT_FILE_MAX_COLUMNS 16
+
+typedef struct
+{
+    int fd;
+    int columns;
+    uint32_t block_rows;
+    uint64_t data_offset;
+    uint64_t block_bytes;
+    uint64_t rows;
+    uint32_t buffered;
+    int64_t *block;
+} result_writer_t;
+
+typedef struct
+{
+    csv_map_t map;
+    int columns;
+    uint32_t block_rows;
+    uint64_t data_offset;
+    uint64_t block_bytes;
+    uint64_t rows;
+    uint64_t blocks;
+    const char *header;
+    size_t header_length;
+    bool recovered;
+} result_reader_t;
+
+/**
+ * Returns true if path ends in RESULT_FILE_EXTENSION.
+ *
+ * @param path The file path.
+ * @return Whether the path names a binary result file.
+ */
+bool result_file_is_binary(const char *path);
+
+/**
+ * Opens a binary result file for writing.
+ * With append set and an existing file, the rows already present are kept
+ * (a partial last block is reloaded) and new rows are appended behind them;
+ * the header of the existing file must have the same number of columns.
+ *
+ * @param writer The writer to initialize.
+ * @param path The file path.
+ * @param columns The number of int64 columns per row.
+ * @param header The CSV header line (without newline) stored in the file.
+ * @param append Whether to continue an existing file.
+ * @return 0 on success, -1 on error.
+ */
+int result_writer_open(result_writer_t *writer, const char *path, int columns,
+                       const char *header, bool append);
+
+/**
+ * Appends one row of writer->columns values. Full blocks are written out.
+ *
+ * @param writer The writer.
+ * @param row The values of the row.
+ * @return 0 on success, -1 on a write error.
+ */
+int result_writer_append(result_writer_t *writer, const int64_t *row);
+
+/**
+ * Drops all rows from index rows on, e.g. rows written after the last
+ * checkpoint of a crashed run. Does nothing if rows >= writer->rows.
+ *
+ * @param writer The writer.
+ * @param rows The number of rows to keep.
+ * @return 0 on success, -1 on an I/O error.
+ */
+int result_writer_truncate(result_writer_t *writer, uint64_t rows);
+
+/**
+ * Writes the partially filled current block so all appended rows are on
+ * disk (they are rewritten in place once the block fills up).
+ *
+ * @param writer The writer.
+ * @param durable Whether to fdatasync() the file as well.
+ * @return 0 on success, -1 on a write error.
+ */
+int result_writer_flush(result_writer_t *writer, bool durable);
+
+/**
+ * Flushes the last block, writes the footer and closes the file.
+ *
+ * @param writer The writer.
+ * @return 0 on success, -1 on a write error.
+ */
+int result_writer_close(result_writer_t *writer);
+
+/**
+ * Maps a binary result file for reading.
+ *
+ * @param reader The reader to initialize.
+ * @param path The file path.
+ * @return 0 on success, -1 if the file is missing or not a result file.
+ */
+int result_reader_open(result_reader_t *reader, const char *path);
+
+/**
+ * Returns the value of a column in a row; row < reader->rows.
+ *
+ * @param reader The reader.
+ * @param row The row index.
+ * @param column The column index.
+ * @return The stored value.
+ */
+static inline int64_t result_reader_get(const result_reader_t *reader, uint64_t row, int column)
+{
+    const uint64_t block = row / reader->block_rows;
+    const uint64_t within = row % reader->block_rows;
+    const int64_t *values = (const int64_t *)(reader->map.data + reader->data_offset
+                                              + block * reader->block_bytes + 16);
+    return values[(uint64_t)column * reader->block_rows + within];
+}
+
+/**
+ * Verifies the checksums of all blocks.
+ *
+ * @param reader The reader.
+ * @param bad_block Receives the first corrupt block, if any (may be NULL).
+ * @return true if every block is intact.
+ */
+bool result_reader_verify(const result_reader_t *reader, uint64_t *bad_block);
+
+/**
+ * Unmaps a reader.
+ *
+ * @param reader The reader.
+ */
+void result_reader_close(result_reader_t *reader);
+
+/**
+ * Counts the data rows of a result file in either format, i.e. the rows of
+ * a ".cnpr" file or the non-blank lines after the header of a CSV file.
+ *
+ * @param path The file path.
+ * @return The number of rows (0 if the file does not exist).
+ */
+size_t result_file_count_rows(const char *path);
+
+/**
+ * Returns a 64-bit checksum of a buffer whose size is a multiple of 8.
+ *
+ * @param data The buffer.
+ * @param size The size in bytes.
+ * @return The checksum.
+ */
+uint64_t result_checksum(const void *data, size_t size);
+
+#endif /* RESULT_FILE_H */
@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "signature.h"
+
+#define INITIAL_SLOTS 1024
+
+/* Longest line of the index file. */
+#define LINE_BYTES 256
+
+/* Spreads a value over all 64 bits (splitmix64 finalizer). */
+static inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= UINT64_C(0xBF58476D1CE4E5B9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+int64_t signature_least_rotation(const int64_t *gaps, int64_t length)
+{
+    // Duval's factorization of the block written twice: the last Lyndon
+    // factor that starts in the first copy starts the least rotation.
+    int64_t i = 0, start = 0;
+    while (i < length)
+    {
+        start = i;
+        int64_t j = i + 1, k = i;
+        while (j < 2 * length && gaps[k % length] <= gaps[j % length])
+        {
+            if (gaps[k % length] < gaps[j % length])
+                k = i;
+            else
+                k++;
+            j++;
+        }
+        while (i <= k)
+            i += j - k;
+    }
+    return start;
+}
+
+void signature_of(const int64_t *gaps, int64_t length, signature_t *signature)
+{
+    const int64_t start = signature_least_rotation(gaps, length);
+    // Two independent 64-bit lanes over the rotated block.
+    uint64_t a = UINT64_C(0x243F6A8885A308D3), b = UINT64_C(0x13198A2E03707344);
+    for (int64_t i = 0; i < length; i++)
+    {
+        const uint64_t g = (uint64_t)gaps[(start + i) % length];
+        a = (a + mix(g ^ UINT64_C(0xA4093822299F31D0))) * UINT64_C(0x9E3779B97F4A7C15);
+        b = (b ^ mix(g + UINT64_C(0x082EFA98EC4E6C89))) * UINT64_C(0xC2B2AE3D27D4EB4F);
+    }
+    signature->hi = mix(a ^ (uint64_t)length);
+    signature->lo = mix(b + (uint64_t)length * UINT64_C(0x452821E638D01377));
+    signature->length = length;
+}
+
+void signature_format(const signature_t *signature, char *hex)
+{
+    snprintf(hex, SIGNATURE_HEX_LENGTH + 1, "%016" PRIx64 "%016" PRIx64, signature->hi, signature->lo);
+}
+
+static bool same(const signature_t *x, const signature_t *y)
+{
+    return x->hi == y->hi && x->lo == y->lo && x->length == y->length;
+}
+
+static size_t slot_of(const signature_index_t *index, const signature_t *signature)
+{
+    size_t slot = (size_t)signature->lo & (index->capacity - 1);
+    while (index->slots[slot].signature.length != 0 && !same(&index->slots[slot].signature, signature))
+        slot = (slot + 1) & (index->capacity - 1);
+    return slot;
+}
+
+/* Doubles the table once it is half full. */
+static int grow(signature_index_t *index)
+{
+    if (2 * (index->count + 1) <= index->capacity)
+        return 0;
+    const size_t capacity = index->capacity ? 2 * index->capacity : INITIAL_SLOTS;
+    signature_entry_t *slots = calloc(capacity, sizeof(*slots));
+    if (slots == NULL)
+        return -1;
+    signature_index_t grown = {index->file, slots, capacity, 0};
+    for (size_t s = 0; s < index->capacity; s++)
+        if (index->slots[s].signature.length != 0)
+            grown.slots[slot_of(&grown, &index->slots[s].signature)] = index->slots[s];
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    return 0;
+}
+
+/* Inserts a new entry into the table. */
+static int insert(signature_index_t *index, const signature_entry_t *entry)
+{
+    if (grow(index) != 0)
+        return -1;
+    const size_t slot = slot_of(index, &entry->signature);
+    if (index->slots[slot].signature.length == 0)
+    {
+        index->slots[slot] = *entry;
+        index->count++;
+    }
+    return 0;
+}
+
+static bool parse_line(const char *line, signature_entry_t *entry)
+{
+    char hex[SIGNATURE_HEX_LENGTH + 1];
+    if (sscanf(line, "%32[0-9a-f],%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64 ",%" SCNd64, hex,
+               &entry->signature.length, &entry->params[0], &entry->params[1], &entry->params[2],
+               &entry->params[3]) != 6 || strlen(hex) != SIGNATURE_HEX_LENGTH || entry->signature.length <= 0)
+        return false;
+    char half[17];
+    memcpy(half, hex, 16);
+    half[16] = '\0';
+    entry->signature.hi = strtoull(half, NULL, 16);
+    entry->signature.lo = strtoull(hex + 16, NULL, 16);
+    return true;
+}
+
+int signature_index_open(signature_index_t *index, const char *path)
+{
+    memset(index, 0, sizeof(*index));
+    index->file = fopen(path, "a+");
+    if (index->file == NULL)
+    {
+        fprintf(stderr, "Error: could not open signature index %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (grow(index) != 0)
+    {
+        signature_index_close(index);
+        return -1;
+    }
+
+    // Load the complete lines; a torn last line is cut off.
+    char line[LINE_BYTES];
+    long complete = 0;
+    bool header = false;
+    rewind(index->file);
+    while (fgets(line, sizeof(line), index->file) != NULL)
+    {
+        if (strchr(line, '\n') == NULL)
+            break;
+        if (!header)
+        {
+            if (strcmp(line, SIGNATURE_HEADER "\n") != 0)
+            {
+                fprintf(stderr, "Error: '%s' is not a signature index\n", path);
+                signature_index_close(index);
+                return -1;
+            }
+            header = true;
+        }
+        else
+        {
+            signature_entry_t entry;
+            if (parse_line(line, &entry) && insert(index, &entry) != 0)
+            {
+                signature_index_close(index);
+                return -1;
+            }
+        }
+        complete = ftell(index->file);
+    }
+    if (ftruncate(fileno(index->file), complete) != 0)
+    {
+        signature_index_close(index);
+        return -1;
+    }
+    fseek(index->file, 0, SEEK_END);
+    if (!header)
+        fprintf(index->file, "%s\n", SIGNATURE_HEADER);
+    return 0;
+}
+
+const signature_entry_t *signature_index_find(const signature_index_t *index, const signature_t *signature)
+{
+    if (index->capacity == 0)
+        return NULL;
+    const signature_entry_t *entry = &index->slots[slot_of(index, signature)];
+    return entry->signature.length != 0 ? entry : NULL;
+}
+
+int signature_index_add(signature_index_t *index, const signature_t *signature, const int64_t params[4],
+                        const signature_entry_t **first)
+{
+    const signature_entry_t *known = signature_index_find(index, signature);
+    if (known != NULL)
+    {
+        if (first != NULL)
+            *first = known;
+        return 0;
+    }
+    signature_entry_t entry = {*signature, {params[0], params[1], params[2], params[3]}};
+    if (insert(index, &entry) != 0)
+        return -1;
+    if (first != NULL)
+        *first = signature_index_find(index, signature);
+
+    char hex[SIGNATURE_HEX_LENGTH + 1];
+    signature_format(signature, hex);
+    if (fprintf(index->file, "%s,%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 "\n", hex,
+                signature->length, params[0], params[1], params[2], params[3]) < 0)
+        return -1;
+    return 1;
+}
+
+int signature_index_sync(signature_index_t *index)
+{
+    if (fflush(index->file) != 0 || fsync(fileno(index->file)) != 0)
+    {
+        fprintf(stderr, "Error: writing the signature index failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int signature_index_close(signature_index_t *index)
+{
+    int rc = 0;
+    if (index->file != NULL)
+    {
+        rc = signature_index_sync(index);
+        if (fclose(index->file) != 0)
+            rc = -1;
+    }
+    free(index->slots);
+    memset(index, 0, sizeof(*index));
+    return rc;
+}
@@ -0,0 +1,121 @@
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Canonical signatures of periodic gap sequences and their persistent
+ * index. Many rows of a census share one cyclic gap sequence up to
+ * rotation; the signature of a period block is a 128-bit hash of its least
+ * rotation (Lyndon factorization after Duval, linear time, no memory), so
+ * two rows have the same signature exactly when their blocks are rotations
+ * of each other (up to hash collisions).
+ *
+ * The index maps every signature to the parameters of the first row that
+ * produced it. On disk it is a CSV (SIGNATURE_HEADER) to which new
+ * signatures are appended; opening loads it into a hash table, and a torn
+ * last line (crash while writing) is dropped.
+ */
+#define SIGNATURE_HEADER "signature,period,o_n,o_d,a_n,a_d"
+
+/* Characters of a formatted signature (32 hex digits), without the NUL. */
+#define SIGNATURE_HEX_LENGTH 32
+
+typedef struct
+{
+    uint64_t hi;
+    uint64_t lo;
+    int64_t length;  // the period
+} signature_t;
+
+typedef struct
+{
+    signature_t signature;
+    int64_t params[4];  // o_n, o_d, a_n, a_d of the first row
+} signature_entry_t;
+
+typedef struct
+{
+    FILE *file;
+    signature_entry_t *slots;  // open addressing, length 0 marks a free slot
+    size_t capacity;           // a power of two
+    size_t count;
+} signature_index_t;
+
+/**
+ * Returns the start of the least rotation of gaps[0, length). O(length).
+ *
+ * @param gaps The period block.
+ * @param length Its length (> 0).
+ * @return The index the least rotation starts at.
+ */
+int64_t signature_least_rotation(const int64_t *gaps, int64_t length);
+
+/**
+ * Computes the signature of a period block: the hash of its least
+ * rotation. Any length consecutive gaps of a sequence with that period
+ * give the same signature.
+ *
+ * @param gaps The period block.
+ * @param length The period (> 0).
+ * @param signature Receives the signature.
+ */
+void signature_of(const int64_t *gaps, int64_t length, signature_t *signature);
+
+/**
+ * Writes the 32 hex digits of a signature and a NUL.
+ *
+ * @param signature The signature.
+ * @param hex Receives the digits (SIGNATURE_HEX_LENGTH + 1 bytes).
+ */
+void signature_format(const signature_t *signature, char *hex);
+
+/**
+ * Opens an index, loading it if the file exists.
+ *
+ * @param index The index to initialize.
+ * @param path The CSV file.
+ * @return 0 on success, -1 if the file cannot be opened or has another header.
+ */
+int signature_index_open(signature_index_t *index, const char *path);
+
+/**
+ * Looks a signature up.
+ *
+ * @param index The index.
+ * @param signature The signature.
+ * @return Its entry, NULL if it is new.
+ */
+const signature_entry_t *signature_index_find(const signature_index_t *index, const signature_t *signature);
+
+/**
+ * Adds a signature unless it is known. New signatures are appended to the
+ * file (buffered until signature_index_sync()).
+ *
+ * @param index The index.
+ * @param signature The signature.
+ * @param params o_n, o_d, a_n, a_d of the row.
+ * @param first Receives the entry of the first row with the signature (may be NULL).
+ * @return 1 if it was new, 0 if it was known, -1 on an I/O or memory error.
+ */
+int signature_index_add(signature_index_t *index, const signature_t *signature, const int64_t params[4],
+                        const signature_entry_t **first);
+
+/**
+ * Makes the appended signatures durable (flush and fsync).
+ *
+ * @param index The index.
+ * @return 0 on success, -1 on error.
+ */
+int signature_index_sync(signature_index_t *index);
+
+/**
+ * Syncs and closes an index and releases its table.
+ *
+ * @param index The index.
+ * @return 0 on success, -1 on error.
+ */
+int signature_index_close(signature_index_t *index);
+
+#endif /* SIGNATURE_H */
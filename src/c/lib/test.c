@@ -0,0 +1,971 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "csv_loader.h"
+#include "result_file.h"
+#include "journal.h"
+#include "queue.h"
+#include "metrics.h"
+#include "cutproject.h"
+#include "kernels.h"
+#include "numa.h"
+#include "external.h"
+#include "period_stream.h"
+#include "block_sketch.h"
+#include "autocorr.h"
+#include "signature.h"
+
+/**
+ * Writes content to a fresh temporary file.
+ *
+ * @param path Buffer receiving the file name (at least 32 bytes).
+ * @param content The file content.
+ */
+static void write_temp_file(char *path, const char *content)
+{
+    strcpy(path, "/tmp/cnp_test_XXXXXX");
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    assert(f != NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+/**
+ * Tests the line parser of the CSV loader.
+ */
+void test_csv_parse_line(void)
+{
+    int64_t v[CSV_MAX_COLUMNS];
+    const char *line = "2367,14935,-43721,10912,8659\nnext";
+    const char *p = line;
+    assert(csv_parse_line(&p, line + strlen(line), ',', v, 6) == 5);
+    assert(v[0] == 2367 && v[1] == 14935 && v[2] == -43721 && v[3] == 10912 && v[4] == 8659);
+    assert(strcmp(p, "next") == 0);
+
+    // Extra columns are counted but not parsed, CRLF is accepted.
+    line = "1;2;3;4;5;6;0.25;x\r\n";
+    p = line;
+    assert(csv_parse_line(&p, line + strlen(line), ';', v, 6) == 8);
+    assert(v[5] == 6);
+    assert(*p == '\0');
+
+    line = "1,2,x,4,5\n";
+    p = line;
+    assert(csv_parse_line(&p, line + strlen(line), ',', v, 6) == -1);
+    assert(*p == '\0');
+
+    // 19 digits could overflow and are rejected.
+    line = "1234567890123456789,1,1,1,1";
+    p = line;
+    assert(csv_parse_line(&p, line + strlen(line), ',', v, 6) == -1);
+}
+
+/**
+ * Tests that csv_split() only cuts directly behind newlines.
+ */
+void test_csv_split(void)
+{
+    const char *data = "1,1\n22,22\n333,333\n4444,4444\n";
+    const size_t size = strlen(data);
+    size_t bounds[9];
+    for (size_t parts = 1; parts <= 8; parts++)
+    {
+        const size_t produced = csv_split(data, size, parts, bounds);
+        assert(produced >= 1 && produced <= parts);
+        assert(bounds[0] == 0 && bounds[produced] == size);
+        for (size_t k = 1; k < produced; k++)
+        {
+            assert(bounds[k] > bounds[k - 1]);
+            assert(data[bounds[k] - 1] == '\n');
+        }
+    }
+}
+
+/**
+ * Tests loading of a six-column file with blank and malformed lines.
+ */
+void test_csv_table_load(void)
+{
+    char path[32];
+    write_temp_file(path,
+                    "o_n,o_d,a_n,a_d,period_multiset,period_set\r\n"
+                    "3,1,1,2,2,1\r\n"
+                    "\r\n"
+                    "8,1,1,2,oops,1\r\n"
+                    "45863,7347,20305,27081,295803,295803\r\n"
+                    "13,1,1,2,8,1");
+
+    for (int threads = 1; threads <= 4; threads++)
+    {
+        csv_table_t table;
+        assert(csv_table_load(path, threads, &table) == 0);
+        assert(table.columns == 6 && table.separator == ',');
+        assert(table.header_length == strlen("o_n,o_d,a_n,a_d,period_multiset,period_set"));
+        assert(table.rows == 3);
+        assert(table.column[CSV_O_N][1] == 45863 && table.column[CSV_PERIOD][1] == 295803);
+        assert(table.column[CSV_PERIOD_SET][0] == 1 && table.column[CSV_A_D][2] == 2);
+        assert(table.error_count == 1);
+        assert(table.errors[0].line == 4);
+        assert(memcmp(table.map.data + table.errors[0].offset, "8,1,1,2,oops", 12) == 0);
+        assert(memcmp(table.map.data + table.offset[2], "13,1", 4) == 0);
+        csv_table_free(&table);
+    }
+
+    csv_stream_t stream;
+    int64_t values[CSV_MAX_COLUMNS];
+    uint64_t offset;
+    assert(csv_stream_open(path, &stream) == 0 && stream.columns == 6);
+    assert(csv_stream_next(&stream, values, &offset) && values[CSV_O_N] == 3);
+    assert(csv_stream_next(&stream, values, &offset) && values[CSV_PERIOD] == 295803);
+    assert(memcmp(stream.map.data + offset, "45863,", 6) == 0);
+    assert(csv_stream_next(&stream, values, NULL) && values[CSV_O_N] == 13);
+    assert(!csv_stream_next(&stream, values, NULL) && stream.error_count == 1);
+    csv_stream_close(&stream);
+
+    assert(csv_count_rows(path) == 4);
+    unlink(path);
+    assert(csv_count_rows(path) == 0);
+}
+
+/**
+ * Tests writing, appending, crash recovery and O(1) reads of the binary
+ * result format.
+ */
+void test_result_file(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cnp_test_%d" RESULT_FILE_EXTENSION, (int)getpid());
+
+    const uint64_t total = 2 * RESULT_FILE_BLOCK_ROWS + 17;
+    int64_t row[6];
+    result_writer_t writer;
+
+    // Write part of the rows, then append the rest to the closed file.
+    assert(result_writer_open(&writer, path, 6, "o_n,o_d,a_n,a_d,period_multiset,period_set", false) == 0);
+    for (uint64_t i = 0; i < RESULT_FILE_BLOCK_ROWS + 5; i++)
+    {
+        for (int c = 0; c < 6; c++)
+            row[c] = (int64_t)(i * 6 + (uint64_t)c) - 3;
+        assert(result_writer_append(&writer, row) == 0);
+    }
+    assert(result_writer_close(&writer) == 0);
+    assert(result_file_count_rows(path) == RESULT_FILE_BLOCK_ROWS + 5);
+
+    assert(result_writer_open(&writer, path, 6, "ignored", true) == 0);
+    for (uint64_t i = RESULT_FILE_BLOCK_ROWS + 5; i < total; i++)
+    {
+        for (int c = 0; c < 6; c++)
+            row[c] = (int64_t)(i * 6 + (uint64_t)c) - 3;
+        assert(result_writer_append(&writer, row) == 0);
+    }
+    assert(result_writer_close(&writer) == 0);
+
+    result_reader_t reader;
+    assert(result_reader_open(&reader, path) == 0);
+    assert(!reader.recovered && reader.rows == total && reader.columns == 6);
+    assert(reader.header_length == strlen("o_n,o_d,a_n,a_d,period_multiset,period_set"));
+    assert(result_reader_verify(&reader, NULL));
+    assert(result_reader_get(&reader, 0, 0) == -3);
+    assert(result_reader_get(&reader, RESULT_FILE_BLOCK_ROWS + 4, 5) == (int64_t)((RESULT_FILE_BLOCK_ROWS + 4) * 6 + 5) - 3);
+    assert(result_reader_get(&reader, total - 1, 2) == (int64_t)((total - 1) * 6 + 2) - 3);
+    result_reader_close(&reader);
+
+    // Without the footer the rows are recovered from the block checksums.
+    result_reader_t probe;
+    assert(result_reader_open(&probe, path) == 0);
+    const uint64_t without_footer = probe.data_offset + 3 * probe.block_bytes;
+    result_reader_close(&probe);
+    assert(truncate(path, (off_t)without_footer) == 0);
+    assert(result_reader_open(&reader, path) == 0);
+    assert(reader.recovered && reader.rows == total);
+    result_reader_close(&reader);
+
+    unlink(path);
+}
+
+/**
+ * Tests out-of-order completion, reloading and torn records of the
+ * checkpoint journal.
+ */
+void test_journal(void)
+{
+    char output[64], path[80];
+    snprintf(output, sizeof(output), "/tmp/cnp_test_%d.csv", (int)getpid());
+    snprintf(path, sizeof(path), "%s" JOURNAL_SUFFIX, output);
+    unlink(path);
+
+    journal_t journal;
+    bool existed = true;
+    assert(journal_open(&journal, output, &existed) == 0 && !existed);
+    assert(journal_mark_range(&journal, 0, 10, 100, 10) == 0);
+    const uint64_t rows[] = {12, 10, 15, 11, 14};
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+        assert(journal_mark(&journal, rows[i], 200 + i, 11 + i) == 0);
+    assert(journal.count == 2 && journal.done == 15);
+    assert(journal_is_done(&journal, 9) && journal_is_done(&journal, 12) && !journal_is_done(&journal, 13));
+    assert(journal_next_pending(&journal, 0) == 13);
+    assert(journal_next_pending(&journal, 14) == 16);
+    assert(journal_flush(&journal) == 0);
+
+    // Simulate a crash: the journal fd is dropped without a snapshot and a
+    // torn half record is appended.
+    const unsigned char garbage[16] = {1, 2, 3};
+    assert(write(journal.fd, garbage, sizeof(garbage)) == (ssize_t)sizeof(garbage));
+    close(journal.fd);
+    free(journal.intervals);
+    free(journal.pending);
+    free(journal.path);
+
+    assert(journal_open(&journal, output, &existed) == 0 && existed);
+    assert(journal.done == 15 && journal.output_offset == 204 && journal.output_rows == 15);
+    assert(journal_mark(&journal, 13, 300, 16) == 0);
+    assert(journal.count == 1 && journal_next_pending(&journal, 0) == 16);
+    assert(journal_close(&journal) == 0);
+
+    assert(journal_open(&journal, output, &existed) == 0 && existed);
+    assert(journal.done == 16 && journal.output_offset == 300);
+
+    // Rows marked after the last sync are dropped when the output failed.
+    assert(journal_mark(&journal, 16, 400, 17) == 0);
+    journal_abandon(&journal);
+    assert(journal_open(&journal, output, &existed) == 0 && existed);
+    assert(journal.done == 16 && journal.output_offset == 300 && !journal_is_done(&journal, 16));
+    assert(journal_close(&journal) == 0);
+    unlink(path);
+}
+
+#define QUEUE_TEST_ITEMS 100000
+
+static void *queue_test_producer(void *arg)
+{
+    for (uint64_t i = 1; i <= QUEUE_TEST_ITEMS; i++)
+        queue_push(arg, &i);
+    return NULL;
+}
+
+/**
+ * Tests the bounded queue: full and empty states, wrap-around and a
+ * concurrent producer/consumer pair.
+ */
+void test_queue(void)
+{
+    queue_t queue;
+    uint64_t value;
+    assert(queue_init(&queue, 3, sizeof(value)) == 0);
+    assert(queue.mask == 3);
+    assert(!queue_try_pop(&queue, &value));
+    for (uint64_t round = 0; round < 3; round++)
+    {
+        for (uint64_t i = 0; i < 4; i++)
+            assert(queue_try_push(&queue, &i));
+        value = 9;
+        assert(!queue_try_push(&queue, &value));
+        for (uint64_t i = 0; i < 4; i++)
+            assert(queue_try_pop(&queue, &value) && value == i);
+        assert(!queue_try_pop(&queue, &value));
+    }
+    queue_destroy(&queue);
+
+    assert(queue_init(&queue, 64, sizeof(value)) == 0);
+    pthread_t producer;
+    assert(pthread_create(&producer, NULL, queue_test_producer, &queue) == 0);
+    uint64_t sum = 0, last = 0;
+    for (uint64_t i = 0; i < QUEUE_TEST_ITEMS; i++)
+    {
+        queue_pop(&queue, &value);
+        assert(value == last + 1);
+        last = value;
+        sum += value;
+    }
+    assert(pthread_join(producer, NULL) == 0);
+    assert(sum == (uint64_t)QUEUE_TEST_ITEMS * (QUEUE_TEST_ITEMS + 1) / 2);
+    queue_destroy(&queue);
+}
+
+void test_metrics(void)
+{
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/tmp/cnp_test_%d.prom", (int)getpid());
+
+    metrics_t m;
+    assert(metrics_open(&m, NULL, "set", "out.csv", 0) == 0 && m.path == NULL);
+    metrics_sample_t s;
+    memset(&s, 0, sizeof(s));
+    assert(metrics_update(&m, &s, true) == 0);
+
+    assert(metrics_open(&m, path, "set", "/data/o\"ut.csv", 3600) == 0);
+    s.rows_total = 10;
+    s.rows_done = 4;
+    s.cost_total = 100.0;
+    s.cost_done = 50.0;
+    metrics_count_failure(&s, -2);
+    metrics_count_failure(&s, -4);
+    metrics_count_failure(&s, 7);
+    assert(s.failures[1] == 1 && s.failures[3] == 1 && s.failures[0] == 0);
+    assert(metrics_update(&m, &s, false) == 0 && access(path, F_OK) != 0);
+    assert(metrics_update(&m, &s, true) == 0);
+
+    FILE *f = fopen(path, "r");
+    assert(f != NULL);
+    bool rows = false, failures = false, eta = false;
+    while (fgets(line, sizeof(line), f))
+    {
+        rows |= strcmp(line, "cnp_rows_done_total{engine=\"set\",job_file=\"o\\\"ut.csv\"} 4\n") == 0;
+        failures |= strstr(line, "code=\"-2\",reason=\"array_size_exceeded\"} 1") != NULL;
+        eta |= strncmp(line, "cnp_eta_seconds{", 16) == 0;
+    }
+    fclose(f);
+    assert(rows && failures && eta);
+    metrics_close(&m);
+    unlink(path);
+}
+
+static void *cutproject_thread(void *arg)
+{
+    cnp_ctx *ctx = cnp_ctx_create(NULL);
+    cnp_result_t r;
+    for (int i = 0; i < 4; i++)
+    {
+        assert(cnp_search(ctx, 2, 1, 3 + 5 * i, 1, 0, &r) == CNP_OK);
+        assert(r.multiset.period == r.n / r.d && r.set.period == 1);
+    }
+    cnp_ctx_destroy(ctx);
+    *(bool *)arg = true;
+    return NULL;
+}
+
+/* Compares the oracle with the materialized cyclic gaps of a row. */
+static void check_gap_oracle(const cnp_config_t *config, int64_t alpha, int64_t beta, int64_t gamma, int64_t delta)
+{
+    cnp_ctx *ctx = cnp_ctx_create(config);
+    cnp_result_t r;
+    int64_t length;
+    assert(cnp_residues(ctx, alpha, beta, gamma, delta, &r) == CNP_OK);
+    const int64_t period = config->periods & CNP_PERIODS_SET ? r.set.period : r.multiset.period;
+    cnp_result_t o;
+    assert(cnp_oracle_periods(ctx, alpha, beta, gamma, delta, &o) == CNP_OK);
+    assert(o.multiset.status == r.multiset.status && o.multiset.period == r.multiset.period);
+    assert(o.set.status == r.set.status && o.set.period == r.set.period);
+    assert(cnp_residues(ctx, alpha, beta, gamma, delta, &r) == CNP_OK);
+    const int64_t *gaps = cnp_ctx_gaps(ctx, &length);
+    int64_t *copy = malloc((size_t)length * sizeof(*copy));
+    memcpy(copy, gaps, (size_t)length * sizeof(*copy));
+
+    assert(cnp_gap_oracle(ctx, alpha, beta, gamma, delta, &r) == CNP_OK && r.values == length);
+    for (int64_t i = -2 * length; i < 3 * length; i++)
+        assert(cnp_gap_at(ctx, i) == copy[((i % length) + length) % length]);
+    assert(cnp_gap_at(ctx, INT64_MAX) == copy[INT64_MAX % length]);
+    assert(cnp_gap_check(ctx, period, 200, 1) == -1);
+    if (period > 1)
+        assert(cnp_gap_check(ctx, 1, 20 * length, 7) >= 0);   // a wrong period is caught
+    free(copy);
+    cnp_ctx_destroy(ctx);
+}
+
+static void test_gap_oracle(void)
+{
+    cnp_config_t multiset, set;
+    cnp_config_default(&multiset);
+    multiset.periods = CNP_PERIODS_MULTISET;
+    cnp_config_default(&set);
+    // N < D (three gap values), N = 1, N a multiple of D, N > D with extra copies.
+    const int64_t rows[][4] = {{3, 7, 5, 2}, {1, 300007, 1, 1}, {7, 3, 1, 3}, {13, 8, 3, 2}, {2, 3, 1, 4},
+                               {2, 1, 3, 1}, {2, 1, 4, 1}, {5, 3, 17, 1}, {1, 1, 1, 1}};
+    for (size_t k = 0; k < sizeof(rows) / sizeof(rows[0]); k++)
+    {
+        check_gap_oracle(&multiset, rows[k][0], rows[k][1], rows[k][2], rows[k][3]);
+        check_gap_oracle(&set, rows[k][0], rows[k][1], rows[k][2], rows[k][3]);
+    }
+
+    // Rows whose N is out of reach of the work buffer still answer.
+    cnp_config_t small;
+    cnp_config_default(&small);
+    small.max_values = 1000;
+    cnp_ctx *ctx = cnp_ctx_create(&small);
+    cnp_result_t r;
+    assert(cnp_gap_oracle(ctx, 1, 3000000, 1, 1, &r) == CNP_OK && r.values == 3000002);
+    assert(cnp_gap_check(ctx, r.values, 1000, 3) == -1 && cnp_gap_at(ctx, 0) > 0);
+    assert(cnp_gap_oracle(ctx, 0, 1, 1, 1, &r) == CNP_INVALID_ARGUMENT && cnp_gap_at(ctx, 5) == 0);
+    cnp_result_t exact;
+    cnp_ctx *large = cnp_ctx_create(NULL);
+    assert(cnp_residues(large, 7, 1000003, 3, 1, &exact) == CNP_OK);
+    cnp_ctx_destroy(large);
+    assert(cnp_residues(ctx, 7, 1000003, 3, 1, &r) == CNP_BUFFER_EXCEEDED);
+    assert(cnp_oracle_periods(ctx, 7, 1000003, 3, 1, &r) == CNP_OK && r.n == exact.n);
+    assert(r.multiset.period == exact.multiset.period && r.set.period == exact.set.period);
+    cnp_ctx_destroy(ctx);
+
+    // A borrowed buffer bounds the calls and is not freed.
+    int64_t buffer[16];
+    ctx = cnp_ctx_create(NULL);
+    cnp_ctx_use_buffer(ctx, buffer, 16);
+    assert(cnp_residues(ctx, 2, 1, 3, 1, &r) == CNP_OK && r.set.period == 1 && cnp_ctx_gaps(ctx, &r.values) == buffer);
+    assert(cnp_residues(ctx, 2, 1, 4, 1, &r) == CNP_OK && r.multiset.period == 13);
+    assert(cnp_residues(ctx, 3, 7, 5, 2, &r) == CNP_BUFFER_EXCEEDED);
+    cnp_ctx_destroy(ctx);
+}
+
+void test_cutproject(void)
+{
+    cnp_ctx *ctx = cnp_ctx_create(NULL);
+    cnp_result_t r;
+    assert(ctx != NULL);
+
+    // D = 5 divides N = 10: multiset N / D, set 1; N = 4 < D: both N.
+    assert(cnp_lambda(ctx, 2, 1, 3, 1, 0, 10000, &r) == CNP_OK);
+    assert(r.n == 10 && r.d == 5 && r.multiset.period == 2 && r.set.period == 1);
+    assert(cnp_lambda(ctx, 4, 2, 2, 2, 0, 10000, &r) == CNP_OK);
+    assert(r.n == 4 && r.multiset.period == 4 && r.set.period == 4 && r.attempts == 1);
+    assert(cnp_search(ctx, 2, 1, 1, 1, 4, &r) == CNP_OK && r.set.period == 4 && r.x_max > 1000);
+    assert(cnp_lambda(ctx, 2, 0, 1, 1, 0, 100, &r) == CNP_INVALID_ARGUMENT);
+    assert(cnp_status_code(r.status) == -5 && strcmp(cnp_status_string(r.status), "invalid_argument") == 0);
+    const cnp_stats_t *stats = cnp_ctx_stats(ctx);
+    assert(stats->calls == 4 && stats->status[CNP_OK] == 3 && stats->buffer_bytes > 0);
+    cnp_ctx_destroy(ctx);
+
+    // Limits are reported as statuses.
+    cnp_config_t config;
+    cnp_config_default(&config);
+    config.max_values = 1000;
+    ctx = cnp_ctx_create(&config);
+    assert(cnp_lambda(ctx, 2, 1, 3, 1, 0, 10000, &r) == CNP_BUFFER_EXCEEDED && cnp_status_code(r.status) == -2);
+    cnp_ctx_destroy(ctx);
+    cnp_config_default(&config);
+    config.budget_values = 1000;
+    ctx = cnp_ctx_create(&config);
+    assert(cnp_lambda(ctx, 2, 1, 3, 1, 0, 10000, &r) == CNP_BUDGET_EXCEEDED);
+    cnp_ctx_destroy(ctx);
+
+    // The residue model gives the same periods without a window.
+    ctx = cnp_ctx_create(NULL);
+    int64_t length;
+    assert(cnp_residues(ctx, 2, 1, 3, 1, &r) == CNP_OK && r.multiset.period == 2 && r.set.period == 1);
+    const int64_t *gaps = cnp_ctx_gaps(ctx, &length);
+    assert(length == 5 && gaps[0] == 1 && r.values == 10);
+    assert(cnp_residues(ctx, 2, 1, 1, 1, &r) == CNP_OK && r.multiset.period == 4 && r.set.period == 4);
+    assert(cnp_residues(ctx, 2, 1, 4, 1, &r) == CNP_OK && r.n == 13 && r.multiset.period == 13 && r.set.period == 1);
+    cnp_ctx_destroy(ctx);
+
+    // The gap oracle reads the cyclic gaps of cnp_residues() at any index.
+    test_gap_oracle();
+
+    // Only the multiset period, of the sorted or of the ordered gaps.
+    cnp_config_default(&config);
+    config.periods = CNP_PERIODS_MULTISET;
+    ctx = cnp_ctx_create(&config);
+    assert(cnp_lambda(ctx, 2, 1, 3, 1, 0, 100, &r) == CNP_OK && r.set.status == CNP_SKIPPED);
+    gaps = cnp_ctx_gaps(ctx, &length);
+    assert(r.multiset.period == 2 && gaps != NULL && length == r.values - 1);
+    cnp_ctx_destroy(ctx);
+    config.ordered = true;
+    ctx = cnp_ctx_create(&config);
+    assert(cnp_lambda(ctx, 2, 1, 3, 1, 0, 100, &r) == CNP_OK && r.multiset.period == 10);
+    gaps = cnp_ctx_gaps(ctx, &length);
+    assert(length == r.values && gaps[0] == -2);
+    cnp_ctx_destroy(ctx);
+    config.periods = CNP_PERIODS_SET;
+    assert(cnp_ctx_create(&config) == NULL);
+
+    // One context per thread, no shared state.
+    pthread_t threads[4];
+    bool done[4] = {false};
+    for (int t = 0; t < 4; t++)
+        pthread_create(&threads[t], NULL, cutproject_thread, &done[t]);
+    for (int t = 0; t < 4; t++)
+    {
+        pthread_join(threads[t], NULL);
+        assert(done[t]);
+    }
+}
+
+static void check_kernels(void)
+{
+    // All lengths around the vector widths, at every alignment, both store kinds.
+    int64_t buffer[80 + 8];
+    for (int stream = 0; stream < 2; stream++)
+        for (int offset = 0; offset < 8; offset++)
+            for (int64_t count = 0; count <= 70; count++)
+            {
+                for (int i = 0; i < 88; i++)
+                    buffer[i] = 12345;
+                kernel_fill(buffer + offset, -7, 3, count, stream);
+                kernel_fence();
+                for (int i = 0; i < 88; i++)
+                    assert(buffer[i] == (i >= offset && i < offset + count ? -7 + 3 * (i - offset) : 12345));
+            }
+    buffer[20] = 12345;
+    kernel_fill(buffer, -2, 0, 20, false);
+    assert(buffer[0] == -2 && buffer[19] == -2 && buffer[20] == 12345);
+
+    // Sorted output is a permutation: values i * 7919 mod 10007 are distinct.
+    int64_t values[5000];
+    for (int64_t i = 0; i < 5000; i++)
+        values[i] = (i * 7919) % 10007 - 5000;
+    kernel_sort(values, 5000);
+    for (int i = 1; i < 5000; i++)
+        assert(values[i - 1] < values[i]);
+    for (int i = 0; i < 5000; i++)
+        values[i] = i % 2;
+    kernel_sort(values, 5000);
+    assert(values[2499] == 0 && values[2500] == 1);
+
+    assert(kernel_equal(values, values + 2, 2498));
+    assert(!kernel_equal(values, values + 2, 2499));
+    assert(kernel_equal(values, values + 1, 0));
+}
+
+void test_kernels(void)
+{
+    static const char *names[] = {"scalar", "avx2", "avx512"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (!kernel_supported(names[i]))
+        {
+            assert(kernel_select(names[i]) != 0);
+            continue;
+        }
+        assert(kernel_self_test(names[i]));
+        assert(kernel_select(names[i]) == 0 && strcmp(kernel_name(), names[i]) == 0);
+        check_kernels();
+    }
+    assert(kernel_select("sse9") != 0 && !kernel_self_test("sse9"));
+    assert(kernel_select("auto") == 0 && kernel_self_test(kernel_name()));
+    assert(kernel_llc_bytes() > 0);
+}
+
+static void *numa_thread(void *arg)
+{
+    int *node = arg;
+    *node = numa_pin_thread(1);
+    return NULL;
+}
+
+void test_numa(void)
+{
+    uint64_t mask[2];
+    assert(numa_parse_list("0-3,8,10-11\n", mask, 128) == 7);
+    assert(mask[0] == 0xd0f && mask[1] == 0);
+    assert(numa_parse_list("64,127", mask, 128) == 2 && mask[0] == 0 && mask[1] == (1ULL | 1ULL << 63));
+    assert(numa_parse_list("\n", mask, 128) == 0);
+    assert(numa_parse_list("128", mask, 128) == -1);
+    assert(numa_parse_list("3-1", mask, 128) == -1);
+    assert(numa_parse_list("1,,2", mask, 128) == -1);
+    assert(numa_parse_list("a", mask, 128) == -1);
+
+    // Works on any machine: one node means no pinning and default placement.
+    const int nodes = numa_nodes();
+    assert(nodes >= 1 && numa_worker_node(0) == numa_worker_node(nodes));
+    int node = -2;
+    pthread_t thread;
+    pthread_create(&thread, NULL, numa_thread, &node);
+    pthread_join(thread, NULL);
+    assert(node == numa_worker_node(1) || (nodes > 1 && node == -1));
+
+    const size_t bytes = (size_t)4 << 20;
+    unsigned char *buffer = malloc(bytes);
+    assert(buffer != NULL);
+    assert(numa_place(buffer, bytes, numa_worker_node(0)) == 0 || nodes > 1);
+    assert(numa_place(buffer, bytes, NUMA_INTERLEAVE) == 0 || nodes > 1);
+    memset(buffer, 1, bytes);
+    assert(buffer[bytes - 1] == 1);
+    free(buffer);
+}
+
+static int collect(void *arg, int64_t *block, size_t count)
+{
+    int64_t **next = arg;
+    block[-1] = 0;   // writable by contract
+    memcpy(*next, block, count * sizeof(int64_t));
+    *next += count;
+    return 0;
+}
+
+/* lambda_trim() with find_period_length(), on gaps in memory. */
+static int64_t reference_trim(const int64_t *g, int64_t length, int64_t t, double fraction)
+{
+    int64_t start = t;
+    int64_t end = length - t;
+    const int64_t initial = end - start + 1;
+    int64_t current = initial;
+    while (true)
+    {
+        start++;
+        end--;
+        current -= 2;
+        if ((double)current / (double)initial < fraction)
+            return EXT_WINDOW_TOO_SMALL;
+        if (start >= end)
+            return EXT_NO_PERIOD;
+        const int64_t n = end - start + 1;
+        for (int64_t p = 1; p <= n / 2; p++)
+            if (memcmp(&g[start], &g[start + p], (size_t)(n - p) * sizeof(int64_t)) == 0)
+                return p;
+    }
+}
+
+void test_external(void)
+{
+    // Runs of different lengths merge into one sorted sequence.
+    const size_t lengths[3] = {5000, 3000, 7000};
+    int64_t *values = malloc(20000 * sizeof(int64_t));
+    int64_t *merged = malloc(15000 * sizeof(int64_t));
+    int64_t *buffer = malloc(64 * 1024 * sizeof(int64_t));
+    assert(values != NULL && merged != NULL && buffer != NULL);
+    ext_runs_t runs;
+    assert(ext_runs_create(&runs, "/tmp") == 0);
+    srand(7);
+    size_t offset = 0;
+    for (int r = 0; r < 3; r++)
+    {
+        for (size_t i = 0; i < lengths[r]; i++)
+            values[offset + i] = rand() % 100000 - 50000;
+        kernel_sort(values + offset, lengths[r]);
+        assert(ext_runs_add(&runs, values + offset, lengths[r]) == 0);
+        offset += lengths[r];
+    }
+    int64_t *next = merged;
+    assert(ext_runs_merge(&runs, buffer, 4 * 1024 + 3 * EXT_MERGE_STATE_VALUES, collect, &next) == 0);
+    assert(next == merged + 15000);
+    kernel_sort(values, 15000);
+    assert(memcmp(values, merged, 15000 * sizeof(int64_t)) == 0);
+    // 1024 per run and output, and the state of each run.
+    assert(ext_runs_merge(&runs, buffer, 4 * 1024 + 3 * EXT_MERGE_STATE_VALUES - 1, collect, &next) == -1);
+    ext_runs_close(&runs);
+
+    // ext_period() agrees with lambda_trim(): periodic gaps with noisy ends, and noise.
+    const int64_t length = 20000;
+    const int64_t to_delete = (int64_t)((1.0 - 0.9) / 40.0 * length);
+    // The last case is long runs of one gap with three defects per period.
+    const int64_t periods[] = {1, 7, 300, 3000, 0, 3001};
+    const size_t cases = sizeof(periods) / sizeof(periods[0]);
+    for (size_t c = 0; c < cases; c++)
+    {
+        const int64_t period = periods[c];
+        for (int64_t i = 0; i < length; i++)
+            values[i] = period == 0 || i < 120 || i >= length - 90 ? 1 + rand() % 3
+                      : c == cases - 1 ? ((i - 120) % period == 17 || (i - 120) % period == 900 ? 1
+                                          : (i - 120) % period == 2500 ? 2 : 5)
+                      : i < 120 + period ? 1 + rand() % 3 : values[i - period];
+        ext_file_t gaps;
+        assert(ext_file_create(&gaps, "/tmp") == 0);
+        assert(ext_file_append(&gaps, values, 7000) == 0 && ext_file_append(&gaps, values + 7000, length - 7000) == 0);
+        assert(ext_file_read(&gaps, length - 1, merged, 2) == -1);
+        const int64_t expected = reference_trim(values, length, to_delete, 0.9);
+        assert(expected == (period == 0 ? EXT_WINDOW_TOO_SMALL : period));
+        assert(ext_period(&gaps, (uint64_t)to_delete, 0.9, 0, buffer, 64 * 1024) == expected);
+        // A hint is verified like the found candidates: right or wrong, the result stands.
+        assert(ext_period(&gaps, (uint64_t)to_delete, 0.9, 5, buffer, 64 * 1024) == expected);
+        if (period > 0)
+            assert(ext_period(&gaps, (uint64_t)to_delete, 0.9, period, buffer, 64 * 1024) == expected);
+        ext_file_close(&gaps);
+    }
+    free(values);
+    free(merged);
+    free(buffer);
+}
+
+void test_block_sketch(void)
+{
+    // sketch_period() agrees with lambda_trim() on the cases of test_external(), longer.
+    const int64_t length = 60000;
+    const int64_t to_delete = (int64_t)((1.0 - 0.9) / 40.0 * length);
+    int64_t *g = malloc((size_t)length * sizeof(int64_t));
+    assert(g != NULL);
+    // The last cases are long runs of one gap with three defects per period.
+    const int64_t periods[] = {1, 7, 300, 3000, 17000, 0, 3001, 12001};
+    const size_t cases = sizeof(periods) / sizeof(periods[0]);
+    srand(13);
+    for (size_t c = 0; c < cases; c++)
+    {
+        const int64_t period = periods[c];
+        const bool runs = c >= cases - 2;
+        for (int64_t i = 0; i < length; i++)
+            g[i] = period == 0 || i < 120 || i >= length - 90 ? 1 + rand() % 3
+                 : runs ? ((i - 120) % period == 17 || (i - 120) % period == 900 ? 1
+                           : (i - 120) % period == 2500 ? 2 : 5)
+                 : i < 120 + period ? 1 + rand() % 3 : g[i - period];
+        const int64_t expected = reference_trim(g, length, to_delete, 0.9);
+        assert(expected == (period == 0 ? EXT_WINDOW_TOO_SMALL : period));
+        assert(sketch_period(g, length, to_delete, 0.9) == expected);
+    }
+
+    // A defect inside the window: the period holds once the window excludes it.
+    for (int64_t i = 0; i < length; i++)
+        g[i] = i < 500 ? 1 + rand() % 3 : g[i - 500];
+    g[length - to_delete - 200] = 7;
+    assert(reference_trim(g, length, to_delete, 0.9) == 500);
+    assert(sketch_period(g, length, to_delete, 0.9) == 500);
+
+    // A lent buffer is used as is: too small, the sketch does not run.
+    const size_t bytes = sketch_buffer_bytes(length);
+    void *buffer = malloc(bytes);
+    assert(buffer != NULL);
+    sketch_use_buffer(buffer, bytes - 1);
+    assert(sketch_period(g, length, to_delete, 0.9) == SKETCH_NO_MEMORY);
+    sketch_use_buffer(buffer, bytes);
+    assert(sketch_period(g, length, to_delete, 0.9) == 500);
+    sketch_release();
+    free(buffer);
+    free(g);
+}
+
+void test_autocorr(void)
+{
+    // The match counts of the transform are exact: the best lag of a periodic sequence.
+    const int64_t length = 60000;
+    const int64_t to_delete = (int64_t)((1.0 - 0.9) / 40.0 * length);
+    int64_t *g = malloc((size_t)length * sizeof(int64_t));
+    assert(g != NULL);
+    srand(17);
+    for (int64_t i = 0; i < 1000; i++)
+        g[i] = i < 333 ? rand() % 5 : g[i - 333];
+    int64_t candidates[AUTOCORR_CANDIDATES];
+    assert(autocorr_candidates(g, 1000, 500, candidates, AUTOCORR_CANDIDATES) == AUTOCORR_CANDIDATES);
+    assert(candidates[0] == 333);
+
+    // A period near the half-window limit, which the sketch cannot see.
+    for (int64_t i = 0; i < length; i++)
+        g[i] = i < 120 || i >= length - 90 ? 1 + rand() % 3 : i < 29820 ? 1 + rand() % 2 : g[i - 29700];
+    assert(reference_trim(g, length, to_delete, 0.9) == 29700);
+    assert(sketch_period(g, length, to_delete, 0.9) != 29700);
+    assert(autocorr_period(g, length, to_delete, 0.9) == 29700);
+
+    // A lent buffer is used as is: too small, the transform does not run.
+    const size_t bytes = autocorr_buffer_bytes(length);
+    void *buffer = malloc(bytes);
+    assert(buffer != NULL);
+    autocorr_use_buffer(buffer, bytes / 2);
+    assert(autocorr_period(g, length, to_delete, 0.9) == AUTOCORR_NO_MEMORY);
+    autocorr_use_buffer(buffer, bytes);
+    assert(autocorr_period(g, length, to_delete, 0.9) == 29700);
+    autocorr_release();
+    free(buffer);
+
+    // Noise has no period; a short one is found too.
+    for (int64_t i = 0; i < length; i++)
+        g[i] = 1 + rand() % 3;
+    assert(autocorr_period(g, length, to_delete, 0.9) == EXT_WINDOW_TOO_SMALL);
+    for (int64_t i = 0; i < length; i++)
+        g[i] = i < 120 || i >= length - 90 ? 1 + rand() % 3 : i < 127 ? 1 + rand() % 3 : g[i - 7];
+    assert(autocorr_period(g, length, to_delete, 0.9) == reference_trim(g, length, to_delete, 0.9));
+    free(g);
+}
+
+void test_candidate_reduction(void)
+{
+    // Noisy ends of different lengths around a constant or short-period
+    // middle: the best ranked lags are often multiples of the period only,
+    // and a verified multiple is reduced to the period.
+    const int64_t length = 20000;
+    const int64_t to_delete = (int64_t)((1.0 - 0.9) / 40.0 * length);
+    int64_t *g = malloc((size_t)length * sizeof(int64_t));
+    assert(g != NULL);
+    srand(23);
+    for (int c = 0; c < 60; c++)
+    {
+        const int64_t left = rand() % 301;
+        const int64_t right = rand() % 301;
+        const int64_t period = c % 3 == 0 ? 1 : c % 3 == 1 ? 2 + rand() % 7 : 50 + rand() % 100;
+        int64_t block[150];
+        for (int64_t i = 0; i < period; i++)
+            block[i] = 1 + rand() % 3;
+        for (int64_t i = 0; i < length; i++)
+            g[i] = i < left || i >= length - right ? 1 + rand() % 5 : block[i % period];
+        const int64_t expected = reference_trim(g, length, to_delete, 0.9);
+        assert(sketch_period(g, length, to_delete, 0.9) == expected);
+        assert(autocorr_period(g, length, to_delete, 0.9) == expected);
+    }
+    free(g);
+}
+
+/* The minimal period of g[0, n) by its definition. */
+static uint64_t reference_period(const int64_t *g, uint64_t n)
+{
+    for (uint64_t p = 1; p < n; p++)
+        if (memcmp(g, g + p, (n - p) * sizeof(int64_t)) == 0)
+            return p;
+    return n;
+}
+
+void test_period_stream(void)
+{
+    // The current period is the minimal period of every prefix.
+    const uint64_t length = 600;
+    int64_t *g = malloc(length * sizeof(int64_t));
+    int64_t *buffer = malloc((4 * length + 2) * sizeof(int64_t));
+    assert(g != NULL && buffer != NULL);
+    period_stream_t s;
+    assert(period_stream_init(&s, buffer, 5, 4) == -1);
+    assert(period_stream_init(&s, buffer, 66, 1) == -1);
+    srand(11);
+    for (int trial = 0; trial < 200; trial++)
+    {
+        // Small alphabets and repeated blocks give long borders.
+        const int alphabet = 1 + trial % 3;
+        const uint64_t block = 1 + (uint64_t)rand() % 40;
+        for (uint64_t i = 0; i < length; i++)
+            g[i] = i < block || rand() % 50 == 0 ? rand() % alphabet : g[i - block];
+        assert(period_stream_init(&s, buffer, 4 * length + 2, 4) == 0 && s.max_period == length);
+        assert(period_stream_current(&s) == PERIOD_STREAM_NONE);
+        for (uint64_t i = 0; i < length; i++)
+        {
+            period_stream_feed(&s, g[i]);
+            assert(period_stream_current(&s) == reference_period(g, i + 1));
+        }
+        assert(s.restarts == 0 && s.stored <= 2 * s.period);
+    }
+
+    // Noise at the start restarts the detector; the period after it is the result.
+    assert(period_stream_init(&s, buffer, 66, 4) == 0 && s.max_period == 16);
+    for (uint64_t i = 0; i < 100; i++)
+        period_stream_feed(&s, (int64_t)(i * i % 101));
+    assert(s.restarts > 0);
+    bool stable = true;
+    period_stream_result(&s, &stable);
+    assert(!stable);
+    for (uint64_t i = 0; i < 10000; i++)
+        period_stream_feed(&s, i % 7 == 3 ? 2 : 1);
+    assert(period_stream_result(&s, &stable) == 7 && stable);
+    assert(s.total == 10100);
+
+    // A defect splits the run; the longer side is kept.
+    for (uint64_t i = 0; i < 5; i++)
+        period_stream_feed(&s, 9);
+    for (uint64_t i = 0; i < 100; i++)
+        period_stream_feed(&s, i % 5 == 0 ? 2 : 1);
+    assert(period_stream_result(&s, &stable) == 7 && stable);
+    free(g);
+    free(buffer);
+}
+
+/* The start of the least rotation by comparing all rotations. */
+static int64_t reference_rotation(const int64_t *g, int64_t n)
+{
+    int64_t best = 0;
+    for (int64_t r = 1; r < n; r++)
+        for (int64_t i = 0; i < n; i++)
+            if (g[(r + i) % n] != g[(best + i) % n])
+            {
+                if (g[(r + i) % n] < g[(best + i) % n])
+                    best = r;
+                break;
+            }
+    return best;
+}
+
+void test_signature(void)
+{
+    // The least rotation, also of blocks that repeat a shorter one.
+    int64_t g[64], rotated[64];
+    srand(23);
+    for (int trial = 0; trial < 2000; trial++)
+    {
+        const int64_t n = 1 + rand() % 40;
+        const int64_t repeat = 1 + rand() % n;
+        for (int64_t i = 0; i < n; i++)
+            g[i] = i < repeat ? rand() % (1 + trial % 4) : g[i - repeat];
+        const int64_t start = signature_least_rotation(g, n);
+        const int64_t expected = reference_rotation(g, n);
+        for (int64_t i = 0; i < n; i++)
+            assert(g[(start + i) % n] == g[(expected + i) % n]);
+    }
+
+    // Rotations share the signature; another block or length does not.
+    const int64_t block[] = {3, 1, 4, 1, 5, 9, 2, 6};
+    signature_t first, second;
+    signature_of(block, 8, &first);
+    for (int64_t r = 0; r < 8; r++)
+    {
+        for (int64_t i = 0; i < 8; i++)
+            rotated[i] = block[(r + i) % 8];
+        signature_of(rotated, 8, &second);
+        assert(second.hi == first.hi && second.lo == first.lo && second.length == 8);
+    }
+    rotated[3] = 7;
+    signature_of(rotated, 8, &second);
+    assert(second.hi != first.hi && second.lo != first.lo);
+    signature_of(block, 7, &second);
+    assert(second.hi != first.hi);
+
+    // The index keeps the first row of each signature across reopening.
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cnp_test_%d.signatures", (int)getpid());
+    unlink(path);
+    signature_index_t index;
+    const signature_entry_t *seen;
+    const int64_t row_a[4] = {1, 2, 3, 4}, row_b[4] = {5, 6, 7, 8};
+    assert(signature_index_open(&index, path) == 0);
+    assert(signature_index_find(&index, &first) == NULL);
+    assert(signature_index_add(&index, &first, row_a, &seen) == 1 && seen->params[2] == 3);
+    assert(signature_index_add(&index, &first, row_b, &seen) == 0 && seen->params[0] == 1);
+    assert(signature_index_add(&index, &second, row_b, NULL) == 1);
+    for (int64_t k = 0; k < 3000; k++)
+    {
+        // Enough signatures to grow the table.
+        signature_t s = {(uint64_t)k, (uint64_t)k * 7, 1 + k};
+        assert(signature_index_add(&index, &s, row_b, NULL) == 1);
+    }
+    assert(signature_index_close(&index) == 0);
+
+    // A torn line at the end is dropped.
+    FILE *f = fopen(path, "a");
+    assert(f != NULL);
+    fputs("0123456789abcdef", f);
+    fclose(f);
+    assert(signature_index_open(&index, path) == 0 && index.count == 3002);
+    assert(signature_index_add(&index, &first, row_b, &seen) == 0 && seen->params[3] == 4);
+    assert(signature_index_find(&index, &second) != NULL);
+    assert(signature_index_close(&index) == 0);
+    assert(signature_index_open(&index, path) == 0 && index.count == 3002);
+    assert(signature_index_close(&index) == 0);
+    unlink(path);
+
+    // The window of cnp_search() and the cycle of cnp_residues() give one signature.
+    cnp_ctx *ctx = cnp_ctx_create(NULL);
+    cnp_result_t r;
+    char window[SIGNATURE_HEX_LENGTH + 1], cycle[SIGNATURE_HEX_LENGTH + 1];
+    const int64_t rows[][4] = {{13, 8, 3, 2}, {3, 7, 5, 2}, {5, 3, 17, 1}, {68, 149, 981, 139}};
+    for (size_t k = 0; k < sizeof(rows) / sizeof(rows[0]); k++)
+    {
+        const int64_t *v = rows[k];
+        assert(cnp_search(ctx, v[0], v[1], v[2], v[3], 0, &r) == CNP_OK);
+        assert(cnp_ctx_signature(ctx, r.set.period, window) == CNP_OK);
+        assert(cnp_residues(ctx, v[0], v[1], v[2], v[3], &r) == CNP_OK);
+        assert(cnp_ctx_signature(ctx, r.set.period, cycle) == CNP_OK && strcmp(window, cycle) == 0);
+    }
+    assert(cnp_ctx_signature(ctx, 0, cycle) == CNP_INVALID_ARGUMENT);
+    cnp_ctx_destroy(ctx);
+
+    char other[32];
+    write_temp_file(other, "o_n,o_d,a_n,a_d\n");
+    assert(signature_index_open(&index, other) == -1);
+    unlink(other);
+}
+
+int main(void)
+{
+    test_csv_parse_line();
+    test_csv_split();
+    test_csv_table_load();
+    test_result_file();
+    test_journal();
+    test_queue();
+    test_metrics();
+    test_cutproject();
+    test_kernels();
+    test_numa();
+    test_external();
+    test_period_stream();
+    test_block_sketch();
+    test_autocorr();
+    test_candidate_reduction();
+    test_signature();
+    printf("All library tests passed.\n");
+    return 0;
+}
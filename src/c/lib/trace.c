@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+typedef struct
+{
+    const char *name;
+    const char *category;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    int64_t arg;
+} trace_event_t;
+
+/**
+ * The events of one thread. Buffers are allocated at full capacity and
+ * linked into a global list by trace_thread(), and only freed by
+ * trace_close().
+ */
+typedef struct trace_buffer
+{
+    struct trace_buffer *next;
+    int tid;
+    char thread_name[32];
+    trace_event_t *events;
+    size_t count;
+    size_t capacity;
+    size_t dropped;
+} trace_buffer_t;
+
+bool trace_active = false;
+
+static FILE *trace_file;
+static uint64_t trace_origin;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_buffer_t *buffers;
+static int next_tid = 1;
+static _Atomic size_t unregistered;   // events of threads without trace_thread()
+
+static _Thread_local trace_buffer_t *thread_buffer;
+
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int trace_open(const char *path)
+{
+    trace_file = fopen(path, "w");
+    if (!trace_file)
+    {
+        fprintf(stderr, "Error creating trace file '%s'\n", path);
+        return -1;
+    }
+    trace_origin = trace_now();
+    trace_active = true;
+    return 0;
+}
+
+/**
+ * Returns the calling thread's buffer, registering it on first use. The
+ * events are allocated here, at full capacity (untouched pages cost no
+ * memory): trace_span() runs under the row timeout, whose siglongjmp()
+ * must never interrupt an allocation.
+ */
+static trace_buffer_t *buffer(void)
+{
+    if (thread_buffer)
+        return thread_buffer;
+
+    trace_buffer_t *b = calloc(1, sizeof(*b));
+    if (!b)
+        return NULL;
+    b->events = malloc(TRACE_MAX_EVENTS_PER_THREAD * sizeof(*b->events));
+    b->capacity = b->events != NULL ? TRACE_MAX_EVENTS_PER_THREAD : 0;
+    pthread_mutex_lock(&buffers_lock);
+    b->tid = next_tid++;
+    b->next = buffers;
+    buffers = b;
+    pthread_mutex_unlock(&buffers_lock);
+    snprintf(b->thread_name, sizeof(b->thread_name), "thread %d", b->tid);
+    thread_buffer = b;
+    return b;
+}
+
+void trace_thread(const char *name)
+{
+    if (!trace_active)
+        return;
+    trace_buffer_t *b = buffer();
+    if (b)
+        snprintf(b->thread_name, sizeof(b->thread_name), "%s", name);
+}
+
+void trace_span(const char *name, const char *category, uint64_t start_ns, uint64_t end_ns, int64_t arg)
+{
+    if (!trace_active)
+        return;
+    trace_buffer_t *b = thread_buffer;
+    if (!b)
+    {
+        unregistered++;
+        return;
+    }
+    if (b->count == b->capacity)
+    {
+        b->dropped++;
+        return;
+    }
+    b->events[b->count++] = (trace_event_t){name, category, start_ns, end_ns - start_ns, arg};
+}
+
+void trace_wait(const char *name, uint64_t waited_ns)
+{
+    if (!trace_active || waited_ns == 0)
+        return;
+    const uint64_t now = trace_now();
+    trace_span(name, "wait", now - waited_ns, now, -1);
+}
+
+int trace_close(void)
+{
+    if (!trace_active)
+        return 0;
+    trace_active = false;
+
+    const int pid = (int)getpid();
+    size_t dropped = 0;
+    bool first = true;
+    fprintf(trace_file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (trace_buffer_t *b = buffers; b; b = b->next)
+    {
+        fprintf(trace_file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", first ? "" : ",", pid, b->tid, b->thread_name);
+        first = false;
+        for (size_t i = 0; i < b->count; i++)
+        {
+            const trace_event_t *e = &b->events[i];
+            const uint64_t start = e->start_ns >= trace_origin ? e->start_ns - trace_origin : 0;
+            fprintf(trace_file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                    "\"ts\": %llu.%03u, \"dur\": %llu.%03u",
+                    e->name, e->category, pid, b->tid,
+                    (unsigned long long)(start / 1000), (unsigned)(start % 1000),
+                    (unsigned long long)(e->duration_ns / 1000), (unsigned)(e->duration_ns % 1000));
+            if (e->arg >= 0)
+                fprintf(trace_file, ", \"args\": {\"value\": %lld}", (long long)e->arg);
+            fprintf(trace_file, "}");
+        }
+        dropped += b->dropped;
+    }
+    fprintf(trace_file, "\n]}\n");
+
+    while (buffers)
+    {
+        trace_buffer_t *next = buffers->next;
+        free(buffers->events);
+        free(buffers);
+        buffers = next;
+    }
+    thread_buffer = NULL;
+
+    dropped += unregistered;
+    unregistered = 0;
+    if (dropped > 0)
+        fprintf(stderr, "Warning: %zu trace events dropped (buffer limit or thread without trace_thread()).\n", dropped);
+    const int rc = ferror(trace_file) ? -1 : 0;
+    return fclose(trace_file) != 0 ? -1 : rc;
+}
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Optional trace sink writing Chrome trace-event JSON, which opens in
+ * Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Every thread appends complete ("X") events to its own buffer without
+ * locking; the buffers are written to the file by trace_close(), after the
+ * traced threads have finished. While no trace is open, recording is a
+ * single branch on trace_active. A thread records only after
+ * trace_thread(), which allocates its buffer: recording never allocates,
+ * so it is safe under the row timeout of add_period_set.
+ */
+
+/* Events per thread, allocated by trace_thread(); later events are counted
+ * as dropped. */
+#define TRACE_MAX_EVENTS_PER_THREAD (1 << 24)
+
+extern bool trace_active;
+
+/**
+ * Starts tracing into path.
+ *
+ * @param path The output file, written by trace_close().
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int trace_open(const char *path);
+
+/**
+ * Names the calling thread in the trace (the name is copied) and allocates
+ * its event buffer; spans of threads that never call it are dropped.
+ *
+ * @param name The thread name, e.g. "worker 2".
+ */
+void trace_thread(const char *name);
+
+/**
+ * Returns the trace clock (CLOCK_MONOTONIC) in nanoseconds.
+ *
+ * @return The current time.
+ */
+uint64_t trace_now(void);
+
+/**
+ * Records a span of the calling thread, or counts it as dropped if its
+ * buffer is full or missing.
+ *
+ * @param name The span name; must outlive the trace (a string literal).
+ * @param category The category; must outlive the trace.
+ * @param start_ns The start, from trace_now().
+ * @param end_ns The end, from trace_now().
+ * @param arg A value shown as args.value, e.g. the row ID (negative: none).
+ */
+void trace_span(const char *name, const char *category, uint64_t start_ns, uint64_t end_ns, int64_t arg);
+
+/**
+ * Records a wait that ended now and lasted waited_ns, as returned by
+ * queue_push() and queue_pop(). Zero waits are not recorded.
+ *
+ * @param name The span name; must outlive the trace.
+ * @param waited_ns The duration of the wait.
+ */
+void trace_wait(const char *name, uint64_t waited_ns);
+
+/**
+ * Writes all buffered events to the trace file and stops tracing.
+ * Must be called once the traced threads have finished.
+ *
+ * @return 0 on success (or if no trace is open), -1 on a write error.
+ */
+int trace_close(void);
+
+#endif /* TRACE_H */
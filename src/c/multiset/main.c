@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include "test.h"
 #include "conjectures.h"
+#include "phase_stats.h"
 
 int main(int argc, const char *argv[])
 {
@@ -35,6 +36,9 @@ int main(int argc, const char *argv[])
             CONJECTURE_DEGENERATE_TARGET_COUNT,
             dx);
 
+    if (PHASE_STATS_ENABLED)
+        phase_stats_print(stdout, phase_stats_thread(), "lambda() phases:");
+
     free(dx);
     return 0;
 }
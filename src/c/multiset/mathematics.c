@@ -1,68 +1,59 @@
 #include <stdbool.h>
 #include <time.h>
+#include "autocorr.h"
+#include "block_sketch.h"
+#include "external.h"
+#include "kernels.h"
 #include "mathematics.h"
+#include "period_stream.h"
+#include "phase_stats.h"
 
 /**
- * Finds the period length of the sequence defined by alpha, beta, gamma and delta
- * (a = alpha/beta, omega = gamma/delta.) in the interval [x_min, x_max].
- *
- * @param alpha The numerator of a.
- * @param beta The denominator of a.
- * @param gamma The numerator of omega.
- * @param delta The denominator of omega.
- * @param x_min The minimum value of x.
- * @param x_max The maximum value of x.
- * @param dx The pointer to the array that will hold the dx values.
- * @return The period length of the sequence or ARRAY_SIZE_EXCEEDED
- *         if the array size is exceeded or DX_LENGTH_TO_SMALL if too 
- *         many elements are cut from dx.
+ * lambda_enumerate() for one mode; sort is a constant at both call sites,
+ * so the compiler emits a specialized loop per mode without the mode test.
+ * With x_stop, a full dx ends the window early instead: *x_stop receives
+ * the first x not enumerated.
  */
-long lambda(number_t alpha, number_t beta, number_t gamma, number_t delta,
-            const number_t x_min, const number_t x_max, bool sort, number_t *dx)
+static inline long enumerate_window(number_t alpha, number_t beta, rational_t l, rational_t u,
+                                    const number_t x_min, const number_t x_max, const bool sort,
+                                    const bool stream, const long capacity, number_t *x_stop,
+                                    number_t *dx)
 {
-    // Shorten the fractions alpha/beta and gamma/delta obtaining smaller figures.
-    shorten(&alpha, &beta);
-    shorten(&gamma, &delta);
-
-    const number_t alpha_delta_xmin = alpha * delta * x_min;
-    const number_t beta_delta = beta * delta;
-    rational_t l = rational_create(alpha_delta_xmin - alpha * gamma, beta_delta);
-    rational_t u = rational_create(alpha_delta_xmin + beta * gamma, beta_delta);
     const rational_t to_add = rational_create(alpha, beta);
-
-    // Calculate the initial dx values, i.e. the projected x values.
     number_t x = x_min;
     long int index_dx = 0;
     number_t beta_x = beta * x;
-    bool is_not_first = false;
-    
+
     while (x < x_max)
     {
         const number_t y_ceil_l = rational_ceil(l);
         const number_t y_floor_u = rational_floor(u);
         const number_t elements_to_add = y_floor_u - y_ceil_l + 1;
-        if (index_dx + elements_to_add >= MAX_PERIOD_ARRAY_SIZE)
+        if (index_dx + elements_to_add >= capacity)
         {
-            return ARRAY_SIZE_EXCEEDED;
+            if (x_stop == NULL)
+                return ARRAY_SIZE_EXCEEDED;
+            *x_stop = x;
+            return index_dx;
         }
 
-        number_t current_dx = beta_x + alpha * y_ceil_l;
-
-        for (int i = 0; i < elements_to_add; i++)
+        const number_t current_dx = beta_x + alpha * y_ceil_l;
+        if (sort)
         {
-            if (!sort) {
-                if (is_not_first)
-                {
-                    dx[index_dx - 1] -= current_dx;
-                }
-                else
-                {
-                    is_not_first = true;
-                }
-
+            kernel_fill(dx + index_dx, current_dx, alpha, elements_to_add, stream);
+            index_dx += elements_to_add;
+        }
+        else if (elements_to_add > 0)
+        {
+            // Inside a progression every difference is -alpha; only the last
+            // value of the previous progression needs the first of this one.
+            if (index_dx > 0)
+            {
+                dx[index_dx - 1] -= current_dx;
             }
-            dx[index_dx++] = current_dx;
-            current_dx += alpha;
+            kernel_fill(dx + index_dx, -alpha, 0, elements_to_add - 1, stream);
+            index_dx += elements_to_add;
+            dx[index_dx - 1] = current_dx + alpha * (elements_to_add - 1);
         }
 
         beta_x += beta;
@@ -71,30 +62,237 @@ long lambda(number_t alpha, number_t beta, number_t gamma, number_t delta,
         x++;
     }
 
-    if (sort) {
-        // Sort the dx values.
-        sort_range(dx, 0, index_dx - 1);
+    return index_dx;
+}
 
-        // compute the difference between the dx values
-        // and store them in dx.
-        for (size_t i = 1; i < index_dx; i++)
+/**
+ * Enumerates the projected values of the points in [x_min, x_max) of the
+ * cut-and-project set defined by alpha, beta, gamma and delta into dx.
+ * Without sort, consecutive values are replaced by their differences on
+ * the fly, which yields the gaps directly. The progressions are written by
+ * kernel_fill(), with non-temporal stores when the expected values exceed
+ * the last-level cache.
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param x_min The minimum value of x.
+ * @param x_max The maximum value of x.
+ * @param sort Whether the values are sorted (and differenced) afterwards.
+ * @param dx The pointer to the array that will hold the dx values.
+ * @return The number of values written or ARRAY_SIZE_EXCEEDED.
+ */
+long lambda_enumerate(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                      const number_t x_min, const number_t x_max, bool sort, number_t *dx)
+{
+    // Shorten the fractions alpha/beta and gamma/delta obtaining smaller figures.
+    shorten(&alpha, &beta);
+    shorten(&gamma, &delta);
+
+    const number_t alpha_delta_xmin = alpha * delta * x_min;
+    const number_t beta_delta = beta * delta;
+    const rational_t l = rational_create(alpha_delta_xmin - alpha * gamma, beta_delta);
+    const rational_t u = rational_create(alpha_delta_xmin + beta * gamma, beta_delta);
+
+    // The projected density (alpha + beta) * gamma / (beta * delta) times the window.
+    const double expected_bytes = (double)(x_max - x_min) * (double)((alpha + beta) * gamma)
+                                  / (double)beta_delta * (double)sizeof(number_t);
+    const bool stream = expected_bytes > (double)kernel_llc_bytes();
+
+    const long length = sort ? enumerate_window(alpha, beta, l, u, x_min, x_max, true, stream,
+                                                MAX_PERIOD_ARRAY_SIZE, NULL, dx)
+                             : enumerate_window(alpha, beta, l, u, x_min, x_max, false, stream,
+                                                MAX_PERIOD_ARRAY_SIZE, NULL, dx);
+    if (stream)
+    {
+        kernel_fence();
+    }
+    return length;
+}
+
+/**
+ * Replaces the sorted values dx[0, length) by the gaps between neighbours.
+ *
+ * @return The number of gaps, length - 1.
+ */
+static long gaps_diff(number_t *dx, long length)
+{
+    // compute the difference between the dx values
+    // and store them in dx.
+    PHASE_BEGIN(PHASE_DIFF);
+    for (size_t i = 1; i < length; i++)
+    {
+        dx[i - 1] = dx[i] - dx[i - 1];
+    }
+    length--; // now length counts the valid differences
+    PHASE_END(PHASE_DIFF, length);
+    return length;
+}
+
+/**
+ * Set-valued case: collapses multiplicities by dropping the zero gaps.
+ *
+ * @return The number of remaining gaps.
+ */
+static long gaps_compact(number_t *dx, long length)
+{
+    PHASE_BEGIN(PHASE_COMPACT);
+    long write = 0;
+    for (long read = 0; read < length; read++)
+    {
+        if (dx[read] != 0)
         {
-            dx[i - 1] = dx[i] - dx[i - 1];
+            dx[write++] = dx[read];
         }
-        index_dx--; // now index_dx counts the valid differences
     }
+    PHASE_END(PHASE_COMPACT, length);
+    return write;
+}
+
+/**
+ * Replaces the sorted projected values dx[0, length) by the gaps between
+ * neighbours.
+ *
+ * @param dx The sorted values; overwritten with the gaps.
+ * @param length The number of values.
+ * @return The number of gaps.
+ */
+long lambda_gaps(number_t *dx, long length)
+{
+    length = gaps_diff(dx, length);
+    return length;
+}
+
+/* The expected period of the row lambda_search() works on (0: unknown),
+ * for lambda_trim_method(). */
+static _Thread_local long expected_period = 0;
+
+/**
+ * Cost model of the period search on length sorted gaps. The trim loop
+ * tries every period at every step, which is cheapest for short
+ * sequences. From SKETCH_MIN_GAPS gaps on, the block sketch costs a few
+ * passes over the gaps. It only misses periods so close to half the
+ * gaps that the central blocks do not recur, and there the FFT
+ * autocorrelation (O(n log n), 40 bytes per transform slot) takes over,
+ * up to AUTOCORR_MAX_GAPS gaps. Whatever the choice, lambda_trim() runs
+ * the exact loop when no candidate verifies; a verified candidate is
+ * exact only under the condition given at lambda_trim().
+ *
+ * @param length The number of gaps.
+ * @param period The expected period (0: unknown).
+ * @return The method.
+ */
+trim_method_t lambda_trim_method(long length, long period)
+{
+    if (SKETCH_MIN_GAPS <= 0 || length < SKETCH_MIN_GAPS)
+        return TRIM_LOOP;
+    const long pattern = SKETCH_PATTERN_BLOCKS * SKETCH_BLOCK;
+    if (period > 0 && period > length / 2 - pattern && length <= AUTOCORR_MAX_GAPS)
+        return TRIM_AUTOCORR;
+    return TRIM_SKETCH;
+}
+
+/* lambda_trim() by the candidates of a sketch or autocorrelation method;
+ * SKETCH_NO_MEMORY (== AUTOCORR_NO_MEMORY) if it cannot run. */
+static long candidate_trim(trim_method_t method, const number_t *dx, long length, long to_delete)
+{
+    if (method == TRIM_AUTOCORR)
+        return autocorr_period(dx, length, to_delete, FRACTION_OF_REMAINING_ELEMENTS);
+    return sketch_period(dx, length, to_delete, FRACTION_OF_REMAINING_ELEMENTS);
+}
 
+/**
+ * Returns the size of the buffer lambda_use_trim_buffer() needs for the
+ * candidate methods of lambda_trim() on up to length gaps (0 if they never
+ * run).
+ *
+ * @param length The most gaps, e.g. MAX_PERIOD_ARRAY_SIZE.
+ * @return The size in bytes.
+ */
+size_t lambda_trim_buffer_bytes(long length)
+{
+    if (SKETCH_MIN_GAPS <= 0 || length < SKETCH_MIN_GAPS)
+        return 0;
+    return sketch_buffer_bytes(length) + autocorr_buffer_bytes(MIN(length, AUTOCORR_MAX_GAPS));
+}
+
+/**
+ * Lends lambda_trim() on the calling thread the memory of its candidate
+ * methods, so that a search a row timeout may leave with siglongjmp()
+ * never allocates. Until lambda_release_trim_buffers() longer gaps go to
+ * the exact loop.
+ *
+ * @param buffer lambda_trim_buffer_bytes(length) bytes, 16-byte aligned.
+ * @param length The most gaps it is sized for.
+ */
+void lambda_use_trim_buffer(void *buffer, long length)
+{
+    // The sketch first, then the transform of the autocorrelation.
+    const size_t sketch = lambda_trim_buffer_bytes(length) > 0 ? sketch_buffer_bytes(length) : 0;
+    sketch_use_buffer(buffer, sketch);
+    autocorr_use_buffer(buffer != NULL ? (char *)buffer + sketch : NULL,
+                        lambda_trim_buffer_bytes(length) - sketch);
+}
+
+/**
+ * Frees the candidate memory of lambda_trim() on the calling thread and
+ * forgets a lent buffer; the exit hook of a thread that ran lambda().
+ */
+void lambda_release_trim_buffers(void)
+{
+    sketch_release();
+    autocorr_release();
+}
+
+/**
+ * Searches the period of the gaps dx[0, length). The window is shrunk from
+ * both ends, one gap per side and step, until a period is found or less
+ * than FRACTION_OF_REMAINING_ELEMENTS of the window remains. Long sorted
+ * sequences check candidates first (lambda_trim_method()): those of a
+ * block sketch or of the FFT autocorrelation, and if none holds those of
+ * the other one; if neither verifies a candidate the exact loop decides.
+ * A verified candidate is reduced to the minimal period of its step, and
+ * the small lags are always checked, but the result is exact only if the
+ * minimal period of the first step with a period (or a multiple of it
+ * holding at that step) is among the candidates.
+ *
+ * @param dx The gaps.
+ * @param length The number of gaps.
+ * @param sort Whether the gaps come from sorted values (a wider margin is cut).
+ * @return The period length or NO_PERIOD / DX_LENGTH_TO_SMALL.
+ */
+long lambda_trim(const number_t *dx, long length, bool sort)
+{
     long to_delete;
     
     if (sort) {
-        to_delete = (1.0 - FRACTION_OF_REMAINING_ELEMENTS) / 40.0 * index_dx;
+        to_delete = (1.0 - FRACTION_OF_REMAINING_ELEMENTS) / 40.0 * length;
     } else {
         to_delete = 1;
     }
 
     // Find the period length.
+    PHASE_BEGIN(PHASE_TRIM);
+    const trim_method_t method = sort ? lambda_trim_method(length, expected_period) : TRIM_LOOP;
+    if (method != TRIM_LOOP)
+    {
+        long period = candidate_trim(method, dx, length, to_delete);
+        // The other generator gets a chance if it fits; above
+        // AUTOCORR_MAX_GAPS a sketch miss goes straight to the exact loop.
+        const trim_method_t other = method == TRIM_SKETCH ? TRIM_AUTOCORR : TRIM_SKETCH;
+        if (period <= 0 && (other == TRIM_SKETCH || length <= AUTOCORR_MAX_GAPS))
+            period = candidate_trim(other, dx, length, to_delete);
+        // Only a verified candidate is final: a miss, or no memory for the
+        // candidates, leaves the answer to the exact loop below.
+        if (period > 0)
+        {
+            PHASE_END(PHASE_TRIM, 1);
+            return period;
+        }
+    }
     long index_start = to_delete;
-    long index_end = index_dx - to_delete;
+    long index_end = length - to_delete;
     const long initial_dx_length = index_end - index_start + 1;
     long current_dx_length = initial_dx_length;
     long period_length = NO_PERIOD;
@@ -112,10 +310,697 @@ long lambda(number_t alpha, number_t beta, number_t gamma, number_t delta,
             break;
         period_length = find_period_length(index_start, index_end, dx);
     }
+    PHASE_END(PHASE_TRIM, index_start - to_delete); // one find_period_length() call per step
 
     return period_length;
 }
 
+/**
+ * Runs the stages of lambda() and reports the number of enumerated values
+ * and of the gaps it leaves in dx (those of the last period searched).
+ * With period_set (sorted case only) both periods are taken from the one
+ * sorted enumeration: the multiset period is returned, then the zero gaps
+ * are dropped and the set period is stored in *period_set.
+ */
+static long lambda_counted(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                           const number_t x_min, const number_t x_max, bool sort, number_t *dx,
+                           long *values, long *gaps, long *period_set)
+{
+    *gaps = 0;
+    PHASE_BEGIN(PHASE_ENUMERATE);
+    long length = lambda_enumerate(alpha, beta, gamma, delta, x_min, x_max, sort, dx);
+    if (length == ARRAY_SIZE_EXCEEDED)
+    {
+        if (period_set != NULL)
+            *period_set = ARRAY_SIZE_EXCEEDED;
+        return ARRAY_SIZE_EXCEEDED;
+    }
+    *values = length;
+    PHASE_END(PHASE_ENUMERATE, length);
+
+    if (sort) {
+        // Sort the dx values.
+        PHASE_BEGIN(PHASE_SORT);
+        sort_range(dx, 0, length - 1);
+        PHASE_END(PHASE_SORT, length);
+        if (period_set != NULL)
+        {
+            length = gaps_diff(dx, length);
+            const long period_multiset = lambda_trim(dx, length, sort);
+            *gaps = gaps_compact(dx, length);
+            *period_set = lambda_trim(dx, *gaps, sort);
+            return period_multiset;
+        }
+        length = lambda_gaps(dx, length);
+    }
+
+    *gaps = length;
+    return lambda_trim(dx, length, sort);
+}
+
+/**
+ * Finds the period length of the sequence defined by alpha, beta, gamma and delta
+ * (a = alpha/beta, omega = gamma/delta.) in the interval [x_min, x_max].
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param x_min The minimum value of x.
+ * @param x_max The maximum value of x.
+ * @param dx The pointer to the array that will hold the dx values.
+ * @return The period length of the sequence or ARRAY_SIZE_EXCEEDED
+ *         if the array size is exceeded or DX_LENGTH_TO_SMALL if too 
+ *         many elements are cut from dx.
+ */
+long lambda(number_t alpha, number_t beta, number_t gamma, number_t delta,
+            const number_t x_min, const number_t x_max, bool sort, number_t *dx)
+{
+    long values = 0, gaps = 0;
+    return lambda_counted(alpha, beta, gamma, delta, x_min, x_max, sort, dx, &values, &gaps, NULL);
+}
+
+/**
+ * Finds the multiset and the set period length of the sequence defined by
+ * alpha, beta, gamma and delta in [x_min, x_max] from a single enumeration
+ * and sort: the multiset period is taken from all gaps, the set period from
+ * the gaps without zeros. Both engines compute the same pair, so one run
+ * yields both period columns of the six-column CSV.
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param x_min The minimum value of x.
+ * @param x_max The maximum value of x.
+ * @param dx The pointer to the array that will hold the dx values.
+ * @param period_set Receives the set period length or an error code.
+ * @return The multiset period length or an error code as for lambda().
+ */
+long lambda_periods(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                    const number_t x_min, const number_t x_max, number_t *dx, long *period_set)
+{
+    long values = 0, gaps = 0;
+    return lambda_counted(alpha, beta, gamma, delta, x_min, x_max, true, dx, &values, &gaps, period_set);
+}
+
+/* A case of lambda_batch() is counted instead of sorted if its values
+ * span at most BATCH_RANGE_FACTOR slots per value plus BATCH_RANGE_SLACK. */
+#define BATCH_RANGE_FACTOR 8
+#define BATCH_RANGE_SLACK 4096
+
+/**
+ * The lanes of lambda_batch(), structure of arrays so that the per-x step
+ * of all lanes compiles to vector instructions. With the common denominator
+ * bd = beta * delta the strip bounds are l = lq + lr / bd and u = uq + ur /
+ * bd (0 <= lr, ur < bd); both advance per x by alpha / beta = sq + sr / bd,
+ * which needs neither gcd() nor a division. Unused lanes have no steps.
+ */
+typedef struct
+{
+    number_t lq[LAMBDA_LANES], lr[LAMBDA_LANES];
+    number_t uq[LAMBDA_LANES], ur[LAMBDA_LANES];
+    number_t sq[LAMBDA_LANES], sr[LAMBDA_LANES], bd[LAMBDA_LANES];
+    number_t alpha[LAMBDA_LANES], beta[LAMBDA_LANES], beta_x[LAMBDA_LANES];
+    number_t steps[LAMBDA_LANES];      // x_max - x_min
+    number_t v_min[LAMBDA_LANES];      // smallest projected value
+    number_t range[LAMBDA_LANES];      // v_max - v_min + 1
+    number_t first[LAMBDA_LANES];      // per step: first value - v_min
+    number_t count[LAMBDA_LANES];      // per step: values
+    number_t *values[LAMBDA_LANES];    // region of dx for the sorted values
+    uint32_t *counts[LAMBDA_LANES];    // region of dx for the histogram
+    long index[LAMBDA_LANES];          // of the case
+    int lanes;
+    long slots;                        // of dx used by the lanes
+} batch_t;
+
+/**
+ * Adds a case as the next lane if it can be counted and its regions fit
+ * into dx behind the lanes before it.
+ *
+ * @return 1 if added, 0 if dx is full, -1 if the case must run through lambda().
+ */
+static int batch_add(batch_t *b, const lambda_case_t *c, long index, number_t *dx)
+{
+    number_t alpha = c->alpha, beta = c->beta, gamma = c->gamma, delta = c->delta;
+    if (alpha <= 0 || beta <= 0 || gamma <= 0 || delta <= 0 || c->x_max <= c->x_min)
+        return -1;
+    shorten(&alpha, &beta);
+    shorten(&gamma, &delta);
+
+    // Keep every product below 2^53 so the bounds need no overflow checks.
+    const double bd = (double)beta * (double)delta;
+    const double x_abs = (double)MAX(c->x_max, -c->x_min);
+    if (bd > 1e9 || (double)alpha * (double)delta * x_abs + (double)beta * (double)gamma > 9e15)
+        return -1;
+
+    const number_t steps = c->x_max - c->x_min;
+    const number_t per_x = ((alpha + beta) * gamma) / (beta * delta) + 1;
+    const double values_max = (double)steps * (double)per_x;
+    const number_t l_num = alpha * delta * c->x_min - alpha * gamma;
+    const number_t u_num = alpha * delta * (c->x_max - 1) + beta * gamma;
+    const number_t v_min = beta * c->x_min + alpha * rational_ceil((rational_t){l_num, beta * delta});
+    const number_t v_max = beta * (c->x_max - 1) + alpha * rational_floor((rational_t){u_num, beta * delta});
+    const double range = (double)(v_max - v_min) + 1.0;
+    if (values_max < 2 || range < 1 || range > BATCH_RANGE_FACTOR * values_max + BATCH_RANGE_SLACK)
+        return -1;
+
+    const long slots = (long)values_max + 2 + (long)(range + 1) / 2;
+    if (b->slots + slots >= MAX_PERIOD_ARRAY_SIZE)
+        return b->lanes == 0 ? -1 : 0;
+
+    const int k = b->lanes++;
+    const number_t lb = beta * delta;
+    b->bd[k] = lb;
+    b->lq[k] = rational_floor((rational_t){l_num, lb});
+    b->lr[k] = l_num - b->lq[k] * lb;
+    const number_t u0 = alpha * delta * c->x_min + beta * gamma;
+    b->uq[k] = rational_floor((rational_t){u0, lb});
+    b->ur[k] = u0 - b->uq[k] * lb;
+    b->sq[k] = (alpha * delta) / lb;
+    b->sr[k] = (alpha * delta) % lb;
+    b->alpha[k] = alpha;
+    b->beta[k] = beta;
+    b->beta_x[k] = beta * c->x_min;
+    b->steps[k] = steps;
+    b->v_min[k] = v_min;
+    b->range[k] = v_max - v_min + 1;
+    b->values[k] = dx + b->slots;
+    b->counts[k] = (uint32_t *)(dx + b->slots + (long)values_max + 2);
+    b->index[k] = index;
+    b->slots += slots;
+    return 1;
+}
+
+/**
+ * Runs the lanes of a batch: all strips advance in lockstep, every value is
+ * counted in the histogram of its lane, and a scan of the histogram yields
+ * the sorted values that lambda() would get from sort_range().
+ *
+ * @return The number of lanes with less than two values, whose period is
+ *         left 0 for lambda() to decide.
+ */
+static int batch_run(batch_t *b, lambda_case_t *cases)
+{
+    number_t steps_max = 0;
+    for (int k = 0; k < b->lanes; k++)
+    {
+        memset(b->counts[k], 0, (size_t)b->range[k] * sizeof(uint32_t));
+        steps_max = MAX(steps_max, b->steps[k]);
+    }
+
+    for (number_t step = 0; step < steps_max; step++)
+    {
+        // Lanes past the end of their window get no values (masked).
+        for (int k = 0; k < LAMBDA_LANES; k++)
+        {
+            const number_t ceil_l = b->lq[k] + (b->lr[k] != 0);
+            const number_t n = b->uq[k] - ceil_l + 1;
+            b->count[k] = step < b->steps[k] && n > 0 ? n : 0;
+            b->first[k] = b->beta_x[k] + b->alpha[k] * ceil_l - b->v_min[k];
+            b->beta_x[k] += b->beta[k];
+
+            b->lr[k] += b->sr[k];
+            const number_t l_carry = b->lr[k] >= b->bd[k];
+            b->lr[k] -= l_carry * b->bd[k];
+            b->lq[k] += b->sq[k] + l_carry;
+            b->ur[k] += b->sr[k];
+            const number_t u_carry = b->ur[k] >= b->bd[k];
+            b->ur[k] -= u_carry * b->bd[k];
+            b->uq[k] += b->sq[k] + u_carry;
+        }
+        for (int k = 0; k < b->lanes; k++)
+        {
+            uint32_t *counts = b->counts[k] + b->first[k];
+            for (number_t i = 0; i < b->count[k]; i++)
+                counts[i * b->alpha[k]]++;
+        }
+    }
+
+    int short_lanes = 0;
+    for (int k = 0; k < b->lanes; k++)
+    {
+        number_t *values = b->values[k];
+        const uint32_t *counts = b->counts[k];
+        long length = 0;
+        // Branch-free for multiplicities up to 2 (two slots of padding).
+        for (number_t offset = 0; offset < b->range[k]; offset++)
+        {
+            const number_t value = b->v_min[k] + offset;
+            const uint32_t n = counts[offset];
+            values[length] = value;
+            values[length + 1] = value;
+            for (uint32_t i = 2; i < n; i++)
+                values[length + i] = value;
+            length += n;
+        }
+
+        lambda_case_t *c = &cases[b->index[k]];
+        if (length < 2)
+        {
+            c->period = 0;
+            short_lanes++;
+            continue;
+        }
+        c->period = lambda_trim(values, lambda_gaps(values, length), true);
+    }
+    return short_lanes;
+}
+
+/**
+ * Computes lambda(alpha, beta, gamma, delta, x_min, x_max, true, dx) for a
+ * batch of cases. Small cases run LAMBDA_LANES at a time: their strips are
+ * stepped in lockstep without rational arithmetic, and their values are
+ * counted in a histogram over the value range instead of sorted, which
+ * removes the per-call overhead, gcd() per x and sort_range() that dominate tiny
+ * rows. Cases with a sparse value range (or too large for dx) run through
+ * lambda() itself. The results equal those of lambda() case by case.
+ *
+ * @param cases The cases; period receives the result of each.
+ * @param count The number of cases.
+ * @param dx The work array, as for lambda().
+ */
+void lambda_batch(lambda_case_t *cases, long count, number_t *dx)
+{
+    long i = 0;
+    while (i < count)
+    {
+        batch_t b;
+        memset(&b, 0, sizeof(b));
+        for (int k = 0; k < LAMBDA_LANES; k++)
+            b.bd[k] = 1;
+
+        // Cases that cannot be counted run on their own, before the lanes
+        // use dx.
+        while (i < count && b.lanes < LAMBDA_LANES)
+        {
+            lambda_case_t *c = &cases[i];
+            const int added = batch_add(&b, c, i, dx);
+            if (added == 0)
+                break;
+            if (added < 0)
+                c->period = lambda(c->alpha, c->beta, c->gamma, c->delta, c->x_min, c->x_max, true, dx);
+            i++;
+        }
+
+        if (b.lanes > 0 && batch_run(&b, cases) > 0)
+        {
+            for (int k = 0; k < b.lanes; k++)
+            {
+                lambda_case_t *c = &cases[b.index[k]];
+                if (c->period == 0)
+                    c->period = lambda(c->alpha, c->beta, c->gamma, c->delta, c->x_min, c->x_max, true, dx);
+            }
+        }
+    }
+}
+
+/**
+ * Enumerates [x_min, x_max) in chunks of x that fill at most capacity
+ * slots of dx, and appends each chunk sorted as a run.
+ *
+ * @return 0, ARRAY_SIZE_EXCEEDED if a single x has more values than dx
+ *         holds, or EXT_IO_ERROR.
+ */
+static long external_runs(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                          const number_t x_min, const number_t x_max, long capacity, number_t *dx,
+                          ext_runs_t *runs, long *values)
+{
+    shorten(&alpha, &beta);
+    shorten(&gamma, &delta);
+    const number_t beta_delta = beta * delta;
+
+    number_t x = x_min;
+    while (x < x_max)
+    {
+        PHASE_BEGIN(PHASE_ENUMERATE);
+        const rational_t l = rational_create(alpha * delta * x - alpha * gamma, beta_delta);
+        const rational_t u = rational_create(alpha * delta * x + beta * gamma, beta_delta);
+        number_t x_stop = x_max;
+        const long length = enumerate_window(alpha, beta, l, u, x, x_max, true, true, capacity, &x_stop, dx);
+        kernel_fence();
+        PHASE_END(PHASE_ENUMERATE, length);
+        if (x_stop == x)
+            return ARRAY_SIZE_EXCEEDED;
+
+        PHASE_BEGIN(PHASE_SORT);
+        sort_range(dx, 0, length - 1);
+        PHASE_END(PHASE_SORT, length);
+        if (ext_runs_add(runs, dx, length) != 0)
+            return EXT_IO_ERROR;
+        *values += length;
+        x = x_stop;
+    }
+    return 0;
+}
+
+/* Share of dx lent to the online period detectors during the merge. */
+#define DETECTOR_SHARE 8
+
+/**
+ * The gap files written while the runs are merged: the engine's gaps
+ * (lambda_gaps()), or with period_set the multiset and the set gaps. Each
+ * gap also goes through an online period detector whose result is the
+ * hint of ext_period().
+ */
+typedef struct
+{
+    ext_file_t *gaps;
+    ext_file_t *gaps_set;   // NULL without period_set
+    bool started;
+    number_t last;          // last value of the previous block
+    period_stream_t detector[2];   // of gaps and gaps_set
+} gap_stream_t;
+
+static int append_gaps(ext_file_t *file, period_stream_t *detector, const number_t *gaps, long count)
+{
+    if (detector->max_period > 0)   // initialized
+        for (long i = 0; i < count; i++)
+            period_stream_feed(detector, gaps[i]);
+    return ext_file_append(file, gaps, count);
+}
+
+static int emit_gaps(void *arg, int64_t *block, size_t count)
+{
+    gap_stream_t *s = arg;
+    number_t *values = block;
+    long length = (long)count;
+    const number_t last = block[count - 1];
+    if (s->started)
+    {
+        // The gap between two blocks.
+        values--;
+        values[0] = s->last;
+        length++;
+    }
+    s->started = true;
+    s->last = last;
+
+    if (s->gaps_set == NULL)
+        return append_gaps(s->gaps, &s->detector[0], values, lambda_gaps(values, length));
+    length = gaps_diff(values, length);
+    if (append_gaps(s->gaps, &s->detector[0], values, length) != 0)
+        return -1;
+    return append_gaps(s->gaps_set, &s->detector[1], values, gaps_compact(values, length));
+}
+
+/**
+ * lambda_trim() with sort for gaps on disk: in dx if they fit, otherwise
+ * by ext_period() with the detector's period as a hint.
+ */
+static long external_trim(const ext_file_t *gaps, const period_stream_t *detector, long capacity, number_t *dx)
+{
+    const long length = (long)gaps->length;
+    if (length <= capacity)
+    {
+        if (length > 0 && ext_file_read(gaps, 0, dx, length) != 0)
+            return ARRAY_SIZE_EXCEEDED;
+        return lambda_trim(dx, length, true);
+    }
+    const long to_delete = (1.0 - FRACTION_OF_REMAINING_ELEMENTS) / 40.0 * length;
+    PHASE_BEGIN(PHASE_TRIM);
+    const long hint = (long)period_stream_result(detector, NULL);
+    const long period = ext_period(gaps, to_delete, FRACTION_OF_REMAINING_ELEMENTS, hint, dx, capacity);
+    PHASE_END(PHASE_TRIM, 1);
+    return period == EXT_IO_ERROR ? ARRAY_SIZE_EXCEEDED : period;
+}
+
+/**
+ * lambda_external() reporting the number of enumerated values.
+ */
+static long external_counted(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                             const number_t x_min, const number_t x_max, const lambda_scratch_t *scratch,
+                             number_t *dx, long *values, long *period_set)
+{
+    if (period_set != NULL)
+        *period_set = ARRAY_SIZE_EXCEEDED;
+    const double expected = (double)(x_max - x_min) * (double)((alpha + beta) * gamma) / (double)(beta * delta);
+    if (scratch->dir == NULL || expected > (double)scratch->max_values)
+        return ARRAY_SIZE_EXCEEDED;
+
+    // On the stack: a row timeout may leave with siglongjmp().
+    ext_runs_t runs;
+    ext_file_t gaps = {-1, 0};
+    ext_file_t gaps_set = {-1, 0};
+    long period = ARRAY_SIZE_EXCEEDED;
+    if (ext_runs_create(&runs, scratch->dir) != 0)
+        return ARRAY_SIZE_EXCEEDED;
+    if (external_runs(alpha, beta, gamma, delta, x_min, x_max, scratch->capacity, dx, &runs, values) == 0 &&
+        ext_file_create(&gaps, scratch->dir) == 0 &&
+        (period_set == NULL || ext_file_create(&gaps_set, scratch->dir) == 0))
+    {
+        // The detectors take the end of dx, as far as the merge can spare it.
+        const int streams = period_set != NULL ? 2 : 1;
+        long spare = scratch->capacity - (long)(runs.runs + 1) * EXT_MIN_SHARE
+                     - (long)runs.runs * EXT_MERGE_STATE_VALUES;
+        if (spare > scratch->capacity / DETECTOR_SHARE)
+            spare = scratch->capacity / DETECTOR_SHARE;
+        const long lent = spare > 0 ? spare / streams : 0;
+        const long merge_capacity = scratch->capacity - streams * lent;
+        gap_stream_t stream = {.gaps = &gaps, .gaps_set = period_set != NULL ? &gaps_set : NULL};
+        for (int i = 0; i < streams; i++)
+            period_stream_init(&stream.detector[i], dx + merge_capacity + i * lent, lent, 4);
+        const int merged = ext_runs_merge(&runs, dx, merge_capacity, emit_gaps, &stream);
+        // Free the disk space of the runs before the period search.
+        ext_runs_close(&runs);
+        if (merged == 0)
+        {
+            period = external_trim(&gaps, &stream.detector[0], scratch->capacity, dx);
+            if (period_set != NULL)
+                *period_set = external_trim(&gaps_set, &stream.detector[1], scratch->capacity, dx);
+        }
+    }
+    ext_runs_close(&runs);
+    ext_file_close(&gaps);
+    ext_file_close(&gaps_set);
+    return period;
+}
+
+/**
+ * lambda() with sort (or lambda_periods() with period_set) for windows
+ * with more values than dx holds: the values are enumerated in chunks of
+ * scratch->capacity, each chunk is sorted and written as a run, the runs
+ * are merged into gap files, and the period is searched on the gaps, in
+ * dx if they fit and otherwise by a streaming pass (ext_period()). The
+ * resident memory stays at dx.
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param x_min The minimum value of x.
+ * @param x_max The maximum value of x.
+ * @param scratch The scratch directory, the value limit and the capacity of dx.
+ * @param dx The pointer to the array of scratch->capacity slots.
+ * @param period_set Receives the set period length or an error code (may be NULL).
+ * @return The period length as returned by lambda(), or ARRAY_SIZE_EXCEEDED
+ *         if the window exceeds scratch->max_values or a scratch file fails.
+ */
+long lambda_external(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                     const number_t x_min, const number_t x_max, const lambda_scratch_t *scratch,
+                     number_t *dx, long *period_set)
+{
+    long values = 0;
+    return external_counted(alpha, beta, gamma, delta, x_min, x_max, scratch, dx, &values, period_set);
+}
+
+/* The out-of-core mode of lambda_search(), off until lambda_set_scratch(). */
+static lambda_scratch_t search_scratch = {NULL, 0, MAX_PERIOD_ARRAY_SIZE};
+
+/**
+ * Enables the out-of-core mode of lambda_search(): windows that need more
+ * values than dx holds run through lambda_external(), and x_max grows
+ * until scratch->max_values. Call before the searches start.
+ *
+ * @param scratch The directory and value limit (capacity is ignored:
+ *                lambda_search() uses all MAX_PERIOD_ARRAY_SIZE slots of
+ *                dx); NULL or a NULL dir turns the mode off.
+ */
+void lambda_set_scratch(const lambda_scratch_t *scratch)
+{
+    search_scratch.dir = scratch != NULL ? scratch->dir : NULL;
+    search_scratch.max_values = scratch != NULL ? scratch->max_values : 0;
+}
+
+/**
+ * The search window of a corpus row: the first x_max of lambda_search()
+ * and, outside degenerate mode, the values the window is sized for.
+ */
+typedef struct
+{
+    number_t x_max;
+    number_t density_num;   // projected values per unit of x:
+    number_t density_den;   // (alpha + beta) * gamma / (beta * delta)
+    number_t target_points;
+    number_t buffer_cap;
+} search_window_t;
+
+static search_window_t search_window(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                                     number_t period, bool degenerate)
+{
+    search_window_t w;
+    w.density_num = (alpha + beta) * gamma;
+    w.density_den = beta * delta;
+    w.target_points = 0;
+    w.buffer_cap = 0;
+    if (degenerate)
+    {
+        const number_t omega_int = gamma / delta + 1;
+        w.x_max = MAX(1000, 25 * omega_int);
+    }
+    else
+    {
+        // Cap target_points so we never request more dx slots than the
+        // buffer can hold.
+        w.buffer_cap = (number_t)MAX_PERIOD_ARRAY_SIZE - 1024;
+        if (search_scratch.dir != NULL)
+            w.buffer_cap = MAX(w.buffer_cap, search_scratch.max_values);
+        w.target_points = MAX(200000, period * 4);
+        if (w.target_points > w.buffer_cap) w.target_points = w.buffer_cap;
+        w.x_max = (w.target_points * w.density_den) / w.density_num;
+        if (w.x_max > X_MAX) w.x_max = X_MAX;
+        if (w.x_max < 1000) w.x_max = 1000;
+    }
+    return w;
+}
+
+/**
+ * Cost model of lambda_search(): the number of values its first attempt
+ * enumerates and sorts, (x_max - X_MIN) times the projected density. Retries
+ * are not predicted. Used to weight rows for progress estimates.
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param period The expected (multiset) period.
+ * @param degenerate Whether the degenerate x_max is used.
+ * @return The predicted number of values.
+ */
+double lambda_search_cost(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                          number_t period, bool degenerate)
+{
+    const search_window_t w = search_window(alpha, beta, gamma, delta, period, degenerate);
+    if (w.density_den <= 0)
+        return 0.0;
+    return (double)(w.x_max - X_MIN) * (double)w.density_num / (double)w.density_den;
+}
+
+static bool is_retryable(long period)
+{
+    return period == DX_LENGTH_TO_SMALL || period == NO_PERIOD;
+}
+
+/**
+ * The search loop of lambda_search() and lambda_search_periods(); with
+ * period_set both periods are searched and x_max grows while either needs
+ * a wider window.
+ */
+static long search(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                   number_t period, bool degenerate, number_t *dx, lambda_search_t *stats,
+                   long *period_set)
+{
+    const search_window_t w = search_window(alpha, beta, gamma, delta, period, degenerate);
+    number_t x_max = w.x_max;
+    number_t target_points = w.target_points;
+
+    lambda_search_t local;
+    if (stats == NULL)
+        stats = &local;
+    stats->attempts = 0;
+    stats->values = 0;
+    stats->max_values = 0;
+    stats->gaps = 0;
+
+    // The multiset-based estimate may not expose a full set period in
+    // the trim window. On DX_LENGTH_TO_SMALL / NO_PERIOD, double x_max
+    // and retry until it succeeds or the buffer / X_MAX ceiling stops
+    // x_max from growing.
+    long ps;
+    expected_period = degenerate ? 0 : (long)period;
+    while (true)
+    {
+        long values = 0, gaps = 0;
+        stats->x_max = x_max;
+        // Windows sized beyond dx, or that overflow it, run on disk.
+        if (target_points <= MAX_PERIOD_ARRAY_SIZE - 1024)
+            ps = lambda_counted(alpha, beta, gamma, delta, X_MIN, x_max, true, dx, &values, &gaps, period_set);
+        else
+            ps = ARRAY_SIZE_EXCEEDED;
+        stats->gaps = gaps;   // 0 if the window ran on disk
+        if (ps == ARRAY_SIZE_EXCEEDED && search_scratch.dir != NULL)
+            ps = external_counted(alpha, beta, gamma, delta, X_MIN, x_max, &search_scratch, dx,
+                                  &values, period_set);
+        stats->attempts++;
+        stats->values += values;
+        stats->max_values = MAX(stats->max_values, values);
+
+        if (degenerate) break;
+        if (!is_retryable(ps) && (period_set == NULL || !is_retryable(*period_set))) break;
+
+        number_t new_target = target_points * 2;
+        if (new_target > w.buffer_cap) new_target = w.buffer_cap;
+        if (new_target <= target_points) break;
+
+        number_t new_x_max = (new_target * w.density_den) / w.density_num;
+        if (new_x_max > X_MAX) new_x_max = X_MAX;
+        if (new_x_max < 1000) new_x_max = 1000;
+        if (new_x_max <= x_max) break;
+
+        target_points = new_target;
+        x_max = new_x_max;
+    }
+    expected_period = 0;
+    return ps;
+}
+
+/**
+ * Finds the (sorted) period length of a corpus row, choosing x_max itself.
+ * In degenerate mode x_max = MAX(1000, 25 * (floor(omega) + 1)). Otherwise
+ * x_max is chosen so dx holds about MAX(200000, 4 * period) values, and it
+ * is doubled while the result is NO_PERIOD or DX_LENGTH_TO_SMALL until the
+ * buffer or X_MAX stops it from growing. After lambda_set_scratch() windows
+ * beyond dx run out of core and grow up to its max_values.
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param period The expected (multiset) period, used to size the window.
+ * @param degenerate Whether to use the degenerate x_max.
+ * @param dx The pointer to the array that will hold the dx values.
+ * @param stats Receives x_max, attempts and enumerated values (may be NULL).
+ * @return The period length as returned by lambda().
+ */
+long lambda_search(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                   number_t period, bool degenerate, number_t *dx, lambda_search_t *stats)
+{
+    return search(alpha, beta, gamma, delta, period, degenerate, dx, stats, NULL);
+}
+
+/**
+ * lambda_search() for both periods from one enumeration per attempt, see
+ * lambda_periods(). x_max is doubled while either period is NO_PERIOD or
+ * DX_LENGTH_TO_SMALL.
+ *
+ * @param alpha The numerator of a.
+ * @param beta The denominator of a.
+ * @param gamma The numerator of omega.
+ * @param delta The denominator of omega.
+ * @param period The expected (multiset) period, used to size the window.
+ * @param degenerate Whether to use the degenerate x_max.
+ * @param dx The pointer to the array that will hold the dx values.
+ * @param stats Receives x_max, attempts and enumerated values (may be NULL).
+ * @param period_set Receives the set period length or an error code.
+ * @return The multiset period length or an error code.
+ */
+long lambda_search_periods(number_t alpha, number_t beta, number_t gamma, number_t delta,
+                           number_t period, bool degenerate, number_t *dx, lambda_search_t *stats,
+                           long *period_set)
+{
+    return search(alpha, beta, gamma, delta, period, degenerate, dx, stats, period_set);
+}
+
 static bool random_is_initilazed = false;
 
 /**
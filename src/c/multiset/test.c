@@ -1,4 +1,6 @@
 #include "test.h"
+#include "csv_loader.h"
+#include "metrics.h"
 
 /**
  * Tests the GCD function.
@@ -126,6 +128,60 @@ void test_lambda(number_t *dx)
     assert(lambda(2, 1, 1, 1, 0, 50, false, dx) == 4);
     printf("lambda(2, 1, 69986, 35837, 0, 10000, true, dx) = %ld\n", lambda(2, 1, 69986, 35837, 0, 10000, true, dx));
     assert(lambda(2, 1, 69986, 35837, 0, 100000, true, dx) == 1);
+
+    // Both periods from one enumeration: D = 5 divides N = 10 (multiset
+    // N / D, set 1), and N = 4 < D (both N).
+    long period_set;
+    assert(lambda_periods(2, 1, 3, 1, 0, 10000, dx, &period_set) == 2 && period_set == 1);
+    assert(lambda_periods(2, 1, 1, 1, 0, 10000, dx, &period_set) == 4 && period_set == 4);
+
+    // Out of core with a dx of 64K slots: 90000 values in two runs, the
+    // gaps searched by ext_period().
+    const lambda_scratch_t scratch = {"/tmp", 1000000, 64 * 1024};
+    const long expected = lambda(2, 1, 3, 1, 0, 10000, true, dx);
+    assert(lambda_external(2, 1, 3, 1, 0, 10000, &scratch, dx, NULL) == expected);
+    assert(lambda_external(2, 1, 3, 1, 0, 10000, &scratch, dx, &period_set) == 2 && period_set == 1);
+    assert(lambda_external(2, 1, 3, 1, 0, 1000000, &scratch, dx, &period_set) == ARRAY_SIZE_EXCEEDED &&
+           period_set == ARRAY_SIZE_EXCEEDED);
+
+    // A row whose period no sketch candidate verifies: the exact trim loop
+    // decides (bench case large_n, about 17.5M gaps).
+    if (MAX_PERIOD_ARRAY_SIZE > 20000000)
+        assert(lambda(20305, 27081, 45863, 7347, 0, 1600000, true, dx) == 295803);
+
+    // Above AUTOCORR_MAX_GAPS only the sketch runs, and its miss still ends
+    // in the exact loop (test_speed() parameters, about 18.3M gaps).
+    assert(SKETCH_MIN_GAPS <= 0 || lambda_trim_method(AUTOCORR_MAX_GAPS + 1, 531930) == TRIM_SKETCH);
+    if (MAX_PERIOD_ARRAY_SIZE > 20000000)
+        assert(lambda(37033, 4687, 51, 4, 0, 160000, true, dx) == 531930);
+
+    // The same in a lent trim buffer (add_period_set), which is never grown.
+    if (MAX_PERIOD_ARRAY_SIZE > 20000000)
+    {
+        void *trim = malloc(lambda_trim_buffer_bytes(20000000));
+        assert(trim != NULL);
+        lambda_use_trim_buffer(trim, 20000000);
+        assert(lambda(37033, 4687, 51, 4, 0, 160000, true, dx) == 531930);
+        lambda_release_trim_buffers();
+        free(trim);
+    }
+
+    // lambda_batch() agrees with lambda() case by case, over several lane
+    // groups, with a case it runs through lambda() (sparse values) and one
+    // with too few values for the lanes.
+    lambda_case_t cases[2 * LAMBDA_LANES + 3];
+    const long count = sizeof(cases) / sizeof(cases[0]);
+    for (long i = 0; i < count; i++)
+        cases[i] = (lambda_case_t){1 + i % 7, 1 + i % 4, 3 + i, 1 + i % 5, i % 3, 1000 + 10 * i, 0};
+    cases[3] = (lambda_case_t){2, 1, 69986, 35837, 0, 10000, 0};
+    cases[5] = (lambda_case_t){97, 3, 1, 100, 0, 50, 0};
+    cases[7] = (lambda_case_t){1, 1, 1, 2, 0, 1, 0};
+    lambda_batch(cases, count, dx);
+    for (long i = 0; i < count; i++)
+    {
+        const lambda_case_t *c = &cases[i];
+        assert(c->period == lambda(c->alpha, c->beta, c->gamma, c->delta, c->x_min, c->x_max, true, dx));
+    }
 }
 
 /**
@@ -288,44 +344,30 @@ int test_with_test_file(const char *filename, number_t x_max, bool sort, number_
 {
     clock_t start = clock();
 
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    csv_table_t table;
+    if (csv_table_load(filename, 1, &table) != 0)
     {
         fprintf(stderr, "Tried to read: %s\n", filename);
-        perror("Failed to open file");
-        return EXIT_FAILURE;
-    }
-
-    char line[256];
-
-    // Read and skip the header
-    if (fgets(line, sizeof(line), file) == NULL)
-    {
-        perror("Error reading header");
-        fclose(file);
         return EXIT_FAILURE;
     }
+    csv_table_report_errors(&table, filename, table.error_count);
 
-    int o_n, o_d, a_n, a_d;
-    long expected_period_length;
-    int counter = 0;
-
-    // Read each line and extract integers
-    while (fgets(line, sizeof(line), file))
+    for (size_t i = 0; i < table.rows; i++)
     {
-        if (sscanf(line, "%d,%d,%d,%d,%ld", &o_n, &o_d, &a_n, &a_d, &expected_period_length) == 5)
-        {
-            long computed_lambda = lambda(a_n, a_d, o_n, o_d, -10, x_max, sort, dx);
-            printf("Read: %d -- %d, %d, %d, %d, %ld = %ld (computed)?\n", ++counter, o_n, o_d, a_n, a_d, expected_period_length, computed_lambda);
-            assert(expected_period_length == computed_lambda);
-        }
-        else
-        {
-            fprintf(stderr, "Malformed line: %s\n", line);
-        }
+        const number_t o_n = table.column[CSV_O_N][i];
+        const number_t o_d = table.column[CSV_O_D][i];
+        const number_t a_n = table.column[CSV_A_N][i];
+        const number_t a_d = table.column[CSV_A_D][i];
+        const long expected_period_length = (long)table.column[CSV_PERIOD][i];
+
+        long computed_lambda = lambda(a_n, a_d, o_n, o_d, -10, x_max, sort, dx);
+        printf("Read: %zu -- %lld, %lld, %lld, %lld, %ld = %ld (computed)?\n", i + 1,
+               (long long)o_n, (long long)o_d, (long long)a_n, (long long)a_d,
+               expected_period_length, computed_lambda);
+        assert(expected_period_length == computed_lambda);
     }
 
-    fclose(file);
+    csv_table_free(&table);
     clock_t end = clock();
     double elapsed_time = (double)(end - start) / CLOCKS_PER_SEC;
     printf("Execution time: %f seconds\n", elapsed_time);
@@ -358,6 +400,17 @@ void create_test_data(const char *filename, const int number_of_tests, number_t
     int written = 0;
     clock_t total_start = clock();
 
+    metrics_t metrics;
+    metrics_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.rows_total = (uint64_t)number_of_tests;
+    sample.buffer_bytes = (uint64_t)MAX_PERIOD_ARRAY_SIZE * sizeof(number_t);
+    if (metrics_open(&metrics, METRICS_FILE, ENGINE_NAME, filename, METRICS_INTERVAL_SEC) != 0)
+    {
+        fclose(file);
+        return;
+    }
+
     for (int i = 0; written < number_of_tests; i++)
     {
         if (i % 100 == 0)
@@ -393,14 +446,23 @@ void create_test_data(const char *filename, const int number_of_tests, number_t
 
         const long period_length = lambda(a.numerator, a.denominator, o.numerator, o.denominator, 0, X_MAX, true, dx);
 
+        // Values enumerated over [0, X_MAX], see lambda_search_cost().
+        sample.points += (uint64_t)((double)X_MAX * (double)((a.numerator + a.denominator) * o.numerator)
+                                    / (double)(a.denominator * o.denominator));
         if (is_legal_period_length(period_length))
         {
             fprintf(file, "%lld,%lld,%lld,%lld,%ld\n", o.numerator, o.denominator, a.numerator, a.denominator, period_length);
             written++;
         }
+        else
+            metrics_count_failure(&sample, period_length);
+        sample.rows_done = (uint64_t)written;
+        metrics_update(&metrics, &sample, false);
     }
 
     fclose(file);
+    metrics_update(&metrics, &sample, true);
+    metrics_close(&metrics);
     double total_elapsed = (double)(clock() - total_start) / CLOCKS_PER_SEC;
     printf("Data to find patterns written to %s (%d lines) [total: %.2f s]\n", filename, written, total_elapsed);
 }
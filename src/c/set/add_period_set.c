@@ -1,19 +1,48 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <setjmp.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "mathematics.h"
+#include "csv_loader.h"
+#include "result_file.h"
+#include "journal.h"
+#include "queue.h"
+#include "phase_stats.h"
+#include "trace.h"
+#include "metrics.h"
+#include "numa.h"
+#include "external.h"
+#include "signature.h"
+#include "cutproject.h"
 
 #define TIMEOUT_RESULT (-4)
 
-static sigjmp_buf timeout_jmp;
-static volatile sig_atomic_t timeout_active = 0;
+/* Capacity of the task and result queues between the pipeline stages. */
+#define QUEUE_CAPACITY 4096
+
+/* Marks the end of the row stream in both queues. */
+#define END_OF_ROWS UINT64_MAX
+
+/* Per-thread state of the row timeout, see on_alrm() and watchdog(). */
+static _Thread_local sigjmp_buf timeout_jmp;
+static _Thread_local volatile sig_atomic_t timeout_active = 0;
+static _Thread_local volatile sig_atomic_t timeout_signals = 0;
+
+/* Statistics of the current row; static storage keeps them valid across the
+ * siglongjmp() of a timeout. */
+static _Thread_local lambda_search_t row_search;
 
 static void on_alrm(int sig)
 {
     (void)sig;
+    timeout_signals++;
     if (timeout_active)
     {
         timeout_active = 0;
@@ -21,17 +50,821 @@ static void on_alrm(int sig)
     }
 }
 
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Columns behind the six data columns: the rung of the escalation ladder
+ * that found the period (--escalate, see rung_t), then the per-row
+ * telemetry (--telemetry): x_max of the last attempt, retries, projected
+ * values over all attempts, wall time and the dx bytes of the largest
+ * attempt. For a timed-out row they cover the attempts completed before
+ * the timeout.
+ */
+enum
+{
+    OUT_ENGINE = CSV_MAX_COLUMNS,
+    OUT_X_MAX,
+    OUT_RETRIES,
+    OUT_VALUES,
+    OUT_WALL_NS,
+    OUT_PEAK_DX_BYTES,
+    OUT_MAX_COLUMNS
+};
+#define ESCALATE_HEADER ",engine"
+#define TELEMETRY_HEADER ",x_max,retries,values,wall_ns,peak_dx_bytes"
+
+/**
+ * The output of a run: the six-column CSV, or the binary columnar format
+ * if the output path ends in RESULT_FILE_EXTENSION; both carry the
+ * selected columns behind the six (extra).
+ */
+typedef struct
+{
+    bool binary;
+    int columns;
+    int extra[OUT_MAX_COLUMNS - CSV_MAX_COLUMNS];  // row index of each column behind the six
+    FILE *csv;
+    result_writer_t writer;
+    uint64_t rows;
+} output_t;
+
+/* Stdio buffer of the CSV output; rows reach the file in large writes. */
+#define OUTPUT_BUFFER_BYTES (1 << 20)
+
+/**
+ * Returns whether the first line of the CSV file at path is header, so a
+ * run does not append rows of another schema.
+ */
+static bool csv_header_matches(const char *path, const char *header)
+{
+    char line[1024];
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    const bool read = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    line[strcspn(line, "\r\n")] = '\0';
+    return read && strcmp(line, header) == 0;
+}
+
+/**
+ * Opens the output for writing (append == false, writes the header) or for
+ * appending behind the rows of a previous run. When appending, the output
+ * is first cut back to the checkpoint: durable_end is a byte offset for
+ * CSV and a row count for the binary format.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int output_open(output_t *out, const char *path, const char *input_header, size_t input_header_length,
+                       bool escalate, bool telemetry, bool append, uint64_t durable_end, uint64_t durable_rows)
+{
+    char header[1024];
+    snprintf(header, sizeof(header), "%.*s,period_set%s%s", (int)input_header_length, input_header,
+             escalate ? ESCALATE_HEADER : "", telemetry ? TELEMETRY_HEADER : "");
+
+    out->rows = append ? durable_rows : 0;
+    out->columns = CSV_MAX_COLUMNS;
+    if (escalate)
+        out->extra[out->columns++ - CSV_MAX_COLUMNS] = OUT_ENGINE;
+    for (int c = OUT_X_MAX; telemetry && c < OUT_MAX_COLUMNS; c++)
+        out->extra[out->columns++ - CSV_MAX_COLUMNS] = c;
+    out->binary = result_file_is_binary(path);
+    if (out->binary)
+    {
+        if (result_writer_open(&out->writer, path, out->columns, header, append) != 0)
+            return -1;
+        return append ? result_writer_truncate(&out->writer, durable_end) : 0;
+    }
+
+    if (append && !csv_header_matches(path, header))
+    {
+        fprintf(stderr, "Error: '%s' has another header than '%s' (run with other --escalate / --telemetry?)\n",
+                path, header);
+        return -1;
+    }
+    if (append && truncate(path, (off_t)durable_end) != 0)
+        return -1;
+    out->csv = fopen(path, append ? "a" : "w");
+    if (!out->csv)
+        return -1;
+    setvbuf(out->csv, NULL, _IOFBF, OUTPUT_BUFFER_BYTES);
+    if (!append)
+        fprintf(out->csv, "%s\n", header);
+    return 0;
+}
+
+/**
+ * Returns the end of the written output, in the unit of output_open(). For a
+ * CSV this is the logical position, which is the end of the file only after
+ * a successful output_flush(); the journal makes it durable no earlier.
+ */
+static uint64_t output_position(output_t *out)
+{
+    return out->binary ? out->writer.rows : (uint64_t)ftell(out->csv);
+}
+
+static int output_fd(output_t *out)
+{
+    return out->binary ? out->writer.fd : fileno(out->csv);
+}
+
+/**
+ * Appends one result row to the output buffer. Rows reach the file when the
+ * buffer (or binary block) fills up or on output_flush().
+ *
+ * @return 0 on success, -1 if the output could not be written.
+ */
+static int output_row(output_t *out, const int64_t row[OUT_MAX_COLUMNS])
+{
+    if (out->binary)
+    {
+        int64_t packed[OUT_MAX_COLUMNS];
+        memcpy(packed, row, CSV_MAX_COLUMNS * sizeof(*row));
+        for (int c = CSV_MAX_COLUMNS; c < out->columns; c++)
+            packed[c] = row[out->extra[c - CSV_MAX_COLUMNS]];
+        if (result_writer_append(&out->writer, packed) != 0)
+            return -1;
+    }
+    else
+    {
+        fprintf(out->csv, "%lld,%lld,%lld,%lld,%lld,%lld",
+                (long long)row[0], (long long)row[1], (long long)row[2],
+                (long long)row[3], (long long)row[4], (long long)row[5]);
+        for (int c = CSV_MAX_COLUMNS; c < out->columns; c++)
+            fprintf(out->csv, ",%lld", (long long)row[out->extra[c - CSV_MAX_COLUMNS]]);
+        fputc('\n', out->csv);
+        if (ferror(out->csv))
+            return -1;
+    }
+    out->rows++;
+    return 0;
+}
+
+/**
+ * @return 0 on success, -1 if the buffered rows could not be written.
+ */
+static int output_flush(output_t *out)
+{
+    if (out->binary)
+        return result_writer_flush(&out->writer, false);
+    return fflush(out->csv) != 0 || ferror(out->csv) ? -1 : 0;
+}
+
+static int output_close(output_t *out)
+{
+    return out->binary ? result_writer_close(&out->writer) : fclose(out->csv);
+}
+
+/**
+ * A row handed from the reader to the workers; row is the journal row ID.
+ */
+typedef struct
+{
+    uint64_t row;
+    int64_t values[CSV_PERIOD + 1];
+} task_t;
+
+/**
+ * The rungs of the escalation ladder (--escalate), as written to the engine
+ * column: each runs only if the ones before left a period unresolved.
+ */
+typedef enum
+{
+    RUNG_NONE,         // no rung found the period, the sentinel stays
+    RUNG_ENUMERATION,  // lambda_search() with the window of the mode
+    RUNG_WINDOW,       // lambda_search() with the largest global window
+    RUNG_RESIDUES,     // cnp_residues(): the sorted residue model, in dx
+    RUNG_ORACLE,       // cnp_oracle_periods(): the gap oracle, a few bits per residue
+    RUNG_COUNT
+} rung_t;
+
+/**
+ * A computed row handed from the workers to the writer, with its telemetry.
+ */
+typedef struct
+{
+    uint64_t row;
+    int64_t values[OUT_MAX_COLUMNS];
+    bool timed_out;
+    rung_t rung;
+    lambda_search_t search;
+    double cost;  // lambda_search_cost() of the input row
+    bool has_signature;
+    signature_t signature;  // of the set period block (--signatures)
+} result_t;
+
+/**
+ * Placement of the workers and their dx buffers on a NUMA machine.
+ */
+typedef enum
+{
+    PLACEMENT_LOCAL,       // worker pinned to a node, its dx buffer on that node
+    PLACEMENT_INTERLEAVE,  // workers unpinned, dx pages spread over all nodes
+    PLACEMENT_OFF          // scheduler and first touch decide
+} placement_t;
+
+/**
+ * Shared state of the reader, worker and writer stages.
+ */
+typedef struct
+{
+    bool degenerate_mode;
+    int timeout_sec;
+    int workers;
+    uint64_t sync_rows;
+    uint64_t sync_ns;
+    const char *trace_path;
+    const char *metrics_path;
+    double metrics_sec;
+    bool telemetry;
+    bool both;
+    bool escalate;
+    int escalate_sec;  // budget of each rung after the enumeration (0: none)
+    placement_t placement;
+    lambda_scratch_t scratch;
+    const char *signatures_path;
+
+    csv_stream_t input;
+    journal_t journal;
+    signature_index_t signatures;
+    output_t out;
+    queue_t tasks;
+    queue_t results;
+
+    uint64_t skip;
+    size_t failures;  // sentinel periods of rows that did not time out
+    size_t timeouts;
+    size_t repeated;  // rows whose signature was already in the index
+    size_t answered[RUNG_COUNT];
+    metrics_t metrics;
+    metrics_sample_t sample;
+    int rc;
+    bool output_failed;  // rows after the last checkpoint may be lost
+} pipeline_t;
+
+/**
+ * A compute worker and the watchdog view of its current row.
+ */
+typedef struct
+{
+    pthread_t thread;
+    pipeline_t *pipeline;
+    number_t *dx;
+    void *trim;    // the candidate buffers of lambda_trim(), lent before any row
+    cnp_ctx *ctx;  // the residue and oracle rungs of --escalate, working in dx
+    atomic_uint_fast64_t deadline_ns;  // 0 once the row ended or the watchdog claimed it
+    sig_atomic_t claimed;              // rows the watchdog claimed, one SIGALRM each
+    phase_stats_t stats;
+    int index;
+} worker_t;
+
+/**
+ * Reader stage: streams the input rows and queues those not yet recorded
+ * in the journal. Row IDs count the valid input rows from 0.
+ */
+static void *reader(void *arg)
+{
+    pipeline_t *p = arg;
+    task_t task;
+    int64_t values[CSV_MAX_COLUMNS];
+    trace_thread("reader");
+
+    for (uint64_t row = 0; csv_stream_next(&p->input, values, NULL); row++)
+    {
+        if (journal_is_done(&p->journal, row))
+            continue;
+        task.row = row;
+        memcpy(task.values, values, sizeof(task.values));
+        trace_wait("task queue full", queue_push(&p->tasks, &task));
+    }
+    if (p->input.error_count > 0)
+        fprintf(stderr, "Warning: %zu malformed input lines are skipped.\n", p->input.error_count);
+
+    task.row = END_OF_ROWS;
+    for (int w = 0; w < p->workers; w++)
+        queue_push(&p->tasks, &task);
+    return NULL;
+}
+
+/**
+ * One lambda_search() of a row (lambda_search_periods() with --both) under
+ * the watchdog: after seconds (0: no limit) SIGALRM aborts it.
+ *
+ * @return false if it timed out; the periods are TIMEOUT_RESULT then.
+ */
+static bool guarded_search(worker_t *w, const int64_t values[], bool degenerate, number_t period, int seconds,
+                           long *multiset, long *ps)
+{
+    pipeline_t *p = w->pipeline;
+    bool completed = true;
+    if (seconds > 0 && sigsetjmp(timeout_jmp, 1) != 0)
+    {
+        // row_search holds the completed attempts; count the aborted one.
+        completed = false;
+        *ps = TIMEOUT_RESULT;
+        if (p->both)
+            *multiset = TIMEOUT_RESULT;
+        row_search.attempts++;
+        ext_close_thread_files();
+    }
+    else
+    {
+        if (seconds > 0)
+        {
+            timeout_active = 1;
+            atomic_store(&w->deadline_ns, now_ns() + (uint64_t)seconds * 1000000000ULL);
+        }
+        if (p->both)
+            *multiset = lambda_search_periods(values[CSV_A_N], values[CSV_A_D], values[CSV_O_N], values[CSV_O_D],
+                                              period, degenerate, w->dx, &row_search, ps);
+        else
+            *ps = lambda_search(values[CSV_A_N], values[CSV_A_D], values[CSV_O_N], values[CSV_O_D],
+                                period, degenerate, w->dx, &row_search);
+        if (seconds > 0)
+            timeout_active = 0;
+    }
+
+    if (seconds > 0)
+    {
+        // Disarm; if the watchdog already claimed this row (deadline 0),
+        // its signal may still be on the way: wait for it so it cannot
+        // hit the next row.
+        if (atomic_exchange(&w->deadline_ns, 0) == 0)
+            w->claimed++;
+        while (timeout_signals < w->claimed)
+            sched_yield();
+    }
+    return completed;
+}
+
+/**
+ * Returns whether a row still lacks a period: the set period, and with
+ * --both the multiset period.
+ */
+static bool unresolved(const pipeline_t *p, long multiset, long ps)
+{
+    return !is_legal_period_length(ps) || (p->both && !is_legal_period_length(multiset));
+}
+
+/**
+ * Returns whether a wider window may find the period.
+ */
+static bool window_failure(long period)
+{
+    return period == DX_LENGTH_TO_SMALL || period == NO_PERIOD;
+}
+
+/**
+ * Takes the periods of a libcutproject rung that the row still lacks.
+ */
+static void take_periods(const pipeline_t *p, const cnp_result_t *r, long *multiset, long *ps)
+{
+    if (!is_legal_period_length(*ps) && r->set.status == CNP_OK)
+        *ps = (long)r->set.period;
+    if (p->both && !is_legal_period_length(*multiset) && r->multiset.status == CNP_OK)
+        *multiset = (long)r->multiset.period;
+}
+
+/**
+ * The escalation ladder of --escalate for a row the enumeration left with
+ * a sentinel. Each rung has its own budget of escalate_sec and runs only
+ * while a period is missing:
+ * - window: lambda_search() over the largest global window (dx, or the
+ *   scratch limit), if the window was too small or had no period and the
+ *   enumeration did not get near that window (degenerate mode);
+ * - residues: cnp_residues() in dx, exact for N below the dx capacity;
+ * - oracle: cnp_oracle_periods(), exact for N up to 16 times the dx
+ *   capacity and any D below 2^62.
+ *
+ * @return The rung that found the last missing period, RUNG_NONE if none did.
+ */
+static rung_t escalate(worker_t *w, const int64_t values[], long *multiset, long *ps)
+{
+    pipeline_t *p = w->pipeline;
+    number_t cap = MAX_PERIOD_ARRAY_SIZE - 1024;
+    if (p->scratch.dir != NULL)
+        cap = MAX(cap, p->scratch.max_values);
+    const double widest = lambda_search_cost(values[CSV_A_N], values[CSV_A_D], values[CSV_O_N], values[CSV_O_D],
+                                             cap / 4, false);
+    if ((window_failure(*ps) || (p->both && window_failure(*multiset))) &&
+        widest > 2.0 * (double)row_search.max_values)
+    {
+        const lambda_search_t first = row_search;
+        long wide_multiset = *multiset, wide_ps;
+        guarded_search(w, values, false, cap / 4, p->escalate_sec, &wide_multiset, &wide_ps);
+        row_search.attempts += first.attempts;
+        row_search.values += first.values;
+        row_search.max_values = MAX(row_search.max_values, first.max_values);
+        if (!is_legal_period_length(*ps))
+            *ps = wide_ps;
+        if (p->both && !is_legal_period_length(*multiset))
+            *multiset = wide_multiset;
+        if (!unresolved(p, *multiset, *ps))
+            return RUNG_WINDOW;
+    }
+    if (w->ctx == NULL)
+        return RUNG_NONE;
+
+    cnp_result_t r;
+    cnp_residues(w->ctx, values[CSV_A_N], values[CSV_A_D], values[CSV_O_N], values[CSV_O_D], &r);
+    take_periods(p, &r, multiset, ps);
+    if (!unresolved(p, *multiset, *ps))
+        return RUNG_RESIDUES;
+    cnp_oracle_periods(w->ctx, values[CSV_A_N], values[CSV_A_D], values[CSV_O_N], values[CSV_O_D], &r);
+    take_periods(p, &r, multiset, ps);
+    return unresolved(p, *multiset, *ps) ? RUNG_NONE : RUNG_ORACLE;
+}
+
+/**
+ * Compute stage: takes rows from the task queue and hands the results to
+ * the writer. A worker never touches the output, so it never waits on disk.
+ */
+static void *worker(void *arg)
+{
+    worker_t *w = arg;
+    pipeline_t *p = w->pipeline;
+    task_t task;
+    result_t result;
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", w->index);
+    trace_thread(name);
+
+    // dx is untouched so far: once the worker runs on its node, the
+    // pages it touches first are allocated there.
+    if (p->placement == PLACEMENT_LOCAL && numa_pin_thread(w->index) >= 0)
+    {
+        numa_place(w->dx, MAX_PERIOD_ARRAY_SIZE * sizeof(number_t), numa_worker_node(w->index));
+        if (w->trim != NULL)
+            numa_place(w->trim, lambda_trim_buffer_bytes(MAX_PERIOD_ARRAY_SIZE), numa_worker_node(w->index));
+    }
+    // The searches below run under the row timeout, so lambda_trim() must
+    // not allocate: it works in the buffer allocated with dx.
+    lambda_use_trim_buffer(w->trim, MAX_PERIOD_ARRAY_SIZE);
+    if (p->escalate)
+    {
+        // The oracle may take as many bytes as dx (N / 2 bytes for N values).
+        cnp_config_t config;
+        cnp_config_default(&config);
+        config.max_values = MAX_PERIOD_ARRAY_SIZE;
+        config.budget_values = 16 * (int64_t)MAX_PERIOD_ARRAY_SIZE;
+        config.budget_seconds = p->escalate_sec;
+        config.periods = p->both ? CNP_PERIODS_MULTISET | CNP_PERIODS_SET : CNP_PERIODS_SET;
+        w->ctx = cnp_ctx_create(&config);
+        if (w->ctx != NULL)
+            cnp_ctx_use_buffer(w->ctx, w->dx, MAX_PERIOD_ARRAY_SIZE);
+    }
+
+    for (;;)
+    {
+        trace_wait("wait for task", queue_pop(&p->tasks, &task));
+        if (task.row == END_OF_ROWS)
+            break;
+
+        const uint64_t row_start = trace_now();
+        const number_t period = task.values[CSV_PERIOD];
+        result.cost = lambda_search_cost(task.values[CSV_A_N], task.values[CSV_A_D], task.values[CSV_O_N],
+                                         task.values[CSV_O_D], period, p->degenerate_mode);
+        long multiset = (long)period, ps;
+        memset(&row_search, 0, sizeof(row_search));
+        guarded_search(w, task.values, p->degenerate_mode, period, p->timeout_sec, &multiset, &ps);
+        result.rung = unresolved(p, multiset, ps) ? RUNG_NONE : RUNG_ENUMERATION;
+        if (p->escalate && result.rung == RUNG_NONE)
+            result.rung = escalate(w, task.values, &multiset, &ps);
+        if (p->both)
+            task.values[CSV_PERIOD] = multiset;
+        result.timed_out = ps == TIMEOUT_RESULT;
+
+        // Any ps consecutive gaps of the trim window (or of the residue
+        // cycle) are a rotation of the period block; the middle ones lie
+        // inside it. The oracle keeps no gaps.
+        const int64_t *gaps = NULL;
+        int64_t length = 0;
+        if (result.rung == RUNG_RESIDUES)
+            gaps = cnp_ctx_gaps(w->ctx, &length);
+        else if (result.rung == RUNG_ENUMERATION || result.rung == RUNG_WINDOW || !p->escalate)
+        {
+            gaps = w->dx;
+            length = row_search.gaps;
+        }
+        result.has_signature = p->signatures_path != NULL && gaps != NULL &&
+                               is_legal_period_length(ps) && ps <= length;
+        if (result.has_signature)
+            signature_of(gaps + (length - ps) / 2, ps, &result.signature);
+
+        const uint64_t row_end = trace_now();
+        result.row = task.row;
+        memcpy(result.values, task.values, sizeof(task.values));
+        result.values[CSV_PERIOD_SET] = ps;
+        result.values[OUT_ENGINE] = result.rung;
+        result.search = row_search;
+        result.values[OUT_X_MAX] = row_search.x_max;
+        result.values[OUT_RETRIES] = row_search.attempts > 0 ? row_search.attempts - 1 : 0;
+        result.values[OUT_VALUES] = row_search.values;
+        result.values[OUT_WALL_NS] = (int64_t)(row_end - row_start);
+        result.values[OUT_PEAK_DX_BYTES] = (int64_t)row_search.max_values * (int64_t)sizeof(number_t);
+        trace_span(result.timed_out ? "row (timeout)" : "row", "row", row_start, row_end, (int64_t)task.row);
+        trace_wait("result queue full", queue_push(&p->results, &result));
+    }
+
+    cnp_ctx_destroy(w->ctx);
+    lambda_release_trim_buffers();
+    result.row = END_OF_ROWS;
+    queue_push(&p->results, &result);
+    w->stats = *phase_stats_thread();
+    return NULL;
+}
+
+/**
+ * Stops the checkpoints after the output could not be written (e.g. ENOSPC or
+ * EIO): the journal keeps only the rows of the last successful checkpoint, so
+ * a resume computes the lost rows again.
+ */
+static void output_failure(pipeline_t *p)
+{
+    fprintf(stderr, "\nError: writing output failed; rows after the last checkpoint are not journaled\n");
+    p->output_failed = true;
+    p->rc = 1;
+}
+
+/**
+ * Writer stage: appends results to the output in large buffered writes and
+ * records them in the journal. Every sync_rows rows or sync_ns nanoseconds
+ * the output is made durable and then the journal (a checkpoint).
+ */
+static void *writer(void *arg)
+{
+    pipeline_t *p = arg;
+    result_t result;
+    uint64_t row = p->skip, unsynced = 0;
+    uint64_t last_sync = now_ns();
+    int finished = 0;
+    trace_thread("writer");
+
+    while (finished < p->workers)
+    {
+        trace_wait("wait for result", queue_pop(&p->results, &result));
+        if (result.row == END_OF_ROWS)
+        {
+            finished++;
+            continue;
+        }
+
+        if (!p->output_failed && output_row(&p->out, result.values) != 0)
+            output_failure(p);
+        if (!p->output_failed
+            && journal_mark(&p->journal, result.row, output_position(&p->out), p->out.rows) != 0)
+            p->rc = 1;
+        row++;
+        unsynced++;
+        if (result.timed_out)
+            p->timeouts++;
+        else if (!is_legal_period_length(result.values[CSV_PERIOD_SET]))
+            p->failures++;
+        p->answered[result.rung]++;
+        if (result.has_signature)
+        {
+            const int64_t params[4] = {result.values[CSV_O_N], result.values[CSV_O_D],
+                                       result.values[CSV_A_N], result.values[CSV_A_D]};
+            const int added = signature_index_add(&p->signatures, &result.signature, params, NULL);
+            if (added < 0)
+                p->rc = 1;
+            else if (added == 0)
+                p->repeated++;
+        }
+
+        p->sample.rows_done++;
+        p->sample.points += (uint64_t)result.search.values;
+        p->sample.cost_done += result.cost;
+        metrics_count_failure(&p->sample, (long)result.values[CSV_PERIOD_SET]);
+        metrics_update(&p->metrics, &p->sample, false);
+
+        const uint64_t now = now_ns();
+        if (unsynced >= p->sync_rows || now - last_sync >= p->sync_ns)
+        {
+            if (!p->output_failed && output_flush(&p->out) != 0)
+                output_failure(p);
+            if (p->signatures_path != NULL && signature_index_sync(&p->signatures) != 0)
+                p->rc = 1;
+            if (!p->output_failed && journal_sync(&p->journal, output_fd(&p->out)) != 0)
+                p->rc = 1;
+            trace_span("checkpoint", "io", now, trace_now(), (int64_t)unsynced);
+            unsynced = 0;
+            last_sync = now;
+        }
+
+        if (row % 100 == 0)
+        {
+            printf("\rRow %llu (failures: %zu, timeouts: %zu)", (unsigned long long)row, p->failures, p->timeouts);
+            fflush(stdout);
+        }
+    }
+
+    // The output must be complete on disk before the final checkpoint.
+    if (!p->output_failed && output_flush(&p->out) != 0)
+        output_failure(p);
+    if (p->signatures_path != NULL && signature_index_sync(&p->signatures) != 0)
+        p->rc = 1;
+    if (!p->output_failed && journal_sync(&p->journal, output_fd(&p->out)) != 0)
+        p->rc = 1;
+    metrics_update(&p->metrics, &p->sample, true);
+    printf("\nDone: %llu rows total (%llu newly processed), %zu failures, %zu timeouts.\n",
+           (unsigned long long)row, (unsigned long long)(row - p->skip), p->failures, p->timeouts);
+    if (p->signatures_path != NULL)
+        printf("Signatures: %zu distinct period blocks in '%s', %zu rows repeated a known one.\n",
+               p->signatures.count, p->signatures_path, p->repeated);
+    if (p->escalate)
+        printf("Escalation: %zu rows by enumeration, %zu by the widest window, %zu by the residue model, "
+               "%zu by the gap oracle, %zu unresolved.\n", p->answered[RUNG_ENUMERATION], p->answered[RUNG_WINDOW],
+               p->answered[RUNG_RESIDUES], p->answered[RUNG_ORACLE], p->answered[RUNG_NONE]);
+    return NULL;
+}
+
+/**
+ * Watchdog run by the main thread while the pipeline works: a worker whose
+ * row exceeds its deadline gets SIGALRM, which aborts that row only.
+ */
+static void watchdog(worker_t *workers, int count, atomic_bool *writer_done)
+{
+    const struct timespec tick = {0, 100000000};
+    while (!atomic_load(writer_done))
+    {
+        nanosleep(&tick, NULL);
+        const uint64_t now = now_ns();
+        for (int i = 0; i < count; i++)
+        {
+            uint_fast64_t deadline = atomic_load(&workers[i].deadline_ns);
+            if (deadline != 0 && now >= deadline &&
+                atomic_compare_exchange_strong(&workers[i].deadline_ns, &deadline, 0))
+                pthread_kill(workers[i].thread, SIGALRM);
+        }
+    }
+}
+
+typedef struct
+{
+    pipeline_t *pipeline;
+    atomic_bool done;
+} writer_arg_t;
+
+static void *writer_main(void *arg)
+{
+    writer_arg_t *w = arg;
+    writer(w->pipeline);
+    atomic_store(&w->done, true);
+    return NULL;
+}
+
+/**
+ * Sizes the run for the metrics: counts the rows still to process and sums
+ * their lambda_search_cost() in a separate pass over the input, so the ETA
+ * covers the whole run from the first update on.
+ *
+ * @return 0 on success, -1 if the input cannot be read.
+ */
+static int metrics_plan(pipeline_t *p, const char *in_path)
+{
+    csv_stream_t input;
+    int64_t v[CSV_MAX_COLUMNS];
+    if (csv_stream_open(in_path, &input) != 0)
+        return -1;
+    for (uint64_t row = 0; csv_stream_next(&input, v, NULL); row++)
+    {
+        if (journal_is_done(&p->journal, row))
+            continue;
+        p->sample.rows_total++;
+        p->sample.cost_total += lambda_search_cost(v[CSV_A_N], v[CSV_A_D], v[CSV_O_N], v[CSV_O_D],
+                                                   v[CSV_PERIOD], p->degenerate_mode);
+    }
+    csv_stream_close(&input);
+    p->sample.rows_skipped = p->skip;
+    p->sample.buffer_bytes = (uint64_t)p->workers * ((uint64_t)MAX_PERIOD_ARRAY_SIZE * sizeof(number_t) +
+                                                     lambda_trim_buffer_bytes(MAX_PERIOD_ARRAY_SIZE));
+    return 0;
+}
+
+/**
+ * Parses "--name=value" options behind the positional arguments.
+ *
+ * @return 0 on success, -1 on an unknown option.
+ */
+static int parse_options(int argc, const char *argv[], pipeline_t *p)
+{
+    double sync_sec = 10.0;
+    for (int i = 5; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--workers=", 10) == 0)
+            p->workers = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--sync-rows=", 12) == 0)
+            p->sync_rows = (uint64_t)atoll(argv[i] + 12);
+        else if (strncmp(argv[i], "--sync-sec=", 11) == 0)
+            sync_sec = atof(argv[i] + 11);
+        else if (strncmp(argv[i], "--trace=", 8) == 0)
+            p->trace_path = argv[i] + 8;
+        else if (strncmp(argv[i], "--metrics=", 10) == 0)
+            p->metrics_path = argv[i] + 10;
+        else if (strncmp(argv[i], "--metrics-sec=", 14) == 0)
+            p->metrics_sec = atof(argv[i] + 14);
+        else if (strcmp(argv[i], "--telemetry") == 0)
+            p->telemetry = true;
+        else if (strcmp(argv[i], "--both") == 0)
+            p->both = true;
+        else if (strcmp(argv[i], "--escalate") == 0)
+            p->escalate = true;
+        else if (strncmp(argv[i], "--escalate=", 11) == 0)
+        {
+            p->escalate = true;
+            p->escalate_sec = atoi(argv[i] + 11);
+        }
+        else if (strcmp(argv[i], "--numa=local") == 0)
+            p->placement = PLACEMENT_LOCAL;
+        else if (strcmp(argv[i], "--numa=interleave") == 0)
+            p->placement = PLACEMENT_INTERLEAVE;
+        else if (strcmp(argv[i], "--numa=off") == 0)
+            p->placement = PLACEMENT_OFF;
+        else if (strncmp(argv[i], "--scratch=", 10) == 0)
+            p->scratch.dir = argv[i] + 10;
+        else if (strncmp(argv[i], "--scratch-max=", 14) == 0)
+            p->scratch.max_values = atol(argv[i] + 14);
+        else if (strncmp(argv[i], "--signatures=", 13) == 0)
+            p->signatures_path = argv[i] + 13;
+        else if (strncmp(argv[i], "--kernel=", 9) == 0)
+        {
+            if (kernel_select(argv[i] + 9) != 0)
+            {
+                fprintf(stderr, "Kernel '%s' is unknown, not supported by this CPU or failed its self-test\n",
+                        argv[i] + 9);
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+    if (p->workers < 1)
+        p->workers = 1;
+    if (p->sync_rows < 1)
+        p->sync_rows = 1;
+    if (p->escalate_sec < 0)
+        p->escalate_sec = p->timeout_sec;
+    p->sync_ns = (uint64_t)(sync_sec * 1e9);
+    if (kernel_rejected() != NULL)
+        fprintf(stderr, "Warning: CNP_KERNEL=%s is unknown, unsupported or failed its self-test; "
+                        "selecting automatically\n", kernel_rejected());
+    return 0;
+}
+
 int main(int argc, const char *argv[])
 {
-    if (argc != 5)
+    if (argc < 5)
     {
         fprintf(stderr,
-            "Usage: %s <input.csv> <output.csv> <global|degenerate> <timeout_sec>\n"
+            "Usage: %s <input.csv> <output.csv> <global|degenerate> <timeout_sec> [options]\n"
             "  global     : pick x_max so dx-array fits and contains ~4*period gaps\n"
             "  degenerate : x_max = MAX(1000, 25 * (o_n/o_d + 1)) per row\n"
             "  timeout_sec: per-row wall-clock cap (0 disables)\n"
-            "Resume: if <output.csv> already exists, the first N input data rows\n"
-            "(where N = data rows in output) are skipped and processing continues.\n",
+            "Options:\n"
+            "  --workers=N    : compute threads, each with its own dx buffer (default 1);\n"
+            "                   with N > 1 rows are written in completion order\n"
+            "  --sync-rows=N  : checkpoint output and journal every N rows (default 1000)\n"
+            "  --sync-sec=S   : ... or at least every S seconds (default 10)\n"
+            "  --trace=FILE   : write a Chrome trace (rows, queue waits, checkpoints;\n"
+            "                   lambda() phases with make STATS=1), open in Perfetto\n"
+            "  --metrics=FILE : rewrite progress metrics in Prometheus text format\n"
+            "                   (rows/s, points/s, failures by code, memory, ETA)\n"
+            "  --metrics-sec=S: ... at most every S seconds (default 15)\n"
+            "  --telemetry    : append per-row columns x_max, retries, values (projected\n"
+            "                   points), wall_ns and peak_dx_bytes to the output\n"
+            "  --both         : also recompute the multiset period (fifth column) from\n"
+            "                   the same enumeration instead of copying it from the input\n"
+            "  --escalate[=S] : retry rows left with a sentinel on a ladder of engines:\n"
+            "                   the widest global window, the residue model (in dx),\n"
+            "                   the gap oracle (2 bits per residue), each within S\n"
+            "                   seconds (default timeout_sec); adds an engine column:\n"
+            "                   0 none, 1 enumeration, 2 window, 3 residues, 4 oracle\n"
+            "  --kernel=NAME  : kernel implementation: scalar, avx2, avx512 or auto\n"
+            "                   (default; also $CNP_KERNEL), see kernels.h\n"
+            "  --numa=MODE    : local (default): pin worker i to NUMA node i mod nodes\n"
+            "                   and place its dx buffer there; interleave: spread the\n"
+            "                   dx pages over all nodes; off. No-op on one node\n"
+            "  --scratch=DIR  : out-of-core mode: windows with more values than dx holds\n"
+            "                   are sorted in runs in DIR and merged (16 bytes per value)\n"
+            "  --scratch-max=N: ... up to N values per window (default 10 dx buffers)\n"
+            "  --signatures=FILE: index of the set period blocks up to rotation (least\n"
+            "                   rotation, 128-bit hash) with the first row of each;\n"
+            "                   kept across runs, rows repeating a known block are counted\n"
+            "Resume: completed rows are recorded in <output.csv>" JOURNAL_SUFFIX ". A rerun\n"
+            "cuts the output back to the last checkpoint and continues with the\n"
+            "rows not yet completed. Without a journal, the first N input data rows\n"
+            "(where N = data rows in output) are skipped.\n"
+            "An output path ending in '" RESULT_FILE_EXTENSION "' selects the binary columnar\n"
+            "format (see cnp-convert in src/c/lib).\n",
             argv[0]);
         return 1;
     }
@@ -39,75 +872,87 @@ int main(int argc, const char *argv[])
     const char *in_path = argv[1];
     const char *out_path = argv[2];
     const char *mode = argv[3];
-    const int timeout_sec = atoi(argv[4]);
 
-    bool degenerate_mode;
+    pipeline_t p;
+    memset(&p, 0, sizeof(p));
+    p.timeout_sec = atoi(argv[4]);
+    p.escalate_sec = -1;
+    p.sync_rows = 1000;
+    p.metrics_sec = 15.0;
+    p.scratch.max_values = 10L * MAX_PERIOD_ARRAY_SIZE;
+    p.scratch.capacity = MAX_PERIOD_ARRAY_SIZE;
+    if (parse_options(argc, argv, &p) != 0)
+        return 1;
+    if (p.scratch.dir != NULL)
+        lambda_set_scratch(&p.scratch);
+
     if (strcmp(mode, "global") == 0)
-        degenerate_mode = false;
+        p.degenerate_mode = false;
     else if (strcmp(mode, "degenerate") == 0)
-        degenerate_mode = true;
+        p.degenerate_mode = true;
     else
     {
         fprintf(stderr, "Unknown mode '%s'\n", mode);
         return 1;
     }
 
-    FILE *fin = fopen(in_path, "r");
-    if (!fin) { fprintf(stderr, "Error opening input '%s'\n", in_path); return 1; }
+    if (csv_stream_open(in_path, &p.input) != 0)
+        return 1;
 
-    char header[1024];
-    if (!fgets(header, sizeof(header), fin))
+    // Resume from the journal; an output without journal (written by an
+    // older version) seeds it with its first N rows.
+    bool journal_existed;
+    if (journal_open(&p.journal, out_path, &journal_existed) != 0)
     {
-        fprintf(stderr, "Error: empty input file\n");
-        fclose(fin);
+        csv_stream_close(&p.input);
         return 1;
     }
-    size_t hlen = strlen(header);
-    while (hlen > 0 && (header[hlen-1] == '\n' || header[hlen-1] == '\r'))
-        header[--hlen] = '\0';
-
-    // Count existing data rows in output for resume.
-    size_t skip = 0;
-    FILE *fout_check = fopen(out_path, "r");
-    if (fout_check)
+    if (!journal_existed)
     {
-        char buf[2048];
-        if (fgets(buf, sizeof(buf), fout_check))
+        const size_t existing = result_file_count_rows(out_path);
+        if (existing > 0)
         {
-            while (fgets(buf, sizeof(buf), fout_check))
-                skip++;
+            struct stat st;
+            const uint64_t end = result_file_is_binary(out_path) ? existing
+                                 : (stat(out_path, &st) == 0 ? (uint64_t)st.st_size : 0);
+            if (journal_mark_range(&p.journal, 0, existing, end, existing) != 0)
+            {
+                fprintf(stderr, "Error seeding the journal of '%s'\n", out_path);
+                journal_close(&p.journal);
+                csv_stream_close(&p.input);
+                return 1;
+            }
         }
-        fclose(fout_check);
     }
-
-    FILE *fout;
-    if (skip > 0)
+    p.skip = p.journal.done;
+    if (p.signatures_path != NULL && signature_index_open(&p.signatures, p.signatures_path) != 0)
     {
-        fout = fopen(out_path, "a");
-        if (!fout) { fprintf(stderr, "Error opening output '%s' for append\n", out_path); return 1; }
-        printf("Resume: skipping %zu rows already in '%s'.\n", skip, out_path);
+        journal_close(&p.journal);
+        csv_stream_close(&p.input);
+        return 1;
     }
-    else
+    const bool append = p.journal.output_offset > 0;
+
+    if (output_open(&p.out, out_path, p.input.header, p.input.header_length, p.escalate, p.telemetry,
+                    append, p.journal.output_offset, p.journal.output_rows) != 0)
     {
-        fout = fopen(out_path, "w");
-        if (!fout) { fprintf(stderr, "Error opening output '%s'\n", out_path); return 1; }
-        fprintf(fout, "%s,period_set\n", header);
+        fprintf(stderr, "Error opening output '%s'%s\n", out_path, append ? " for append" : "");
+        journal_close(&p.journal);
+        csv_stream_close(&p.input);
+        return 1;
     }
+    if (p.skip > 0)
+        printf("Resume: skipping %llu rows already in '%s'.\n", (unsigned long long)p.skip, out_path);
 
-    // Skip already-processed input data rows.
-    long long o_n, o_d, a_n, a_d, period;
-    for (size_t i = 0; i < skip; i++)
+    if (metrics_open(&p.metrics, p.metrics_path, ENGINE_NAME, out_path, p.metrics_sec) != 0 ||
+        (p.metrics_path && metrics_plan(&p, in_path) != 0))
     {
-        if (fscanf(fin, "%lld,%lld,%lld,%lld,%lld", &o_n, &o_d, &a_n, &a_d, &period) != 5)
-        {
-            fprintf(stderr, "Error: input has fewer rows (%zu) than expected (%zu) for resume.\n", i, skip);
-            fclose(fin); fclose(fout);
-            return 1;
-        }
+        fprintf(stderr, "Error preparing metrics '%s'\n", p.metrics_path);
+        return 1;
     }
 
-    // Install SIGALRM handler for per-row timeout.
-    if (timeout_sec > 0)
+    // Install SIGALRM handler for per-row timeout (and the window rung).
+    if (p.timeout_sec > 0 || (p.escalate && p.escalate_sec > 0))
     {
         struct sigaction sa;
         memset(&sa, 0, sizeof(sa));
@@ -117,109 +962,90 @@ int main(int argc, const char *argv[])
         if (sigaction(SIGALRM, &sa, NULL) != 0)
         {
             fprintf(stderr, "Error installing SIGALRM handler\n");
-            fclose(fin); fclose(fout);
+            csv_stream_close(&p.input); output_close(&p.out); journal_close(&p.journal);
             return 1;
         }
     }
 
-    number_t *dx = dx_alloc(MAX_PERIOD_ARRAY_SIZE);
-
-    size_t row = skip;
-    size_t failures = 0;
-    size_t timeouts = 0;
-
-    while (fscanf(fin, "%lld,%lld,%lld,%lld,%lld", &o_n, &o_d, &a_n, &a_d, &period) == 5)
+    worker_t *workers = calloc((size_t)p.workers, sizeof(*workers));
+    if (workers == NULL ||
+        queue_init(&p.tasks, QUEUE_CAPACITY, sizeof(task_t)) != 0 ||
+        queue_init(&p.results, QUEUE_CAPACITY, sizeof(result_t)) != 0)
     {
-        row++;
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
 
-        number_t x_max;
-        number_t density_num = 0, density_den = 1;
-        number_t target_points = 0, buffer_cap = 0;
-        if (degenerate_mode)
-        {
-            const number_t omega_int = (number_t)(o_n / o_d) + 1;
-            x_max = MAX(1000, 25 * omega_int);
-        }
-        else
-        {
-            // Cap target_points so we never request more dx slots than the
-            // buffer can hold.
-            density_num = ((number_t)a_n + (number_t)a_d) * (number_t)o_n;
-            density_den = (number_t)a_d * (number_t)o_d;
-            buffer_cap = (number_t)MAX_PERIOD_ARRAY_SIZE - 1024;
-            target_points = MAX(200000, (number_t)period * 4);
-            if (target_points > buffer_cap) target_points = buffer_cap;
-            x_max = (target_points * density_den) / density_num;
-            if (x_max > X_MAX) x_max = X_MAX;
-            if (x_max < 1000) x_max = 1000;
-        }
+    if (p.trace_path && trace_open(p.trace_path) != 0)
+        return 1;
+
+    if (p.placement != PLACEMENT_OFF && numa_nodes() > 1)
+        printf("NUMA: %d nodes, %s\n", numa_nodes(),
+               p.placement == PLACEMENT_LOCAL ? "workers pinned round-robin with local dx buffers"
+                                              : "dx buffers interleaved");
+    if (p.scratch.dir != NULL)
+        printf("Out-of-core: scratch files in %s, windows up to %ld values\n",
+               p.scratch.dir, p.scratch.max_values);
 
-        long ps;
-        if (timeout_sec > 0 && sigsetjmp(timeout_jmp, 1) != 0)
+    // Reader -> workers -> writer, connected by the two queues.
+    pthread_t reader_thread, writer_thread;
+    writer_arg_t writer_arg = {&p, false};
+    pthread_create(&reader_thread, NULL, reader, &p);
+    for (int i = 0; i < p.workers; i++)
+    {
+        workers[i].pipeline = &p;
+        workers[i].index = i;
+        workers[i].dx = dx_alloc(MAX_PERIOD_ARRAY_SIZE);
+        const size_t trim_bytes = lambda_trim_buffer_bytes(MAX_PERIOD_ARRAY_SIZE);
+        workers[i].trim = trim_bytes > 0 ? malloc(trim_bytes) : NULL;
+        if (trim_bytes > 0 && workers[i].trim == NULL)
         {
-            ps = TIMEOUT_RESULT;
-            timeouts++;
+            fprintf(stderr, "Error: out of memory for the trim buffers\n");
+            exit(EXIT_FAILURE);
         }
-        else
+        if (p.placement == PLACEMENT_INTERLEAVE)
         {
-            if (timeout_sec > 0)
-            {
-                timeout_active = 1;
-                alarm((unsigned)timeout_sec);
-            }
-
-            // The multiset-based estimate may not expose a full set period in
-            // the trim window. On DX_LENGTH_TO_SMALL / NO_PERIOD, double x_max
-            // and retry until it succeeds or the buffer / X_MAX ceiling stops
-            // x_max from growing.
-            while (true)
-            {
-                ps = lambda((number_t)a_n, (number_t)a_d,
-                            (number_t)o_n, (number_t)o_d,
-                            X_MIN, x_max, true, dx);
-
-                if (degenerate_mode) break;
-                if (is_legal_period_length(ps)) break;
-                if (ps != DX_LENGTH_TO_SMALL && ps != NO_PERIOD) break;
-
-                number_t new_target = target_points * 2;
-                if (new_target > buffer_cap) new_target = buffer_cap;
-                if (new_target <= target_points) break;
-
-                number_t new_x_max = (new_target * density_den) / density_num;
-                if (new_x_max > X_MAX) new_x_max = X_MAX;
-                if (new_x_max < 1000) new_x_max = 1000;
-                if (new_x_max <= x_max) break;
-
-                target_points = new_target;
-                x_max = new_x_max;
-            }
-
-            if (timeout_sec > 0)
-            {
-                alarm(0);
-                timeout_active = 0;
-            }
-            if (!is_legal_period_length(ps))
-                failures++;
+            numa_place(workers[i].dx, MAX_PERIOD_ARRAY_SIZE * sizeof(number_t), NUMA_INTERLEAVE);
+            if (trim_bytes > 0)
+                numa_place(workers[i].trim, trim_bytes, NUMA_INTERLEAVE);
         }
+        atomic_init(&workers[i].deadline_ns, 0);
+        pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+    }
+    pthread_create(&writer_thread, NULL, writer_main, &writer_arg);
 
-        fprintf(fout, "%lld,%lld,%lld,%lld,%lld,%ld\n",
-                o_n, o_d, a_n, a_d, period, ps);
-        fflush(fout);
+    watchdog(workers, p.workers, &writer_arg.done);
 
-        if (row % 100 == 0)
-        {
-            printf("\rRow %zu (failures: %zu, timeouts: %zu)", row, failures, timeouts);
-            fflush(stdout);
-        }
+    pthread_join(reader_thread, NULL);
+    phase_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < p.workers; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].dx);
+        free(workers[i].trim);
+        phase_stats_add(&stats, &workers[i].stats);
     }
+    pthread_join(writer_thread, NULL);
+    if (PHASE_STATS_ENABLED)
+        phase_stats_print(stdout, &stats, "lambda() phases over all workers:");
+    if (trace_close() != 0)
+        fprintf(stderr, "Error writing trace '%s'\n", p.trace_path);
+    metrics_close(&p.metrics);
 
-    printf("\nDone: %zu rows total (%zu newly processed), %zu failures, %zu timeouts.\n",
-           row, row - skip, failures, timeouts);
+    free(workers);
+    queue_destroy(&p.tasks);
+    queue_destroy(&p.results);
+    csv_stream_close(&p.input);
 
-    free(dx);
-    fclose(fin);
-    fclose(fout);
-    return 0;
+    int rc = p.rc;
+    if (output_close(&p.out) != 0)
+        rc = 1;
+    if (p.output_failed)
+        journal_abandon(&p.journal);
+    else if (journal_close(&p.journal) != 0)
+        rc = 1;
+    if (p.signatures_path != NULL && signature_index_close(&p.signatures) != 0)
+        rc = 1;
+    return rc;
 }
@@ -1,5 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "conjectures.h"
+#include "csv_loader.h"
+#include "journal.h"
+#include "metrics.h"
 
 typedef enum Conjecture
 {
@@ -83,7 +89,8 @@ void test_conjecture(number_t *dx, const Conjecture conjecture, const int number
 
 /**
  * Tests the conjecture against observed period lengths stored in a CSV file.
- * The CSV must have the header "o_n,o_d,a_n,a_d,period" and one data row per line.
+ * The CSV must have the header "o_n,o_d,a_n,a_d,period" and one data row per line;
+ * it is loaded through the mmap-based CSV loader, malformed lines are reported.
  * For each row, computes N = floor(o_n*alpha/o_d) + floor(o_n*beta/o_d) + 1
  * and D = alpha^2 + beta^2, then checks that the observed period equals
  * N if D does not divide N, else N / D.
@@ -92,60 +99,160 @@ void test_conjecture(number_t *dx, const Conjecture conjecture, const int number
  */
 void test_conjecture_from_csv(const char *path)
 {
-    FILE *f = fopen(path, "r");
-    if (f == NULL)
-    {
-        fprintf(stderr, "Error: could not open %s\n", path);
+    csv_table_t table;
+    if (csv_table_load(path, 0, &table) != 0)
         exit(EXIT_FAILURE);
-    }
-
-    // Skip header line
-    char buffer[256];
-    if (fgets(buffer, sizeof(buffer), f) == NULL)
-    {
-        fprintf(stderr, "Error: empty file %s\n", path);
-        fclose(f);
-        exit(EXIT_FAILURE);
-    }
+    csv_table_report_errors(&table, path, 10);
 
-    long long o_n, o_d, a_n, a_d, period;
+    const int64_t *o_n = table.column[CSV_O_N];
+    const int64_t *o_d = table.column[CSV_O_D];
+    const int64_t *a_n = table.column[CSV_A_N];
+    const int64_t *a_d = table.column[CSV_A_D];
+    const int64_t *period = table.column[CSV_PERIOD];
     size_t total = 0, mismatches = 0;
 
-    while (fscanf(f, "%lld,%lld,%lld,%lld,%lld", &o_n, &o_d, &a_n, &a_d, &period) == 5)
+    for (size_t i = 0; i < table.rows; i++)
     {
-        const number_t alpha = (number_t)a_n;
-        const number_t beta = (number_t)a_d;
-        const number_t N = rational_floor((rational_t){(number_t)o_n * alpha, (number_t)o_d})
-                         + rational_floor((rational_t){(number_t)o_n * beta, (number_t)o_d})
+        const number_t alpha = (number_t)a_n[i];
+        const number_t beta = (number_t)a_d[i];
+        const number_t N = rational_floor((rational_t){(number_t)o_n[i] * alpha, (number_t)o_d[i]})
+                         + rational_floor((rational_t){(number_t)o_n[i] * beta, (number_t)o_d[i]})
                          + 1;
         const number_t D = alpha * alpha + beta * beta;
         const number_t expected = (N % D == 0) ? N / D : N;
 
         total++;
-        if (expected != (number_t)period)
+        if (expected != (number_t)period[i])
         {
             mismatches++;
             if (mismatches <= 10)
             {
                 printf("Mismatch: omega = %lld/%lld, alpha = %lld, beta = %lld, N = %lld, D = %lld, expected = %lld, observed period = %lld\n",
-                       o_n, o_d, (long long)alpha, (long long)beta,
-                       (long long)N, (long long)D, (long long)expected, period);
+                       (long long)o_n[i], (long long)o_d[i], (long long)alpha, (long long)beta,
+                       (long long)N, (long long)D, (long long)expected, (long long)period[i]);
             }
         }
     }
 
-    fclose(f);
+    csv_table_free(&table);
 
     printf("Conjecture test from CSV '%s': %zu rows checked, %zu mismatches.\n",
            path, total, mismatches);
 }
 
+/* Candidates generate_conjecture_degenerate_csv() passes to lambda_batch() at once. */
+#define DEGENERATE_BATCH (4 * LAMBDA_LANES)
+
+/**
+ * A matching candidate of generate_conjecture_degenerate_csv() waiting for
+ * its batch.
+ */
+typedef struct
+{
+    lambda_case_t lambda;
+    uint64_t id;      // row ID in the journal
+    number_t N;
+    number_t D;
+    bool too_large;   // not computed: more than 10^7 expected points
+} degenerate_candidate_t;
+
+/**
+ * The output state of generate_conjecture_degenerate_csv().
+ */
+typedef struct
+{
+    FILE *f;
+    journal_t journal;
+    metrics_t metrics;
+    metrics_sample_t sample;
+    int target_count;
+    int count;
+    int generated;
+    size_t lambda_failures;
+    size_t formula_disagreements;
+} degenerate_run_t;
+
+/**
+ * Computes a batch of candidates and handles the results in candidate
+ * order: rows are written and journaled as if computed one by one. Once
+ * target_count rows exist the rest of the batch is dropped unjournaled.
+ */
+static void degenerate_flush(degenerate_run_t *run, degenerate_candidate_t *pending, int n, number_t *dx)
+{
+    lambda_case_t cases[DEGENERATE_BATCH];
+    int computed = 0;
+    for (int i = 0; i < n; i++)
+        if (!pending[i].too_large)
+            cases[computed++] = pending[i].lambda;
+    if (computed > 0)
+    {
+        const lambda_case_t *c = &cases[0];
+        printf("\rComputing: %d candidates from alpha=%lld, beta=%lld, omega=%lld/%lld ...          ",
+               computed, (long long)c->alpha, (long long)c->beta, (long long)c->gamma, (long long)c->delta);
+        fflush(stdout);
+        lambda_batch(cases, computed, dx);
+    }
+
+    journal_t *journal = &run->journal;
+    computed = 0;
+    for (int i = 0; i < n && run->count < run->target_count; i++)
+    {
+        const degenerate_candidate_t *d = &pending[i];
+        const lambda_case_t *c = &d->lambda;
+        if (d->too_large)
+        {
+            run->lambda_failures++;
+            metrics_count_failure(&run->sample, ARRAY_SIZE_EXCEEDED);
+            journal_mark(journal, d->id, (uint64_t)ftell(run->f), (uint64_t)run->count);
+            continue;
+        }
+
+        const long lam = cases[computed++].period;
+        run->sample.points += (uint64_t)lambda_search_cost(c->alpha, c->beta, c->gamma, c->delta, 0, true);
+        if (!is_legal_period_length(lam))
+        {
+            run->lambda_failures++;
+            metrics_count_failure(&run->sample, lam);
+            metrics_update(&run->metrics, &run->sample, false);
+            printf("\rSkipped: alpha=%lld, beta=%lld, omega=%lld/%lld, N=%lld, D=%lld (lambda=%ld, failures=%zu)    ",
+                   (long long)c->alpha, (long long)c->beta, (long long)c->gamma, (long long)c->delta,
+                   (long long)d->N, (long long)d->D, lam, run->lambda_failures);
+            fflush(stdout);
+            journal_mark(journal, d->id, (uint64_t)ftell(run->f), (uint64_t)run->count);
+            journal_flush(journal);
+            continue;
+        }
+
+        const number_t expected = d->N / d->D;
+        if (lam != expected)
+        {
+            run->formula_disagreements++;
+            fprintf(stderr, "Warning: lambda = %ld != N/D = %lld for alpha=%lld, beta=%lld, omega=%lld/%lld, N=%lld, D=%lld\n",
+                    lam, (long long)expected, (long long)c->alpha, (long long)c->beta,
+                    (long long)c->gamma, (long long)c->delta, (long long)d->N, (long long)d->D);
+        }
+
+        fprintf(run->f, "%lld,%lld,%lld,%lld,%ld\n",
+                (long long)c->gamma, (long long)c->delta, (long long)c->alpha, (long long)c->beta, lam);
+        fflush(run->f);
+        run->count++;
+        run->generated++;
+        journal_mark(journal, d->id, (uint64_t)ftell(run->f), (uint64_t)run->count);
+        journal_flush(journal);
+        printf("\r%d / %d", run->count, run->target_count);
+        fflush(stdout);
+        run->sample.rows_done = (uint64_t)run->generated;
+        metrics_update(&run->metrics, &run->sample, false);
+    }
+}
+
 /**
  * Generates a CSV of test cases that exercise the degenerate branch of
  * the conjecture (D | N, so lambda = N / D).
  * Scans small coprime (alpha, beta) and omega = p/q in lowest terms.
  * For each (alpha, beta, omega) with D | N, computes the actual period via
- * lambda() and writes a row "o_n,o_d,a_n,a_d,period".
+ * lambda() and writes a row "o_n,o_d,a_n,a_d,period". The candidates are
+ * tiny, so they are computed DEGENERATE_BATCH at a time by lambda_batch().
  * Stops after target_count successful rows.
  *
  * @param path The output CSV path.
@@ -154,65 +261,78 @@ void test_conjecture_from_csv(const char *path)
  */
 void generate_conjecture_degenerate_csv(const char *path, int target_count, number_t *dx)
 {
-    // Resume support: append if file exists and has content, else write fresh
-    FILE *f_check = fopen(path, "r");
-    bool resume = false;
-    int existing_count = 0;
-    if (f_check != NULL)
+    degenerate_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.target_count = target_count;
+
+    // Resume support: the journal next to the output records which matching
+    // candidates are done (written or failed) and the durable end of the
+    // output. An output without journal seeds it: its rows stand for the
+    // first existing_count candidates.
+    journal_t *journal = &run.journal;
+    bool journal_existed;
+    if (journal_open(journal, path, &journal_existed) != 0)
+        exit(EXIT_FAILURE);
+    if (!journal_existed)
     {
-        char buf[256];
-        if (fgets(buf, sizeof(buf), f_check) != NULL)  // header
-        {
-            while (fgets(buf, sizeof(buf), f_check) != NULL)
-                existing_count++;
-        }
-        fclose(f_check);
-        if (existing_count > 0)
-            resume = true;
+        const size_t rows = csv_count_rows(path);
+        struct stat st;
+        if (rows > 0 && stat(path, &st) == 0)
+            journal_mark_range(journal, 0, rows, (uint64_t)st.st_size, rows);
     }
+    const int existing_count = (int)journal->output_rows;
+    const bool resume = journal->output_offset > 0;
+
+    // Rows are weighted equally: the candidates still to find are unknown.
+    metrics_sample_t *sample = &run.sample;
+    sample->rows_total = target_count > existing_count ? (uint64_t)(target_count - existing_count) : 0;
+    sample->rows_skipped = (uint64_t)existing_count;
+    sample->buffer_bytes = (uint64_t)MAX_PERIOD_ARRAY_SIZE * sizeof(number_t);
+    if (metrics_open(&run.metrics, METRICS_FILE, ENGINE_NAME, path, METRICS_INTERVAL_SEC) != 0)
+        exit(EXIT_FAILURE);
 
     FILE *f;
     if (resume)
     {
-        f = fopen(path, "a");
+        f = truncate(path, (off_t)journal->output_offset) == 0 ? fopen(path, "a") : NULL;
         printf("Resuming: appending to '%s' (%d existing rows)\n", path, existing_count);
     }
     else
     {
         f = fopen(path, "w");
-        fprintf(f, "o_n,o_d,a_n,a_d,period\n");
+        if (f != NULL)
+            fprintf(f, "o_n,o_d,a_n,a_d,period\n");
     }
     if (f == NULL)
     {
         fprintf(stderr, "Error: could not open %s for writing\n", path);
         exit(EXIT_FAILURE);
     }
-
-    int count = existing_count;
-    int generated = 0;
-    size_t lambda_failures = 0;
-    size_t formula_disagreements = 0;
+    run.f = f;
+    run.count = existing_count;
 
     const number_t ALPHA_MAX = 10;
     const number_t BETA_MAX  = 10;
     const number_t Q_MAX     = 50;
     const number_t P_MAX     = 2000;
 
-    // Skip counter for resume: skip the first existing_count matching candidates
-    int skip = existing_count;
+    // Ordinal of the current matching candidate, the row ID in the journal.
+    uint64_t candidate = 0;
+    degenerate_candidate_t pending[DEGENERATE_BATCH];
+    int pending_count = 0;
 
-    for (number_t alpha = 1; alpha <= ALPHA_MAX && count < target_count; alpha++)
+    for (number_t alpha = 1; alpha <= ALPHA_MAX && run.count < target_count; alpha++)
     {
-        for (number_t beta = 1; beta <= BETA_MAX && count < target_count; beta++)
+        for (number_t beta = 1; beta <= BETA_MAX && run.count < target_count; beta++)
         {
             if (gcd(alpha, beta) != 1)
                 continue;
 
             const number_t D = alpha * alpha + beta * beta;
 
-            for (number_t q = 1; q <= Q_MAX && count < target_count; q++)
+            for (number_t q = 1; q <= Q_MAX && run.count < target_count; q++)
             {
-                for (number_t p = 1; p <= P_MAX && count < target_count; p++)
+                for (number_t p = 1; p <= P_MAX && run.count < target_count; p++)
                 {
                     if (gcd(p, q) != 1)
                         continue;
@@ -221,62 +341,39 @@ void generate_conjecture_degenerate_csv(const char *path, int target_count, numb
                     if (N < D || N % D != 0)
                         continue;
 
-                    // Skip already-computed rows when resuming
-                    if (skip > 0)
-                    {
-                        skip--;
+                    // Skip already-computed candidates when resuming
+                    const uint64_t id = candidate++;
+                    if (journal_is_done(journal, id))
                         continue;
-                    }
 
                     // x_max must be >> omega so the 10% edge trim in lambda()
                     // covers the boundary corruption (which spans ~omega x-values).
                     const number_t omega_int = p / q + 1;
                     const number_t x_max_degenerate = MAX(1000, 25 * omega_int);
                     const number_t estimated_points = x_max_degenerate * N / D;
-                    if (estimated_points > 10000000)
-                    {
-                        lambda_failures++;
-                        continue;
-                    }
-                    printf("\rComputing: alpha=%lld, beta=%lld, omega=%lld/%lld, N=%lld, D=%lld, x_max=%lld ...          ",
-                           (long long)alpha, (long long)beta, (long long)p, (long long)q,
-                           (long long)N, (long long)D, (long long)x_max_degenerate);
-                    fflush(stdout);
-                    long lam = lambda(alpha, beta, p, q, X_MIN, x_max_degenerate, true, dx);
-                    if (!is_legal_period_length(lam))
+                    pending[pending_count++] = (degenerate_candidate_t){
+                        {alpha, beta, p, q, X_MIN, x_max_degenerate, 0}, id, N, D,
+                        estimated_points > 10000000};
+                    // Never compute more candidates than rows are missing.
+                    if (pending_count == DEGENERATE_BATCH || pending_count >= target_count - run.count)
                     {
-                        lambda_failures++;
-                        printf("\rSkipped: alpha=%lld, beta=%lld, omega=%lld/%lld, N=%lld, D=%lld (lambda=%ld, failures=%zu)    ",
-                               (long long)alpha, (long long)beta, (long long)p, (long long)q,
-                               (long long)N, (long long)D, lam, lambda_failures);
-                        fflush(stdout);
-                        continue;
+                        degenerate_flush(&run, pending, pending_count, dx);
+                        pending_count = 0;
                     }
-
-                    const number_t expected = N / D;
-                    if (lam != expected)
-                    {
-                        formula_disagreements++;
-                        fprintf(stderr, "Warning: lambda = %ld != N/D = %lld for alpha=%lld, beta=%lld, omega=%lld/%lld, N=%lld, D=%lld\n",
-                                lam, (long long)expected, (long long)alpha, (long long)beta,
-                                (long long)p, (long long)q, (long long)N, (long long)D);
-                    }
-
-                    fprintf(f, "%lld,%lld,%lld,%lld,%ld\n",
-                            (long long)p, (long long)q, (long long)alpha, (long long)beta, lam);
-                    fflush(f);
-                    count++;
-                    generated++;
-                    printf("\r%d / %d", count, target_count);
-                    fflush(stdout);
                 }
             }
         }
     }
+    degenerate_flush(&run, pending, pending_count, dx);
 
+    fflush(f);
+    journal_sync(journal, fileno(f));
     fclose(f);
+    journal_close(journal);
+    metrics_update(&run.metrics, sample, true);
+    metrics_close(&run.metrics);
     printf("\nWrote %d new rows (%d total) to '%s' (lambda() failures skipped: %zu, formula disagreements: %zu).\n",
-           generated, count, path, lambda_failures, formula_disagreements);
+           run.generated, run.count, path, run.lambda_failures, run.formula_disagreements);
 }
 
 /**
@@ -11,6 +11,14 @@
 #define CREATE_FILE_TO_FIND_A_PATTERN true
 #define NUMBER_OF_LINES_IN_THE_PATTERN_FILE 5002
 #define FRACTION_OF_REMAINING_ELEMENTS 0.9
+/* Gaps from which lambda_trim() tries the candidate methods first (0 disables). */
+#define SKETCH_MIN_GAPS 4194304
+/* Gaps up to which lambda_trim() may use the FFT autocorrelation (40 bytes per transform slot). */
+#define AUTOCORR_MAX_GAPS 16777216
+#define ENGINE_NAME "set"
+/* Progress metrics of the long runs in Prometheus text format ("" disables). */
+#define METRICS_FILE ""
+#define METRICS_INTERVAL_SEC 15
 
 #define TEST_FILE "./pattern_x_max_1000000_1000_lines.csv"
 #define FILE_TO_FIND_PATTERN "./find_pattern_x_max_1000000_%d_lines.csv"
@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include "constants.h"
+#include "kernels.h"
 
 typedef int_fast64_t number_t;
 
@@ -229,8 +230,7 @@ static long find_period_length(const long index_start, const long index_end, con
 
         // Check if the sequence is periodic with period p.
         size_t count = index_end - period - index_start + 1;
-        if (memcmp(&dx[index_start], &dx[index_start + period],
-                   count * sizeof(number_t)) == 0)
+        if (kernel_equal(&dx[index_start], &dx[index_start + period], count))
             return period;
     }
 
@@ -249,22 +249,7 @@ static inline bool is_legal_period_length(long period_length)
 }
 
 /**
- * Compares two number_t values for sorting.
- * Returns negative if x < y, zero if x == y, positive if x > y.
- *
- * @param p Pointer to the first number_t value.
- * @param q Pointer to the second number_t value.
- * @return The comparison result.
- */
-static inline int cmp_int_fast64(const void *p, const void *q) {
-    number_t x = *(const number_t*)p;
-    number_t y = *(const number_t*)q;
-    // return negative if x<y, zero if x==y, positive if x>y
-    return (x > y) - (x < y);
-}
-
-/**
- * Sorts a range of elements in an array using qsort.
+ * Sorts a range of elements in an array with kernel_sort().
  * The range is defined by the indices a and b (inclusive).
  *
  * @param array The array to sort.
@@ -273,15 +258,76 @@ static inline int cmp_int_fast64(const void *p, const void *q) {
  */
 static inline void sort_range(number_t *array, size_t a, size_t b) {
     if (b < a) return;                     // nothing to do
-    size_t count = b - a + 1;              // number of elements
-    qsort(array + a,                      // start at &array[a]
-          count,                          // how many elements
-          sizeof *array,                  // size of each element
-          cmp_int_fast64);                // your comparator
+    kernel_sort(array + a, b - a + 1);
 }
 
+/**
+ * Statistics of one lambda_search() call.
+ */
+typedef struct
+{
+    number_t x_max;  // x_max of the last (or running) attempt
+    int attempts;    // number of lambda() runs (1 + retries)
+    long values;     // projected values enumerated over all attempts
+    long max_values; // largest number of dx slots used by one attempt
+    long gaps;       // gaps the last attempt left in dx (0: none, or on disk)
+} lambda_search_t;
+
+/**
+ * Out-of-core mode of lambda_external() and lambda_search(): windows with
+ * more values than dx holds are sorted in runs on disk and merged.
+ */
+typedef struct
+{
+    const char *dir;      // directory of the scratch files, NULL: mode off
+    long max_values;      // largest window in values (the disk needs 16 bytes per value)
+    long capacity;        // dx slots used for runs and read buffers
+} lambda_scratch_t;
+
+/**
+ * Period searches of lambda_trim(), chosen per row by lambda_trim_method().
+ */
+typedef enum
+{
+    TRIM_LOOP = 0,   // every period at every step (find_period_length())
+    TRIM_SKETCH,     // block sketch candidates (sketch_period())
+    TRIM_AUTOCORR    // FFT autocorrelation candidates (autocorr_period())
+} trim_method_t;
+
+/* Cases lambda_batch() runs in lockstep. */
+#define LAMBDA_LANES 8
+
+/**
+ * A case of lambda_batch(): the arguments of lambda() with sort, and its
+ * result.
+ */
+typedef struct
+{
+    number_t alpha;
+    number_t beta;
+    number_t gamma;
+    number_t delta;
+    number_t x_min;
+    number_t x_max;
+    long period;  // result of lambda(alpha, beta, gamma, delta, x_min, x_max, true, dx)
+} lambda_case_t;
+
 // Function prototypes
+long lambda_enumerate(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t x_min, number_t x_max, bool sort, number_t *dx);
+long lambda_gaps(number_t *dx, long length);
+long lambda_trim(const number_t *dx, long length, bool sort);
+trim_method_t lambda_trim_method(long length, long period);
+size_t lambda_trim_buffer_bytes(long length);
+void lambda_use_trim_buffer(void *buffer, long length);
+void lambda_release_trim_buffers(void);
 long lambda(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t x_min, number_t x_max, bool sort, number_t *dx);
+long lambda_periods(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t x_min, number_t x_max, number_t *dx, long *period_set);
+void lambda_batch(lambda_case_t *cases, long count, number_t *dx);
+long lambda_external(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t x_min, number_t x_max, const lambda_scratch_t *scratch, number_t *dx, long *period_set);
+void lambda_set_scratch(const lambda_scratch_t *scratch);
+long lambda_search(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t period, bool degenerate, number_t *dx, lambda_search_t *stats);
+long lambda_search_periods(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t period, bool degenerate, number_t *dx, lambda_search_t *stats, long *period_set);
+double lambda_search_cost(number_t alpha, number_t beta, number_t gamma, number_t delta, number_t period, bool degenerate);
 number_t random_number_including(const number_t min, const number_t max);
 rational_t rational_random_gt_0_lt_1(void);
 rational_t rational_random_gt_1(void);
@@ -10,12 +10,21 @@ Examples:
     python3 test_lambda.py 1 2 3 1              # swapped: alpha=1, beta=2, omega=3
     python3 test_lambda.py 2 1 3 1 --debug      # show dx array
     python3 test_lambda.py 2 1 3 1 --x_max 100  # smaller x range
+
+lambda_period() runs in C through src/python/cutproject.py when
+libcutproject is built (make -C src/c/lib libcutproject), so full-size
+windows take seconds; otherwise (or with CNP_PURE_PYTHON=1) the pure-Python
+implementation below is used.
 """
 
+import os
 import sys
 from fractions import Fraction
 from math import ceil, floor, gcd
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "python"))
+import cutproject  # noqa: E402
+
 
 def find_period_length(dx, index_start, index_end):
     n = index_end - index_start + 1
@@ -37,6 +46,17 @@ def find_period_length(dx, index_start, index_end):
 
 def lambda_period(alpha, beta, gamma, delta, x_min=0, x_max=10000,
                   sort_mode=False, fraction_remaining=0.9):
+    if cutproject.available():
+        ctx = cutproject.context(periods=cutproject.PERIODS_MULTISET, ordered=not sort_mode,
+                                 remaining_fraction=fraction_remaining)
+        result = ctx.lambda_(alpha, beta, gamma, delta, x_min, x_max)
+        return result.multiset, ctx.gaps()
+    return lambda_period_python(alpha, beta, gamma, delta, x_min, x_max,
+                                sort_mode, fraction_remaining)
+
+
+def lambda_period_python(alpha, beta, gamma, delta, x_min=0, x_max=10000,
+                         sort_mode=False, fraction_remaining=0.9):
     g = gcd(alpha, beta)
     alpha, beta = alpha // g, beta // g
     g = gcd(gamma, delta)
@@ -0,0 +1,312 @@
+"""
+ctypes binding of libcutproject (src/c/lib/cutproject.h).
+
+Exposes the C period engines to the Python tools: the windowed enumeration
+of lambda() (sorted: multiset and set period; ordered: the unsorted
+differences) and the exact residue model. Build the library first:
+
+    make -C src/c/lib libcutproject
+
+The library is looked up in $CNP_LIBRARY, then next to this file in
+../c/lib/libcutproject.so. Set CNP_PURE_PYTHON=1 to make available() report
+False, so the tools fall back to their pure-Python implementations (e.g. to
+cross-check the two).
+
+Every call runs in C with the GIL released (ctypes.CDLL), so threads run
+rows in parallel. A Context owns its work buffer, which grows on demand and
+is reused by the following calls; a Context must not be shared between
+threads. context() returns one Context per thread and configuration.
+
+Usage:
+    import cutproject
+    r = cutproject.context().search(2, 1, 3, 1)
+    r.multiset, r.set           # 2 1
+    cutproject.context().residues(2, 1, 4, 1).set
+"""
+
+import ctypes
+import os
+import threading
+from dataclasses import dataclass
+from typing import Optional
+
+_STATUS_NAMES = ("ok", "no_period", "buffer_exceeded", "window_too_small",
+                 "budget_exceeded", "invalid_argument", "out_of_memory", "skipped")
+_STATUS_COUNT = len(_STATUS_NAMES)
+
+PERIODS_MULTISET = 1
+PERIODS_SET = 2
+
+
+class _Config(ctypes.Structure):
+    _fields_ = [
+        ("max_values", ctypes.c_int64),
+        ("x_max_limit", ctypes.c_int64),
+        ("remaining_fraction", ctypes.c_double),
+        ("degenerate", ctypes.c_bool),
+        ("budget_values", ctypes.c_int64),
+        ("budget_seconds", ctypes.c_double),
+        ("periods", ctypes.c_uint),
+        ("ordered", ctypes.c_bool),
+    ]
+
+
+class _Period(ctypes.Structure):
+    _fields_ = [("status", ctypes.c_int), ("period", ctypes.c_int64)]
+
+
+class _Result(ctypes.Structure):
+    _fields_ = [
+        ("status", ctypes.c_int),
+        ("multiset", _Period),
+        ("set", _Period),
+        ("n", ctypes.c_int64),
+        ("d", ctypes.c_int64),
+        ("x_min", ctypes.c_int64),
+        ("x_max", ctypes.c_int64),
+        ("attempts", ctypes.c_int),
+        ("values", ctypes.c_int64),
+        ("max_values", ctypes.c_int64),
+        ("seconds", ctypes.c_double),
+    ]
+
+
+class _Stats(ctypes.Structure):
+    _fields_ = [
+        ("calls", ctypes.c_uint64),
+        ("attempts", ctypes.c_uint64),
+        ("values", ctypes.c_uint64),
+        ("status", ctypes.c_uint64 * _STATUS_COUNT),
+        ("buffer_bytes", ctypes.c_uint64),
+        ("seconds", ctypes.c_double),
+    ]
+
+
+@dataclass(frozen=True)
+class Result:
+    """
+    The result of one call. multiset / set are the periods, None if the
+    period was not found or not requested (see multiset_status /
+    set_status); status is the first failure, "ok" if there is none.
+    """
+    status: str
+    multiset: Optional[int]
+    set: Optional[int]
+    multiset_status: str
+    set_status: str
+    n: int
+    d: int
+    x_min: int
+    x_max: int
+    attempts: int
+    values: int
+    max_values: int
+    seconds: float
+
+    @property
+    def multiset_code(self) -> int:
+        """The multiset period, or the engines' negative sentinel code."""
+        return self.multiset if self.multiset is not None else _code(self.multiset_status)
+
+    @property
+    def set_code(self) -> int:
+        """The set period, or the engines' negative sentinel code."""
+        return self.set if self.set is not None else _code(self.set_status)
+
+
+def _code(status: str) -> int:
+    return _lib().cnp_status_code(_STATUS_NAMES.index(status))
+
+
+_library = None
+_library_lock = threading.Lock()
+
+
+def _default_path() -> str:
+    here = os.path.dirname(os.path.abspath(__file__))
+    return os.path.normpath(os.path.join(here, "..", "c", "lib", "libcutproject.so"))
+
+
+def _lib() -> ctypes.CDLL:
+    global _library
+    with _library_lock:
+        if _library is None:
+            lib = ctypes.CDLL(os.environ.get("CNP_LIBRARY") or _default_path())
+            i64 = ctypes.c_int64
+            lib.cnp_config_default.argtypes = [ctypes.POINTER(_Config)]
+            lib.cnp_config_default.restype = None
+            lib.cnp_ctx_create.argtypes = [ctypes.POINTER(_Config)]
+            lib.cnp_ctx_create.restype = ctypes.c_void_p
+            lib.cnp_ctx_destroy.argtypes = [ctypes.c_void_p]
+            lib.cnp_ctx_destroy.restype = None
+            lib.cnp_ctx_stats.argtypes = [ctypes.c_void_p]
+            lib.cnp_ctx_stats.restype = ctypes.POINTER(_Stats)
+            lib.cnp_ctx_gaps.argtypes = [ctypes.c_void_p, ctypes.POINTER(i64)]
+            lib.cnp_ctx_gaps.restype = ctypes.POINTER(i64)
+            lib.cnp_lambda.argtypes = [ctypes.c_void_p, i64, i64, i64, i64, i64, i64,
+                                       ctypes.POINTER(_Result)]
+            lib.cnp_search.argtypes = [ctypes.c_void_p, i64, i64, i64, i64, i64,
+                                       ctypes.POINTER(_Result)]
+            lib.cnp_residues.argtypes = [ctypes.c_void_p, i64, i64, i64, i64,
+                                         ctypes.POINTER(_Result)]
+            lib.cnp_gap_oracle.argtypes = [ctypes.c_void_p, i64, i64, i64, i64,
+                                           ctypes.POINTER(_Result)]
+            lib.cnp_oracle_periods.argtypes = [ctypes.c_void_p, i64, i64, i64, i64,
+                                               ctypes.POINTER(_Result)]
+            lib.cnp_gap_at.argtypes = [ctypes.c_void_p, i64]
+            lib.cnp_gap_at.restype = i64
+            lib.cnp_gap_check.argtypes = [ctypes.c_void_p, i64, i64, ctypes.c_uint64]
+            lib.cnp_gap_check.restype = i64
+            lib.cnp_ctx_signature.argtypes = [ctypes.c_void_p, i64, ctypes.c_char_p]
+            lib.cnp_status_code.argtypes = [ctypes.c_int]
+            lib.cnp_status_code.restype = ctypes.c_int
+            _library = lib
+        return _library
+
+
+def available() -> bool:
+    """
+    Whether libcutproject can be loaded (and CNP_PURE_PYTHON is not set).
+    """
+    if os.environ.get("CNP_PURE_PYTHON"):
+        return False
+    try:
+        _lib()
+    except OSError:
+        return False
+    return True
+
+
+def _period(p: _Period) -> Optional[int]:
+    return p.period if p.status == 0 else None
+
+
+class Context:
+    """
+    A libcutproject context: configuration, reusable work buffer and
+    statistics. Keyword arguments override cnp_config_default(); periods is
+    a combination of PERIODS_MULTISET and PERIODS_SET.
+    """
+
+    def __init__(self, **config):
+        lib = _lib()
+        c = _Config()
+        lib.cnp_config_default(ctypes.byref(c))
+        for name, value in config.items():
+            if name not in dict(_Config._fields_):
+                raise TypeError(f"unknown configuration '{name}'")
+            setattr(c, name, value)
+        self._lib = lib
+        self._ctx = lib.cnp_ctx_create(ctypes.byref(c))
+        if not self._ctx:
+            raise ValueError(f"invalid configuration {config}")
+        self._result = _Result()
+
+    def close(self) -> None:
+        if self._ctx:
+            self._lib.cnp_ctx_destroy(self._ctx)
+            self._ctx = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def _wrap(self) -> Result:
+        r = self._result
+        return Result(status=_STATUS_NAMES[r.status],
+                      multiset=_period(r.multiset), set=_period(r.set),
+                      multiset_status=_STATUS_NAMES[r.multiset.status],
+                      set_status=_STATUS_NAMES[r.set.status],
+                      n=r.n, d=r.d, x_min=r.x_min, x_max=r.x_max,
+                      attempts=r.attempts, values=r.values,
+                      max_values=r.max_values, seconds=r.seconds)
+
+    def lambda_(self, alpha: int, beta: int, gamma: int, delta: int,
+                x_min: int = 0, x_max: int = 10000) -> Result:
+        """The periods over the fixed window [x_min, x_max) (cnp_lambda)."""
+        self._lib.cnp_lambda(self._ctx, alpha, beta, gamma, delta, x_min, x_max,
+                             ctypes.byref(self._result))
+        return self._wrap()
+
+    def search(self, alpha: int, beta: int, gamma: int, delta: int,
+               period_hint: int = 0) -> Result:
+        """The periods of a corpus row, choosing the window (cnp_search)."""
+        self._lib.cnp_search(self._ctx, alpha, beta, gamma, delta, period_hint,
+                             ctypes.byref(self._result))
+        return self._wrap()
+
+    def residues(self, alpha: int, beta: int, gamma: int, delta: int) -> Result:
+        """The exact periods from the residue model (cnp_residues)."""
+        self._lib.cnp_residues(self._ctx, alpha, beta, gamma, delta,
+                               ctypes.byref(self._result))
+        return self._wrap()
+
+    def gap_oracle(self, alpha: int, beta: int, gamma: int, delta: int) -> Result:
+        """Prepares gap_at() for a row from the residue model (cnp_gap_oracle)."""
+        self._lib.cnp_gap_oracle(self._ctx, alpha, beta, gamma, delta,
+                                 ctypes.byref(self._result))
+        return self._wrap()
+
+    def oracle_periods(self, alpha: int, beta: int, gamma: int, delta: int) -> Result:
+        """The periods of residues() on the gap oracle (cnp_oracle_periods)."""
+        self._lib.cnp_oracle_periods(self._ctx, alpha, beta, gamma, delta,
+                                     ctypes.byref(self._result))
+        return self._wrap()
+
+    def gap_at(self, i: int) -> int:
+        """Gap i of the cyclic sequence of the last gap_oracle() (cnp_gap_at)."""
+        return self._lib.cnp_gap_at(self._ctx, i)
+
+    def gap_check(self, period: int, samples: int = 64, seed: int = 0) -> Optional[int]:
+        """
+        Spot-checks a claimed period at samples random positions
+        (cnp_gap_check): a position where it fails, None if all agree.
+        """
+        i = self._lib.cnp_gap_check(self._ctx, period, samples, seed)
+        return None if i < 0 else i
+
+    def gaps(self) -> list:
+        """A copy of the gap sequence the last call searched (cnp_ctx_gaps)."""
+        length = ctypes.c_int64()
+        gaps = self._lib.cnp_ctx_gaps(self._ctx, ctypes.byref(length))
+        return gaps[:length.value] if gaps else []
+
+    def signature(self, period: int) -> Optional[str]:
+        """
+        The canonical signature (32 hex digits) of the gaps the last call
+        left with this period, as in add_period_set --signatures
+        (cnp_ctx_signature); None if period does not fit them.
+        """
+        hex_digits = ctypes.create_string_buffer(33)
+        if self._lib.cnp_ctx_signature(self._ctx, period, hex_digits) != 0:
+            return None
+        return hex_digits.value.decode()
+
+    def stats(self) -> dict:
+        """The cumulative statistics (cnp_ctx_stats)."""
+        s = self._lib.cnp_ctx_stats(self._ctx).contents
+        return {"calls": s.calls, "attempts": s.attempts, "values": s.values,
+                "status": {name: s.status[i] for i, name in enumerate(_STATUS_NAMES)},
+                "buffer_bytes": s.buffer_bytes, "seconds": s.seconds}
+
+
+_contexts = threading.local()
+
+
+def context(**config) -> Context:
+    """
+    The Context of the calling thread for this configuration, created on
+    first use, so repeated calls reuse one work buffer.
+    """
+    cache = getattr(_contexts, "cache", None)
+    if cache is None:
+        cache = _contexts.cache = {}
+    key = tuple(sorted(config.items()))
+    if key not in cache:
+        cache[key] = Context(**config)
+    return cache[key]
@@ -7,6 +7,10 @@ Enforces diversity: at most MAX_PER_PAIR cases per (alpha, beta) pair.
 
 Output: tests/set_theorem_balanced_test.csv
 Columns: o_n, o_d, a_n, a_d, period_multiset, period_set
+
+Both periods are computed in C through cutproject.py when libcutproject is
+built (make -C src/c/lib libcutproject); otherwise (or with
+CNP_PURE_PYTHON=1) in pure Python.
 """
 
 import csv
@@ -20,6 +24,7 @@ _here = os.path.dirname(os.path.abspath(__file__))
 _c_dir = os.path.join(_here, '..', 'c', 'multiset')
 sys.path.insert(0, _c_dir)
 from test_lambda import lambda_period  # sort_mode=True → multiset period
+import cutproject  # noqa: E402  (src/python, on the path via test_lambda)
 
 
 # ─── set-period computation ───────────────────────────────────────────────────
@@ -44,6 +49,10 @@ def lambda_set_period(alpha, beta, gamma, delta, x_min=0, x_max=5000,
     Uses the same adaptive-trim / shrinking-window strategy as lambda_period
     to handle boundary artefacts at x_min and x_max.
     """
+    if cutproject.available():
+        ctx = cutproject.context(periods=cutproject.PERIODS_SET,
+                                 remaining_fraction=fraction_remaining)
+        return ctx.lambda_(alpha, beta, gamma, delta, x_min, x_max).set
     g = gcd(alpha, beta); alpha, beta = alpha // g, beta // g
     g = gcd(gamma, delta); gamma, delta = gamma // g, delta // g
 
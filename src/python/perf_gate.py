@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Performance regression gate for the stage micro-benchmark of the C engines
+(`make bench` in src/c/set or src/c/multiset, see src/c/lib/bench.c).
+
+A run (bench.json with the raw samples of every case and stage) is compared
+against a rolling baseline taken from a local history file: the samples of
+the last --window runs recorded on the same CPU model, for the same engine,
+kernel implementation and benchmark size, are pooled per (case, stage). A stage regresses when
+
+    1. a one-sided Mann-Whitney U test says the new samples are larger
+       (p < --alpha), and
+    2. the median slowed down by more than --tolerance, and by at least
+       --min-delta milliseconds.
+
+All conditions are needed: the test guards against noise, the thresholds
+against statistically significant but irrelevant shifts (sub-millisecond
+stages are dominated by scheduler and timer jitter).
+
+Passing runs are appended to the history (one JSON object per line, keyed
+by commit and CPU model), so the baseline follows accepted changes. A failing
+run is not recorded unless --accept is given, e.g. after an intended
+trade-off. Everything runs offline; only git and /proc/cpuinfo are read.
+
+Usage:
+    python3 perf_gate.py bench.json [--history=perf_history.jsonl]
+        [--window=5] [--alpha=0.01] [--tolerance=0.10] [--min-delta=0.5]
+        [--accept]
+
+Exit status: 0 if no stage regressed, 1 otherwise.
+"""
+
+import argparse
+import json
+import math
+import os
+import platform
+import subprocess
+import sys
+import time
+
+
+def cpu_model() -> str:
+    """Returns the CPU model name of this machine."""
+    try:
+        with open("/proc/cpuinfo", encoding="utf-8") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    return line.split(":", 1)[1].strip()
+    except OSError:
+        pass
+    return platform.processor() or platform.machine()
+
+
+def git_commit(path: str) -> tuple:
+    """Returns (commit, dirty) of the work tree containing path."""
+    cwd = os.path.dirname(os.path.abspath(path))
+    try:
+        commit = subprocess.run(["git", "rev-parse", "--short=12", "HEAD"], cwd=cwd,
+                                capture_output=True, text=True, check=True).stdout.strip()
+        status = subprocess.run(["git", "status", "--porcelain", "--untracked-files=no"], cwd=cwd,
+                                capture_output=True, text=True, check=True).stdout
+        return commit, bool(status.strip())
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown", False
+
+
+def mann_whitney_greater(new: list, old: list) -> float:
+    """
+    One-sided Mann-Whitney U test with the normal approximation (with tie
+    and continuity correction). Returns the p-value of the hypothesis that
+    values of `new` tend to be larger than values of `old`.
+    """
+    n1, n2 = len(new), len(old)
+    if n1 == 0 or n2 == 0:
+        return 1.0
+
+    values = sorted([(v, 0) for v in new] + [(v, 1) for v in old])
+    rank_sum_new = 0.0
+    tie_term = 0.0
+    i = 0
+    while i < len(values):
+        j = i
+        while j < len(values) and values[j][0] == values[i][0]:
+            j += 1
+        rank = (i + 1 + j) / 2.0  # average of ranks i+1 .. j
+        rank_sum_new += rank * sum(1 for k in range(i, j) if values[k][1] == 0)
+        t = j - i
+        tie_term += t * t * t - t
+        i = j
+
+    u = rank_sum_new - n1 * (n1 + 1) / 2.0
+    n = n1 + n2
+    mean = n1 * n2 / 2.0
+    variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (u - mean - 0.5) / math.sqrt(variance)
+    return 0.5 * math.erfc(z / math.sqrt(2.0))
+
+
+def median(values: list) -> float:
+    s = sorted(values)
+    m = len(s) // 2
+    return float(s[m]) if len(s) % 2 else (s[m - 1] + s[m]) / 2.0
+
+
+def load_run(path: str) -> dict:
+    """Reads bench.json into a history entry."""
+    with open(path, encoding="utf-8") as f:
+        bench = json.load(f)
+    cases = {}
+    for case in bench["cases"]:
+        if case.get("skipped"):
+            continue
+        cases[case["name"]] = {stage["stage"]: stage["samples_ns"] for stage in case["stages"]}
+    commit, dirty = git_commit(path)
+    return {
+        "commit": commit,
+        "dirty": dirty,
+        "cpu": cpu_model(),
+        "engine": bench["engine"],
+        "compiler": bench["compiler"],
+        "kernel": bench.get("kernel"),
+        "target_points": bench["target_points"],
+        "timestamp": int(time.time()),
+        "cases": cases,
+    }
+
+
+def load_history(path: str) -> list:
+    if not os.path.exists(path):
+        return []
+    entries = []
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                try:
+                    entries.append(json.loads(line))
+                except json.JSONDecodeError:
+                    print(f"Warning: skipping a corrupt line of '{path}'", file=sys.stderr)
+    return entries
+
+
+def baseline_for(run: dict, history: list, window: int) -> list:
+    """Returns the last `window` comparable runs of the history."""
+    same = [e for e in history
+            if e.get("cpu") == run["cpu"] and e.get("engine") == run["engine"]
+            and e.get("target_points") == run["target_points"]
+            and e.get("kernel", run["kernel"]) == run["kernel"]]
+    return same[-window:]
+
+
+def compare(run: dict, baseline: list, alpha: float, tolerance: float, min_delta_ns: float) -> list:
+    """Compares every (case, stage) and returns the list of regressions."""
+    regressions = []
+    print(f"{'case':<12} {'stage':<10} {'base ms':>10} {'new ms':>10} {'change':>8} {'p':>9}")
+    for case, stages in run["cases"].items():
+        for stage, samples in stages.items():
+            pooled = [v for e in baseline for v in e["cases"].get(case, {}).get(stage, [])]
+            if not pooled:
+                continue
+            base, new = median(pooled), median(samples)
+            change = new / base - 1.0 if base > 0 else 0.0
+            p = mann_whitney_greater(samples, pooled)
+            regressed = p < alpha and change > tolerance and new - base >= min_delta_ns
+            print(f"{case:<12} {stage:<10} {base * 1e-6:10.3f} {new * 1e-6:10.3f} "
+                  f"{change * 100:+7.1f}% {p:9.2e}{'  REGRESSION' if regressed else ''}")
+            if regressed:
+                regressions.append((case, stage, change, p))
+    return regressions
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Compare a bench.json run against the stored baseline.")
+    parser.add_argument("bench", help="bench.json written by cnp_bench")
+    parser.add_argument("--history", default="perf_history.jsonl", help="history file (JSON lines)")
+    parser.add_argument("--window", type=int, default=5, help="number of previous runs in the baseline")
+    parser.add_argument("--alpha", type=float, default=0.01, help="significance level of the U test")
+    parser.add_argument("--tolerance", type=float, default=0.10, help="allowed relative slowdown of the median")
+    parser.add_argument("--min-delta", type=float, default=0.5, help="minimal slowdown of the median in ms")
+    parser.add_argument("--accept", action="store_true", help="record the run even if it regressed")
+    args = parser.parse_args()
+
+    run = load_run(args.bench)
+    history = load_history(args.history)
+    baseline = baseline_for(run, history, args.window)
+    print(f"Engine {run['engine']}, commit {run['commit']}{' (dirty)' if run['dirty'] else ''}, "
+          f"CPU {run['cpu']}")
+
+    if not baseline:
+        print("No baseline for this CPU and engine yet; recording this run as the baseline.")
+        regressions = []
+    else:
+        commits = ", ".join(e["commit"] for e in baseline)
+        print(f"Baseline: {len(baseline)} runs ({commits})")
+        regressions = compare(run, baseline, args.alpha, args.tolerance, args.min_delta * 1e6)
+
+    if not regressions or args.accept:
+        with open(args.history, "a", encoding="utf-8") as f:
+            f.write(json.dumps(run, separators=(",", ":")) + "\n")
+
+    if regressions:
+        print(f"\n{len(regressions)} stage(s) slower than the baseline by more than "
+              f"{args.tolerance * 100:.0f}% (p < {args.alpha}).")
+        return 0 if args.accept else 1
+    print("\nNo performance regression.")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
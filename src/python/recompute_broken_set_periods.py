@@ -22,9 +22,13 @@ empirically from the residue gaps.
 Usage:
     python3 recompute_broken_set_periods.py [csv_path ...]
 
+The residue model runs in C (cnp_residues() through cutproject.py) when
+libcutproject is built; otherwise it falls back to NumPy.
+
 Default: rewrites the three CSVs in tests/ in place.  Original values are
 preserved for rows where period_set is non-negative; only negative-sentinel
-rows are replaced.
+rows are replaced. Columns behind period_set (the per-row telemetry of
+`add_period_set --telemetry`) are kept as they are.
 """
 
 import csv
@@ -32,7 +36,7 @@ import os
 import sys
 from math import gcd
 
-import numpy as np
+import cutproject
 
 
 def _divisors(n):
@@ -52,10 +56,24 @@ def set_period_from_residues(alpha: int, beta: int, omega_n: int, omega_d: int)
     """
     Compute the minimal set-valued period directly from the residue model.
 
-    Memory: ~8*N bytes for the residue array (numpy int64).
+    Memory: ~8*N bytes for the residue array (int64).
     Time:   O(N log N) for the sort plus O(N * d(N)) worst-case for the
             period search, where d(N) is the divisor count of N.
     """
+    if cutproject.available():
+        result = cutproject.context(periods=cutproject.PERIODS_SET).residues(
+            alpha, beta, omega_n, omega_d)
+        if result.set is None:
+            raise RuntimeError(f"residue model failed for a={alpha}/{beta}, "
+                               f"w={omega_n}/{omega_d}: {result.set_status}")
+        return result.set
+    return set_period_from_residues_numpy(alpha, beta, omega_n, omega_d)
+
+
+def set_period_from_residues_numpy(alpha: int, beta: int, omega_n: int, omega_d: int) -> int:
+    """set_period_from_residues() in NumPy, without libcutproject."""
+    import numpy as np
+
     D = alpha * alpha + beta * beta
     r_max = (omega_n * alpha) // omega_d
     r_min = -((omega_n * beta) // omega_d)
@@ -100,15 +118,15 @@ def recompute_csv(path: str) -> tuple[int, int]:
         header = next(reader)
         rows = list(reader)
 
-    if header != ["o_n", "o_d", "a_n", "a_d", "period_multiset", "period_set"]:
+    if header[:6] != ["o_n", "o_d", "a_n", "a_d", "period_multiset", "period_set"]:
         raise ValueError(f"unexpected header in {path}: {header}")
 
     changed = 0
     for i, row in enumerate(rows):
-        on, od, a, b, pm, ps = (int(x) for x in row)
+        on, od, a, b, pm, ps = (int(x) for x in row[:6])
         if ps < 0:
             new_ps = set_period_from_residues(a, b, on, od)
-            rows[i] = [str(on), str(od), str(a), str(b), str(pm), str(new_ps)]
+            rows[i] = [str(on), str(od), str(a), str(b), str(pm), str(new_ps)] + row[6:]
             changed += 1
             print(f"  {os.path.basename(path)} row {i+2}: "
                   f"a={a}, b={b}, w={on}/{od} -> period_set = {new_ps} "
@@ -17,7 +17,8 @@ Checks, for every row:
 
 The CSVs use the six-column format
     o_n, o_d, a_n, a_d, period_multiset, period_set
-where (o_n / o_d) = omega and (a_n, a_d) = (alpha, beta).
+where (o_n / o_d) = omega and (a_n, a_d) = (alpha, beta). Further columns
+(the per-row telemetry of `add_period_set --telemetry`) are ignored.
 
 Negative period_set values are reported separately (sentinel error codes
 emitted by aborted C-side runs).  The expected value from the theorem is
@@ -55,11 +56,11 @@ def verify_csv(path: str) -> dict:
     with open(path, newline="") as f:
         reader = csv.reader(f)
         header = next(reader)
-        if header != ["o_n", "o_d", "a_n", "a_d", "period_multiset", "period_set"]:
+        if header[:6] != ["o_n", "o_d", "a_n", "a_d", "period_multiset", "period_set"]:
             raise ValueError(f"Unexpected header in {path}: {header}")
 
         for row in reader:
-            o_n, o_d, alpha, beta, period_multi, period_set = (int(x) for x in row)
+            o_n, o_d, alpha, beta, period_multi, period_set = (int(x) for x in row[:6])
             omega = Fraction(o_n, o_d)
             N = (o_n * alpha) // o_d + (o_n * beta) // o_d + 1
             D = alpha * alpha + beta * beta